@@ -27,6 +27,8 @@
 #include <bferrorcodes.h>
 #include <bfelf_loader.h>
 #include <bfdebugringinterface.h>
+#include <bfexitstatsinterface.h>
+#include <bfmemstatsinterface.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -152,6 +154,35 @@ common_stop_vmm(void);
 int64_t
 common_dump_vmm(struct debug_ring_resources_t **drr, uint64_t vcpuid);
 
+/**
+ * Dump Exit Stats
+ *
+ * This grabs the VM exit counters and latency histograms of a vCPU so that
+ * they can be provided to the user. Note that the VMM must at least be loaded
+ * for this function to work as it has to do a symbol lookup
+ *
+ * @param stats the exit stats to fill in. The snapshot is copied into
+ *     this buffer, so it must be accessible to the VMM.
+ * @param vcpuid indicates which exit stats to get as each vcpu has its own
+ * @return BF_SUCCESS on success, negative error code on failure
+ */
+int64_t
+common_dump_exit_stats(struct exit_stats_t *stats, uint64_t vcpuid);
+
+/**
+ * Dump Memory Stats
+ *
+ * This grabs a snapshot of the usage of the VMM's memory pools so that it
+ * can be provided to the user. Note that the VMM must at least be loaded
+ * for this function to work as it has to do a symbol lookup
+ *
+ * @param stats the memory stats to fill in. The snapshot is copied into
+ *     this buffer, so it must be accessible to the VMM.
+ * @return BF_SUCCESS on success, negative error code on failure
+ */
+int64_t
+common_dump_mem_stats(struct mem_stats_t *stats);
+
 /**
  * Call VMM
  *
@@ -505,6 +505,52 @@ common_dump_vmm(struct debug_ring_resources_t **drr, uint64_t vcpuid)
     return BF_SUCCESS;
 }
 
+int64_t
+common_dump_exit_stats(struct exit_stats_t *stats, uint64_t vcpuid)
+{
+    int64_t ret = 0;
+
+    if (stats == 0) {
+        return BF_ERROR_INVALID_ARG;
+    }
+
+    if (common_vmm_status() == VMM_UNLOADED) {
+        return BF_ERROR_VMM_INVALID_STATE;
+    }
+
+    ret = platform_call_vmm_on_core(
+        0, BF_REQUEST_GET_EXIT_STATS, (uint64_t)vcpuid, (uint64_t)stats);
+
+    if (ret != BFELF_SUCCESS) {
+        return ret;
+    }
+
+    return BF_SUCCESS;
+}
+
+int64_t
+common_dump_mem_stats(struct mem_stats_t *stats)
+{
+    int64_t ret = 0;
+
+    if (stats == 0) {
+        return BF_ERROR_INVALID_ARG;
+    }
+
+    if (common_vmm_status() == VMM_UNLOADED) {
+        return BF_ERROR_VMM_INVALID_STATE;
+    }
+
+    ret = platform_call_vmm_on_core(
+        0, BF_REQUEST_GET_MEM_STATS, (uint64_t)stats, 0);
+
+    if (ret != BFELF_SUCCESS) {
+        return ret;
+    }
+
+    return BF_SUCCESS;
+}
+
 typedef struct thread_context_t tc_t;
 
 int64_t
@@ -249,6 +249,66 @@ ioctl_dump_vmm(struct debug_ring_resources_t *user_drr)
     return BF_IOCTL_SUCCESS;
 }
 
+static long
+ioctl_dump_exit_stats(struct exit_stats_t *user_stats)
+{
+    int64_t ret;
+    struct exit_stats_t *stats = platform_alloc_rw(sizeof(struct exit_stats_t));
+
+    if (stats == 0) {
+        BFALERT("IOCTL_DUMP_EXIT_STATS: failed to allocate memory for the stats\n");
+        return BF_IOCTL_FAILURE;
+    }
+
+    ret = common_dump_exit_stats(stats, g_vcpuid);
+    if (ret != BF_SUCCESS) {
+        BFALERT("IOCTL_DUMP_EXIT_STATS: common_dump_exit_stats failed: %p - %s\n", (void *)ret, ec_to_str(ret));
+        platform_free_rw(stats, sizeof(struct exit_stats_t));
+        return BF_IOCTL_FAILURE;
+    }
+
+    ret = copy_to_user(user_stats, stats, sizeof(struct exit_stats_t));
+    platform_free_rw(stats, sizeof(struct exit_stats_t));
+
+    if (ret != 0) {
+        BFALERT("IOCTL_DUMP_EXIT_STATS: failed to copy memory from userspace\n");
+        return BF_IOCTL_FAILURE;
+    }
+
+    BFDEBUG("IOCTL_DUMP_EXIT_STATS: succeeded\n");
+    return BF_IOCTL_SUCCESS;
+}
+
+static long
+ioctl_dump_mem_stats(struct mem_stats_t *user_stats)
+{
+    int64_t ret;
+    struct mem_stats_t *stats = platform_alloc_rw(sizeof(struct mem_stats_t));
+
+    if (stats == 0) {
+        BFALERT("IOCTL_DUMP_MEM_STATS: failed to allocate memory for the stats\n");
+        return BF_IOCTL_FAILURE;
+    }
+
+    ret = common_dump_mem_stats(stats);
+    if (ret != BF_SUCCESS) {
+        BFALERT("IOCTL_DUMP_MEM_STATS: common_dump_mem_stats failed: %p - %s\n", (void *)ret, ec_to_str(ret));
+        platform_free_rw(stats, sizeof(struct mem_stats_t));
+        return BF_IOCTL_FAILURE;
+    }
+
+    ret = copy_to_user(user_stats, stats, sizeof(struct mem_stats_t));
+    platform_free_rw(stats, sizeof(struct mem_stats_t));
+
+    if (ret != 0) {
+        BFALERT("IOCTL_DUMP_MEM_STATS: failed to copy memory from userspace\n");
+        return BF_IOCTL_FAILURE;
+    }
+
+    BFDEBUG("IOCTL_DUMP_MEM_STATS: succeeded\n");
+    return BF_IOCTL_SUCCESS;
+}
+
 static long
 ioctl_vmm_status(int64_t *status)
 {
@@ -320,6 +380,12 @@ dev_unlocked_ioctl(struct file *file,
         case IOCTL_VMM_STATUS:
             return ioctl_vmm_status((int64_t *)arg);
 
+        case IOCTL_DUMP_EXIT_STATS:
+            return ioctl_dump_exit_stats((struct exit_stats_t *)arg);
+
+        case IOCTL_DUMP_MEM_STATS:
+            return ioctl_dump_mem_stats((struct mem_stats_t *)arg);
+
         case IOCTL_SET_VCPUID:
             return ioctl_set_vcpuid((uint64_t *)arg);
 
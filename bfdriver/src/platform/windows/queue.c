@@ -186,6 +186,46 @@ ioctl_dump_vmm(struct debug_ring_resources_t *user_drr)
     return BF_IOCTL_SUCCESS;
 }
 
+static long
+ioctl_dump_exit_stats(struct exit_stats_t *user_stats, size_t size)
+{
+    int64_t ret;
+
+    if (user_stats == 0 || size < sizeof(struct exit_stats_t)) {
+        BFALERT("IOCTL_DUMP_EXIT_STATS: invalid output buffer\n");
+        return BF_IOCTL_FAILURE;
+    }
+
+    ret = common_dump_exit_stats(user_stats, g_vcpuid);
+    if (ret != BF_SUCCESS) {
+        BFALERT("IOCTL_DUMP_EXIT_STATS: common_dump_exit_stats failed: %p - %s\n", (void *)ret, ec_to_str(ret));
+        return BF_IOCTL_FAILURE;
+    }
+
+    BFDEBUG("IOCTL_DUMP_EXIT_STATS: succeeded\n");
+    return BF_IOCTL_SUCCESS;
+}
+
+static long
+ioctl_dump_mem_stats(struct mem_stats_t *user_stats, size_t size)
+{
+    int64_t ret;
+
+    if (user_stats == 0 || size < sizeof(struct mem_stats_t)) {
+        BFALERT("IOCTL_DUMP_MEM_STATS: invalid output buffer\n");
+        return BF_IOCTL_FAILURE;
+    }
+
+    ret = common_dump_mem_stats(user_stats);
+    if (ret != BF_SUCCESS) {
+        BFALERT("IOCTL_DUMP_MEM_STATS: common_dump_mem_stats failed: %p - %s\n", (void *)ret, ec_to_str(ret));
+        return BF_IOCTL_FAILURE;
+    }
+
+    BFDEBUG("IOCTL_DUMP_MEM_STATS: succeeded\n");
+    return BF_IOCTL_SUCCESS;
+}
+
 static long
 ioctl_vmm_status(int64_t *status)
 {
@@ -304,6 +344,14 @@ bareflankEvtIoDeviceControl(
             ret = ioctl_vmm_status((int64_t *)out);
             break;
 
+        case IOCTL_DUMP_EXIT_STATS:
+            ret = ioctl_dump_exit_stats((struct exit_stats_t *)out, out_size);
+            break;
+
+        case IOCTL_DUMP_MEM_STATS:
+            ret = ioctl_dump_mem_stats((struct mem_stats_t *)out, out_size);
+            break;
+
         case IOCTL_SET_VCPUID:
             ret = ioctl_set_vcpuid((uint64_t *)in);
             break;
@@ -23,11 +23,15 @@
 
 #include <bfdriverinterface.h>
 #include <bfdebugringinterface.h>
+#include <bfexitstatsinterface.h>
+#include <bfmemstatsinterface.h>
 
 #include <common.h>
 #include <test_support.h>
 
 debug_ring_resources_t *g_drr;
+exit_stats_t g_exit_stats;
+mem_stats_t g_mem_stats;
 
 TEST_CASE("common_add_module: invalid drr")
 {
@@ -64,3 +68,75 @@ TEST_CASE("common_add_module: success")
     CHECK(common_dump_vmm(&g_drr, 0) == BF_SUCCESS);
     CHECK(common_fini() == BF_SUCCESS);
 }
+
+TEST_CASE("common_dump_exit_stats: invalid stats")
+{
+    CHECK(common_dump_exit_stats(nullptr, 0) == BF_ERROR_INVALID_ARG);
+}
+
+TEST_CASE("common_dump_exit_stats: unloaded")
+{
+    CHECK(common_dump_exit_stats(&g_exit_stats, 0) == BF_ERROR_VMM_INVALID_STATE);
+}
+
+TEST_CASE("common_dump_exit_stats: get exit stats fails")
+{
+    binaries_info info{&g_file, g_filenames_get_exit_stats_fails, false};
+
+    for (const auto &binary : info.binaries()) {
+        REQUIRE(common_add_module(binary.file, binary.file_size) == BF_SUCCESS);
+    }
+
+    CHECK(common_load_vmm() == BF_SUCCESS);
+    CHECK(common_dump_exit_stats(&g_exit_stats, 0) == ENTRY_ERROR_UNKNOWN);
+    CHECK(common_fini() == BF_SUCCESS);
+}
+
+TEST_CASE("common_dump_exit_stats: success")
+{
+    binaries_info info{&g_file, g_filenames_success, false};
+
+    for (const auto &binary : info.binaries()) {
+        REQUIRE(common_add_module(binary.file, binary.file_size) == BF_SUCCESS);
+    }
+
+    CHECK(common_load_vmm() == BF_SUCCESS);
+    CHECK(common_dump_exit_stats(&g_exit_stats, 0) == BF_SUCCESS);
+    CHECK(common_fini() == BF_SUCCESS);
+}
+
+TEST_CASE("common_dump_mem_stats: invalid stats")
+{
+    CHECK(common_dump_mem_stats(nullptr) == BF_ERROR_INVALID_ARG);
+}
+
+TEST_CASE("common_dump_mem_stats: unloaded")
+{
+    CHECK(common_dump_mem_stats(&g_mem_stats) == BF_ERROR_VMM_INVALID_STATE);
+}
+
+TEST_CASE("common_dump_mem_stats: get mem stats fails")
+{
+    binaries_info info{&g_file, g_filenames_get_mem_stats_fails, false};
+
+    for (const auto &binary : info.binaries()) {
+        REQUIRE(common_add_module(binary.file, binary.file_size) == BF_SUCCESS);
+    }
+
+    CHECK(common_load_vmm() == BF_SUCCESS);
+    CHECK(common_dump_mem_stats(&g_mem_stats) == ENTRY_ERROR_UNKNOWN);
+    CHECK(common_fini() == BF_SUCCESS);
+}
+
+TEST_CASE("common_dump_mem_stats: success")
+{
+    binaries_info info{&g_file, g_filenames_success, false};
+
+    for (const auto &binary : info.binaries()) {
+        REQUIRE(common_add_module(binary.file, binary.file_size) == BF_SUCCESS);
+    }
+
+    CHECK(common_load_vmm() == BF_SUCCESS);
+    CHECK(common_dump_mem_stats(&g_mem_stats) == BF_SUCCESS);
+    CHECK(common_fini() == BF_SUCCESS);
+}
@@ -51,6 +51,18 @@
 #define REQUEST_GET_DRR_RETURN ENTRY_ERROR_UNKNOWN
 #endif
 
+#ifndef REQUEST_GET_EXIT_STATS_FAILS
+#define REQUEST_GET_EXIT_STATS_RETURN ENTRY_SUCCESS
+#else
+#define REQUEST_GET_EXIT_STATS_RETURN ENTRY_ERROR_UNKNOWN
+#endif
+
+#ifndef REQUEST_GET_MEM_STATS_FAILS
+#define REQUEST_GET_MEM_STATS_RETURN ENTRY_SUCCESS
+#else
+#define REQUEST_GET_MEM_STATS_RETURN ENTRY_ERROR_UNKNOWN
+#endif
+
 #ifndef REQUEST_SET_RSDP_FAILS
 #define REQUEST_SET_RSDP_RETURN ENTRY_SUCCESS
 #else
@@ -125,6 +137,12 @@ bfmain(uintptr_t request, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3)
         case BF_REQUEST_GET_DRR:
             return REQUEST_GET_DRR_RETURN;
 
+        case BF_REQUEST_GET_EXIT_STATS:
+            return REQUEST_GET_EXIT_STATS_RETURN;
+
+        case BF_REQUEST_GET_MEM_STATS:
+            return REQUEST_GET_MEM_STATS_RETURN;
+
         case BF_REQUEST_VMM_INIT:
             return REQUEST_VMM_INIT_RETURN;
 
@@ -216,12 +216,16 @@ namespace exit_reason
         constexpr const auto invpcid = 58U;                                     // invpcid
         constexpr const auto vmfunc = 59U;                                      // vmfunc
         constexpr const auto rdseed = 61U;                                      // rdseed
+        constexpr const auto page_modification_log_full = 62U;                  // pml_full
         constexpr const auto xsaves = 63U;                                      // xsaves
         constexpr const auto xrstors = 64U;                                     // xrstors
 
         inline auto get()
         { return get_bits(get_vmcs_field(addr, name, exists()), mask) >> from; }
 
+        inline auto get(value_type field)
+        { return get_bits(field, mask) >> from; }
+
         inline auto basic_exit_reason_description(value_type reason)
         {
             switch (reason) {
@@ -399,6 +403,9 @@ namespace exit_reason
                 case rdseed:
                     return "rdseed";
 
+                case page_modification_log_full:
+                    return "page_modification_log_full";
+
                 case xsaves:
                     return "xsaves";
 
@@ -153,7 +153,7 @@ _outsbrep:
     mov rdx, rdi
     mov rdi, rsi
     cld
-    outsb
+    rep outsb
     xor rax, rax
     ret
 
@@ -163,7 +163,7 @@ _outswrep:
     mov rdx, rdi
     mov rdi, rsi
     cld
-    outsw
+    rep outsw
     xor rax, rax
     ret
 
@@ -173,6 +173,6 @@ _outsdrep:
     mov rdx, rdi
     mov rdi, rsi
     cld
-    outsd
+    rep outsd
     xor rax, rax
     ret
@@ -36,7 +36,9 @@ enum class command_line_parser_command {
     stop = 5,
     quick = 6,
     dump = 7,
-    status = 8
+    status = 8,
+    stats = 9,
+    memstats = 10
 };
 
 #ifdef _MSC_VER
@@ -137,6 +139,8 @@ private:
     void parse_quick(arg_list_type &args);
     void parse_dump(arg_list_type &args);
     void parse_status(arg_list_type &args);
+    void parse_stats(arg_list_type &args);
+    void parse_memstats(arg_list_type &args);
 
 private:
 
@@ -27,6 +27,8 @@
 #include <bfgsl.h>
 #include <bffile.h>
 #include <bfdebugringinterface.h>
+#include <bfexitstatsinterface.h>
+#include <bfmemstatsinterface.h>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -67,6 +69,10 @@ public:
     using binary_data = file::binary_data;          ///< Binary data type
     using drr_type = debug_ring_resources_t;        ///< Debug ring resources type
     using drr_pointer = drr_type *;                 ///< Debug ring resources pointer type
+    using exit_stats_type = exit_stats_t;           ///< Exit stats type
+    using exit_stats_pointer = exit_stats_type *;   ///< Exit stats pointer type
+    using mem_stats_type = mem_stats_t;             ///< Memory stats type
+    using mem_stats_pointer = mem_stats_type *;     ///< Memory stats pointer type
     using vcpuid_type = uint64_t;                   ///< VCPUID type
     using status_type = int64_t;                    ///< Status type
     using status_pointer = status_type *;           ///< Status pointer type
@@ -164,6 +170,31 @@ public:
     ///
     virtual void call_ioctl_vmm_status(gsl::not_null<status_pointer> status);
 
+    /// Dump Exit Stats
+    ///
+    /// Dumps the VM exit counters and latency histograms of a vCPU
+    ///
+    /// @expects stats != nullptr
+    /// @ensures none
+    ///
+    /// @param stats pointer to an exit_stats_t to store the results
+    /// @param vcpuid indicates which exit stats to get (every vcpu has its own)
+    ///
+    virtual void call_ioctl_dump_exit_stats(
+        gsl::not_null<exit_stats_pointer> stats, vcpuid_type vcpuid);
+
+    /// Dump Memory Stats
+    ///
+    /// Dumps the usage of the VMM's memory pools and SLAB allocators
+    ///
+    /// @expects stats != nullptr
+    /// @ensures none
+    ///
+    /// @param stats pointer to a mem_stats_t to store the results
+    ///
+    virtual void call_ioctl_dump_mem_stats(
+        gsl::not_null<mem_stats_pointer> stats);
+
 private:
 
     std::unique_ptr<ioctl_private_base> m_d;
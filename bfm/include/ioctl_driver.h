@@ -96,6 +96,8 @@ private:
     void quick_vmm();
     void dump_vmm();
     void vmm_status();
+    void dump_exit_stats();
+    void dump_mem_stats();
 
     status_type get_status() const;
 
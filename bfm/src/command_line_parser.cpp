@@ -90,6 +90,8 @@ command_line_parser::parse(const arg_list_type &args)
     if (cmd == "quick") { return parse_quick(filtered_args); }
     if (cmd == "dump") { return parse_dump(filtered_args); }
     if (cmd == "status") { return parse_status(filtered_args); }
+    if (cmd == "stats") { return parse_stats(filtered_args); }
+    if (cmd == "memstats") { return parse_memstats(filtered_args); }
 
     throw std::runtime_error("unknown command: " + cmd);
 }
@@ -165,3 +167,17 @@ command_line_parser::parse_status(arg_list_type &args)
     bfignored(args);
     m_cmd = command_type::status;
 }
+
+void
+command_line_parser::parse_stats(arg_list_type &args)
+{
+    bfignored(args);
+    m_cmd = command_type::stats;
+}
+
+void
+command_line_parser::parse_memstats(arg_list_type &args)
+{
+    bfignored(args);
+    m_cmd = command_type::memstats;
+}
@@ -64,6 +64,12 @@ ioctl_driver::process()
 
         case command_line_parser::command_type::status:
             return this->vmm_status();
+
+        case command_line_parser::command_type::stats:
+            return this->dump_exit_stats();
+
+        case command_line_parser::command_type::memstats:
+            return this->dump_mem_stats();
     }
 }
 
@@ -176,6 +182,90 @@ ioctl_driver::vmm_status()
     }
 }
 
+void
+ioctl_driver::dump_exit_stats()
+{
+    auto stats = std::make_unique<ioctl::exit_stats_type>();
+
+    switch (get_status()) {
+        case VMM_RUNNING: break;
+        case VMM_LOADED: break;
+        case VMM_UNLOADED: throw std::runtime_error("vmm must be loaded first");
+        case VMM_CORRUPT: throw std::runtime_error("vmm corrupt");
+        default: throw std::runtime_error("unknown status");
+    }
+
+    m_ioctl->call_ioctl_dump_exit_stats(stats.get(), m_clp->vcpuid());
+
+    for (std::ptrdiff_t reason = 0; reason < EXIT_STATS_NUM_REASONS; reason++) {
+        const auto count = gsl::at(stats->count, reason);
+        const auto &hist = gsl::at(stats->hist, reason);
+
+        if (count == 0) {
+            continue;
+        }
+
+        std::cout << "exit reason " << reason << ": " << count << " exits\n";
+
+        for (std::ptrdiff_t bucket = 0; bucket < EXIT_STATS_NUM_BUCKETS; bucket++) {
+            if (gsl::at(hist, bucket) == 0) {
+                continue;
+            }
+
+            std::cout << "    [2^" << bucket << ", ";
+
+            if (bucket == EXIT_STATS_NUM_BUCKETS - 1) {
+                std::cout << "inf";
+            }
+            else {
+                std::cout << "2^" << bucket + 1;
+            }
+
+            std::cout << ") cycles: " << gsl::at(hist, bucket) << '\n';
+        }
+    }
+}
+
+void
+ioctl_driver::dump_mem_stats()
+{
+    auto stats = std::make_unique<ioctl::mem_stats_type>();
+
+    switch (get_status()) {
+        case VMM_RUNNING: break;
+        case VMM_LOADED: break;
+        case VMM_UNLOADED: throw std::runtime_error("vmm must be loaded first");
+        case VMM_CORRUPT: throw std::runtime_error("vmm corrupt");
+        default: throw std::runtime_error("unknown status");
+    }
+
+    m_ioctl->call_ioctl_dump_mem_stats(stats.get());
+
+    const std::array<const char *, MEM_STATS_NUM_POOLS> names = {
+        "page pool", "huge pool", "mem map pool", "slab pool"
+    };
+
+    for (std::ptrdiff_t i = 0; i < MEM_STATS_NUM_POOLS; i++) {
+        const auto &pool = gsl::at(stats->pools, i);
+
+        std::cout << gsl::at(names, i) << ": "
+                  << "total " << pool.total << ", "
+                  << "used " << pool.used << ", "
+                  << "free " << pool.free << ", "
+                  << "high water " << pool.high_water << ", "
+                  << "largest free " << pool.largest_free << " bytes\n";
+    }
+
+    for (std::ptrdiff_t i = 0; i < MEM_STATS_NUM_SLABS; i++) {
+        const auto &slab = gsl::at(stats->slabs, i);
+
+        std::cout << "slab 0x" << std::hex << slab.size << std::dec << ": "
+                  << "used " << slab.used << ", "
+                  << "free " << slab.free << ", "
+                  << "high water " << slab.high_water << " objects\n";
+    }
+}
+
 ioctl_driver::list_type
 ioctl_driver::library_path()
 {
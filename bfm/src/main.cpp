@@ -87,6 +87,8 @@ bfm_help()
     std::cout << R"(  or:  bfm [OPTION]... stop...)" << std::endl;
     std::cout << R"(  or:  bfm [OPTION]... dump...)" << std::endl;
     std::cout << R"(  or:  bfm [OPTION]... status...)" << std::endl;
+    std::cout << R"(  or:  bfm [OPTION]... stats...)" << std::endl;
+    std::cout << R"(  or:  bfm [OPTION]... memstats...)" << std::endl;
     std::cout << R"(Controls or queries the bareflank hypervisor)" << std::endl;
     std::cout << std::endl;
     std::cout << R"(       -h, --help      show this help menu)" << std::endl;
@@ -156,3 +156,23 @@ ioctl_private::call_ioctl_vmm_status(gsl::not_null<status_pointer> status)
         throw std::runtime_error("ioctl failed: IOCTL_VMM_STATUS");
     }
 }
+
+void
+ioctl_private::call_ioctl_dump_exit_stats(gsl::not_null<exit_stats_pointer> stats, vcpuid_type vcpuid)
+{
+    if (bfm_write_ioctl(fd, IOCTL_SET_VCPUID, &vcpuid) < 0) {
+        throw std::runtime_error("ioctl failed: IOCTL_SET_VCPUID");
+    }
+
+    if (bfm_read_ioctl(fd, IOCTL_DUMP_EXIT_STATS, stats) < 0) {
+        throw std::runtime_error("ioctl failed: IOCTL_DUMP_EXIT_STATS");
+    }
+}
+
+void
+ioctl_private::call_ioctl_dump_mem_stats(gsl::not_null<mem_stats_pointer> stats)
+{
+    if (bfm_read_ioctl(fd, IOCTL_DUMP_MEM_STATS, stats) < 0) {
+        throw std::runtime_error("ioctl failed: IOCTL_DUMP_MEM_STATS");
+    }
+}
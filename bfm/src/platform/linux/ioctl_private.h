@@ -33,6 +33,8 @@ public:
     using drr_pointer = ioctl::drr_pointer;
     using vcpuid_type = ioctl::vcpuid_type;
     using status_pointer = ioctl::status_pointer;
+    using exit_stats_pointer = ioctl::exit_stats_pointer;
+    using mem_stats_pointer = ioctl::mem_stats_pointer;
     using handle_type = int;
 
     ioctl_private();
@@ -47,6 +49,8 @@ public:
     virtual void call_ioctl_stop_vmm();
     virtual void call_ioctl_dump_vmm(gsl::not_null<drr_pointer> drr, vcpuid_type vcpuid);
     virtual void call_ioctl_vmm_status(gsl::not_null<status_pointer> status);
+    virtual void call_ioctl_dump_exit_stats(gsl::not_null<exit_stats_pointer> stats, vcpuid_type vcpuid);
+    virtual void call_ioctl_dump_mem_stats(gsl::not_null<mem_stats_pointer> stats);
 
 private:
 
@@ -89,3 +89,19 @@ ioctl::call_ioctl_vmm_status(gsl::not_null<status_pointer> status)
         d->call_ioctl_vmm_status(status);
     }
 }
+
+void
+ioctl::call_ioctl_dump_exit_stats(gsl::not_null<exit_stats_pointer> stats, vcpuid_type vcpuid)
+{
+    if (auto d = dynamic_cast<ioctl_private *>(m_d.get())) {
+        d->call_ioctl_dump_exit_stats(stats, vcpuid);
+    }
+}
+
+void
+ioctl::call_ioctl_dump_mem_stats(gsl::not_null<mem_stats_pointer> stats)
+{
+    if (auto d = dynamic_cast<ioctl_private *>(m_d.get())) {
+        d->call_ioctl_dump_mem_stats(stats);
+    }
+}
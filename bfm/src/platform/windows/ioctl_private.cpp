@@ -225,6 +225,26 @@ ioctl_private::call_ioctl_vmm_status(gsl::not_null<status_pointer> status)
     }
 }
 
+void
+ioctl_private::call_ioctl_dump_exit_stats(gsl::not_null<exit_stats_pointer> stats, vcpuid_type vcpuid)
+{
+    if (bfm_write_ioctl(fd, IOCTL_SET_VCPUID, &vcpuid, sizeof(vcpuid)) == BF_IOCTL_FAILURE) {
+        throw std::runtime_error("ioctl failed: IOCTL_SET_VCPUID");
+    }
+
+    if (bfm_read_ioctl(fd, IOCTL_DUMP_EXIT_STATS, stats, sizeof(*stats)) == BF_IOCTL_FAILURE) {
+        throw std::runtime_error("ioctl failed: IOCTL_DUMP_EXIT_STATS");
+    }
+}
+
+void
+ioctl_private::call_ioctl_dump_mem_stats(gsl::not_null<mem_stats_pointer> stats)
+{
+    if (bfm_read_ioctl(fd, IOCTL_DUMP_MEM_STATS, stats, sizeof(*stats)) == BF_IOCTL_FAILURE) {
+        throw std::runtime_error("ioctl failed: IOCTL_DUMP_MEM_STATS");
+    }
+}
+
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #endif
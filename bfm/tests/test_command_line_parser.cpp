@@ -199,6 +199,25 @@ TEST_CASE("test command line parser with valid status")
     CHECK(clp.cmd() == command_line_parser::command_type::status);
 }
 
+TEST_CASE("test command line parser with valid stats")
+{
+    auto args = {"stats"_s, "--vcpuid"_s, "1"_s};
+    command_line_parser clp{};
+
+    CHECK_NOTHROW(clp.parse(args));
+    CHECK(clp.cmd() == command_line_parser::command_type::stats);
+    CHECK(clp.vcpuid() == 1);
+}
+
+TEST_CASE("test command line parser with valid memstats")
+{
+    auto args = {"memstats"_s};
+    command_line_parser clp{};
+
+    CHECK_NOTHROW(clp.parse(args));
+    CHECK(clp.cmd() == command_line_parser::command_type::memstats);
+}
+
 TEST_CASE("test command line parser no vcpuid")
 {
     auto args = {"dump"_s, "--vcpuid"_s};
@@ -58,6 +58,8 @@ setup_ioctl(MockRepository &mocks, ioctl::status_type status)
     mocks.OnCall(ctl, ioctl::call_ioctl_start_vmm);
     mocks.OnCall(ctl, ioctl::call_ioctl_stop_vmm);
     mocks.OnCall(ctl, ioctl::call_ioctl_dump_vmm);
+    mocks.OnCall(ctl, ioctl::call_ioctl_dump_exit_stats);
+    mocks.OnCall(ctl, ioctl::call_ioctl_dump_mem_stats);
 
     mocks.OnCall(ctl, ioctl::call_ioctl_vmm_status).Do([&](auto s) {
         *s = g_status;
@@ -898,4 +900,124 @@ TEST_CASE("test ioctl driver process vmm status unknown status")
     CHECK_THROWS(driver.process());
 }
 
+TEST_CASE("test ioctl driver process stats vmm unloaded")
+{
+    MockRepository mocks;
+
+    auto fil = setup_file(mocks);
+    auto ctl = setup_ioctl(mocks, VMM_UNLOADED);
+    auto clp = setup_command_line_parser(mocks, clpc::stats);
+
+    mocks.NeverCall(ctl, ioctl::call_ioctl_dump_exit_stats);
+
+    auto driver = ioctl_driver(fil, ctl, clp);
+    CHECK_THROWS(driver.process());
+}
+
+TEST_CASE("test ioctl driver process stats vmm corrupted")
+{
+    MockRepository mocks;
+
+    auto fil = setup_file(mocks);
+    auto ctl = setup_ioctl(mocks, VMM_CORRUPT);
+    auto clp = setup_command_line_parser(mocks, clpc::stats);
+
+    mocks.NeverCall(ctl, ioctl::call_ioctl_dump_exit_stats);
+
+    auto driver = ioctl_driver(fil, ctl, clp);
+    CHECK_THROWS(driver.process());
+}
+
+TEST_CASE("test ioctl driver process stats dump failed")
+{
+    MockRepository mocks;
+
+    auto fil = setup_file(mocks);
+    auto ctl = setup_ioctl(mocks, VMM_RUNNING);
+    auto clp = setup_command_line_parser(mocks, clpc::stats);
+
+    mocks.OnCall(ctl, ioctl::call_ioctl_dump_exit_stats).Throw(std::runtime_error("error"));
+
+    auto driver = ioctl_driver(fil, ctl, clp);
+    CHECK_THROWS(driver.process());
+}
+
+TEST_CASE("test ioctl driver process stats success")
+{
+    MockRepository mocks;
+
+    auto fil = setup_file(mocks);
+    auto ctl = setup_ioctl(mocks, VMM_RUNNING);
+    auto clp = setup_command_line_parser(mocks, clpc::stats);
+
+    mocks.OnCall(ctl, ioctl::call_ioctl_dump_exit_stats).Do([](gsl::not_null<ioctl::exit_stats_pointer> stats, auto) {
+        stats->count[10] = 3;
+        stats->hist[10][5] = 2;
+        stats->hist[10][EXIT_STATS_NUM_BUCKETS - 1] = 1;
+    });
+
+    auto driver = ioctl_driver(fil, ctl, clp);
+    CHECK_NOTHROW(driver.process());
+}
+
+TEST_CASE("test ioctl driver process memstats vmm unloaded")
+{
+    MockRepository mocks;
+
+    auto fil = setup_file(mocks);
+    auto ctl = setup_ioctl(mocks, VMM_UNLOADED);
+    auto clp = setup_command_line_parser(mocks, clpc::memstats);
+
+    mocks.NeverCall(ctl, ioctl::call_ioctl_dump_mem_stats);
+
+    auto driver = ioctl_driver(fil, ctl, clp);
+    CHECK_THROWS(driver.process());
+}
+
+TEST_CASE("test ioctl driver process memstats vmm corrupted")
+{
+    MockRepository mocks;
+
+    auto fil = setup_file(mocks);
+    auto ctl = setup_ioctl(mocks, VMM_CORRUPT);
+    auto clp = setup_command_line_parser(mocks, clpc::memstats);
+
+    mocks.NeverCall(ctl, ioctl::call_ioctl_dump_mem_stats);
+
+    auto driver = ioctl_driver(fil, ctl, clp);
+    CHECK_THROWS(driver.process());
+}
+
+TEST_CASE("test ioctl driver process memstats dump failed")
+{
+    MockRepository mocks;
+
+    auto fil = setup_file(mocks);
+    auto ctl = setup_ioctl(mocks, VMM_RUNNING);
+    auto clp = setup_command_line_parser(mocks, clpc::memstats);
+
+    mocks.OnCall(ctl, ioctl::call_ioctl_dump_mem_stats).Throw(std::runtime_error("error"));
+
+    auto driver = ioctl_driver(fil, ctl, clp);
+    CHECK_THROWS(driver.process());
+}
+
+TEST_CASE("test ioctl driver process memstats success")
+{
+    MockRepository mocks;
+
+    auto fil = setup_file(mocks);
+    auto ctl = setup_ioctl(mocks, VMM_RUNNING);
+    auto clp = setup_command_line_parser(mocks, clpc::memstats);
+
+    mocks.OnCall(ctl, ioctl::call_ioctl_dump_mem_stats).Do([](gsl::not_null<ioctl::mem_stats_pointer> stats) {
+        stats->pools[MEM_STATS_POOL_PAGE].total = 0x1000;
+        stats->pools[MEM_STATS_POOL_PAGE].free = 0x1000;
+        stats->slabs[0].size = 0x10;
+    });
+
+    auto driver = ioctl_driver(fil, ctl, clp);
+    CHECK_NOTHROW(driver.process());
+}
+
 #endif
@@ -77,11 +77,26 @@ ioctl::call_ioctl_vmm_status(gsl::not_null<status_pointer> status)
     bfignored(status);
 }
 
+void
+ioctl::call_ioctl_dump_exit_stats(gsl::not_null<exit_stats_pointer> stats, vcpuid_type vcpuid)
+{
+    bfignored(stats);
+    bfignored(vcpuid);
+}
+
+void
+ioctl::call_ioctl_dump_mem_stats(gsl::not_null<mem_stats_pointer> stats)
+{
+    bfignored(stats);
+}
+
 TEST_CASE("support")
 {
     ioctl ctl{};
     int64_t status;
     auto drr = ioctl::drr_type{};
+    auto stats = std::make_unique<ioctl::exit_stats_type>();
+    auto mem_stats = std::make_unique<ioctl::mem_stats_type>();
     auto data = ioctl::binary_data{};
 
     CHECK_NOTHROW(ctl.call_ioctl_add_module(data));
@@ -91,6 +106,8 @@ TEST_CASE("support")
     CHECK_NOTHROW(ctl.call_ioctl_stop_vmm());
     CHECK_NOTHROW(ctl.call_ioctl_dump_vmm(&drr, 0));
     CHECK_NOTHROW(ctl.call_ioctl_vmm_status(&status));
+    CHECK_NOTHROW(ctl.call_ioctl_dump_exit_stats(stats.get(), 0));
+    CHECK_NOTHROW(ctl.call_ioctl_dump_mem_stats(mem_stats.get()));
 }
 
 #endif
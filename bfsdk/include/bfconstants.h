@@ -85,6 +85,24 @@
 #define MEM_MAP_POOL_K (15ULL)
 #endif
 
+/*
+ * SLAB Pool K
+ *
+ * Defines the size of the pool that backs the memory manager's SLAB
+ * allocators (i.e. all allocations of 0x800 bytes or less). This pool is
+ * kept apart from the rest of the page pool so that small allocations do
+ * not fragment the pages used for page tables. The pool is carved out of
+ * the page pool when the memory manager is created, so it does not add to
+ * the size of the VMM, but the page pool has that much less memory for
+ * everything else. Once the pool is full, the SLAB allocators take their
+ * pages from the rest of the page pool, so this is not a limit on the
+ * number of small allocations. "K" must be less than PAGE_POOL_K. Note that
+ * increasing "K" by 1 will double the amount of memory.
+ */
+#ifndef SLAB_POOL_K
+#define SLAB_POOL_K (11ULL)
+#endif
+
 /*
  * Memory Map Pool Start
  *
@@ -108,6 +126,63 @@
 #define MEM_MAP_POOL_START 0xBF000000000ULL
 #endif
 
+/*
+ * Direct Map Start
+ *
+ * This defines the starting location of the virtual memory that is used
+ * for the VMM's direct map of host physical memory (see DIRECT_MAP_SIZE).
+ * Host physical address "x" is mapped at DIRECT_MAP_START + x. Like the
+ * memory map pool, the direct map is placed high in the lower half of the
+ * canonical address space, above the memory map pool, to stay out of the
+ * way of BIOS/EFI and the Host OS.
+ *
+ * Note: defined in bytes, and must be 1g aligned
+ */
+#ifndef DIRECT_MAP_START
+#define DIRECT_MAP_START 0x400000000000ULL
+#endif
+
+/*
+ * Direct Map Size
+ *
+ * Defines the maximum number of bytes of host physical memory the VMM maps
+ * at DIRECT_MAP_START when its CR3 is set up. Once mapped, any host
+ * physical address in the direct map can be accessed without having to map
+ * it first (e.g. map_hpa_4k() simply returns its address in the direct
+ * map). The amount of memory that is mapped is also limited by the
+ * physical address width reported by CPUID. The direct map is disabled by
+ * default, and is enabled by setting this to a non-zero value (e.g.
+ * 0x10000000000ULL for 1TB). Note that this must not be larger than the
+ * lower half of the canonical address space above DIRECT_MAP_START.
+ *
+ * Note: defined in bytes
+ */
+#ifndef DIRECT_MAP_SIZE
+#define DIRECT_MAP_SIZE (0ULL)
+#endif
+
+/*
+ * Magazine Size
+ *
+ * Defines the number of objects each CPU caches for each of the memory
+ * manager's SLAB size classes. A CPU allocates from, and frees to its own
+ * cache without taking the memory manager's lock. The lock is only taken to
+ * refill an empty cache, or drain a full one, half a cache at a time.
+ */
+#ifndef MAGAZINE_SIZE
+#define MAGAZINE_SIZE (16ULL)
+#endif
+
+/*
+ * Magazine Max CPUs
+ *
+ * Defines the number of CPUs that have a SLAB cache (see MAGAZINE_SIZE).
+ * CPUs with a larger CPUID use the SLAB allocators directly.
+ */
+#ifndef MAGAZINE_MAX_CPUS
+#define MAGAZINE_MAX_CPUS (64ULL)
+#endif
+
 /*
  * Max Supported Modules
  *
@@ -118,6 +193,98 @@
 #define MAX_NUM_MODULES (75LL)
 #endif
 
+/*
+ * Max Handlers Per Exit Reason
+ *
+ * Defines the maximum number of handlers that can be registered with the
+ * exit handler for a single basic exit reason, as well as the maximum number
+ * of exit delegates. The exit handler stores its delegates in a flat,
+ * fixed-size table so that dispatching a VM exit never touches the heap. If
+ * an extension needs to register more handlers than this, this value may be
+ * increased at the cost of additional memory per vCPU.
+ */
+#ifndef MAX_HANDLERS_PER_EXIT_REASON
+#define MAX_HANDLERS_PER_EXIT_REASON (7ULL)
+#endif
+
+/*
+ * VMCS Write Queue Size
+ *
+ * Defines the number of distinct VMCS fields that a vCPU can buffer when
+ * VMCS write-back is enabled. Writes to the same field are coalesced, and
+ * the queue is flushed with one VMWRITE per field right before the VMCS is
+ * resumed. If the queue fills up during a VM exit, it is flushed early.
+ */
+#ifndef VMCS_WRITE_QUEUE_SIZE
+#define VMCS_WRITE_QUEUE_SIZE (16ULL)
+#endif
+
+/*
+ * GPA TLB Size
+ *
+ * Defines the number of entries in each vCPU's guest physical to host
+ * physical translation cache, which gpa_to_hpa() consults before walking
+ * the EPT page tables. The cache is direct-mapped on the guest physical
+ * page number, so this value must be a power of two.
+ */
+#ifndef GPA_TLB_SIZE
+#define GPA_TLB_SIZE (64ULL)
+#endif
+
+/*
+ * GVA TLB Size
+ *
+ * Defines the number of entries in each vCPU's guest virtual to guest
+ * physical translation cache, which gva_to_gpa() consults before walking
+ * the guest's page tables. The cache is direct-mapped on the guest virtual
+ * page number, so this value must be a power of two.
+ */
+#ifndef GVA_TLB_SIZE
+#define GVA_TLB_SIZE (64ULL)
+#endif
+
+/*
+ * EPT Shootdown Timer
+ *
+ * Defines the VMX-preemption timer value that a vCPU uses while it is
+ * attached to an EPT map (and nothing else is using its preemption timer).
+ * A CPU that changes a shared EPT map has to wait for every vCPU using the
+ * map to exit, and a guest that never exits on its own (e.g. an idle guest
+ * that halts without HLT exiting) is forced to exit at least this often.
+ * The timer counts down at the rate reported by IA32_VMX_MISC, and only
+ * while the guest is executing. Decreasing this value bounds the wait more
+ * tightly at the cost of more VM exits.
+ */
+#ifndef EPT_SHOOTDOWN_TIMER
+#define EPT_SHOOTDOWN_TIMER (0x10000ULL)
+#endif
+
+/*
+ * Map Cache Size
+ *
+ * Defines the number of 4k host virtual address windows each vCPU keeps
+ * mapped for map_hpa_4k() / map_gpa_4k(). Mapping a host physical page
+ * that is already in one of these windows does not touch the VMM's page
+ * tables or the TLB. The windows are indexed by a hash of the host
+ * physical page number, so this value must be a power of two.
+ */
+#ifndef MAP_CACHE_SIZE
+#define MAP_CACHE_SIZE (64ULL)
+#endif
+
+/*
+ * Invalidation Queue Size
+ *
+ * Defines the number of guest virtual addresses that a vCPU can queue for
+ * an individual-address INVVPID before its next VM entry. Queuing more
+ * addresses than this escalates the invalidation to a single-context
+ * INVVPID, which is cheaper than a long run of individual-address
+ * invalidations.
+ */
+#ifndef INVALIDATION_QUEUE_SIZE
+#define INVALIDATION_QUEUE_SIZE (8ULL)
+#endif
+
 /*
  * Debug Ring Size
  *
@@ -59,7 +59,9 @@ extern "C" {
 #define IOCTL_STOP_VMM_CMD 0x806
 #define IOCTL_DUMP_VMM_CMD 0x807
 #define IOCTL_VMM_STATUS_CMD 0x808
+#define IOCTL_DUMP_EXIT_STATS_CMD 0x809
 #define IOCTL_SET_VCPUID_CMD 0x80A
+#define IOCTL_DUMP_MEM_STATS_CMD 0x80B
 
 /* -------------------------------------------------------------------------- */
 /* Linux Interfaces                                                           */
@@ -75,7 +77,9 @@ extern "C" {
 #define IOCTL_STOP_VMM _IO(BAREFLANK_MAJOR, IOCTL_STOP_VMM_CMD)
 #define IOCTL_DUMP_VMM _IOR(BAREFLANK_MAJOR, IOCTL_DUMP_VMM_CMD, struct debug_ring_resources_t *)
 #define IOCTL_VMM_STATUS _IOR(BAREFLANK_MAJOR, IOCTL_VMM_STATUS_CMD, int64_t *)
+#define IOCTL_DUMP_EXIT_STATS _IOR(BAREFLANK_MAJOR, IOCTL_DUMP_EXIT_STATS_CMD, struct exit_stats_t *)
 #define IOCTL_SET_VCPUID _IOW(BAREFLANK_MAJOR, IOCTL_SET_VCPUID_CMD, uint64_t *)
+#define IOCTL_DUMP_MEM_STATS _IOR(BAREFLANK_MAJOR, IOCTL_DUMP_MEM_STATS_CMD, struct mem_stats_t *)
 
 #endif
 
@@ -108,7 +112,9 @@ DEFINE_GUID(
 #define IOCTL_STOP_VMM CTL_CODE(BAREFLANK_DEVICETYPE, IOCTL_STOP_VMM_CMD, METHOD_BUFFERED, 0)
 #define IOCTL_DUMP_VMM CTL_CODE(BAREFLANK_DEVICETYPE, IOCTL_DUMP_VMM_CMD, METHOD_OUT_DIRECT, FILE_READ_DATA)
 #define IOCTL_VMM_STATUS CTL_CODE(BAREFLANK_DEVICETYPE, IOCTL_VMM_STATUS_CMD, METHOD_BUFFERED, FILE_READ_DATA)
+#define IOCTL_DUMP_EXIT_STATS CTL_CODE(BAREFLANK_DEVICETYPE, IOCTL_DUMP_EXIT_STATS_CMD, METHOD_OUT_DIRECT, FILE_READ_DATA)
 #define IOCTL_SET_VCPUID CTL_CODE(BAREFLANK_DEVICETYPE, IOCTL_SET_VCPUID_CMD, METHOD_IN_DIRECT, FILE_WRITE_DATA)
+#define IOCTL_DUMP_MEM_STATS CTL_CODE(BAREFLANK_DEVICETYPE, IOCTL_DUMP_MEM_STATS_CMD, METHOD_OUT_DIRECT, FILE_READ_DATA)
 
 #endif
 
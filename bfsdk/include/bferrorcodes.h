@@ -66,6 +66,20 @@
 #define GET_DRR_SUCCESS bfscast(status_t, SUCCESS)
 #define GET_DRR_FAILURE bfscast(status_t, 0x8000000000010000)
 
+/* -------------------------------------------------------------------------- */
+/* Exit Stats Error Codes                                                     */
+/* -------------------------------------------------------------------------- */
+
+#define GET_EXIT_STATS_SUCCESS bfscast(status_t, SUCCESS)
+#define GET_EXIT_STATS_FAILURE bfscast(status_t, 0x8000000000020000)
+
+/* -------------------------------------------------------------------------- */
+/* Memory Stats Error Codes                                                   */
+/* -------------------------------------------------------------------------- */
+
+#define GET_MEM_STATS_SUCCESS bfscast(status_t, SUCCESS)
+#define GET_MEM_STATS_FAILURE bfscast(status_t, 0x8000000000030000)
+
 /* -------------------------------------------------------------------------- */
 /* ELF Loader Error Codes                                                     */
 /* -------------------------------------------------------------------------- */
@@ -145,6 +159,8 @@ ec_to_str(int64_t value)
         case CRT_FAILURE: return "CRT_FAILURE";
         case REGISTER_EH_FRAME_FAILURE: return "REGISTER_EH_FRAME_FAILURE";
         case GET_DRR_FAILURE: return "GET_DRR_FAILURE";
+        case GET_EXIT_STATS_FAILURE: return "GET_EXIT_STATS_FAILURE";
+        case GET_MEM_STATS_FAILURE: return "GET_MEM_STATS_FAILURE";
         case MEMORY_MANAGER_FAILURE: return "MEMORY_MANAGER_FAILURE";
         case BFELF_ERROR_INVALID_ARG: return "BFELF_ERROR_INVALID_ARG";
         case BFELF_ERROR_INVALID_FILE: return "BFELF_ERROR_INVALID_FILE";
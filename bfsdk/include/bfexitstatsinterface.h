@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 Assured Information Security, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * @file bfexitstatsinterface.h
+ */
+
+#ifndef BFEXITSTATSINTERFACE_H
+#define BFEXITSTATSINTERFACE_H
+
+#include <bftypes.h>
+#include <bfconstants.h>
+#include <bferrorcodes.h>
+
+#pragma pack(push, 1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of Exit Reasons
+ *
+ * The number of basic exit reasons that are tracked. This matches the size
+ * of the exit handler's dispatch table. Exit reasons beyond this value are
+ * not recorded.
+ */
+#define EXIT_STATS_NUM_REASONS 128
+
+/**
+ * Number of Histogram Buckets
+ *
+ * The number of log2 buckets in each histogram. Bucket n counts the VM exits
+ * that took [2^n, 2^(n+1)) TSC cycles to handle (bucket 0 also counts exits
+ * that took 0 cycles), and the last bucket counts everything that took longer
+ * than that.
+ */
+#define EXIT_STATS_NUM_BUCKETS 24
+
+/**
+ * @struct exit_stats_t
+ *
+ * Exit Stats
+ *
+ * Each vCPU owns one of these structures, and updates it every time a VM
+ * exit is handled. Since only the vCPU that owns the structure writes to
+ * it, no locks are used. A reader (i.e. the driver entry) simply copies the
+ * structure out, which means a snapshot might be off by a single exit, which
+ * is fine for profiling purposes.
+ *
+ * @var exit_stats_t::tag
+ *     used to identify the exit stats from a memory dump
+ * @var exit_stats_t::count
+ *     the total number of VM exits handled per basic exit reason
+ * @var exit_stats_t::hist
+ *     the number of TSC cycles spent handling each VM exit per basic exit
+ *     reason, stored as a log2 histogram
+ */
+struct exit_stats_t {
+    uint64_t tag;
+    uint64_t count[EXIT_STATS_NUM_REASONS];
+    uint64_t hist[EXIT_STATS_NUM_REASONS][EXIT_STATS_NUM_BUCKETS];
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma pack(pop)
+
+#endif
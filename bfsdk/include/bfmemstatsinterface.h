@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2019 Assured Information Security, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/**
+ * @file bfmemstatsinterface.h
+ */
+
+#ifndef BFMEMSTATSINTERFACE_H
+#define BFMEMSTATSINTERFACE_H
+
+#include <bftypes.h>
+#include <bfconstants.h>
+#include <bferrorcodes.h>
+
+#pragma pack(push, 1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Memory Pools
+ *
+ * The pools that are managed by the VMM's memory manager. The page pool
+ * backs alloc_page() and single page allocations, the huge pool backs
+ * allocations larger than a page, the mem map pool provides the virtual
+ * address space that memory is mapped into, and the SLAB pool provides
+ * the pages used by the SLAB allocators.
+ */
+#define MEM_STATS_POOL_PAGE 0
+#define MEM_STATS_POOL_HUGE 1
+#define MEM_STATS_POOL_MEM_MAP 2
+#define MEM_STATS_POOL_SLAB 3
+#define MEM_STATS_NUM_POOLS 4
+
+/**
+ * Number of SLABs
+ *
+ * The number of SLAB size classes (0x10 through 0x800 bytes)
+ */
+#define MEM_STATS_NUM_SLABS 9
+
+/**
+ * @struct mem_stats_pool_t
+ *
+ * Memory Pool Stats
+ *
+ * All values are in bytes.
+ *
+ * @var mem_stats_pool_t::total
+ *     the size of the pool
+ * @var mem_stats_pool_t::used
+ *     the number of bytes that are currently allocated
+ * @var mem_stats_pool_t::free
+ *     the number of bytes that are currently free
+ * @var mem_stats_pool_t::high_water
+ *     the largest number of bytes that were ever allocated at once
+ * @var mem_stats_pool_t::largest_free
+ *     the size of the largest allocation that would currently succeed
+ */
+struct mem_stats_pool_t {
+    uint64_t total;
+    uint64_t used;
+    uint64_t free;
+    uint64_t high_water;
+    uint64_t largest_free;
+};
+
+/**
+ * @struct mem_stats_slab_t
+ *
+ * SLAB Stats
+ *
+ * All values (other than size) are in objects.
+ *
+ * @var mem_stats_slab_t::size
+ *     the size of each object in bytes
+ * @var mem_stats_slab_t::used
+ *     the number of objects that are currently allocated
+ * @var mem_stats_slab_t::free
+ *     the number of objects that are free (including the objects that are
+ *     cached by each CPU)
+ * @var mem_stats_slab_t::high_water
+ *     the largest number of objects that the SLAB allocator ever had handed
+ *     out at once (including the objects that are cached by each CPU)
+ */
+struct mem_stats_slab_t {
+    uint64_t size;
+    uint64_t used;
+    uint64_t free;
+    uint64_t high_water;
+};
+
+/**
+ * @struct mem_stats_t
+ *
+ * Memory Stats
+ *
+ * A snapshot of the memory manager's pools. Each pool is read under its
+ * own lock, so the snapshot as a whole is not atomic, which is fine for
+ * sizing the pools.
+ *
+ * @var mem_stats_t::tag
+ *     used to identify the memory stats from a memory dump
+ * @var mem_stats_t::pools
+ *     the stats of each memory pool (see MEM_STATS_POOL_xxx)
+ * @var mem_stats_t::slabs
+ *     the stats of each SLAB size class
+ */
+struct mem_stats_t {
+    uint64_t tag;
+    struct mem_stats_pool_t pools[MEM_STATS_NUM_POOLS];
+    struct mem_stats_slab_t slabs[MEM_STATS_NUM_SLABS];
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#pragma pack(pop)
+
+#endif
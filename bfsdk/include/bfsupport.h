@@ -177,6 +177,8 @@ struct crt_info_t {
 #define BF_REQUEST_ADD_MDL 4
 #define BF_REQUEST_GET_DRR 5
 #define BF_REQUEST_SET_RSDP 6
+#define BF_REQUEST_GET_EXIT_STATS 7
+#define BF_REQUEST_GET_MEM_STATS 8
 #define BF_REQUEST_END 0xFFFF
 
 /* @endcond */
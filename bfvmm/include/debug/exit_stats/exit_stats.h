@@ -0,0 +1,181 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef EXIT_STATS_H
+#define EXIT_STATS_H
+
+#include <memory>
+
+#include <bftypes.h>
+#include <bfvcpuid.h>
+#include <bfexitstatsinterface.h>
+
+// -----------------------------------------------------------------------------
+// Exports
+// -----------------------------------------------------------------------------
+
+#include <bfexports.h>
+
+#ifndef STATIC_DEBUG
+#ifdef SHARED_DEBUG
+#define EXPORT_DEBUG EXPORT_SYM
+#else
+#define EXPORT_DEBUG IMPORT_SYM
+#endif
+#else
+#define EXPORT_DEBUG
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+
+// -----------------------------------------------------------------------------
+// Definitions
+// -----------------------------------------------------------------------------
+
+namespace bfvmm
+{
+
+/// Exit Stats
+///
+/// Records how many VM exits a vCPU has handled, and how long each one took,
+/// per basic exit reason. The stats live in a buffer owned by the vCPU, and
+/// are only ever written by that vCPU, so recording an exit does not need a
+/// lock. Readers never see the buffer itself; get_exit_stats copies it out
+/// while the buffer is registered, so it cannot be freed mid-copy.
+///
+class EXPORT_DEBUG exit_stats
+{
+public:
+
+    /// Default Constructor
+    ///
+    /// If the stats buffer cannot be allocated (or registered with
+    /// get_exit_stats), the error is reported and the stats are left
+    /// disabled, in which case record() and clear() do nothing, and data()
+    /// returns nullptr.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param vcpuid the vcpuid of the exit stats
+    ///
+    exit_stats(vcpuid::type vcpuid) noexcept;
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL ~exit_stats() noexcept;
+
+    /// Record
+    ///
+    /// Increments the count for the provided exit reason, and adds the
+    /// number of TSC cycles that were needed to handle the exit to the
+    /// exit reason's log2 histogram. Exit reasons that are out of range
+    /// are ignored.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param reason the basic exit reason of the VM exit
+    /// @param cycles the number of TSC cycles needed to handle the VM exit
+    ///
+    VIRTUAL void record(uint64_t reason, uint64_t cycles) noexcept;
+
+    /// Clear
+    ///
+    /// Resets all of the counters back to 0
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL void clear() noexcept;
+
+    /// Data
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return a pointer to the exit stats that are being recorded
+    ///
+    exit_stats_t *data() const noexcept
+    { return m_stats.get(); }
+
+    /// Bucket
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param cycles the number of TSC cycles needed to handle a VM exit
+    /// @return the histogram bucket that the provided cycles are recorded in
+    ///
+    static uint64_t bucket(uint64_t cycles) noexcept;
+
+private:
+
+    vcpuid::type m_vcpuid;
+    std::unique_ptr<exit_stats_t> m_stats;
+
+public:
+
+    /// @cond
+
+    exit_stats(exit_stats &&) noexcept = default;
+    exit_stats &operator=(exit_stats &&) noexcept = default;
+
+    exit_stats(const exit_stats &) = delete;
+    exit_stats &operator=(const exit_stats &) = delete;
+
+    /// @endcond
+};
+
+}
+
+/// Get Exit Stats
+///
+/// Copies a snapshot of the exit stats of a given vCPU into the provided
+/// buffer. The copy is made while holding the lock that guards the vCPU's
+/// stats buffer, so the buffer cannot be freed while it is being read.
+/// Since the vCPU records exits without that lock, a counter that is
+/// updated during the copy may be one exit behind.
+///
+/// @expects stats != nullptr
+/// @expects vcpuid == vcpu that exists
+/// @ensures none
+///
+/// @param vcpuid defines which exit stats to return
+/// @param stats the buffer to copy the exit stats into
+/// @return GET_EXIT_STATS_SUCCESS on success, GET_EXIT_STATS_FAILURE
+///     otherwise
+///
+extern "C" EXPORT_DEBUG int64_t get_exit_stats(
+    uint64_t vcpuid, struct exit_stats_t *stats) noexcept;
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif
@@ -0,0 +1,300 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef DIRTY_LOG_INTEL_X64_H
+#define DIRTY_LOG_INTEL_X64_H
+
+#include <vector>
+
+#include <intrinsics.h>
+
+#include "ept/mmap.h"
+#include "../../../memory_manager/memory_manager.h"
+
+// -----------------------------------------------------------------------------
+// Exports
+// -----------------------------------------------------------------------------
+
+#include <bfexports.h>
+
+#ifndef STATIC_HVE
+#ifdef SHARED_HVE
+#define EXPORT_HVE EXPORT_SYM
+#else
+#define EXPORT_HVE IMPORT_SYM
+#endif
+#else
+#define EXPORT_HVE
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+
+// -----------------------------------------------------------------------------
+// Definitions
+// -----------------------------------------------------------------------------
+
+namespace bfvmm::intel_x64
+{
+
+class vcpu;
+
+/// Dirty Page Logging
+///
+/// Provides an interface for tracking the guest physical pages a vCPU
+/// writes to. The pages are recorded in this vCPU's dirty bitmap, which
+/// has one bit per 4k page, starting at guest physical address 0. There
+/// are two modes:
+///
+/// - pml: uses the EPT accessed / dirty flags and Page Modification
+///   Logging (PML). Each time the CPU sets the dirty flag of an EPT entry,
+///   it logs the guest physical address being written to in a 512 entry
+///   buffer. When the buffer is full, the CPU causes a "page modification
+///   log full" VM exit, and the buffer is drained into the dirty bitmap.
+///
+/// - write_protect: for CPUs without PML. The pages being tracked are
+///   write-protected in EPT, and the first write to each page causes an
+///   EPT violation, which marks the page as dirty and makes it writable
+///   again. This handler registers its EPT violation delegate directly
+///   with the exit handler, ahead of ept_violation_handler, so a fault
+///   never walks the EPT violation handler lists and never allocates. EPT
+///   violations that are not caused by dirty logging are passed on to
+///   ept_violation_handler. The write protection lives in the shared EPT
+///   map, so a write by another vCPU using the same map, that has not
+///   enabled dirty logging, is logged to the vCPU that enabled it.
+///
+/// In both modes, a write to a page that is already dirty does not cause a
+/// VM exit, and pages that are mapped using a 2m or 1g page are tracked
+/// once per large page, so the entire large page is marked as dirty.
+///
+class EXPORT_HVE dirty_log_handler
+{
+public:
+
+    /// Dirty Logging Mode
+    ///
+    enum class mode_t {
+        none,                   ///< Dirty logging is disabled
+        pml,                    ///< Page Modification Logging
+        write_protect           ///< EPT write protection
+    };
+
+    /// Constructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param vcpu the vcpu object for this dirty log handler
+    ///
+    dirty_log_handler(
+        gsl::not_null<vcpu *> vcpu);
+
+    /// Destructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    ~dirty_log_handler();
+
+    /// Enable
+    ///
+    /// Starts logging writes to guest physical memory in [0, size), using
+    /// PML if the CPU supports it, and write protection otherwise. Writes
+    /// to guest physical addresses at or above size (e.g. device memory)
+    /// are not recorded.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param map the EPT map this vCPU is using
+    /// @param size the number of bytes of guest physical memory to track
+    ///
+    void enable(ept::mmap &map, uintptr_t size);
+
+    /// Enable
+    ///
+    /// Starts logging writes to guest physical memory in [0, size) using
+    /// the provided mode. In pml mode, the EPT accessed / dirty flags and
+    /// PML are enabled, and the dirty flags of the pages in the range are
+    /// cleared, so every page starts out clean (the PML buffer is allocated
+    /// the first time pml mode is enabled). In write_protect mode, every
+    /// writable page in the range is write-protected. Once the range is
+    /// set up, INVEPT is executed on every vCPU using the map (see
+    /// ept::mmap::shootdown()).
+    ///
+    /// @note The EPT map is shared. In pml mode, each vCPU logs its own
+    ///     writes, so when a map is used by more than one vCPU, dirty
+    ///     logging should be enabled (and disabled) on each of them. In
+    ///     write_protect mode, enabling dirty logging on one of them is
+    ///     enough, as it logs the writes of every vCPU using the map.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param map the EPT map this vCPU is using
+    /// @param size the number of bytes of guest physical memory to track
+    /// @param mode the dirty logging mode to use
+    ///
+    void enable(ept::mmap &map, uintptr_t size, mode_t mode);
+
+    /// Disable
+    ///
+    /// In pml mode, drains the PML buffer, and disables PML and the EPT
+    /// accessed / dirty flags. In write_protect mode, the pages that are
+    /// still write-protected are made writable again. The dirty bitmap is
+    /// kept, so the pages that were written to while logging was enabled
+    /// can still be harvested.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void disable();
+
+    /// Drain
+    ///
+    /// Moves the guest physical addresses in the PML buffer into the dirty
+    /// bitmap and resets the PML index. This is done automatically on a
+    /// "page modification log full" VM exit, and by harvest() and
+    /// disable(). In write_protect mode, this does nothing.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void drain();
+
+    /// Harvest
+    ///
+    /// Drains the PML buffer, ORs the dirty bitmap into the provided
+    /// bitmap and clears the dirty bitmap. The pages that were reported are
+    /// then re-armed (i.e. their EPT dirty flags are cleared in pml mode,
+    /// and they are write-protected again in write_protect mode), followed
+    /// by a single INVEPT on every vCPU using the map (see
+    /// ept::mmap::shootdown()), so that the next write to each of these
+    /// pages is logged again, no matter which vCPU performs it. Since the
+    /// provided bitmap is ORed into, the dirty pages of all of the vCPUs
+    /// that share a map can be collected by harvesting each of them into
+    /// the same bitmap.
+    ///
+    /// @note This does not return until every other vCPU using the map has
+    ///     acknowledged the INVEPT, which happens on its next VM exit.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param bitmap the bitmap to OR the dirty pages into. This bitmap
+    ///     must have at least bitmap_size() entries.
+    /// @return Returns the number of dirty pages that were reported
+    ///
+    std::size_t harvest(gsl::span<uint64_t> bitmap);
+
+    /// Is Enabled
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns true if dirty page logging is enabled, false
+    ///     otherwise
+    ///
+    bool is_enabled() const noexcept
+    { return m_mode != mode_t::none; }
+
+    /// Mode
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns the dirty logging mode that is in use
+    ///
+    mode_t mode() const noexcept
+    { return m_mode; }
+
+    /// Bitmap Size
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns the number of 64bit words in the dirty bitmap (i.e.
+    ///     the size of the bitmap harvest() expects)
+    ///
+    std::size_t bitmap_size() const noexcept
+    { return m_bitmap.size(); }
+
+    /// PML Buffer
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a pointer to the PML buffer, or a nullptr if pml
+    ///     mode has never been enabled
+    ///
+    uint64_t *pml() const noexcept
+    { return m_pml.get(); }
+
+public:
+
+    /// @cond
+
+    bool handle(gsl::not_null<vcpu *> vcpu);
+    bool handle_ept_violation(gsl::not_null<vcpu *> vcpu);
+
+    /// @endcond
+
+private:
+
+    bool handle_shared_ept_violation(gsl::not_null<vcpu *> vcpu);
+
+    void log(uintptr_t gpa, uintptr_t from);
+    uintptr_t rearm(uintptr_t gpa);
+
+private:
+
+    vcpu *m_vcpu;
+    ept::mmap *m_mmap{};
+
+    page_ptr<uint64_t> m_pml;
+    uintptr_t m_pml_phys{};
+
+    uintptr_t m_size{};
+    mode_t m_mode{mode_t::none};
+    std::vector<uint64_t> m_bitmap;
+
+public:
+
+    /// @cond
+
+    dirty_log_handler(dirty_log_handler &&) = default;
+    dirty_log_handler &operator=(dirty_log_handler &&) = default;
+
+    dirty_log_handler(const dirty_log_handler &) = delete;
+    dirty_log_handler &operator=(const dirty_log_handler &) = delete;
+
+    /// @endcond
+};
+
+}
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif
@@ -56,8 +56,8 @@ identity_map_1g(
     expects(bfn::lower(saddr, pdpt::from) == 0);
     expects(bfn::lower(eaddr, pdpt::from) == 0);
 
-    for (auto gpa = saddr; gpa < eaddr; gpa += pdpt::page_size) {
-        map.map_1g(gpa, gpa, attr, cache);
+    if (saddr < eaddr) {
+        map.map_range(saddr, saddr, eaddr - saddr, attr, cache, pdpt::from);
     }
 }
 
@@ -85,8 +85,8 @@ identity_map_2m(
     expects(bfn::lower(saddr, pd::from) == 0);
     expects(bfn::lower(eaddr, pd::from) == 0);
 
-    for (auto gpa = saddr; gpa < eaddr; gpa += pd::page_size) {
-        map.map_2m(gpa, gpa, attr, cache);
+    if (saddr < eaddr) {
+        map.map_range(saddr, saddr, eaddr - saddr, attr, cache, pd::from);
     }
 }
 
@@ -114,8 +114,8 @@ identity_map_4k(
     expects(bfn::lower(saddr, pt::from) == 0);
     expects(bfn::lower(eaddr, pt::from) == 0);
 
-    for (auto gpa = saddr; gpa < eaddr; gpa += pt::page_size) {
-        map.map_4k(gpa, gpa, attr, cache);
+    if (saddr < eaddr) {
+        map.map_range(saddr, saddr, eaddr - saddr, attr, cache, pt::from);
     }
 }
 
@@ -445,9 +445,15 @@ identity_map_convert_4k_to_2m(
 ///
 /// Adds a 1:1 map from the starting address to the ending address.
 /// This version incorporates the MTRRs, ensuring the cache type is set up
-/// properly in EPT. 2m granularity is always used unless the MTRRs define a
-/// range that is not on a 2m boundry in which case 4k is used. Regular RAM
-/// is likely to be mapped using 2m regions.
+/// properly in EPT. Each MTRR range is mapped using map_range(), which
+/// uses the largest pages that fit the range (up to max_from), falling back
+/// to 4k only at the edges of a range that is not on a 2m boundry. Regular
+/// RAM is likely to be mapped using 2m regions (or 1g regions if max_from
+/// is pdpt::from).
+///
+/// 2m is the default, as the rest of the ept helpers (e.g.
+/// identity_map_convert_2m_to_4k()) expect a 2m map. 1g pages are only
+/// used if the CPU supports them, even if max_from asks for them.
 ///
 /// Note that this version should ALWAYS be used when creating an EPT memory
 /// map for the Host OS, as using EPT ignores the MTRRs which can cause
@@ -457,36 +463,38 @@ identity_map_convert_4k_to_2m(
 /// @param saddr the starting address for the map
 /// @param eaddr the ending address for the map
 /// @param attr the memory attributes to apply to the map
+/// @param max_from the largest page size (as a "from") that may be used
 ///
 inline void
 identity_map(
     mmap &map,
     mmap::phys_addr_t saddr,
     mmap::phys_addr_t eaddr,
-    mmap::attr_type attr = mmap::attr_type::read_write_execute)
+    mmap::attr_type attr = mmap::attr_type::read_write_execute,
+    uintptr_t max_from = ::intel_x64::ept::pd::from)
 {
     using namespace ::intel_x64::ept;
+    namespace ept_vpid_cap = ::intel_x64::msrs::ia32_vmx_ept_vpid_cap;
+
     auto range = g_mtrrs->ranges().begin();
 
     expects(g_mtrrs->size() != 0);
     expects(bfn::lower(saddr, pd::from) == 0);
     expects(bfn::lower(eaddr, pd::from) == 0);
 
+    if (max_from > pd::from && !ept_vpid_cap::pdpte_1gb_support::is_enabled()) {
+        max_from = pd::from;
+    }
+
     while (saddr < eaddr) {
-        while (!range->contains(saddr)) {
+        while (!range->contains(saddr) || range->distance(saddr) == 0) {
             range++;
         }
 
-        if (bfn::lower(saddr, pd::from) == 0 &&
-            std::min(range->distance(saddr), eaddr - saddr) >= pd::page_size
-           ) {
-            map.map_2m(saddr, saddr, attr, range->type);
-            saddr += pd::page_size;
-        }
-        else {
-            map.map_4k(saddr, saddr, attr, range->type);
-            saddr += pt::page_size;
-        }
+        const auto len = std::min(range->distance(saddr), eaddr - saddr);
+        map.map_range(saddr, saddr, len, attr, range->type, max_from);
+
+        saddr += len;
     }
 }
 
@@ -505,13 +513,15 @@ identity_map(
 /// @param map the map to apply the identity map too
 /// @param eaddr the ending address for the map
 /// @param attr the memory attributes to apply to the map
+/// @param max_from the largest page size (as a "from") that may be used
 ///
 inline void
 identity_map(
     mmap &map,
     mmap::phys_addr_t eaddr,
-    mmap::attr_type attr = mmap::attr_type::read_write_execute)
-{ identity_map(map, 0, eaddr, attr); }
+    mmap::attr_type attr = mmap::attr_type::read_write_execute,
+    uintptr_t max_from = ::intel_x64::ept::pd::from)
+{ identity_map(map, 0, eaddr, attr, max_from); }
 
 }
 
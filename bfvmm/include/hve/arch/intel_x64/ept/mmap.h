@@ -23,12 +23,18 @@
 #define EPT_MMAP_INTEL_X64_H
 
 #include <mutex>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 
 #include <bfgsl.h>
 #include <bfdebug.h>
+#include <bfdelegate.h>
 #include <bfupperlower.h>
 
 #include <intrinsics.h>
+#include "../invalidation_queue.h"
 #include "../../../../memory_manager/memory_manager.h"
 
 // -----------------------------------------------------------------------------
@@ -153,6 +159,61 @@ public:
         return m_pml4.phys_addr;
     }
 
+    /// Generation
+    ///
+    /// Returns a counter that changes every time this map is (or might
+    /// be) modified, i.e. when a mapping is added, unmapped or released,
+    /// or when an entry is updated using update_entry(). Translation caches tag
+    /// their entries with the generation they were filled at, and treat an
+    /// entry as stale once the generation has changed.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns the current generation of this map
+    ///
+    uint64_t generation() const noexcept
+    { return m_sequence.load(std::memory_order_acquire); }
+
+    /// Attach
+    ///
+    /// Registers the invalidation queue of a vCPU that uses this map (see
+    /// vcpu::set_eptp()). When a change to this map requires INVEPT (see
+    /// shootdown()), INVEPT is also queued on every attached vCPU.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param queue the invalidation queue of the vCPU using this map
+    ///
+    void attach(gsl::not_null<invalidation_queue *> queue)
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (std::find(m_queues.begin(), m_queues.end(), queue.get()) == m_queues.end()) {
+            m_queues.push_back(queue.get());
+        }
+    }
+
+    /// Detach
+    ///
+    /// Unregisters the invalidation queue of a vCPU that no longer uses
+    /// this map (see attach()).
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param queue the invalidation queue to unregister
+    ///
+    void detach(gsl::not_null<invalidation_queue *> queue)
+    {
+        std::lock_guard lock(m_mutex);
+
+        m_queues.erase(
+            std::remove(m_queues.begin(), m_queues.end(), queue.get()), m_queues.end()
+        );
+    }
+
     /// Map 1g Virt Address to Phys Address
     ///
     /// @expects
@@ -172,7 +233,7 @@ public:
         attr_type attr = attr_type::read_write_execute,
         memory_type cache = memory_type::write_back)
     {
-        std::lock_guard lock(m_mutex);
+        write_lock lock(this);
         using namespace ::intel_x64::ept;
 
         expects(bfn::lower(virt_addr, pdpt::from) == 0);
@@ -223,7 +284,7 @@ public:
         attr_type attr = attr_type::read_write_execute,
         memory_type cache = memory_type::write_back)
     {
-        std::lock_guard lock(m_mutex);
+        write_lock lock(this);
         using namespace ::intel_x64::ept;
 
         expects(bfn::lower(virt_addr, pd::from) == 0);
@@ -276,7 +337,7 @@ public:
         attr_type attr = attr_type::read_write_execute,
         memory_type cache = memory_type::write_back)
     {
-        std::lock_guard lock(m_mutex);
+        write_lock lock(this);
         using namespace ::intel_x64::ept;
 
         expects(bfn::lower(virt_addr, pt::from) == 0);
@@ -311,48 +372,443 @@ public:
         return map_4k(reinterpret_cast<void *>(virt_addr), phys_addr, attr, cache);
     }
 
-    /// Unmap Virtual Address
+    /// Map Range
+    ///
+    /// Maps [virt_addr, virt_addr + len) to [phys_addr, phys_addr + len)
+    /// using the largest pages possible. A 1g or 2m page is used whenever
+    /// both addresses are aligned to it, and enough of the range remains
+    /// to fill it. Otherwise a smaller page is used. The lock is taken
+    /// once for the whole range, and as the range is mapped in order, the
+    /// page tables are only walked again when the walk moves to a new
+    /// table.
+    ///
+    /// @note All of the pages in the range are given the same memory type,
+    ///     so a range must not span more than one MTRR range. See
+    ///     ept::identity_map() for a version that handles the MTRRs.
+    ///
+    /// @expects virt_addr, phys_addr and len are 4k aligned
+    /// @ensures
+    ///
+    /// @param virt_addr the virtual address to map from
+    /// @param phys_addr the physical address to map to
+    /// @param len the number of bytes to map
+    /// @param attr the map permissions
+    /// @param cache the memory type for the mapping
+    /// @param max_from the largest page size (as a "from") that may be used.
+    ///     Set this to pd::from if the CPU does not support 1g EPT pages.
+    ///
+    void
+    map_range(
+        virt_addr_t virt_addr,
+        phys_addr_t phys_addr,
+        size_type len,
+        attr_type attr = attr_type::read_write_execute,
+        memory_type cache = memory_type::write_back,
+        uintptr_t max_from = ::intel_x64::ept::pdpt::from)
+    {
+        write_lock lock(this);
+        using namespace ::intel_x64::ept;
+
+        expects(bfn::lower(virt_addr, pt::from) == 0);
+        expects(bfn::lower(phys_addr, pt::from) == 0);
+        expects(bfn::lower(len, pt::from) == 0);
+
+        const auto end = virt_addr + len;
+
+        while (virt_addr < end) {
+            const auto remaining = end - virt_addr;
+            const auto addr = reinterpret_cast<void *>(virt_addr);
+
+            this->map_pdpt(pml4::index(virt_addr));
+
+            if (max_from >= pdpt::from && remaining >= pdpt::page_size &&
+                bfn::lower(virt_addr, pdpt::from) == 0 && bfn::lower(phys_addr, pdpt::from) == 0) {
+                this->map_pdpte(addr, phys_addr, attr, cache);
+
+                virt_addr += pdpt::page_size;
+                phys_addr += pdpt::page_size;
+                continue;
+            }
+
+            this->map_pd(pdpt::index(virt_addr));
+
+            if (max_from >= pd::from && remaining >= pd::page_size &&
+                bfn::lower(virt_addr, pd::from) == 0 && bfn::lower(phys_addr, pd::from) == 0) {
+                this->map_pde(addr, phys_addr, attr, cache);
+
+                virt_addr += pd::page_size;
+                phys_addr += pd::page_size;
+                continue;
+            }
+
+            this->map_pt(pd::index(virt_addr));
+            this->map_pte(addr, phys_addr, attr, cache);
+
+            virt_addr += pt::page_size;
+            phys_addr += pt::page_size;
+        }
+    }
+
+    /// Split
+    ///
+    /// Replaces the 1g or 2m page that maps the provided virtual address
+    /// with a fully populated table of 2m or 4k pages (respectively) that
+    /// map the same physical memory with the same attributes and memory
+    /// type. The new table is filled in before it is linked into the map,
+    /// and the large page is replaced using a single write, so the guest
+    /// never sees the range unmapped. Once the page is split, INVEPT is
+    /// executed on every CPU using this map (see shootdown()).
+    ///
+    /// To trap a single 4k page that is mapped using a 1g page, split the
+    /// address twice, and then modify the page using update_entry().
     ///
     /// @expects
     /// @ensures
     ///
-    /// @param virt_addr the virtual address to unmap
-    /// @return the from for the address that was unmapped
+    /// @param virt_addr the virtual address whose large page should be split
+    /// @return Returns the page size (as a "from") that maps the virtual
+    ///     address after the split. If the address was already mapped with
+    ///     a 4k page, nothing is done and pt::from is returned.
     ///
     uintptr_t
-    unmap(void *virt_addr)
+    split(virt_addr_t virt_addr)
     {
-        std::lock_guard lock(m_mutex);
+        write_lock lock(this);
         using namespace ::intel_x64::ept;
 
-        this->map_pdpt(pml4::index(virt_addr));
-        auto &pdpte = m_pdpt.virt_addr.at(pdpt::index(virt_addr));
+        auto ret = this->walk(virt_addr);
+        if (ret.entry == nullptr || *ret.entry == 0) {
+            throw std::runtime_error(std::string("split: ") + entry_name(ret.from) + " not mapped");
+        }
+
+        auto &entry = *ret.entry;
+
+        switch (ret.from) {
+            case pdpt::from: {
+                auto table = this->allocate(pd::num_entries);
+                const auto phys_addr = pdpt::entry::phys_addr::get(entry);
+
+                for (index_type pdi = 0; pdi < pd::num_entries; pdi++) {
+                    auto pde = entry;
+                    pd::entry::phys_addr::set(pde, phys_addr + (gsl::narrow_cast<uintptr_t>(pdi) * pd::page_size));
+                    table.virt_addr.at(pdi) = pde;
+                }
+
+                entry = table_entry(table.phys_addr);
+                break;
+            }
 
-        if (pdpte == 0) {
-            return ::intel_x64::ept::pdpt::from;
+            case pd::from: {
+                auto table = this->allocate(pt::num_entries);
+                const auto phys_addr = pd::entry::phys_addr::get(entry);
+
+                for (index_type pti = 0; pti < pt::num_entries; pti++) {
+                    auto pte = entry;
+                    pt::entry::ps::disable(pte);
+                    pt::entry::phys_addr::set(pte, phys_addr + (gsl::narrow_cast<uintptr_t>(pti) * pt::page_size));
+                    table.virt_addr.at(pti) = pte;
+                }
+
+                entry = table_entry(table.phys_addr);
+                break;
+            }
+
+            default:
+                return pt::from;
         }
 
-        if (pdpt::entry::ps::is_enabled(pdpte)) {
-            pdpte = 0;
-            return ::intel_x64::ept::pdpt::from;
+        this->queue_invept();
+        return ret.from == pdpt::from ? pd::from : pt::from;
+    }
+
+    /// Coalesce
+    ///
+    /// The opposite of split(). If all of the entries in the table that
+    /// maps the provided virtual address are pages that map contiguous,
+    /// suitably aligned physical memory with identical attributes and
+    /// memory type, the table is replaced with a single 2m page (for a
+    /// table of 4k pages) or 1g page (for a table of 2m pages, if the CPU
+    /// supports 1g EPT pages). Once the pages are coalesced, INVEPT is
+    /// executed on every CPU using this map (see shootdown()), and only
+    /// then is the table released, as until then, another CPU might still
+    /// be caching it.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param virt_addr the virtual address whose table should be coalesced
+    /// @return Returns true if the table was coalesced, false otherwise
+    ///
+    bool
+    coalesce(virt_addr_t virt_addr)
+    {
+        write_lock lock(this);
+        using namespace ::intel_x64::ept;
+        namespace ept_vpid_cap = ::intel_x64::msrs::ia32_vmx_ept_vpid_cap;
+
+        auto ret = this->walk(virt_addr);
+        if (ret.entry == nullptr || *ret.entry == 0) {
+            throw std::runtime_error(std::string("coalesce: ") + entry_name(ret.from) + " not mapped");
         }
 
-        this->map_pd(pdpt::index(virt_addr));
-        auto &pde = m_pd.virt_addr.at(pd::index(virt_addr));
+        uintptr_t page_size{};
+        uintptr_t large_page_from{};
 
-        if (pde == 0) {
-            return ::intel_x64::ept::pd::from;
+        switch (ret.from) {
+            case pd::from:
+                if (ept_vpid_cap::pdpte_1gb_support::is_disabled()) {
+                    return false;
+                }
+
+                page_size = pd::page_size;
+                large_page_from = pdpt::from;
+                break;
+
+            case pt::from:
+                page_size = pt::page_size;
+                large_page_from = pd::from;
+                break;
+
+            default:
+                return false;
         }
 
-        if (pd::entry::ps::is_enabled(pde)) {
-            pde = 0;
-            return ::intel_x64::ept::pd::from;
+        auto &parent = *ret.parent;
+        auto table = phys_to_pair(pd::entry::phys_addr::get(parent), pt::num_entries).virt_addr;
+
+        auto first = table.at(0);
+        const auto phys_addr = pt::entry::phys_addr::get(first);
+
+        if (first == 0 || bfn::lower(phys_addr, large_page_from) != 0) {
+            return false;
         }
 
-        this->map_pt(pd::index(virt_addr));
-        m_pt.virt_addr.at(pt::index(virt_addr)) = 0;
+        if (large_page_from == pdpt::from && pd::entry::ps::is_disabled(first)) {
+            return false;
+        }
+
+        for (index_type i = 0; i < pt::num_entries; i++) {
+            auto entry = table.at(i);
+            const auto expected = phys_addr + (gsl::narrow_cast<uintptr_t>(i) * page_size);
+
+            if (entry == 0 ||
+                pt::entry::phys_addr::get(entry) != expected ||
+                (entry & ~pt::entry::phys_addr::mask) != (first & ~pt::entry::phys_addr::mask)) {
+                return false;
+            }
+        }
+
+        auto large_page = first;
+        pd::entry::ps::enable(large_page);
+
+        parent = large_page;
+        this->retire_table(table);
+
+        this->queue_invept();
+        return true;
+    }
+
+    /// INVEPT
+    ///
+    /// Invalidates the guest-physical and combined mappings that were
+    /// derived from this map, using a single-context INVEPT if supported,
+    /// and an all-context INVEPT otherwise. If eptp() has never been
+    /// called, the map has never been used by a vCPU, and nothing is done.
+    ///
+    /// @note INVEPT only affects the CPU that executes it. If this map is
+    ///     shared by vCPUs that run on other CPUs, use shootdown() instead.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void invept() const
+    {
+        namespace ept_pointer = ::intel_x64::vmcs::ept_pointer;
+        namespace ept_vpid_cap = ::intel_x64::msrs::ia32_vmx_ept_vpid_cap;
+
+        if (m_pml4.phys_addr == 0) {
+            return;
+        }
+
+        if (ept_vpid_cap::invept_single_context_support::is_enabled()) {
+            ::intel_x64::vmcs::value_type eptp = m_pml4.phys_addr;
+
+            ept_pointer::memory_type::set(eptp, ept_pointer::memory_type::write_back);
+            ept_pointer::page_walk_length_minus_one::set(eptp, 3U);
+
+            ::intel_x64::vmx::invept_single_context(eptp);
+        }
+        else {
+            ::intel_x64::vmx::invept_global();
+        }
+    }
+
+    /// Shootdown
+    ///
+    /// Executes INVEPT (see invept()), queues a single-context INVEPT on
+    /// every vCPU attached to this map (see attach()), and waits until each
+    /// of them has acknowledged it (see invalidation_queue::acknowledged()).
+    /// Once this returns, no CPU can use a translation that was derived
+    /// from this map before the call.
+    ///
+    /// @note A vCPU that is executing guest code acknowledges the INVEPT on
+    ///     its next VM exit. vcpu::set_eptp() arms the VMX-preemption timer
+    ///     of an attached vCPU (see EPT_SHOOTDOWN_TIMER), so this wait is
+    ///     bounded even if the guest never exits on its own.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void shootdown()
+    {
+        std::lock_guard lock(m_mutex);
+
+        this->queue_invept();
+        this->synchronize();
+    }
+
+    /// Update Flags
+    ///
+    /// Clears the bits in clear_mask and then sets the bits in set_mask of
+    /// the page that maps the provided virtual address, but only if at
+    /// least one of the bits in if_mask is set in the entry (an if_mask of
+    /// 0 always updates the entry). The CPU sets the accessed / dirty flags
+    /// of an entry using a locked operation, so the entry is updated using
+    /// a locked compare-exchange, which ensures a flag set by the CPU while
+    /// the entry is being updated is never lost. The physical address of
+    /// the mapping must not be changed using this function, which is why
+    /// lookups are not disturbed. INVEPT is not executed, which allows a
+    /// caller to update any number of pages before executing invept() once.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param virt_addr the virtual address whose entry should be updated
+    /// @param set_mask the bits to set
+    /// @param clear_mask the bits to clear
+    /// @param if_mask the bits, one of which must be set for the entry to
+    ///     be updated
+    /// @return Returns the value of the entry before it was updated (or
+    ///     the value that failed if_mask), and the size (as a "from") of
+    ///     the memory the entry covers. If the virtual address is not
+    ///     mapped, the entry is 0, and "from" is the size of the unmapped
+    ///     region that was found, which allows a caller that is walking a
+    ///     range to skip it.
+    ///
+    std::pair<entry_type, uintptr_t>
+    update_flags(
+        virt_addr_t virt_addr, entry_type set_mask, entry_type clear_mask, entry_type if_mask = 0)
+    {
+        std::lock_guard lock(m_mutex);
+        return this->update_flags_locked(virt_addr, set_mask, clear_mask, if_mask);
+    }
+
+    /// Dirty Log Delegate
+    ///
+    /// The delegate log_write() reports a write to. It is given the
+    /// virtual address that was written to, and the size (as a "from") of
+    /// the page that maps it.
+    ///
+    using dirty_log_delegate_t = delegate<void(uintptr_t, uintptr_t)>;
+
+    /// Set Dirty Log
+    ///
+    /// Registers the delegate that log_write() reports writes to (see
+    /// dirty_log_handler). The delegate is only ever called with the lock
+    /// held, so once an empty delegate is set, the previous delegate is
+    /// certain not to be running, and will never be called again.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param d the delegate to register, or an empty delegate
+    ///
+    void set_dirty_log(const dirty_log_delegate_t &d)
+    {
+        std::lock_guard lock(m_mutex);
+        m_dirty_log = d;
+    }
+
+    /// Log Write
+    ///
+    /// Updates the flags of the page that maps the provided virtual
+    /// address (see update_flags()), and if the entry was updated, reports
+    /// the write to the delegate registered using set_dirty_log(), while
+    /// still holding the lock. This is how a vCPU resolves a write to a
+    /// page that was write-protected for dirty logging by another vCPU
+    /// that shares this map, and records it in that vCPU's dirty log.
+    ///
+    /// Most of the writes this is called for are to pages that were never
+    /// write-protected for dirty logging, so the entry is first checked
+    /// without taking the lock (like lookup()), and the lock is only taken
+    /// if one of the bits in if_mask is set.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param virt_addr the virtual address that was written to
+    /// @param set_mask the bits to set
+    /// @param clear_mask the bits to clear
+    /// @param if_mask the bits, one of which must be set for the entry to
+    ///     be updated (and the write to be reported)
+    /// @return Returns the same as update_flags()
+    ///
+    std::pair<entry_type, uintptr_t>
+    log_write(
+        virt_addr_t virt_addr, entry_type set_mask, entry_type clear_mask, entry_type if_mask)
+    {
+        if (if_mask != 0) {
+            if (const auto ret = this->read_entry(virt_addr); (ret.first & if_mask) == 0) {
+                return ret;
+            }
+        }
+
+        std::lock_guard lock(m_mutex);
+        const auto ret = this->update_flags_locked(virt_addr, set_mask, clear_mask, if_mask);
+
+        if ((ret.first & if_mask) != 0 && m_dirty_log) {
+            m_dirty_log(virt_addr, ret.second);
+        }
+
+        return ret;
+    }
+
+    /// Clear Dirty
+    ///
+    /// Clears the dirty flag of the page that maps the provided virtual
+    /// address (see update_flags()).
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param virt_addr the virtual address whose dirty flag should be
+    ///     cleared
+    /// @return Returns the size (as a "from") of the memory the entry that
+    ///     was cleared covers, or of the unmapped region that was found
+    ///
+    uintptr_t
+    clear_dirty(virt_addr_t virt_addr)
+    { return this->update_flags(virt_addr, 0, ::intel_x64::ept::pt::entry::dirty::mask).second; }
+
+    /// Unmap Virtual Address
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param virt_addr the virtual address to unmap
+    /// @return the from for the address that was unmapped
+    ///
+    uintptr_t
+    unmap(void *virt_addr)
+    {
+        write_lock lock(this);
 
-        return ::intel_x64::ept::pt::from;
+        auto ret = this->walk(reinterpret_cast<virt_addr_t>(virt_addr));
+        if (ret.entry != nullptr) {
+            *ret.entry = 0;
+        }
+
+        return ret.from;
     }
 
     /// Unmap Virtual Address
@@ -386,12 +842,29 @@ public:
     void
     release(void *virt_addr)
     {
-        std::lock_guard lock(m_mutex);
+        write_lock lock(this);
         using namespace ::intel_x64::ept;
 
+        if (m_pml4.virt_addr.at(pml4::index(virt_addr)) == 0) {
+            return;
+        }
+
+        const auto num_retired = m_retired.size();
+
         if (this->release_pdpte(virt_addr)) {
             m_pml4.virt_addr.at(pml4::index(virt_addr)) = 0;
         }
+
+        // Note:
+        //
+        // Other CPUs might still have the retired tables cached, so they
+        // have to be flushed before the lock is released and the tables
+        // are reclaimed.
+        //
+
+        if (m_retired.size() != num_retired) {
+            this->queue_invept();
+        }
     }
 
     /// Release Virtual Address
@@ -410,63 +883,78 @@ public:
     inline void release(virt_addr_t virt_addr)
     { release(reinterpret_cast<void *>(virt_addr)); }
 
-    /// Virtual Address to Entry
+    /// Update Entry
+    ///
+    /// Calls the provided function with a copy of the entry that maps the
+    /// provided virtual address, and stores the modified copy back into
+    /// the map while holding the lock, which increments the generation
+    /// (see generation()) once the entry has been written. Like
+    /// update_flags(), the entry is stored using a locked compare-exchange,
+    /// and if the CPU set the accessed / dirty flags of the entry in the
+    /// meantime, the function is called again with the new value, so the
+    /// function should not have any side effects. Unlike update_flags(),
+    /// the function may change the physical address of the mapping. INVEPT
+    /// is not executed.
     ///
     /// @expects
     /// @ensures
     ///
-    /// @param virt_addr the virtual address to be converted
-    /// @return returns entry for the map
+    /// @param virt_addr the virtual address whose entry should be updated
+    /// @param fn the function that modifies the entry, with the signature
+    ///     void(entry_type &)
+    /// @return Returns the value the entry was updated to, and the size (as
+    ///     a "from") of the memory the entry covers
     ///
-    std::pair<std::reference_wrapper<entry_type>, uintptr_t>
-    entry(void *virt_addr)
+    template<typename F>
+    std::pair<entry_type, uintptr_t>
+    update_entry(virt_addr_t virt_addr, F fn)
     {
-        std::lock_guard lock(m_mutex);
-        using namespace ::intel_x64::ept;
-
-        this->map_pdpt(pml4::index(virt_addr));
-        auto &pdpte = m_pdpt.virt_addr.at(pdpt::index(virt_addr));
+        write_lock lock(this);
 
-        if (pdpte == 0) {
-            throw std::runtime_error("entry: pdpte not mapped");
+        auto ret = this->walk(virt_addr);
+        if (ret.entry == nullptr || *ret.entry == 0) {
+            throw std::runtime_error(std::string("update_entry: ") + entry_name(ret.from) + " not mapped");
         }
 
-        if (pdpt::entry::ps::is_enabled(pdpte)) {
-            return {pdpte, pdpt::from};
-        }
+        auto entry = *ret.entry;
+        while (true) {
+            auto val = entry;
+            fn(val);
 
-        this->map_pd(pdpt::index(virt_addr));
-        auto &pde = m_pd.virt_addr.at(pd::index(virt_addr));
+            const auto prev =
+                __sync_val_compare_and_swap(ret.entry, entry, val);
 
-        if (pde == 0) {
-            throw std::runtime_error("entry: pde not mapped");
-        }
-
-        if (pd::entry::ps::is_enabled(pde)) {
-            return {pde, pd::from};
-        }
-
-        this->map_pt(pd::index(virt_addr));
-        auto &pte = m_pt.virt_addr.at(pt::index(virt_addr));
+            if (prev == entry) {
+                return {val, ret.from};
+            }
 
-        if (pte == 0) {
-            throw std::runtime_error("entry: pte not mapped");
+            entry = prev;
         }
-
-        return {pte, pt::from};
     }
 
-    /// Virtual Address to Entry
+    /// Get Entry
+    ///
+    /// Returns a copy of the entry that maps the provided virtual address.
+    /// Like lookup(), this never takes the lock. Use update_entry() to
+    /// modify the entry.
     ///
     /// @expects
     /// @ensures
     ///
-    /// @param virt_addr the virtual address to be converted
-    /// @return returns entry for the map
+    /// @param virt_addr the virtual address whose entry should be returned
+    /// @return Returns the entry, and the size (as a "from") of the memory
+    ///     the entry covers
     ///
-    inline std::pair<std::reference_wrapper<entry_type>, uintptr_t>
-    entry(virt_addr_t virt_addr)
-    { return entry(reinterpret_cast<void *>(virt_addr)); }
+    std::pair<entry_type, uintptr_t>
+    get_entry(virt_addr_t virt_addr) const
+    {
+        auto ret = this->read_entry(virt_addr);
+        if (ret.first == 0) {
+            throw std::runtime_error(std::string("get_entry: ") + entry_name(ret.second) + " not mapped");
+        }
+
+        return ret;
+    }
 
     /// Virtual Address to Physical Address
     ///
@@ -476,7 +964,7 @@ public:
     /// @param virt_addr the virtual address to be converted
     /// @return Returns the phys_addr for the map
     ///
-    inline std::pair<uintptr_t, uintptr_t> virt_to_phys(void *virt_addr)
+    inline std::pair<uintptr_t, uintptr_t> virt_to_phys(void *virt_addr) const
     { return virt_to_phys(reinterpret_cast<uintptr_t>(virt_addr)); }
 
     /// Virtual Address to Physical Address
@@ -488,52 +976,55 @@ public:
     /// @return Returns the phys_addr for the map
     ///
     std::pair<uintptr_t, uintptr_t>
-    virt_to_phys(virt_addr_t virt_addr)
+    virt_to_phys(virt_addr_t virt_addr) const
     {
-        std::lock_guard lock(m_mutex);
-        using namespace ::intel_x64::ept;
-
-        this->map_pdpt(pml4::index(virt_addr));
-        auto pdpte = m_pdpt.virt_addr.at(pdpt::index(virt_addr));
-
-        if (pdpte == 0) {
-            throw std::runtime_error("virt_to_phys: pdpte not mapped");
-        }
-
-        if (pdpt::entry::ps::is_enabled(pdpte)) {
-            return {
-                pdpt::entry::phys_addr::get(pdpte) | bfn::lower(virt_addr, pdpt::from),
-                pdpt::from
-            };
-        }
-
-        this->map_pd(pdpt::index(virt_addr));
-        auto pde = m_pd.virt_addr.at(pd::index(virt_addr));
-
-        if (pde == 0) {
-            throw std::runtime_error("virt_to_phys: pde not mapped");
-        }
-
-        if (pd::entry::ps::is_enabled(pde)) {
-            return {
-                pd::entry::phys_addr::get(pde) | bfn::lower(virt_addr, pd::from),
-                pd::from
-            };
+        auto [entry, from] = this->read_entry(virt_addr);
+        if (entry == 0) {
+            throw std::runtime_error(std::string("virt_to_phys: ") + entry_name(from) + " not mapped");
         }
 
-        this->map_pt(pd::index(virt_addr));
-        auto pte = m_pt.virt_addr.at(pt::index(virt_addr));
+        return {entry_to_phys(entry, from, virt_addr), from};
+    }
 
-        if (pte == 0) {
-            throw std::runtime_error("virt_to_phys: pte not mapped");
+    /// Lookup
+    ///
+    /// Converts a virtual address to a physical address without taking
+    /// the lock and without allocating any page tables. Unlike
+    /// virt_to_phys(), this function does not throw if the virtual address
+    /// is not mapped. Instead, "from" is set to 0.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param virt_addr the virtual address to be converted
+    /// @return Returns the phys_addr and from for the map, or {0, 0} if the
+    ///     virtual address is not mapped
+    ///
+    std::pair<uintptr_t, uintptr_t>
+    lookup(virt_addr_t virt_addr) const
+    {
+        auto [entry, from] = this->read_entry(virt_addr);
+        if (entry == 0) {
+            return {0, 0};
         }
 
-        return {
-            pt::entry::phys_addr::get(pte) | bfn::lower(virt_addr, pt::from),
-            pt::from
-        };
+        return {entry_to_phys(entry, from, virt_addr), from};
     }
 
+    /// Is Mapped
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param virt_addr the virtual address to test
+    /// @return returns true if the virtual address is mapped, false
+    ///     otherwise. Like lookup(), this never takes the lock and never
+    ///     allocates page tables.
+    ///
+    bool
+    is_mapped(virt_addr_t virt_addr) const
+    { return this->read_entry(virt_addr).first != 0; }
+
     /// Virtual Address to From
     ///
     /// @expects
@@ -543,41 +1034,14 @@ public:
     /// @return returns page size of the mapping (i.e. from)
     ///
     uintptr_t
-    from(void *virt_addr)
+    from(void *virt_addr) const
     {
-        std::lock_guard lock(m_mutex);
-        using namespace ::intel_x64::ept;
-
-        this->map_pdpt(pml4::index(virt_addr));
-        auto pdpte = m_pdpt.virt_addr.at(pdpt::index(virt_addr));
-
-        if (pdpte == 0) {
-            throw std::runtime_error("from: pdpte not mapped");
+        auto [entry, from] = this->read_entry(reinterpret_cast<virt_addr_t>(virt_addr));
+        if (entry == 0) {
+            throw std::runtime_error(std::string("from: ") + entry_name(from) + " not mapped");
         }
 
-        if (pdpt::entry::ps::is_enabled(pdpte)) {
-            return pdpt::from;
-        }
-
-        this->map_pd(pdpt::index(virt_addr));
-        auto pde = m_pd.virt_addr.at(pd::index(virt_addr));
-
-        if (pde == 0) {
-            throw std::runtime_error("from: pde not mapped");
-        }
-
-        if (pd::entry::ps::is_enabled(pde)) {
-            return pd::from;
-        }
-
-        this->map_pt(pd::index(virt_addr));
-        auto pte = m_pt.virt_addr.at(pt::index(virt_addr));
-
-        if (pte == 0) {
-            throw std::runtime_error("from: pte not mapped");
-        }
-
-        return pt::from;
+        return from;
     }
 
     /// Virtual Address to From
@@ -588,7 +1052,7 @@ public:
     /// @param virt_addr the virtual address to test
     /// @return returns page size of the mapping (i.e. from)
     ///
-    inline uintptr_t from(virt_addr_t virt_addr)
+    inline uintptr_t from(virt_addr_t virt_addr) const
     { return from(reinterpret_cast<void *>(virt_addr)); }
 
     /// Is 1g
@@ -600,7 +1064,7 @@ public:
     /// @return returns true if the virtual address was mapped as 1g page,
     ///     false otherwise
     ///
-    inline auto is_1g(void *virt_addr)
+    inline auto is_1g(void *virt_addr) const
     { return from(virt_addr) == ::intel_x64::ept::pdpt::from; }
 
     /// Is 1g
@@ -612,7 +1076,7 @@ public:
     /// @return returns true if the virtual address was mapped as 1g page,
     ///     false otherwise
     ///
-    inline auto is_1g(virt_addr_t virt_addr)
+    inline auto is_1g(virt_addr_t virt_addr) const
     { return is_1g(reinterpret_cast<void *>(virt_addr)); }
 
     /// Is 2m
@@ -624,7 +1088,7 @@ public:
     /// @return returns true if the virtual address was mapped as 2m page,
     ///     false otherwise
     ///
-    inline auto is_2m(void *virt_addr)
+    inline auto is_2m(void *virt_addr) const
     { return from(virt_addr) == ::intel_x64::ept::pd::from; }
 
     /// Is 2m
@@ -636,7 +1100,7 @@ public:
     /// @return returns true if the virtual address was mapped as 2m page,
     ///     false otherwise
     ///
-    inline auto is_2m(virt_addr_t virt_addr)
+    inline auto is_2m(virt_addr_t virt_addr) const
     { return is_2m(reinterpret_cast<void *>(virt_addr)); }
 
     /// Is 4k
@@ -648,7 +1112,7 @@ public:
     /// @return returns true if the virtual address was mapped as 4k page,
     ///     false otherwise
     ///
-    inline auto is_4k(void *virt_addr)
+    inline auto is_4k(void *virt_addr) const
     { return from(virt_addr) == ::intel_x64::ept::pt::from; }
 
     /// Is 4k
@@ -660,11 +1124,287 @@ public:
     /// @return returns true if the virtual address was mapped as 4k page,
     ///     false otherwise
     ///
-    inline auto is_4k(virt_addr_t virt_addr)
+    inline auto is_4k(virt_addr_t virt_addr) const
     { return is_4k(reinterpret_cast<void *>(virt_addr)); }
 
 private:
 
+    // Note:
+    //
+    // Changes to the tables are serialized using m_mutex and are bracketed
+    // by m_sequence, which is odd while a change is in progress (i.e. a
+    // seqlock). Lookups never take the lock. Instead, read_entry() walks
+    // the tables and retries if the sequence changed while it was walking.
+    //
+    // A table that is removed from the map cannot be freed right away, as a
+    // racing walk, or the paging-structure cache of another CPU, might
+    // still be using it. Instead, it is retired, and once the change is
+    // complete (but before the lock is released), synchronize() waits for
+    // every INVEPT queued by the change to be acknowledged, and then
+    // reclaim() waits for a grace period before freeing it. Every walk is
+    // bracketed by a read_guard, which counts the walk against the current
+    // epoch (one of two counters). reclaim() starts a new epoch and waits
+    // for the count of the previous epoch to drain. A walk that starts
+    // after the new epoch can only see the tables that are still linked
+    // into the map, so once the count has drained, nothing can be walking
+    // the retired tables (i.e. RCU with two counters).
+    //
+
+    struct write_lock {
+        explicit write_lock(mmap *self) :
+            m_self{self},
+            m_lock{self->m_mutex}
+        { m_self->m_sequence.fetch_add(1, std::memory_order_acq_rel); }
+
+        ~write_lock()
+        {
+            m_self->m_sequence.fetch_add(1, std::memory_order_release);
+            m_self->synchronize();
+        }
+
+        mmap *m_self;
+        std::lock_guard<std::mutex> m_lock;
+
+        write_lock(write_lock &&) = delete;
+        write_lock &operator=(write_lock &&) = delete;
+        write_lock(const write_lock &) = delete;
+        write_lock &operator=(const write_lock &) = delete;
+    };
+
+    struct read_guard {
+        explicit read_guard(const mmap *self) noexcept :
+            m_self{self}
+        {
+            while (true) {
+                m_epoch = m_self->m_epoch.load();
+                m_self->m_readers.at(m_epoch & 1U).fetch_add(1);
+
+                if (m_self->m_epoch.load() == m_epoch) {
+                    return;
+                }
+
+                m_self->m_readers.at(m_epoch & 1U).fetch_sub(1);
+            }
+        }
+
+        ~read_guard()
+        { m_self->m_readers.at(m_epoch & 1U).fetch_sub(1, std::memory_order_release); }
+
+        const mmap *m_self;
+        uint64_t m_epoch{};
+
+        read_guard(read_guard &&) = delete;
+        read_guard &operator=(read_guard &&) = delete;
+        read_guard(const read_guard &) = delete;
+        read_guard &operator=(const read_guard &) = delete;
+    };
+
+    struct walk_result {
+        entry_type *entry;
+        uintptr_t from;
+        entry_type *parent;
+    };
+
+    // Note:
+    //
+    // Returns the last entry the walk visited, which is either a leaf
+    // (i.e. a 1g, 2m or 4k mapping) or an entry that is 0, along with the
+    // size of the memory that entry maps and the entry that points to the
+    // table the entry is in. If the PML4 entry is 0, there is no PDPT to
+    // return an entry from, and the entry is a nullptr. This never
+    // allocates a page table.
+    //
+
+    walk_result
+    walk(virt_addr_t virt_addr) const
+    {
+        using namespace ::intel_x64::ept;
+
+        auto &pml4e = m_pml4.virt_addr.at(pml4::index(virt_addr));
+        if (pml4e == 0) {
+            return {nullptr, pdpt::from, nullptr};
+        }
+
+        auto pdpt_span = phys_to_pair(pml4::entry::phys_addr::get(pml4e), pdpt::num_entries).virt_addr;
+        auto &pdpte = pdpt_span.at(pdpt::index(virt_addr));
+
+        if (pdpte == 0 || pdpt::entry::ps::is_enabled(pdpte)) {
+            return {&pdpte, pdpt::from, &pml4e};
+        }
+
+        auto pd_span = phys_to_pair(pdpt::entry::phys_addr::get(pdpte), pd::num_entries).virt_addr;
+        auto &pde = pd_span.at(pd::index(virt_addr));
+
+        if (pde == 0 || pd::entry::ps::is_enabled(pde)) {
+            return {&pde, pd::from, &pdpte};
+        }
+
+        auto pt_span = phys_to_pair(pd::entry::phys_addr::get(pde), pt::num_entries).virt_addr;
+        return {&pt_span.at(pt::index(virt_addr)), pt::from, &pde};
+    }
+
+    std::pair<entry_type, uintptr_t>
+    read_entry(virt_addr_t virt_addr) const
+    {
+        while (true) {
+            const auto sequence = m_sequence.load(std::memory_order_acquire);
+            if ((sequence & 1U) != 0) {
+                ::intel_x64::pause();
+                continue;
+            }
+
+            read_guard guard(this);
+
+            try {
+                auto ret = this->walk(virt_addr);
+                auto entry = ret.entry != nullptr ? *ret.entry : 0;
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_sequence.load(std::memory_order_relaxed) == sequence) {
+                    return {entry, ret.from};
+                }
+            }
+            catch (...) {
+                if (m_sequence.load(std::memory_order_acquire) == sequence) {
+                    throw;
+                }
+            }
+        }
+    }
+
+    static entry_type
+    table_entry(phys_addr_t phys_addr) noexcept
+    {
+        using namespace ::intel_x64::ept;
+
+        entry_type entry{};
+
+        pml4::entry::phys_addr::set(entry, phys_addr);
+        pml4::entry::read_access::enable(entry);
+        pml4::entry::write_access::enable(entry);
+        pml4::entry::execute_access::enable(entry);
+
+        return entry;
+    }
+
+    void
+    retire_table(gsl::span<virt_addr_t> table)
+    {
+        const auto phys_addr = g_mm->virtptr_to_physint(table.data());
+
+        if (m_pdpt.phys_addr == phys_addr) {
+            m_pdpt = {};
+        }
+
+        if (m_pd.phys_addr == phys_addr) {
+            m_pd = {};
+        }
+
+        if (m_pt.phys_addr == phys_addr) {
+            m_pt = {};
+        }
+
+        m_retired.push_back(table.data());
+    }
+
+    std::pair<entry_type, uintptr_t>
+    update_flags_locked(
+        virt_addr_t virt_addr, entry_type set_mask, entry_type clear_mask, entry_type if_mask)
+    {
+        auto ret = this->walk(virt_addr);
+        if (ret.entry == nullptr) {
+            return {0, ret.from};
+        }
+
+        auto entry = *ret.entry;
+        while (entry != 0 && (if_mask == 0 || (entry & if_mask) != 0)) {
+            const auto prev =
+                __sync_val_compare_and_swap(ret.entry, entry, (entry & ~clear_mask) | set_mask);
+
+            if (prev == entry) {
+                break;
+            }
+
+            entry = prev;
+        }
+
+        return {entry, ret.from};
+    }
+
+    void
+    queue_invept()
+    {
+        this->invept();
+
+        for (auto queue : m_queues) {
+            m_tickets.emplace_back(queue, queue->invept_single_context());
+        }
+    }
+
+    void
+    synchronize() noexcept
+    {
+        for (const auto &[queue, ticket] : m_tickets) {
+            while (!queue->acknowledged(ticket)) {
+                ::intel_x64::pause();
+            }
+        }
+
+        m_tickets.clear();
+        this->reclaim();
+    }
+
+    void
+    reclaim() noexcept
+    {
+        if (m_retired.empty()) {
+            return;
+        }
+
+        const auto epoch = m_epoch.fetch_add(1);
+        while (m_readers.at(epoch & 1U).load() != 0) {
+            ::intel_x64::pause();
+        }
+
+        for (auto table : m_retired) {
+            free_page(table);
+        }
+
+        m_retired.clear();
+    }
+
+    static uintptr_t
+    entry_to_phys(entry_type entry, uintptr_t from, virt_addr_t virt_addr) noexcept
+    {
+        using namespace ::intel_x64::ept;
+
+        switch (from) {
+            case pdpt::from:
+                return pdpt::entry::phys_addr::get(entry) | bfn::lower(virt_addr, pdpt::from);
+
+            case pd::from:
+                return pd::entry::phys_addr::get(entry) | bfn::lower(virt_addr, pd::from);
+
+            default:
+                return pt::entry::phys_addr::get(entry) | bfn::lower(virt_addr, pt::from);
+        }
+    }
+
+    static const char *
+    entry_name(uintptr_t from) noexcept
+    {
+        switch (from) {
+            case ::intel_x64::ept::pdpt::from:
+                return "pdpte";
+
+            case ::intel_x64::ept::pd::from:
+                return "pde";
+
+            default:
+                return "pte";
+        }
+    }
+
     gsl::span<virt_addr_t>
     allocate_span(size_type num_entries)
     {
@@ -701,7 +1441,7 @@ private:
 private:
 
     pair
-    phys_to_pair(phys_addr_t phys_addr, size_type num_entries)
+    phys_to_pair(phys_addr_t phys_addr, size_type num_entries) const
     {
         auto virt_addr =
             static_cast<virt_addr_t *>(
@@ -1126,7 +1866,7 @@ private:
         this->map_pdpt(pml4::index(virt_addr));
         auto &entry = m_pdpt.virt_addr.at(pdpt::index(virt_addr));
 
-        if (pdpt::entry::ps::is_disabled(entry)) {
+        if (entry != 0 && pdpt::entry::ps::is_disabled(entry)) {
             if (!this->release_pde(virt_addr)) {
                 return false;
             }
@@ -1142,7 +1882,7 @@ private:
         }
 
         if (empty) {
-            this->free(m_pdpt.virt_addr);
+            this->retire_table(m_pdpt.virt_addr);
             return true;
         }
 
@@ -1157,7 +1897,7 @@ private:
         this->map_pd(pdpt::index(virt_addr));
         auto &entry = m_pd.virt_addr.at(pd::index(virt_addr));
 
-        if (pd::entry::ps::is_disabled(entry)) {
+        if (entry != 0 && pd::entry::ps::is_disabled(entry)) {
             if (!this->release_pte(virt_addr)) {
                 return false;
             }
@@ -1173,7 +1913,7 @@ private:
         }
 
         if (empty) {
-            this->free(m_pd.virt_addr);
+            this->retire_table(m_pd.virt_addr);
             return true;
         }
 
@@ -1196,7 +1936,7 @@ private:
         }
 
         if (empty) {
-            this->free(m_pt.virt_addr);
+            this->retire_table(m_pt.virt_addr);
             return true;
         }
 
@@ -1211,6 +1951,16 @@ private:
     pair m_pt;
 
     mutable std::mutex m_mutex;
+    std::atomic<uint64_t> m_sequence{2};
+
+    std::atomic<uint64_t> m_epoch{};
+    mutable std::array<std::atomic<uint64_t>, 2> m_readers{};
+    std::vector<virt_addr_t *> m_retired;
+
+    std::vector<invalidation_queue *> m_queues;
+    std::vector<std::pair<invalidation_queue *, uint64_t>> m_tickets;
+
+    dirty_log_delegate_t m_dirty_log{};
 
 public:
 
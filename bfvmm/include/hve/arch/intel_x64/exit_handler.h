@@ -23,6 +23,7 @@
 #define EXIT_HANDLER_INTEL_X64_H
 
 #include <bfdelegate.h>
+#include <bfconstants.h>
 
 #include <list>
 #include <array>
@@ -31,6 +32,7 @@
 #include <intrinsics.h>
 
 #include "vmcs.h"
+#include "../../../debug/exit_stats/exit_stats.h"
 #include "../x64/gdt.h"
 #include "../x64/idt.h"
 #include "../x64/tss.h"
@@ -80,6 +82,9 @@ void emulate_wrmsr(::x64::msrs::field_type msr, ::x64::msrs::value_type val);
 uintptr_t emulate_rdgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu);
 void emulate_wrgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, uintptr_t val);
 
+uintptr_t emulate_rdgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, uint64_t reg);
+void emulate_wrgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, uint64_t reg, uintptr_t val);
+
 // -----------------------------------------------------------------------------
 // Exit Handler
 // -----------------------------------------------------------------------------
@@ -133,6 +138,10 @@ public:
     ///     for this VM exit will execute, or an unimplemented exit reason
     ///     error will trigger
     ///
+    /// @note At most MAX_HANDLERS_PER_EXIT_REASON delegates can be registered
+    ///     per exit reason, and delegates cannot be registered once the
+    ///     exit handler has been sealed (see seal()).
+    ///
     /// @expects none
     /// @ensures none
     ///
@@ -152,6 +161,10 @@ public:
     ///
     /// Note the return value of the delegate is ignored
     ///
+    /// @note At most MAX_HANDLERS_PER_EXIT_REASON exit delegates can be
+    ///     registered, and delegates cannot be registered once the exit
+    ///     handler has been sealed (see seal()).
+    ///
     /// @expects none
     /// @ensures none
     ///
@@ -161,6 +174,29 @@ public:
         const handler_delegate_t &d
     );
 
+    /// Seal
+    ///
+    /// Freezes the dispatch table. Once sealed, attempts to add a handler
+    /// or an exit delegate will throw. The vCPU seals its exit handler
+    /// right before it is launched for the first time, which means all
+    /// handlers must be registered during the construction of the vCPU.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL void seal() noexcept;
+
+    /// Is Sealed
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return Returns true if the dispatch table has been sealed, false
+    ///     otherwise
+    ///
+    bool is_sealed() const noexcept
+    { return m_sealed; }
+
     /// Add Init Delegate
     ///
     /// Adds an init function to the init list. Init functions are executed
@@ -237,6 +273,39 @@ public:
     auto host_gdt() noexcept
     { return &m_host_gdt; }
 
+    /// Get Exit Stats
+    ///
+    /// Returns the VM exit counters and latency histograms that are
+    /// recorded by handle() for this exit handler's vCPU.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return Returns a pointer to the exit stats
+    ///
+    auto exit_stats() noexcept
+    { return &m_exit_stats; }
+
+#ifndef ENABLE_BUILD_TEST
+private:
+#endif
+
+    /// Dispatch
+    ///
+    /// Executes the handlers registered with add_exit_handler(), followed by
+    /// the handlers registered for the provided exit reason (newest first),
+    /// until one of them handles the VM exit. This is the part of handle()
+    /// that does not resume the guest.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param reason the basic exit reason of the VM exit
+    /// @return Returns true if a handler handled the VM exit, false
+    ///     otherwise
+    ///
+    bool dispatch(::intel_x64::vmcs::value_type reason);
+
 private:
 
     void write_host_state();
@@ -257,16 +326,40 @@ private:
 
     bool handle_cpuid(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu);
 
+private:
+
+    /// @cond
+
+    // Note:
+    //
+    // Each entry stores its delegates inline and in the order they were
+    // registered. Dispatch walks an entry from the back to the front so that
+    // the most recently registered delegate is executed first.
+    //
+
+    struct handler_table_entry_t {
+        std::size_t size{};
+        std::array<handler_delegate_t, MAX_HANDLERS_PER_EXIT_REASON> delegates{};
+    };
+
+    void add_to_entry(handler_table_entry_t &entry, const handler_delegate_t &d);
+
+    /// @endcond
+
 private:
 
     vcpu *m_vcpu;
     std::unique_ptr<gsl::byte[]> m_ist1;
     std::unique_ptr<gsl::byte[]> m_stack;
 
-    std::list<init_handler_delegate_t> m_exit_handlers;
+    bool m_sealed{false};
+    bfvmm::exit_stats m_exit_stats;
+
+    handler_table_entry_t m_exit_handlers{};
+    std::array<handler_table_entry_t, 128> m_exit_handlers_array{};
+
     std::list<init_handler_delegate_t> m_init_handlers;
     std::list<fini_handler_delegate_t> m_fini_handlers;
-    std::array<std::list<handler_delegate_t>, 128> m_exit_handlers_array;
 
 public:
 
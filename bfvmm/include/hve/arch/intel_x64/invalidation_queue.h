@@ -0,0 +1,255 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef INVALIDATION_QUEUE_INTEL_X64_H
+#define INVALIDATION_QUEUE_INTEL_X64_H
+
+#include <array>
+#include <atomic>
+
+#include <bfgsl.h>
+#include <bfconstants.h>
+
+// -----------------------------------------------------------------------------
+// Exports
+// -----------------------------------------------------------------------------
+
+#include <bfexports.h>
+
+#ifndef STATIC_HVE
+#ifdef SHARED_HVE
+#define EXPORT_HVE EXPORT_SYM
+#else
+#define EXPORT_HVE IMPORT_SYM
+#endif
+#else
+#define EXPORT_HVE
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+
+// -----------------------------------------------------------------------------
+// Definitions
+// -----------------------------------------------------------------------------
+
+namespace bfvmm::intel_x64
+{
+
+/// Invalidation Queue
+///
+/// Accumulates the TLB invalidations (INVEPT / INVVPID) a vCPU needs, and
+/// executes them once, right before the vCPU's next VM entry, using the
+/// narrowest invalidation that covers all of them:
+///
+/// - Any number of INVEPT requests result in a single INVEPT, which is a
+///   single-context INVEPT of the vCPU's EPTP if supported.
+/// - When EPT is enabled, an INVEPT also invalidates all of the combined
+///   mappings of the vCPU's guest, so any INVVPID requests are dropped.
+/// - When VPID is disabled, every VM entry invalidates the mappings of the
+///   guest, so INVVPID requests are dropped.
+/// - Up to INVALIDATION_QUEUE_SIZE individual-address INVVPID requests
+///   are executed as is. Any more than that (or a single-context request)
+///   result in a single single-context INVVPID.
+///
+/// The number of invalidations requested and the number that were actually
+/// executed are counted, so the number of invalidations that were saved
+/// can be determined.
+///
+/// The requests that can be made from any CPU return a ticket. Another CPU
+/// can use the ticket to wait for the invalidation to take effect (see
+/// acknowledged()). This is how an EPT change is shot down on every CPU
+/// that is executing a vCPU using the same EPT map.
+///
+class EXPORT_HVE invalidation_queue
+{
+public:
+
+    /// Constructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    invalidation_queue() = default;
+
+    /// Destructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    ~invalidation_queue() = default;
+
+    /// INVEPT (Single Context)
+    ///
+    /// Queues an invalidation of the guest-physical and combined mappings
+    /// derived from the vCPU's EPTP. This can be called from any CPU.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a ticket that can be passed to acknowledged()
+    ///
+    uint64_t invept_single_context() noexcept;
+
+    /// INVEPT (Global)
+    ///
+    /// Queues an invalidation of the guest-physical and combined mappings
+    /// derived from all EPTPs. This can be called from any CPU.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a ticket that can be passed to acknowledged()
+    ///
+    uint64_t invept_global() noexcept;
+
+    /// INVVPID (Individual Address)
+    ///
+    /// Queues an invalidation of the linear and combined mappings of the
+    /// provided guest virtual address. Unlike the other requests, this must
+    /// only be called by the CPU that is executing the vCPU.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param gva the guest virtual address to invalidate
+    ///
+    void invvpid_individual_address(uintptr_t gva) noexcept;
+
+    /// INVVPID (Single Context)
+    ///
+    /// Queues an invalidation of all of the linear and combined mappings of
+    /// the vCPU's VPID. This can be called from any CPU.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a ticket that can be passed to acknowledged()
+    ///
+    uint64_t invvpid_single_context() noexcept;
+
+    /// Flush
+    ///
+    /// Executes the queued invalidations and empties the queue. The vCPU's
+    /// VMCS must be loaded. This is called by the vCPU right before it is
+    /// launched or resumed, and from this point on, the vCPU is considered
+    /// to be executing guest code until exited() is called.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void flush();
+
+    /// Exited
+    ///
+    /// Records that the vCPU is no longer executing guest code. This is
+    /// called at the start of every VM exit, before anything else might
+    /// wait for another CPU.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void exited() noexcept
+    { m_in_guest.store(false); }
+
+    /// Acknowledged
+    ///
+    /// Returns true once the invalidation that returned the provided ticket
+    /// can no longer be missed by the vCPU, i.e. once the vCPU has executed
+    /// it, or if the vCPU is not executing guest code (in which case it
+    /// will execute it before its next VM entry). This can be called from
+    /// any CPU.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param ticket the ticket returned when the invalidation was queued
+    /// @return Returns true if the invalidation has taken effect, false
+    ///     otherwise
+    ///
+    bool acknowledged(uint64_t ticket) const noexcept
+    { return !m_in_guest.load() || m_completed.load(std::memory_order_acquire) >= ticket; }
+
+    /// Empty
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns true if no invalidations are queued, false otherwise
+    ///
+    bool empty() const noexcept
+    { return m_pending.load(std::memory_order_relaxed) == 0 && m_num_addresses == 0; }
+
+    /// Requested
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns the number of invalidations that have been queued
+    ///
+    uint64_t requested() const noexcept
+    { return m_requested.load(std::memory_order_relaxed); }
+
+    /// Issued
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns the number of INVEPT / INVVPID instructions that
+    ///     have been executed by flush()
+    ///
+    uint64_t issued() const noexcept
+    { return m_issued; }
+
+private:
+
+    std::atomic<uint32_t> m_pending{};
+    std::atomic<uint64_t> m_tickets{};
+    std::atomic<uint64_t> m_completed{};
+    std::atomic<bool> m_in_guest{};
+    std::size_t m_num_addresses{};
+    std::array<uintptr_t, INVALIDATION_QUEUE_SIZE> m_addresses{};
+
+    std::atomic<uint64_t> m_requested{};
+    uint64_t m_issued{};
+
+public:
+
+    /// @cond
+
+    invalidation_queue(invalidation_queue &&) = delete;
+    invalidation_queue &operator=(invalidation_queue &&) = delete;
+
+    invalidation_queue(const invalidation_queue &) = delete;
+    invalidation_queue &operator=(const invalidation_queue &) = delete;
+
+    /// @endcond
+};
+
+}
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif
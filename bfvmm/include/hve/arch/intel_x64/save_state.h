@@ -30,6 +30,24 @@ namespace intel_x64
 {
 
 /// @cond
+
+// Note:
+//
+// The guest's FPU/SIMD state is switched lazily. On a VM exit, the state is
+// left in the registers and the host's CR0.TS bit is set. If the VMM uses
+// the FPU/SIMD registers, a #NM is raised and the state is saved to
+// xsave_area (using XSAVE if fpu_flags has SAVE_STATE_FPU_XSAVE set and the
+// guest's XCR0 enables SSE, otherwise FXSAVE). fpu_saved records which
+// instruction was used so that the state can be restored before the next
+// VM entry. The ymm slots are only used to seed xmm0-7 on the first launch.
+//
+
+constexpr const uint64_t SAVE_STATE_FPU_XSAVE = 0x1;
+
+constexpr const uint64_t SAVE_STATE_FPU_LIVE = 0x0;
+constexpr const uint64_t SAVE_STATE_FPU_SAVED_XSAVE = 0x1;
+constexpr const uint64_t SAVE_STATE_FPU_SAVED_FXSAVE = 0x2;
+
 #pragma pack(push, 1)
 
 struct save_state_t {
@@ -51,8 +69,8 @@ struct save_state_t {
     uint64_t rip;                   // 0x078
     uint64_t rsp;                   // 0x080
 
-    uint64_t reserved1;             // 0x088
-    uint64_t reserved2;             // 0x090
+    uint64_t fpu_flags;             // 0x088
+    uint64_t fpu_saved;             // 0x090
     uint64_t vcpu_ptr;              // 0x098
     uint64_t exit_handler_ptr;      // 0x0A0
 
@@ -77,10 +95,15 @@ struct save_state_t {
     uint64_t ymm14[4];              // 0x280
     uint64_t ymm15[4];              // 0x2A0
 
-    uint64_t remaining_space_in_page[0x1A8];
+    uint64_t remaining_space_in_page[0x28];
+
+    uint8_t xsave_area[0xC00];      // 0x400
 };
 
 #pragma pack(pop)
+
+static_assert(sizeof(save_state_t) == 0x1000, "save state is not a page in size");
+
 /// @endcond
 
 }
@@ -37,15 +37,19 @@
 #include "vmexit/wrmsr.h"
 #include "vmexit/xsetbv.h"
 
+#include "dirty_log.h"
 #include "ept.h"
 #include "exit_handler.h"
 #include "interrupt_queue.h"
+#include "invalidation_queue.h"
 #include "microcode.h"
 #include "vcpu_global_state.h"
 #include "vmcs.h"
+#include "vmcs_shadow.h"
 #include "vmx.h"
 #include "vpid.h"
 
+#include "../x64/map_cache.h"
 #include "../x64/unmapper.h"
 
 #include "../../../vcpu/vcpu.h"
@@ -106,7 +110,7 @@ public:
     /// @expects none
     /// @ensures none
     ///
-    ~vcpu() override = default;
+    ~vcpu() override;
 
     /// Run Delegate
     ///
@@ -156,6 +160,30 @@ public:
     ///
     VIRTUAL void promote();
 
+    /// Enable VMCS Write Back
+    ///
+    /// Buffers the VMCS writes made through this vCPU's register accessors
+    /// (e.g. set_cr4()) and executes them right before the vCPU is resumed.
+    /// Repeated writes to the same field during a VM exit result in a
+    /// single VMWRITE. Once enabled, VMCS fields written through this vCPU
+    /// must also be read through this vCPU (and not using the VMCS
+    /// intrinsics), otherwise a pending write will not be seen.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL void enable_vmcs_write_back() noexcept;
+
+    /// Disable VMCS Write Back
+    ///
+    /// Flushes any pending VMCS writes and executes all future VMCS writes
+    /// immediately. This is the default.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL void disable_vmcs_write_back();
+
     //==========================================================================
     // Handlers
     //==========================================================================
@@ -232,7 +260,10 @@ public:
 
     /// Set EPTP
     ///
-    /// Enables EPT and sets the EPTP to point to the provided mmap.
+    /// Enables EPT and sets the EPTP to point to the provided mmap. The
+    /// vCPU's invalidation queue is attached to the map (see
+    /// ept::mmap::attach()), so changes to the map made by other vCPUs
+    /// are also invalidated on this vCPU.
     ///
     /// @expects
     /// @ensures
@@ -248,6 +279,16 @@ public:
     ///
     VIRTUAL void disable_ept();
 
+    /// EPT Map
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a pointer to the map set using set_eptp(), or a
+    ///     nullptr if EPT is disabled
+    ///
+    VIRTUAL ept::mmap *ept_map() const;
+
     //==========================================================================
     // VPID
     //==========================================================================
@@ -266,6 +307,215 @@ public:
     ///
     VIRTUAL void disable_vpid();
 
+    //==========================================================================
+    // Invalidations
+    //==========================================================================
+
+    /// Invalidations
+    ///
+    /// Returns this vCPU's invalidation queue. The INVEPT / INVVPID
+    /// invalidations this vCPU needs should be queued here instead of being
+    /// executed directly, so that they are combined and executed once,
+    /// right before the vCPU's next VM entry (see invalidation_queue).
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a pointer to this vCPU's invalidation queue
+    ///
+    auto invalidations() noexcept
+    { return &m_invalidation_queue; }
+
+    //==========================================================================
+    // Map Cache
+    //==========================================================================
+
+    /// Map Cache
+    ///
+    /// Returns the cache of host virtual address windows that is used by
+    /// map_hpa_4k() and map_gpa_4k(). If the host physical pages that were
+    /// mapped by this vCPU can no longer be accessed, the cache must be
+    /// cleared (see map_cache::clear()).
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a pointer to this vCPU's map cache
+    ///
+    auto map_cache() noexcept
+    { return &m_map_cache; }
+
+    //==========================================================================
+    // VMCS Shadowing
+    //==========================================================================
+
+    /// Enable VMCS Shadowing
+    ///
+    /// Points the VMCS link pointer to this vCPU's shadow VMCS and enables
+    /// VMCS shadowing, allowing the guest to execute VMREAD / VMWRITE
+    /// without trapping for all fields that are passed through. All fields
+    /// are trapped by default. The shadow VMCS is allocated the first time
+    /// VMCS shadowing is used.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    VIRTUAL void enable_vmcs_shadowing();
+
+    /// Disable VMCS Shadowing
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    VIRTUAL void disable_vmcs_shadowing();
+
+    /// Trap On VMREAD
+    ///
+    /// Sets a '1' in the VMREAD bitmap corresponding with the provided
+    /// field. All attempts made by the guest to VMREAD the provided field
+    /// will be trapped by the hypervisor.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to trap
+    ///
+    VIRTUAL void trap_on_vmread(vmcs_n::field_type field);
+
+    /// Pass Through VMREAD
+    ///
+    /// Sets a '0' in the VMREAD bitmap corresponding with the provided
+    /// field. All attempts made by the guest to VMREAD the provided field
+    /// will be serviced from the shadow VMCS.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to pass through
+    ///
+    VIRTUAL void pass_through_vmread(vmcs_n::field_type field);
+
+    /// Trap On VMWRITE
+    ///
+    /// Sets a '1' in the VMWRITE bitmap corresponding with the provided
+    /// field. All attempts made by the guest to VMWRITE the provided field
+    /// will be trapped by the hypervisor.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to trap
+    ///
+    VIRTUAL void trap_on_vmwrite(vmcs_n::field_type field);
+
+    /// Pass Through VMWRITE
+    ///
+    /// Sets a '0' in the VMWRITE bitmap corresponding with the provided
+    /// field. All attempts made by the guest to VMWRITE the provided field
+    /// will be serviced by the shadow VMCS.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to pass through
+    ///
+    VIRTUAL void pass_through_vmwrite(vmcs_n::field_type field);
+
+    /// Add VMREAD Handler
+    ///
+    /// Traps VMREAD of the provided field, and calls the provided handler
+    /// when the guest executes a VMREAD of it while VMCS shadowing is
+    /// enabled.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to listen to
+    /// @param d the delegate to call when a vmread exit occurs
+    ///
+    VIRTUAL void add_vmread_handler(
+        vmcs_n::field_type field, const vmcs_shadow_handler::handler_delegate_t &d);
+
+    /// Add VMWRITE Handler
+    ///
+    /// Traps VMWRITE of the provided field, and calls the provided handler
+    /// when the guest executes a VMWRITE of it while VMCS shadowing is
+    /// enabled.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to listen to
+    /// @param d the delegate to call when a vmwrite exit occurs
+    ///
+    VIRTUAL void add_vmwrite_handler(
+        vmcs_n::field_type field, const vmcs_shadow_handler::handler_delegate_t &d);
+
+    /// Shadow VMCS
+    ///
+    /// Returns this vCPU's shadow VMCS, which is used to synchronize the
+    /// shadow VMCS with a nested hypervisor's VMCS when it executes
+    /// VMPTRLD, VMLAUNCH or VMRESUME. The shadow VMCS is allocated on the
+    /// first call.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a pointer to this vCPU's shadow VMCS
+    ///
+    vmcs_shadow_handler *shadow_vmcs();
+
+    //==========================================================================
+    // Dirty Page Logging
+    //==========================================================================
+
+    /// Enable Dirty Logging
+    ///
+    /// Starts logging the guest physical pages in [0, size) that this vCPU
+    /// writes to, using PML, or EPT write protection on CPUs without PML
+    /// (see dirty_log_handler). EPT must be enabled
+    /// (see set_eptp()) before dirty logging can be enabled. Dirty logging
+    /// is disabled automatically if EPT is disabled or a different map is
+    /// set.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param size the number of bytes of guest physical memory to track
+    ///
+    VIRTUAL void enable_dirty_logging(uintptr_t size);
+
+    /// Disable Dirty Logging
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    VIRTUAL void disable_dirty_logging();
+
+    /// Harvest Dirty Log
+    ///
+    /// ORs the pages this vCPU has written to since the last harvest into
+    /// the provided bitmap (one bit per 4k page) and starts tracking them
+    /// again (see dirty_log_handler::harvest()).
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param bitmap the bitmap to OR the dirty pages into
+    /// @return Returns the number of dirty pages that were reported
+    ///
+    VIRTUAL std::size_t harvest_dirty_log(gsl::span<uint64_t> bitmap);
+
+    /// Dirty Log
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a pointer to this vCPU's dirty log handler
+    ///
+    auto dirty_log() noexcept
+    { return &m_dirty_log_handler; }
+
     //==========================================================================
     // Helpers
     //==========================================================================
@@ -594,6 +844,24 @@ public:
         const io_instruction_handler::handler_delegate_t &in_d,
         const io_instruction_handler::handler_delegate_t &out_d);
 
+    /// Add Pass Through IO Instruction Handler
+    ///
+    /// Adds a handler that only observes the guest's accesses to the given
+    /// port (see io_instruction_handler::add_pass_through_handler()).
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param port the port to call
+    /// @param in_d the delegate to call when the reads in from the given port
+    /// @param out_d the delegate to call when the guest writes out to the
+    ///        given port.
+    ///
+    VIRTUAL void add_pass_through_io_instruction_handler(
+        vmcs_n::value_type port,
+        const io_instruction_handler::handler_delegate_t &in_d,
+        const io_instruction_handler::handler_delegate_t &out_d);
+
     /// Add IO Instruction Default Handler
     ///
     /// @expects
@@ -813,6 +1081,11 @@ public:
 
     /// Set VMX preemption timer
     ///
+    /// Once this is called, the vCPU stops using the preemption timer to
+    /// force VM exits while it is attached to an EPT map (see
+    /// EPT_SHOOTDOWN_TIMER), and the caller is responsible for making sure
+    /// the vCPU still exits periodically.
+    ///
     /// @expects
     /// @ensures
     ///
@@ -839,6 +1112,8 @@ public:
 
     /// Disable VMX preemption timer exiting
     ///
+    /// See set_preemption_timer() for how this affects EPT shootdowns.
+    ///
     /// @expects
     /// @ensures
     ///
@@ -876,6 +1151,10 @@ public:
     /// the GPA (as the HPA == the GPA), and "from" will be set to 0 as
     /// this information is not available.
     ///
+    /// Translations are cached in a small, per-vCPU TLB that is tagged with
+    /// the EPT map's generation, so any change made to the map (on any
+    /// vCPU) causes the next lookup to walk the EPT page tables again.
+    ///
     /// @expects
     /// @ensures
     ///
@@ -900,11 +1179,32 @@ public:
     VIRTUAL std::pair<uintptr_t, uintptr_t> gpa_to_hpa(void *gpa)
     { return gpa_to_hpa(reinterpret_cast<uintptr_t>(gpa)); }
 
+    /// Flush GPA TLB
+    ///
+    /// Drops all of the translations cached by gpa_to_hpa(). This is done
+    /// automatically when the EPT map changes, and is only needed if the
+    /// EPT page tables are modified without going through ept::mmap.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void flush_gpa_tlb() noexcept;
+
     /// Convert GVA to GPA
     ///
     /// Converts a guest virtual address to a guest physical address
     /// using EPT.
     ///
+    /// Translations are cached in a small, per-vCPU TLB that is tagged with
+    /// the guest's CR3 (including its PCID) and the EPT map's generation.
+    /// The vCPU flushes the cache on INVLPG, INVPCID and MOV to CR exits
+    /// before any other handler sees them. Since the guest can also
+    /// invalidate its own translations without a VM exit, the cache is only
+    /// kept from one VM exit to the next if CR3-load and INVLPG exiting are
+    /// both enabled, and CR0.PG, CR4.PGE and CR4.PCIDE are all owned by the
+    /// VMM (i.e. set in the guest/host masks). Otherwise it is flushed on
+    /// every VM entry.
+    ///
     /// Note:
     ///
     /// The vCPU must be loaded before this operation can take place
@@ -937,6 +1237,28 @@ public:
     VIRTUAL std::pair<uintptr_t, uintptr_t> gva_to_gpa(void *gva)
     { return gva_to_gpa(reinterpret_cast<uintptr_t>(gva)); }
 
+    /// Flush GVA TLB
+    ///
+    /// Drops all of the translations cached by gva_to_gpa().
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void flush_gva_tlb() noexcept;
+
+    /// Flush GVA TLB (Individual Address)
+    ///
+    /// Drops the translations cached by gva_to_gpa() for the page that
+    /// contains the provided guest virtual address (i.e. what INVLPG does),
+    /// no matter which CR3 / PCID they were cached for.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param gva the guest virtual address to invalidate
+    ///
+    void flush_gva_tlb(uint64_t gva) noexcept;
+
     /// Convert GVA to HPA
     ///
     /// Converts a guest virtual address to a host physical address
@@ -974,6 +1296,49 @@ public:
     VIRTUAL std::pair<uintptr_t, uintptr_t> gva_to_hpa(void *gva)
     { return gva_to_hpa(reinterpret_cast<uintptr_t>(gva)); }
 
+    /// Read Guest Memory
+    ///
+    /// Copies len bytes from the guest, starting at the provided guest
+    /// virtual address, into dst. Unlike map_gva_4k(), no window is
+    /// allocated to hold the whole range. Instead, the range is translated
+    /// into runs of contiguous host physical memory (each guest page walk
+    /// covers the rest of the guest's page, and of the EPT page that
+    /// backs it), and each run is copied through the VMM's direct map if
+    /// possible, and this vCPU's map cache otherwise.
+    ///
+    /// @note If part of the range is not mapped by the guest, an exception
+    ///     is thrown, and dst might have been partially written.
+    ///
+    /// @note The vCPU must be loaded before this operation can take place
+    ///     as this function will use VMCS functions.
+    ///
+    /// @expects dst != nullptr
+    /// @ensures
+    ///
+    /// @param gva the guest virtual address to read from
+    /// @param dst the buffer to copy the guest's memory into
+    /// @param len the number of bytes to read
+    ///
+    VIRTUAL void read_guest(uint64_t gva, void *dst, std::size_t len);
+
+    /// Write Guest Memory
+    ///
+    /// Copies len bytes from src into the guest, starting at the provided
+    /// guest virtual address. See read_guest() for more information.
+    ///
+    /// @note If part of the range is not mapped by the guest, an exception
+    ///     is thrown, and the guest's memory might have been partially
+    ///     written.
+    ///
+    /// @expects src != nullptr
+    /// @ensures
+    ///
+    /// @param gva the guest virtual address to write to
+    /// @param src the buffer to copy into the guest's memory
+    /// @param len the number of bytes to write
+    ///
+    VIRTUAL void write_guest(uint64_t gva, const void *src, std::size_t len);
+
     /// Map 1g GPA to HPA (Read-Only)
     ///
     /// Maps a 1g guest physical address to a 1g host physical address
@@ -1112,6 +1477,10 @@ public:
         expects(bfn::lower(hpa, from) == 0);
         expects(bfn::upper(hpa, from) != 0);
 
+        if (auto hva = x64::cr3::vmm_direct_map_hva(hpa, page_size)) {
+            return x64::unique_map<T>(static_cast<T *>(hva), x64::unmapper());
+        }
+
         auto hva = g_mm->alloc_map(page_size);
         g_cr3->map_1g(hva, hpa);
 
@@ -1159,6 +1528,10 @@ public:
         expects(bfn::lower(hpa, from) == 0);
         expects(bfn::upper(hpa, from) != 0);
 
+        if (auto hva = x64::cr3::vmm_direct_map_hva(hpa, page_size)) {
+            return x64::unique_map<T>(static_cast<T *>(hva), x64::unmapper());
+        }
+
         auto hva = g_mm->alloc_map(page_size);
         g_cr3->map_2m(hva, hpa);
 
@@ -1191,6 +1564,16 @@ public:
     /// function is a unique_map that will unmap when scope is lost, and
     /// provides the ability to access the HPA using the provided HVA.
     ///
+    /// The map is served by this vCPU's map cache (see map_cache()), so
+    /// mapping a host physical address that was recently mapped does not
+    /// modify the VMM's page tables or flush the TLB. As a result, the
+    /// unique_map must not outlive this vCPU. Maps from a CPU other than
+    /// the one executing this vCPU bypass the cache. Cached windows stay
+    /// mapped write-back after the unique_map loses scope, so this
+    /// function must not be used for MMIO. If the hpa is in the VMM's
+    /// direct map (see DIRECT_MAP_SIZE), its address in the direct map is
+    /// returned instead, and nothing is mapped at all.
+    ///
     /// @expects hpa is 4k page aligned
     /// @expects hpa != 0
     /// @ensures
@@ -1206,13 +1589,7 @@ public:
         expects(bfn::lower(hpa, from) == 0);
         expects(bfn::upper(hpa, from) != 0);
 
-        auto hva = g_mm->alloc_map(page_size);
-        g_cr3->map_4k(hva, hpa);
-
-        return x64::unique_map<T>(
-                   static_cast<T *>(hva),
-                   x64::unmapper(hva, page_size)
-               );
+        return m_map_cache.map<T>(hpa);
     }
 
     /// Map HPA (4k)
@@ -1619,6 +1996,10 @@ public:
     VIRTUAL void set_cr3(uint64_t val) noexcept;
     VIRTUAL uint64_t cr4() const noexcept;
     VIRTUAL void set_cr4(uint64_t val) noexcept;
+    VIRTUAL uint64_t cr0_read_shadow() const noexcept;
+    VIRTUAL void set_cr0_read_shadow(uint64_t val) noexcept;
+    VIRTUAL uint64_t cr4_read_shadow() const noexcept;
+    VIRTUAL void set_cr4_read_shadow(uint64_t val) noexcept;
     VIRTUAL uint64_t ia32_efer() const noexcept;
     VIRTUAL void set_ia32_efer(uint64_t val) noexcept;
     VIRTUAL uint64_t ia32_pat() const noexcept;
@@ -1689,6 +2070,22 @@ public:
     VIRTUAL uint64_t ldtr_access_rights() const noexcept;
     VIRTUAL void set_ldtr_access_rights(uint64_t val) noexcept;
 
+    /// vCPU Exit Information
+    ///
+    /// These functions return the VMCS's read-only VM-exit information
+    /// fields. Each field is read from the VMCS at most once per VM exit
+    /// (see vmcs::read_only_field()), so VM exit handlers should use these
+    /// functions instead of reading the fields from the VMCS directly.
+    ///
+
+    VIRTUAL uint64_t exit_reason() const;
+    VIRTUAL uint64_t exit_qualification() const;
+    VIRTUAL uint64_t exit_instruction_length() const;
+    VIRTUAL uint64_t exit_instruction_information() const;
+    VIRTUAL uint64_t exit_interruption_information() const;
+    VIRTUAL uint64_t guest_linear_address() const;
+    VIRTUAL uint64_t guest_physical_address() const;
+
     // TODO:
     //
     // Remove me. This causes a trainwreck
@@ -1700,12 +2097,61 @@ public:
 private:
 
     uintptr_t get_entry(uintptr_t tble_gpa, std::ptrdiff_t index);
+    std::pair<uintptr_t, uintptr_t> walk_gva(uintptr_t cr3, uint64_t gva);
+
+    template<typename T>
+    void copy_guest(uint64_t gva, T *buf, std::size_t len);
+
+    template<typename T>
+    void copy_hpa(uintptr_t hpa, T *buf, std::size_t len);
+
+    void expire_gva_tlb();
+    bool handle_gva_tlb(gsl::not_null<vcpu *> obj);
+
+    void enable_shootdown_timer();
+    void disable_shootdown_timer();
+    bool handle_shootdown_timer(gsl::not_null<vcpu *> obj);
+
+    bool handle_vmread(gsl::not_null<vcpu *> obj);
+    bool handle_vmwrite(gsl::not_null<vcpu *> obj);
 
 private:
 
     std::unique_ptr<vmx> m_vmx{};
 
     ept::mmap *m_mmap{};
+
+    /// @cond
+
+    struct gpa_tlb_entry_t {
+        uint64_t gpa{};
+        uint64_t hpa{};
+        uint64_t from{};
+        uint64_t generation{};
+    };
+
+    static_assert((GPA_TLB_SIZE & (GPA_TLB_SIZE - 1)) == 0, "GPA_TLB_SIZE must be a power of 2");
+    std::array<gpa_tlb_entry_t, GPA_TLB_SIZE> m_gpa_tlb{};
+
+    struct gva_tlb_entry_t {
+        uint64_t cr3{};
+        uint64_t gva{};
+        uint64_t gpa{};
+        uint64_t from{};
+        uint64_t generation{};
+    };
+
+    static_assert((GVA_TLB_SIZE & (GVA_TLB_SIZE - 1)) == 0, "GVA_TLB_SIZE must be a power of 2");
+    std::array<gva_tlb_entry_t, GVA_TLB_SIZE> m_gva_tlb{};
+    bool m_gva_tlb_used{};
+
+    bool m_shootdown_timer{};
+
+    /// @endcond
+
+    x64::map_cache m_map_cache{};
+
+    invalidation_queue m_invalidation_queue{};
     vcpu_global_state_t *m_vcpu_global_state{};
 
     page_ptr<uint8_t> m_msr_bitmap;
@@ -1735,6 +2181,8 @@ private:
     ept_handler m_ept_handler;
     microcode_handler m_microcode_handler;
     vpid_handler m_vpid_handler;
+    std::unique_ptr<vmcs_shadow_handler> m_vmcs_shadow_handler;
+    dirty_log_handler m_dirty_log_handler;
     preemption_timer_handler m_preemption_timer_handler;
 
 private:
@@ -22,8 +22,11 @@
 #ifndef VMCS_INTEL_X64_H
 #define VMCS_INTEL_X64_H
 
+#include <array>
+
 #include <bftypes.h>
 #include <bfvcpuid.h>
+#include <bfconstants.h>
 
 #include "save_state.h"
 #include "check.h"
@@ -208,14 +211,139 @@ public:
     VIRTUAL save_state_t *save_state() const
     { return m_save_state.get(); }
 
+    /// Read Only Field
+    ///
+    /// Returns the value of one of the VMCS's read-only data fields (i.e.
+    /// the VM-exit information fields, like the exit reason and the exit
+    /// qualification). The first time a field is read after a VM exit, a
+    /// VMREAD is executed and the result is cached. All subsequent reads
+    /// of the same field return the cached value until the cache is
+    /// invalidated, which happens on every VM entry (i.e. launch() and
+    /// resume()), as well as on load() and clear(). Fields that are not
+    /// read-only data fields are always read from the VMCS.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param field the encoding of the VMCS field to read
+    /// @param name the name of the VMCS field (used for error reporting)
+    /// @return the value of the requested VMCS field
+    ///
+    VIRTUAL ::intel_x64::vmcs::value_type read_only_field(
+        ::intel_x64::vmcs::field_type field, const char *name = "") const;
+
+    /// Invalidate Read Only Fields
+    ///
+    /// Drops all of the cached read-only data fields, forcing the next call
+    /// to read_only_field() to execute a VMREAD. This is done automatically
+    /// on VM entry, and should only be needed if the VMCS's read-only data
+    /// fields are modified outside of a VM exit (e.g. by a VMCS migration).
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL void invalidate_read_only_fields() const noexcept;
+
+    /// Read
+    ///
+    /// Returns the value of a VMCS field. If write-back is enabled and the
+    /// field has a pending write, the pending value is returned. Otherwise
+    /// the field is read using read_only_field(), which means read-only
+    /// data fields are served from the cache.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param field the encoding of the VMCS field to read
+    /// @param name the name of the VMCS field (used for error reporting)
+    /// @return the value of the requested VMCS field
+    ///
+    VIRTUAL ::intel_x64::vmcs::value_type read(
+        ::intel_x64::vmcs::field_type field, const char *name = "") const;
+
+    /// Write
+    ///
+    /// Writes a value to a VMCS field. If write-back is disabled, this
+    /// executes a VMWRITE immediately. Otherwise the write is added to this
+    /// VMCS's write queue (replacing any pending write to the same field)
+    /// and is executed by flush_writes(), which is called before the VMCS
+    /// is launched, resumed or promoted, and right after it is loaded.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param field the encoding of the VMCS field to write
+    /// @param val the value to write to the VMCS field
+    /// @param name the name of the VMCS field (used for error reporting)
+    ///
+    VIRTUAL void write(
+        ::intel_x64::vmcs::field_type field,
+        ::intel_x64::vmcs::value_type val,
+        const char *name = "");
+
+    /// Flush Writes
+    ///
+    /// Executes a VMWRITE for each pending write and empties the write
+    /// queue. This VMCS must be loaded when this function is called.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL void flush_writes();
+
+    /// Enable Write Back
+    ///
+    /// Once enabled, write() buffers VMCS writes instead of executing them
+    /// immediately. Code that reads a field written with write() must use
+    /// read() (or the vCPU's accessors) and not the VMCS intrinsics, as the
+    /// intrinsics will not see pending writes.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL void enable_write_back() noexcept;
+
+    /// Disable Write Back
+    ///
+    /// Flushes any pending writes and causes write() to execute each VMWRITE
+    /// immediately. This is the default.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    VIRTUAL void disable_write_back();
+
+    /// Pending Writes
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return Returns the number of writes that are waiting to be flushed
+    ///
+    auto pending_writes() const noexcept
+    { return m_num_pending_writes; }
+
 private:
 
+    struct pending_write_t {
+        ::intel_x64::vmcs::field_type field;
+        ::intel_x64::vmcs::value_type val;
+        const char *name;
+    };
+
     vcpu *m_vcpu;
     page_ptr<save_state_t> m_save_state;
 
     page_ptr<uint32_t> m_vmcs_region;
     uintptr_t m_vmcs_region_phys;
 
+    mutable uint32_t m_read_only_fields_valid{};
+    mutable std::array<::intel_x64::vmcs::value_type, 32> m_read_only_fields{};
+
+    bool m_write_back{false};
+    std::size_t m_num_pending_writes{};
+    std::array<pending_write_t, VMCS_WRITE_QUEUE_SIZE> m_pending_writes{};
+
 public:
 
     /// @cond
@@ -0,0 +1,391 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef VMCS_SHADOW_INTEL_X64_H
+#define VMCS_SHADOW_INTEL_X64_H
+
+#include <list>
+#include <unordered_map>
+
+#include <bfgsl.h>
+#include <bfdelegate.h>
+
+#include "exit_handler.h"
+#include "../../../memory_manager/memory_manager.h"
+
+// -----------------------------------------------------------------------------
+// Exports
+// -----------------------------------------------------------------------------
+
+#include <bfexports.h>
+
+#ifndef STATIC_HVE
+#ifdef SHARED_HVE
+#define EXPORT_HVE EXPORT_SYM
+#else
+#define EXPORT_HVE IMPORT_SYM
+#endif
+#else
+#define EXPORT_HVE
+#endif
+
+// -----------------------------------------------------------------------------
+// Definitions
+// -----------------------------------------------------------------------------
+
+namespace bfvmm::intel_x64
+{
+
+class vcpu;
+
+/// VMCS Shadowing
+///
+/// Provides an interface for enabling VMCS shadowing. When enabled, VMREAD
+/// and VMWRITE instructions executed by the guest (i.e. a nested hypervisor)
+/// are serviced by the CPU using this vCPU's shadow VMCS instead of causing
+/// a VM exit, unless the field being accessed is set in the VMREAD or
+/// VMWRITE bitmap.
+///
+/// By default, every field is trapped, as nothing populates the shadow VMCS
+/// on its own. VMLAUNCH, VMRESUME, VMPTRLD and VMCLEAR still cause a VM
+/// exit, which is where the shadow VMCS should be synchronized with the
+/// nested hypervisor's VMCS using read() and write(). A field should only
+/// be passed through once the shadow VMCS holds the value the nested
+/// hypervisor expects (e.g. the VM-exit information fields, once they have
+/// been copied from the vCPU's VMCS on a nested VM exit).
+///
+/// A VMREAD / VMWRITE of a trapped field is emulated using the shadow VMCS
+/// (i.e. a VMREAD returns the field's value in the shadow VMCS, and a
+/// VMWRITE updates it), and the handlers registered for the field are
+/// called so that they can inspect or override the value. Trapped accesses
+/// are only emulated while VMCS shadowing is enabled.
+///
+class EXPORT_HVE vmcs_shadow_handler
+{
+public:
+
+    ///
+    /// Info
+    ///
+    /// This struct is created by vmcs_shadow_handler::handle_vmread and
+    /// vmcs_shadow_handler::handle_vmwrite before being passed to each
+    /// registered handler.
+    ///
+    struct info_t {
+
+        /// Field (in)
+        ///
+        /// The encoding of the VMCS field accessed by the guest
+        ///
+        /// default: the guest's register operand
+        ///
+        uint64_t field;
+
+        /// Value (in/out)
+        ///
+        /// For a VMREAD, the value returned to the guest. For a VMWRITE,
+        /// the value written by the guest.
+        ///
+        /// default: the field's value in the shadow VMCS (VMREAD)
+        /// default: the guest's source operand (VMWRITE)
+        ///
+        uint64_t val;
+
+        /// Ignore write (out)
+        ///
+        /// - For a VMREAD, do not store info.val in the guest's destination
+        ///   operand if this field is true.
+        ///
+        /// - For a VMWRITE, do not write info.val to the shadow VMCS if this
+        ///   field is true.
+        ///
+        /// default: false
+        ///
+        bool ignore_write;
+
+        /// Ignore advance (out)
+        ///
+        /// If true, do not advance the guest's instruction pointer.
+        /// Set this to true if your handler returns true and has already
+        /// advanced the guest's instruction pointer.
+        ///
+        /// default: false
+        ///
+        bool ignore_advance;
+    };
+
+    /// Handler delegate type
+    ///
+    /// The type of delegate clients must use when registering
+    /// handlers
+    ///
+    using handler_delegate_t =
+        delegate<bool(gsl::not_null<vcpu *>, info_t &)>;
+
+    /// Constructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param vcpu the vcpu object for this VMCS shadowing handler
+    ///
+    vmcs_shadow_handler(
+        gsl::not_null<vcpu *> vcpu);
+
+    /// Destructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    ~vmcs_shadow_handler() = default;
+
+    /// Add VMREAD Handler
+    ///
+    /// Traps VMREAD of the provided field, and calls the provided handler
+    /// each time the guest executes a VMREAD of it.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to listen to
+    /// @param d the handler to call when an exit occurs
+    ///
+    void add_vmread_handler(
+        vmcs_n::field_type field, const handler_delegate_t &d);
+
+    /// Add VMWRITE Handler
+    ///
+    /// Traps VMWRITE of the provided field, and calls the provided handler
+    /// each time the guest executes a VMWRITE of it.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to listen to
+    /// @param d the handler to call when an exit occurs
+    ///
+    void add_vmwrite_handler(
+        vmcs_n::field_type field, const handler_delegate_t &d);
+
+    /// Enable
+    ///
+    /// Sets the VMCS link pointer to this vCPU's shadow VMCS, sets the
+    /// VMREAD / VMWRITE bitmap addresses and enables VMCS shadowing.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void enable();
+
+    /// Disable
+    ///
+    /// Disables VMCS shadowing and clears the VMCS link pointer.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void disable();
+
+    /// Trap On VMREAD
+    ///
+    /// Sets a '1' in the VMREAD bitmap corresponding with the provided field.
+    /// All attempts made by the guest to VMREAD the provided field will be
+    /// trapped by the hypervisor.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to trap
+    ///
+    void trap_on_vmread(vmcs_n::field_type field);
+
+    /// Pass Through VMREAD
+    ///
+    /// Sets a '0' in the VMREAD bitmap corresponding with the provided field.
+    /// All attempts made by the guest to VMREAD the provided field will be
+    /// serviced from the shadow VMCS and will not trap to the hypervisor.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to pass through
+    ///
+    void pass_through_vmread(vmcs_n::field_type field);
+
+    /// Trap On VMWRITE
+    ///
+    /// Sets a '1' in the VMWRITE bitmap corresponding with the provided
+    /// field. All attempts made by the guest to VMWRITE the provided field
+    /// will be trapped by the hypervisor.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to trap
+    ///
+    void trap_on_vmwrite(vmcs_n::field_type field);
+
+    /// Pass Through VMWRITE
+    ///
+    /// Sets a '0' in the VMWRITE bitmap corresponding with the provided
+    /// field. All attempts made by the guest to VMWRITE the provided field
+    /// will be serviced by the shadow VMCS and will not trap to the
+    /// hypervisor.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to pass through
+    ///
+    void pass_through_vmwrite(vmcs_n::field_type field);
+
+    /// Is VMREAD Trapped
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to query
+    /// @return Returns true if a guest VMREAD of the provided field causes a
+    ///     VM exit, false otherwise
+    ///
+    bool is_vmread_trapped(vmcs_n::field_type field) const;
+
+    /// Is VMWRITE Trapped
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to query
+    /// @return Returns true if a guest VMWRITE of the provided field causes a
+    ///     VM exit, false otherwise
+    ///
+    bool is_vmwrite_trapped(vmcs_n::field_type field) const;
+
+    /// Read
+    ///
+    /// Reads a field from the shadow VMCS. This loads the shadow VMCS,
+    /// executes a VMREAD and then loads the vCPU's VMCS again, so if more
+    /// than a couple of fields are needed, the shadow VMCS should be
+    /// loaded once using load() instead.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to read
+    /// @return the value of the field in the shadow VMCS
+    ///
+    vmcs_n::value_type read(vmcs_n::field_type field);
+
+    /// Write
+    ///
+    /// Writes a field in the shadow VMCS. This loads the shadow VMCS,
+    /// executes a VMWRITE and then loads the vCPU's VMCS again. Note that
+    /// writing a VM-exit information field requires support for VMWRITE
+    /// to any field (IA32_VMX_MISC bit 29).
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param field the encoding of the VMCS field to write
+    /// @param val the value to write
+    ///
+    void write(vmcs_n::field_type field, vmcs_n::value_type val);
+
+    /// Load
+    ///
+    /// Loads the shadow VMCS, causing all VMREAD / VMWRITE instructions
+    /// executed by the hypervisor to operate on the shadow VMCS. The vCPU's
+    /// VMCS must be loaded again (using vcpu::load()) before the vCPU's
+    /// state can be accessed.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void load();
+
+    /// Physical Address
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns the physical address of the shadow VMCS
+    ///
+    uintptr_t phys() const noexcept
+    { return m_shadow_vmcs_region_phys; }
+
+    /// Is Enabled
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns true if VMCS shadowing is enabled, false otherwise
+    ///
+    bool is_enabled() const noexcept
+    { return m_enabled; }
+
+public:
+
+    /// @cond
+
+    bool handle_vmread(gsl::not_null<vcpu *> vcpu);
+    bool handle_vmwrite(gsl::not_null<vcpu *> vcpu);
+
+    /// @endcond
+
+private:
+
+    uint64_t operand_address(gsl::not_null<vcpu *> vcpu, uint64_t ii);
+    std::size_t operand_size() const;
+
+    bool succeed(gsl::not_null<vcpu *> vcpu, const info_t &info);
+    bool fail(gsl::not_null<vcpu *> vcpu, uint64_t error);
+
+private:
+
+    vcpu *m_vcpu;
+    bool m_enabled{false};
+
+    page_ptr<uint32_t> m_shadow_vmcs_region;
+    uintptr_t m_shadow_vmcs_region_phys;
+
+    page_ptr<uint8_t> m_vmread_bitmap;
+    page_ptr<uint8_t> m_vmwrite_bitmap;
+
+    std::unordered_map<vmcs_n::field_type, std::list<handler_delegate_t>> m_vmread_handlers;
+    std::unordered_map<vmcs_n::field_type, std::list<handler_delegate_t>> m_vmwrite_handlers;
+
+public:
+
+    /// @cond
+
+    vmcs_shadow_handler(vmcs_shadow_handler &&) = default;
+    vmcs_shadow_handler &operator=(vmcs_shadow_handler &&) = default;
+
+    vmcs_shadow_handler(const vmcs_shadow_handler &) = delete;
+    vmcs_shadow_handler &operator=(const vmcs_shadow_handler &) = delete;
+
+    /// @endcond
+};
+
+}
+
+#endif
@@ -58,6 +58,27 @@ class vcpu;
 ///
 /// Provides an interface for handling port I/O exits base on the port number
 ///
+/// String instructions (INS / OUTS, with or without a REP prefix) are
+/// handled in blocks. The guest's buffer is translated and mapped once per
+/// page, and the registered handlers are called once per element, in the
+/// order the guest would access them (i.e. honoring the direction flag).
+/// For ports that are not emulated, the elements of each block are written
+/// to the port using a single REP OUTS when possible, and, if the port only
+/// has pass through handlers (see add_pass_through_handler()), read from
+/// the port using a single REP INS. Once all of the elements have been
+/// handled, RCX, and RDI or RSI, are updated and the instruction is
+/// advanced. If no handler accepts an element, the registers are updated
+/// for the elements that were handled and the default handler is called,
+/// which allows the guest to restart the instruction with the remaining
+/// elements.
+///
+/// The address size of a string instruction is taken from the VM-exit
+/// instruction information field, which the CPU only provides for INS /
+/// OUTS if IA32_VMX_BASIC reports it. Otherwise the address size of the
+/// guest's code segment is used, and a single element is handled per
+/// VM exit (the instruction is not advanced until RCX reaches 0, so the
+/// guest executes it again for the next element).
+///
 class EXPORT_HVE io_instruction_handler
 {
 public:
@@ -92,9 +113,10 @@ public:
 
         /// Address
         ///
-        /// For accesses via string instructions, the guest linear address.
+        /// For accesses via string instructions, the guest linear address
+        /// of the element being accessed.
         ///
-        /// default: vmcs_n::guest_linear_address
+        /// default: vmcs_n::guest_linear_address (for the first element)
         ///
         uint64_t address;
 
@@ -188,6 +210,31 @@ public:
     ///
     void emulate(vmcs_n::value_type port);
 
+    /// Add Pass Through Handler
+    ///
+    /// Adds a handler that only observes the guest's accesses to a port
+    /// that is not emulated, meaning it never declines an access (i.e. it
+    /// always returns true). Since such a handler cannot change which
+    /// elements of a REP INS are read from the port, the elements of a
+    /// REP INS are read from the port in blocks, before the handlers are
+    /// called, as long as every handler for the port was added using this
+    /// function. A handler added using add_handler() may decline an
+    /// element, so once one is added, each element is read from the port
+    /// on its own, right before the handlers are called for it.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param port the port to listen to
+    /// @param in_d the handler to call when an in exit occurs
+    /// @param out_d the handler to call when an out exit occurs
+    ///
+    void add_pass_through_handler(
+        vmcs_n::value_type port,
+        const handler_delegate_t &in_d,
+        const handler_delegate_t &out_d
+    );
+
     /// Add Default Handler
     ///
     /// This is called when no registered handlers have been called and
@@ -288,9 +335,22 @@ private:
 
     bool handle_in(gsl::not_null<vcpu *> vcpu, info_t &info);
     bool handle_out(gsl::not_null<vcpu *> vcpu, info_t &info);
+    bool handle_string(gsl::not_null<vcpu *> vcpu, info_t &info, bool in, bool rep);
+
+    uint64_t handle_block(
+        gsl::not_null<vcpu *> vcpu,
+        const std::list<handler_delegate_t> &hdlrs,
+        info_t &info,
+        uint8_t *buf,
+        uint64_t count,
+        bool in,
+        bool backward,
+        bool &advance);
 
     void emulate_in(info_t &info);
     void emulate_out(info_t &info);
+    void emulate_ins(info_t &info, uint8_t *buf, uint64_t count);
+    void emulate_outs(info_t &info, uint8_t *buf, uint64_t count);
 
     void load_operand(gsl::not_null<vcpu *> vcpu, info_t &info);
     void store_operand(gsl::not_null<vcpu *> vcpu, info_t &info);
@@ -298,12 +358,14 @@ private:
 private:
 
     vcpu *m_vcpu;
+    bool m_ins_outs_information;
 
     gsl::span<uint8_t> m_io_bitmap_a;
     gsl::span<uint8_t> m_io_bitmap_b;
 
     ::handler_delegate_t m_default_handler;
     std::unordered_map<vmcs_n::value_type, bool> m_emulate;
+    std::unordered_map<vmcs_n::value_type, bool> m_intercept;
     std::unordered_map<vmcs_n::value_type, std::list<handler_delegate_t>> m_in_handlers;
     std::unordered_map<vmcs_n::value_type, std::list<handler_delegate_t>> m_out_handlers;
 
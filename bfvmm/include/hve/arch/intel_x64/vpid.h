@@ -22,6 +22,9 @@
 #ifndef VPID_INTEL_X64_H
 #define VPID_INTEL_X64_H
 
+#include <array>
+#include <atomic>
+
 // -----------------------------------------------------------------------------
 // Exports
 // -----------------------------------------------------------------------------
@@ -47,9 +50,95 @@ namespace bfvmm::intel_x64
 
 class vcpu;
 
+/// VPID Allocator
+///
+/// Hands out VPIDs from a bitmap that covers the entire 16bit VPID space.
+/// VPID 0 is reserved for VMX root operation and is never allocated.
+/// Allocations and releases are atomic, and can be performed from any
+/// CPU. A VPID that is released can be handed out again, so the owner of
+/// a newly allocated VPID must invalidate it before its first VM entry
+/// (see vpid_handler).
+///
+class EXPORT_HVE vpid_allocator
+{
+public:
+
+    /// Constructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    vpid_allocator() noexcept;
+
+    /// Destructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    ~vpid_allocator() = default;
+
+    /// Get Singleton Instance
+    ///
+    /// @expects none
+    /// @ensures ret != nullptr
+    ///
+    /// @return a singleton instance of vpid_allocator
+    ///
+    static vpid_allocator *instance() noexcept;
+
+    /// Allocate
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns a VPID that is not in use, or 0 if all of the
+    ///     VPIDs are in use
+    ///
+    uint16_t allocate() noexcept;
+
+    /// Release
+    ///
+    /// Returns a VPID to the allocator. Releasing 0 does nothing.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param id the VPID to release
+    ///
+    void release(uint16_t id) noexcept;
+
+    /// Is Allocated
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @param id the VPID to query
+    /// @return Returns true if id is in use, false otherwise
+    ///
+    bool is_allocated(uint16_t id) const noexcept;
+
+private:
+
+    std::atomic<std::size_t> m_next{};
+    std::array<std::atomic<uint64_t>, 0x10000 / 64> m_bitmap{};
+
+public:
+
+    /// @cond
+
+    vpid_allocator(vpid_allocator &&) = delete;
+    vpid_allocator &operator=(vpid_allocator &&) = delete;
+
+    vpid_allocator(const vpid_allocator &) = delete;
+    vpid_allocator &operator=(const vpid_allocator &) = delete;
+
+    /// @endcond
+};
+
 /// VPID
 ///
-/// Provides an interface for enabling VPID
+/// Provides an interface for enabling VPID. Each handler allocates its
+/// VPID from the vpid_allocator, and releases it when it is destroyed.
 ///
 class EXPORT_HVE vpid_handler
 {
@@ -67,10 +156,12 @@ public:
 
     /// Destructor
     ///
+    /// Returns the VPID to the VPID allocator
+    ///
     /// @expects
     /// @ensures
     ///
-    ~vpid_handler() = default;
+    ~vpid_handler();
 
     /// Get ID
     ///
@@ -83,6 +174,9 @@ public:
 
     /// Enable
     ///
+    /// Enables VPID. If a VPID could not be allocated when this handler
+    /// was created, VPID remains disabled.
+    ///
     /// @expects
     /// @ensures
     ///
@@ -104,8 +198,8 @@ public:
 
     /// @cond
 
-    vpid_handler(vpid_handler &&) = default;
-    vpid_handler &operator=(vpid_handler &&) = default;
+    vpid_handler(vpid_handler &&) = delete;
+    vpid_handler &operator=(vpid_handler &&) = delete;
 
     vpid_handler(const vpid_handler &) = delete;
     vpid_handler &operator=(const vpid_handler &) = delete;
@@ -0,0 +1,304 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef MAP_CACHE_X64_H
+#define MAP_CACHE_X64_H
+
+#include <array>
+
+#include <bfgsl.h>
+#include <bfconstants.h>
+
+#include "unmapper.h"
+#include "../../../memory_manager/arch/x64/cr3.h"
+
+// -----------------------------------------------------------------------------
+// Exports
+// -----------------------------------------------------------------------------
+
+#include <bfexports.h>
+
+#ifndef STATIC_HVE
+#ifdef SHARED_HVE
+#define EXPORT_HVE EXPORT_SYM
+#else
+#define EXPORT_HVE IMPORT_SYM
+#endif
+#else
+#define EXPORT_HVE
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4251)
+#endif
+
+// -----------------------------------------------------------------------------
+// Definitions
+// -----------------------------------------------------------------------------
+
+namespace bfvmm::x64
+{
+
+/// Map Cache
+///
+/// Keeps up to MAP_CACHE_SIZE 4k host virtual address windows mapped, each
+/// to a host physical page, so that mapping the same host physical page
+/// over and over again (e.g. a guest's page tables, or a ring that is
+/// shared with a guest) does not require a new window to be allocated and
+/// mapped, and then unmapped, INVLPG'd and freed once the map loses scope.
+///
+/// - A host physical page that is already in a window is a hit, and the
+///   window is handed out as is (no page table walk, and no TLB flush).
+/// - Otherwise the least recently used window that is not in use is
+///   pointed at the host physical page, which is a single PTE write and a
+///   single INVLPG.
+/// - If every window is in use, the map falls back to alloc_map(), just
+///   like a map that does not use the cache.
+///
+/// If the VMM has a direct map (see DIRECT_MAP_SIZE) that contains the
+/// host physical page, the direct map is used instead, and the cache is
+/// not touched.
+///
+/// A window is in use until all of the unique_maps that reference it lose
+/// scope, which means a unique_map returned by map() must not outlive the
+/// cache.
+///
+/// The cache is not thread safe. It is owned by the CPU that last called
+/// set_owner() (the vCPU that owns the cache calls it on every VM entry, so
+/// this is the CPU that is executing the vCPU), and a map from any other
+/// CPU (e.g. a vCPU's guest memory being accessed from a remote CPU), or
+/// before the cache has an owner, does not touch the cache, and falls back
+/// to alloc_map() instead. A unique_map that was served by the cache must
+/// be released on the owning CPU.
+///
+/// Windows are mapped read/write and write-back (the default memory type
+/// of cr3::mmap::map_4k()), and a window stays mapped after its
+/// unique_map loses scope, until the window is reused for a different
+/// host physical page, or the cache is cleared. As a result, a host
+/// physical page that was mapped using the cache remains accessible (and
+/// cacheable) through the VMM's page tables after it is unmapped, and the
+/// cache must not be used to map pages that need a different memory type
+/// (e.g. MMIO), or pages whose mappings must be gone once they are
+/// unmapped (see clear()).
+///
+class EXPORT_HVE map_cache
+{
+public:
+
+    /// Constructor
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    map_cache() = default;
+
+    /// Destructor
+    ///
+    /// Unmaps all of the windows and returns them to the memory manager.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    ~map_cache();
+
+    /// Map
+    ///
+    /// Map a 4k host physical address into the VMM, using one of the
+    /// cache's windows if possible. The result is a unique_map that hands
+    /// the window back to the cache when scope is lost.
+    ///
+    /// @expects hpa is 4k page aligned
+    /// @expects
+    ///
+    /// @param hpa the host physical address to map
+    /// @return a unique_map that can be used to access the hpa
+    ///
+    template<typename T>
+    auto map(uintptr_t hpa)
+    {
+        using namespace ::x64::pt;
+
+        if (auto hva = cr3::vmm_direct_map_hva(hpa, page_size)) {
+            return unique_map<T>(static_cast<T *>(hva), unmapper());
+        }
+
+        if (auto hva = this->acquire(hpa)) {
+            return unique_map<T>(
+                       static_cast<T *>(hva),
+                       unmapper(hva, page_size, this)
+                   );
+        }
+
+        auto hva = g_mm->alloc_map(page_size);
+        g_cr3->map_4k(hva, hpa);
+
+        return unique_map<T>(
+                   static_cast<T *>(hva),
+                   unmapper(hva, page_size)
+               );
+    }
+
+    /// Acquire
+    ///
+    /// Returns a window that maps the provided host physical address, and
+    /// marks it as in use. Every successful call to this function must be
+    /// paired with a call to release().
+    ///
+    /// @expects hpa is 4k page aligned
+    /// @ensures
+    ///
+    /// @param hpa the host physical address to map
+    /// @return the host virtual address of the window, or nullptr if all
+    ///     of the windows are in use, or if this function is called from
+    ///     a CPU other than the CPU that owns the cache
+    ///
+    void *acquire(uintptr_t hpa);
+
+    /// Release
+    ///
+    /// Marks a window returned by acquire() as no longer in use. The window
+    /// remains mapped (write-back) until it is reused for a different host
+    /// physical address, or the cache is cleared. If this function is
+    /// called from a CPU other than the CPU that owns the cache, the window
+    /// is left in use (and is never reused) instead of racing with the
+    /// owning CPU.
+    ///
+    /// @expects hva was returned by acquire()
+    /// @expects called from the CPU that owns the cache
+    /// @ensures
+    ///
+    /// @param hva the host virtual address of the window
+    ///
+    void release(void *hva) noexcept;
+
+    /// Set Owner
+    ///
+    /// Makes the calling CPU the owner of the cache. If the cache moves to
+    /// a different CPU, the windows are flushed from the new CPU's TLB, as
+    /// it might still hold translations from the last time it owned the
+    /// cache.
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    void set_owner() noexcept;
+
+    /// Clear
+    ///
+    /// Unmaps all of the windows that are not in use, which is needed if
+    /// the host physical pages that they map can no longer be accessed
+    /// (e.g. the pages are given back to the host OS).
+    ///
+    /// @expects called from the CPU that owns the cache
+    /// @ensures
+    ///
+    void clear();
+
+    /// Hits
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns the number of maps that were served by a window
+    ///     that already mapped the requested host physical address
+    ///
+    uint64_t hits() const noexcept
+    { return m_hits; }
+
+    /// Misses
+    ///
+    /// @expects
+    /// @ensures
+    ///
+    /// @return Returns the number of maps that had to point a window at
+    ///     a new host physical address, or fall back to alloc_map()
+    ///
+    uint64_t misses() const noexcept
+    { return m_misses; }
+
+private:
+
+    /// @cond
+
+    using index_type = uint16_t;
+    static constexpr const index_type s_none = 0xFFFFU;
+    static constexpr const uint64_t s_no_owner = ~0ULL;
+
+    struct window_t {
+        uintptr_t hpa{};
+        cr3::mmap::entry_type *pte{};
+        uint32_t refs{};
+        index_type chain{s_none};
+        index_type prev{s_none};
+        index_type next{s_none};
+    };
+
+    static_assert((MAP_CACHE_SIZE & (MAP_CACHE_SIZE - 1)) == 0, "MAP_CACHE_SIZE must be a power of 2");
+    static_assert(MAP_CACHE_SIZE < s_none, "MAP_CACHE_SIZE is too large");
+
+    void init();
+    bool owner() const noexcept;
+
+    void hash_insert(index_type i) noexcept;
+    void hash_remove(index_type i) noexcept;
+
+    void lru_push(index_type i) noexcept;
+    void lru_remove(index_type i) noexcept;
+
+    uintptr_t window_hva(index_type i) const noexcept;
+
+    /// @endcond
+
+private:
+
+    uintptr_t m_base{};
+    uint64_t m_cpuid{s_no_owner};
+
+    index_type m_lru_head{s_none};
+    index_type m_lru_tail{s_none};
+
+    std::array<window_t, MAP_CACHE_SIZE> m_windows{};
+    std::array<index_type, MAP_CACHE_SIZE> m_buckets{};
+
+    uint64_t m_hits{};
+    uint64_t m_misses{};
+
+public:
+
+    /// @cond
+
+    map_cache(map_cache &&) = delete;
+    map_cache &operator=(map_cache &&) = delete;
+
+    map_cache(const map_cache &) = delete;
+    map_cache &operator=(const map_cache &) = delete;
+
+    /// @endcond
+};
+
+}
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif
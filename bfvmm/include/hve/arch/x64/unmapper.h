@@ -48,19 +48,31 @@
 namespace bfvmm::x64
 {
 
+class map_cache;
+
 /// Unmapper
 ///
 /// This class is used by the mapping functions to unmap previously mapped
 /// memory. This unmapper adheres to the deleter concept for a
 /// std::unique_ptr so that a std::unique_ptr can be used for mapping memory.
 ///
+/// If the memory was mapped using a map_cache, the memory is not unmapped.
+/// Instead, the window that was used is handed back to the cache so that
+/// it can be used again.
+///
 class unmapper
 {
     uintptr_t m_hva{};
     std::size_t m_len{};
+    map_cache *m_cache{};
 
 public:
 
+    /// Default Constructor
+    ///
+    /// Creates an unmapper that does nothing, which is used for memory
+    /// that is always mapped (e.g. the VMM's direct map).
+    ///
     unmapper() = default;
 
     /// Constructor
@@ -69,13 +81,17 @@ public:
     ///
     /// @param hva the host virtual address to unmap
     /// @param len the length of the buffer that was previous mapped
+    /// @param cache the map_cache that owns hva, or nullptr if hva was
+    ///     allocated using alloc_map()
     ///
     explicit unmapper(
         void *hva,
-        std::size_t len
+        std::size_t len,
+        map_cache *cache = nullptr
     ) :
         m_hva{reinterpret_cast<uintptr_t>(hva)},
-        m_len{len}
+        m_len{len},
+        m_cache{cache}
     { }
 
     /// Unmap Functor
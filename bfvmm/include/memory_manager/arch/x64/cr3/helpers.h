@@ -48,6 +48,8 @@ namespace bfvmm::x64::cr3
 ///                           | Unusable         |
 ///             0xBF000000000 +------------------+
 ///                           | VMM Map Space    |
+///            0x400000000000 +------------------+
+///                           | Direct Map       |
 ///            0x7FFFFFFFFFFF +------------------+
 ///                           | Unusable         |
 ///        0xFFFF800000000000 +------------------+
@@ -71,6 +73,9 @@ namespace bfvmm::x64::cr3
 /// while at the same time, not touching any address in the higher half which
 /// might accidentally collide with the Host OS.
 ///
+/// If enabled (see DIRECT_MAP_SIZE), host physical memory is also mapped
+/// (by default) at 0x400000000000 (see init_vmm_direct_map()).
+///
 gsl::not_null<mmap *>
 vmm_cr3();
 
@@ -317,6 +322,78 @@ identity_map_convert_4k_to_2m(
     mmap::attr_type attr = mmap::attr_type::read_write,
     mmap::memory_type cache = mmap::memory_type::write_back);
 
+/// Direct Map
+///
+/// Maps host physical memory from 0 to size at DIRECT_MAP_START, using
+/// 1g maps if the CPU supports them, and 2m maps otherwise. The size is
+/// rounded up to the granularity of the maps that are used.
+///
+/// @note The direct map uses the write-back memory type. Any range that
+///     is not RAM (e.g. MMIO) is expected to be covered by an uncacheable
+///     MTRR, which takes precedence over the PAT.
+///
+/// @expects size != 0
+/// @ensures
+///
+/// @param map the map to add the direct map to
+/// @param size the number of bytes of host physical memory to map
+/// @return the number of bytes of host physical memory that were mapped
+///
+mmap::phys_addr_t
+direct_map(
+    mmap &map,
+    mmap::phys_addr_t size);
+
+/// Initialize the VMM's Direct Map
+///
+/// Adds a direct map of all host physical memory (as reported by CPUID,
+/// limited to DIRECT_MAP_SIZE bytes) to the VMM's CR3. This is done once,
+/// while the VMM's CR3 is being set up. If DIRECT_MAP_SIZE is 0, the
+/// direct map is disabled and this function does nothing.
+///
+/// @expects
+/// @ensures
+///
+void
+init_vmm_direct_map();
+
+/// VMM Direct Map Size
+///
+/// @expects
+/// @ensures
+///
+/// @return Returns the number of bytes of host physical memory in the
+///     VMM's direct map, or 0 if the direct map is disabled
+///
+mmap::phys_addr_t
+vmm_direct_map_size() noexcept;
+
+/// Host Physical Address to Direct Map
+///
+/// Converts a host physical address to the host virtual address that it
+/// has in the VMM's direct map. Unlike a mapping made with alloc_map(),
+/// the result is always mapped, and must not be unmapped.
+///
+/// @expects
+/// @ensures
+///
+/// @param hpa the host physical address to convert
+/// @param len the number of bytes starting at hpa that must be mapped
+/// @return Returns the host virtual address of hpa, or nullptr if the
+///     range is not in the VMM's direct map
+///
+inline void *
+vmm_direct_map_hva(mmap::phys_addr_t hpa, mmap::size_type len) noexcept
+{
+    const auto size = vmm_direct_map_size();
+
+    if (len > size || hpa > size - len) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<void *>(DIRECT_MAP_START + hpa);
+}
+
 }
 
 /// Global CR3
@@ -22,6 +22,8 @@
 #ifndef BUDDY_ALLOCATOR_H
 #define BUDDY_ALLOCATOR_H
 
+#include <array>
+
 #include <bfgsl.h>
 #include <bfbitmanip.h>
 #include <bfexception.h>
@@ -62,15 +64,32 @@ next_power_2(uint64_t size)
 /// The goals of this allocator includes:
 /// - O(log2n) allocation time
 /// - O(log2n) deallocation time
+/// - No recursion, and no pointer chasing through a tree
 /// - No external fragmentation (internal fragmentation is allowed, and can
 ///   be high depending on the size of the object)
 /// - All allocations are a multiple of a page
 ///
 /// To support these features, this allocator uses 2 buffers.
 /// - buffer: this is the main buffer that is allocated and returned. This
-///   buffer must be page aligned, and a power of 2^k.
-/// - node tree buffer: The node tree buffer stores the binary tree that keeps
-///   track of each allocation.
+///   buffer must be page aligned, and a power of 2^k. The buddy allocator
+///   never dereferences this buffer, so it can be used to allocate virtual
+///   address space that has no backing.
+/// - node tree buffer: stores the allocator's bookkeeping, which is a
+///   block_t for each page in the buffer.
+///
+/// A block of order n is 2^n pages in size, and starts at a page index
+/// that is a multiple of 2^n. The first page of each block stores the
+/// block's tag (whether the block is free or used, and its order), while
+/// the tag of every other page is 0. Each free block is also on the free
+/// list for its order, which is a doubly linked list of page indexes that
+/// is threaded through the block_t of the block's first page.
+///
+/// An allocation pops a block from the free list of the smallest order
+/// that is large enough and not empty, and splits the block in half until
+/// it is the requested order, pushing each unused half onto its free list.
+/// A deallocation marks the block free, and then merges it with its buddy
+/// (the block whose page index only differs by bit n), for as long as the
+/// buddy is a free block of the same order.
 ///
 class buddy_allocator
 {
@@ -82,74 +101,24 @@ public:
 
 private:
 
-    /// @struct node
-    ///
-    /// This node is used to define the binary tree. child0 and child1 define
-    /// the child nodes (left or right) in the binary tree. ptr stores the
-    /// location in the provided buffer that this node refers to, and size
-    /// defines the size of the allocation. Note that bits 62-63 in the size
-    /// field define the type of node. 00 == unused, 01 == leaf and
-    /// 10 == parent. This binary tree doesn't set child0 and child1 to 0
-    /// on deallocation, but instead changes the node type in the field size.
-    /// This is done to prevent the need to recycle nodes. Once a node is
-    /// created, it remains in place, and the node type is used to determine
-    /// its state. This greatly simplifies the overall design of the buddy
-    /// allocator, and reduces the amount of memory that is needed for
-    /// bookkeeping. A deallocation consists of simply setting the node type to
-    /// from 1 (all allocations are leaf nodes) to 0 (for unused). Finally
-    /// the adjacent node's type is checked. If the adjacent node is also
-    /// unused, the parent node's type is changed to unused, and the process
-    /// is repeated. The nodes remain in place, and future allocations simply
-    /// change the node type to represent an allocation. Finally, type 11
-    /// means the node is full. This is an optimization to speed up allocations
-    /// by preventing a search from occuring on nodes that do not have
-    /// available memory.
-    ///
-    struct node_t {
-        node_t *child0;
-        node_t *child1;
-        integer_pointer ptr;
-        size_type size;
+    /// @struct block_t
+    ///
+    /// The bookkeeping for a single page of the buffer. next and prev link
+    /// a free block into the free list of its order, and tag stores the
+    /// state of the block that starts at this page (0 if no block starts
+    /// at this page).
+    ///
+    struct block_t {
+        uint32_t next;
+        uint32_t prev;
+        uint8_t tag;
     };
 
-    inline auto get_size(node_t *node) const
-    { return get_bits(node->size, 0x0FFFFFFFFFFFFFFFULL); }
-
-    inline auto is_unused(node_t *node) const
-    { return get_bits(node->size, 0xC000000000000000ULL) == 0x0000000000000000ULL; }
-
-    inline auto is_leaf(node_t *node) const
-    { return get_bits(node->size, 0xC000000000000000ULL) == 0x4000000000000000ULL; }
-
-    inline auto is_parent(node_t *node) const
-    { return get_bits(node->size, 0xC000000000000000ULL) == 0x8000000000000000ULL; }
+    static constexpr const uint32_t s_none = 0xFFFFFFFFU;
 
-    inline auto is_full(node_t *node) const
-    { return get_bits(node->size, 0xC000000000000000ULL) == 0xC000000000000000ULL; }
-
-    inline node_t *set_unused(node_t *node) noexcept
-    {
-        node->size = set_bits(node->size, 0xC000000000000000ULL, 0x0000000000000000ULL);
-        return node;
-    }
-
-    inline node_t *set_leaf(node_t *node) noexcept
-    {
-        node->size = set_bits(node->size, 0xC000000000000000ULL, 0x4000000000000000ULL);
-        return node;
-    }
-
-    inline node_t *set_parent(node_t *node) noexcept
-    {
-        node->size = set_bits(node->size, 0xC000000000000000ULL, 0x8000000000000000ULL);
-        return node;
-    }
-
-    inline node_t *set_full(node_t *node) noexcept
-    {
-        node->size = set_bits(node->size, 0xC000000000000000ULL, 0xC000000000000000ULL);
-        return node;
-    }
+    static constexpr const uint8_t s_free = 0x80U;
+    static constexpr const uint8_t s_used = 0x40U;
+    static constexpr const uint8_t s_order = 0x3FU;
 
 public:
 
@@ -164,7 +133,7 @@ public:
     /// @param k the size of the buffer using the formula:
     ///     (1ULL << k) * BAREFLANK_PAGE_SIZE
     /// @param node_tree the buffer that will be used to store the buddy
-    ///     allocators binary tree. This buffer is assume to be
+    ///     allocators bookkeeping. This buffer is assume to be
     ///     buddy_allocator::node_tree_size(k).
     ///
     buddy_allocator(
@@ -177,7 +146,7 @@ public:
 
     /// Integer Pointer Constructor
     ///
-    /// @expects none
+    /// @expects k < 32
     /// @ensures none
     ///
     /// @param buffer the buffer that the buddy allocator will manage. Note
@@ -186,21 +155,27 @@ public:
     /// @param k the size of the buffer using the formula:
     ///     (1ULL << k) * BAREFLANK_PAGE_SIZE
     /// @param node_tree the buffer that will be used to store the buddy
-    ///     allocators binary tree. This buffer is assume to be
+    ///     allocators bookkeeping. This buffer is assume to be
     ///     buddy_allocator::node_tree_size(k).
     ///
     buddy_allocator(
         integer_pointer buffer, size_type k, void *node_tree) noexcept
     {
+        m_k = gsl::narrow_cast<uint32_t>(k);
         m_buffer = buffer;
         m_buffer_size = this->buffer_size(k);
 
-        m_nodes = static_cast<node_t *>(node_tree);
-        m_nodes_view = gsl::span<node_t>(m_nodes, this->node_tree_size(k));
+        m_blocks = gsl::span<block_t>(
+            static_cast<block_t *>(node_tree),
+            gsl::narrow_cast<std::ptrdiff_t>(1ULL << k)
+        );
+
+        for (auto &block : m_blocks) {
+            block = {s_none, s_none, 0};
+        }
 
-        m_root = &m_nodes_view[m_node_index++];
-        m_root->ptr = m_buffer;
-        m_root->size = m_buffer_size;
+        m_heads.fill(s_none);
+        this->push(0, m_k);
     }
 
     /// Destructor
@@ -228,15 +203,40 @@ public:
             throw std::bad_alloc();
         }
 
-        if (size < BAREFLANK_PAGE_SIZE) {
-            size = BAREFLANK_PAGE_SIZE;
+        const auto order = this->size_to_order(size);
+
+        auto current = order;
+        while (current <= m_k && m_heads.at(current) == s_none) {
+            current++;
+        }
+
+        if (current > m_k) {
+            throw std::bad_alloc();
         }
 
-        if (auto ptr = this->private_allocate(next_power_2(size), nullptr, m_root)) {
-            return ptr;
+        const auto index = m_heads.at(current);
+        this->remove(index, current);
+
+        while (current > order) {
+            current--;
+            this->push(index + (1U << current), current);
+        }
+
+        m_blocks[index].tag = gsl::narrow_cast<uint8_t>(s_used | order);
+
+        m_used += this->order_to_size(order);
+        if (m_used > m_high_water) {
+            m_high_water = m_used;
         }
 
-        throw std::bad_alloc();
+        bfdebug_transaction(BUDDY_ALLOCATOR_DEBUG, [&](std::string * msg) {
+            bfdebug_info(BUDDY_ALLOCATOR_DEBUG, "allocate", msg);
+            bfdebug_subnhex(BUDDY_ALLOCATOR_DEBUG, "ptr", this->index_to_ptr(index), msg);
+            bfdebug_subnhex(BUDDY_ALLOCATOR_DEBUG, "size", this->order_to_size(order), msg);
+            bfdebug_brk2(BUDDY_ALLOCATOR_DEBUG, msg);
+        });
+
+        return reinterpret_cast<pointer>(this->index_to_ptr(index));
     }
 
     /// Deallocate
@@ -248,12 +248,38 @@ public:
     ///
     inline void deallocate(pointer ptr)
     {
-        if (ptr == nullptr) {
+        auto index = this->find_used(reinterpret_cast<integer_pointer>(ptr));
+        if (index == s_none) {
             return;
         }
 
-        this->private_deallocate(
-            reinterpret_cast<integer_pointer>(ptr), nullptr, m_root);
+        auto order = this->tag_to_order(m_blocks[index].tag);
+        m_blocks[index].tag = 0;
+
+        m_used -= this->order_to_size(order);
+
+        bfdebug_transaction(BUDDY_ALLOCATOR_DEBUG, [&](std::string * msg) {
+            bfdebug_info(BUDDY_ALLOCATOR_DEBUG, "deallocate", msg);
+            bfdebug_subnhex(BUDDY_ALLOCATOR_DEBUG, "ptr", this->index_to_ptr(index), msg);
+            bfdebug_subnhex(BUDDY_ALLOCATOR_DEBUG, "size", this->order_to_size(order), msg);
+            bfdebug_brk2(BUDDY_ALLOCATOR_DEBUG, msg);
+        });
+
+        while (order < m_k) {
+            const auto buddy = index ^ (1U << order);
+
+            if (m_blocks[buddy].tag != (s_free | order)) {
+                break;
+            }
+
+            this->remove(buddy, order);
+            m_blocks[buddy].tag = 0;
+
+            index &= ~(1U << order);
+            order++;
+        }
+
+        this->push(index, order);
     }
 
     /// Size
@@ -266,14 +292,12 @@ public:
     ///
     inline size_type size(pointer ptr) const
     {
-        if (ptr == nullptr) {
+        auto index = this->find_used(reinterpret_cast<integer_pointer>(ptr));
+        if (index == s_none) {
             return 0;
         }
 
-        return
-            this->private_size(
-                reinterpret_cast<integer_pointer>(ptr), nullptr, m_root
-            );
+        return this->order_to_size(this->tag_to_order(m_blocks[index].tag));
     }
 
     /// Contains Address
@@ -294,6 +318,46 @@ public:
         return (uintptr >= m_buffer) && (uintptr < m_buffer + m_buffer_size);
     }
 
+    /// Used
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of bytes that are currently allocated
+    ///
+    inline size_type used() const noexcept
+    { return m_used; }
+
+    /// High Water
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the largest number of bytes that were ever allocated at once
+    ///
+    inline size_type high_water() const noexcept
+    { return m_high_water; }
+
+    /// Largest Free
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the size of the largest free block (i.e. the largest
+    ///     allocation that would currently succeed), or 0 if the buddy
+    ///     allocator is full
+    ///
+    inline size_type largest_free() const noexcept
+    {
+        for (auto order = m_k + 1; order > 0; order--) {
+            if (m_heads.at(order - 1) != s_none) {
+                return this->order_to_size(order - 1);
+            }
+        }
+
+        return 0;
+    }
+
     /// Buffer Size
     ///
     /// @expects none
@@ -316,201 +380,105 @@ public:
     /// @return the size of the node tree given size k
     ///
     inline constexpr static size_type node_tree_size(size_type k) noexcept
-    { return ((2ULL << k) - 1ULL) * sizeof(node_t); }
+    { return (1ULL << k) * sizeof(block_t); }
 
 private:
 
-    void get_nodes(node_t *parent)
-    {
-        auto child0 = &m_nodes_view[m_node_index++];
-        auto child1 = &m_nodes_view[m_node_index++];
-
-        child0->size = this->get_size(parent) >> 1;
-        child1->size = this->get_size(parent) >> 1;
-
-        child0->ptr = parent->ptr;
-        child1->ptr = parent->ptr + child0->size;
-
-        parent->child0 = child0;
-        parent->child1 = child1;
-    }
-
-    pointer private_allocate(
-        size_type size, node_t *parent, node_t *node)
+    inline uint32_t size_to_order(size_type size) const noexcept
     {
-        if (this->is_leaf(node) || this->is_full(node)) {
-            return 0;
-        }
-
-        if (size == this->get_size(node)) {
-            if (this->is_unused(node)) {
-
-                bfdebug_transaction(BUDDY_ALLOCATOR_DEBUG, [&](std::string * msg) {
-                    bfdebug_info(BUDDY_ALLOCATOR_DEBUG, "allocate", msg);
-                    bfdebug_subnhex(BUDDY_ALLOCATOR_DEBUG, "ptr", node->ptr, msg);
-                    bfdebug_subnhex(BUDDY_ALLOCATOR_DEBUG, "size", this->get_size(node), msg);
-                    bfdebug_brk2(BUDDY_ALLOCATOR_DEBUG, msg);
-                });
-
-                return reinterpret_cast<pointer>(this->set_leaf(node)->ptr);
-            }
-        }
-        else {
-            if (!node->child0) {
-                this->get_nodes(node);
-            }
-
-            if (size == this->get_size(node->child0)) {
-                if (this->is_unused(node->child0)) {
-                    bfdebug_nhex(BUDDY_ALLOCATOR_DEBUG, "child0: unused", this->get_size(node));
-                    if (auto ptr = private_allocate_next(size, node, node->child0)) {
-                        return ptr;
-                    }
-                }
-            }
-            else {
-                if (!this->is_full(node->child0) && !this->is_leaf(node->child0)) {
-                    bfdebug_nhex(BUDDY_ALLOCATOR_DEBUG, "child0: !full", this->get_size(node));
-                    if (auto ptr = private_allocate_next(size, node, node->child0)) {
-                        return ptr;
-                    }
-                }
-            }
-
-            if (size == this->get_size(node->child1)) {
-                if (this->is_unused(node->child1)) {
-                    bfdebug_nhex(BUDDY_ALLOCATOR_DEBUG, "child1: unused", this->get_size(node));
-                    if (auto ptr = private_allocate_next(size, node, node->child1)) {
-                        return ptr;
-                    }
-                }
-            }
-            else {
-                if (!this->is_full(node->child1) && !this->is_leaf(node->child1)) {
-                    bfdebug_nhex(BUDDY_ALLOCATOR_DEBUG, "child1: !full", this->get_size(node));
-                    if (auto ptr = private_allocate_next(size, node, node->child1)) {
-                        return ptr;
-                    }
-                }
-            }
+        if (size < BAREFLANK_PAGE_SIZE) {
+            size = BAREFLANK_PAGE_SIZE;
         }
 
-        return nullptr;
+        const auto pages = next_power_2(size) / BAREFLANK_PAGE_SIZE;
+        return gsl::narrow_cast<uint32_t>(__builtin_ctzll(pages));
     }
 
-    pointer private_allocate_next(
-        size_type size, node_t *parent, node_t *node)
-    {
-        auto ptr = private_allocate(size, parent, node);
+    inline size_type order_to_size(uint32_t order) const noexcept
+    { return BAREFLANK_PAGE_SIZE << order; }
 
-        if (ptr && parent) {
-            this->set_parent(parent);
+    inline uint32_t tag_to_order(uint8_t tag) const noexcept
+    { return tag & s_order; }
 
-            if (this->is_leaf(parent->child0) && this->is_leaf(parent->child1)) {
-                this->set_full(parent);
-            }
+    inline integer_pointer index_to_ptr(uint32_t index) const noexcept
+    { return m_buffer + (index * BAREFLANK_PAGE_SIZE); }
 
-            if (this->is_leaf(parent->child0) && this->is_full(parent->child1)) {
-                this->set_full(parent);
-            }
+    inline void push(uint32_t index, uint32_t order) noexcept
+    {
+        auto &block = m_blocks[index];
+        auto &head = m_heads.at(order);
 
-            if (this->is_full(parent->child0) && this->is_leaf(parent->child1)) {
-                this->set_full(parent);
-            }
+        block.tag = gsl::narrow_cast<uint8_t>(s_free | order);
+        block.prev = s_none;
+        block.next = head;
 
-            if (this->is_full(parent->child0) && this->is_full(parent->child1)) {
-                this->set_full(parent);
-            }
+        if (head != s_none) {
+            m_blocks[head].prev = index;
         }
 
-        return ptr;
+        head = index;
     }
 
-private:
-
-    bool private_deallocate(
-        integer_pointer ptr, node_t *parent, node_t *node)
+    inline void remove(uint32_t index, uint32_t order) noexcept
     {
-        if (this->is_leaf(node)) {
+        auto &block = m_blocks[index];
 
-            bfdebug_transaction(BUDDY_ALLOCATOR_DEBUG, [&](std::string * msg) {
-                bfdebug_info(BUDDY_ALLOCATOR_DEBUG, "deallocate", msg);
-                bfdebug_subnhex(BUDDY_ALLOCATOR_DEBUG, "ptr", node->ptr, msg);
-                bfdebug_subnhex(BUDDY_ALLOCATOR_DEBUG, "size", this->get_size(node), msg);
-                bfdebug_brk2(BUDDY_ALLOCATOR_DEBUG, msg);
-            });
-
-            this->set_unused(node);
-            return true;
+        if (block.prev != s_none) {
+            m_blocks[block.prev].next = block.next;
         }
         else {
-            if (!node->child0) {
-                return false;
-            }
+            m_heads.at(order) = block.next;
+        }
 
-            if (ptr < node->child0->ptr + this->get_size(node->child0)) {
-                bfdebug_nhex(BUDDY_ALLOCATOR_DEBUG, "child0: equal", this->get_size(node));
-                return private_deallocate_next(ptr, node, node->child0);
-            }
-            else {
-                bfdebug_nhex(BUDDY_ALLOCATOR_DEBUG, "child0: not equal", this->get_size(node));
-                return private_deallocate_next(ptr, node, node->child1);
-            }
+        if (block.next != s_none) {
+            m_blocks[block.next].prev = block.prev;
         }
 
-        return false;
+        block.next = s_none;
+        block.prev = s_none;
     }
 
-    bool private_deallocate_next(
-        integer_pointer ptr, node_t *parent, node_t *node)
-    {
-        auto res = private_deallocate(ptr, parent, node);
-
-        if (res && parent) {
-            this->set_parent(parent);
+    // Note:
+    //
+    // Finds the used block that contains ptr. The only blocks that can
+    // contain a page are the ones that start at the page's index rounded
+    // down to each order, so these are checked from the smallest order to
+    // the largest. The search stops at the first block that is found.
+    //
 
-            if (this->is_unused(parent->child0) && this->is_unused(parent->child1)) {
-                this->set_unused(parent);
-            }
+    inline uint32_t find_used(integer_pointer ptr) const noexcept
+    {
+        if (ptr < m_buffer || ptr >= m_buffer + m_buffer_size) {
+            return s_none;
         }
 
-        return res;
-    }
+        const auto index = gsl::narrow_cast<uint32_t>((ptr - m_buffer) / BAREFLANK_PAGE_SIZE);
 
-private:
+        for (uint32_t order = 0; order <= m_k; order++) {
+            const auto start = index & ~((1U << order) - 1U);
+            const auto tag = m_blocks[start].tag;
 
-    size_type private_size(
-        integer_pointer ptr, node_t *parent, node_t *node) const
-    {
-        if (this->is_leaf(node)) {
-            return this->get_size(node);
-        }
-        else {
-            if (!node->child0) {
-                return 0;
+            if (tag == 0 || this->tag_to_order(tag) < order) {
+                continue;
             }
 
-            if (ptr < node->child0->ptr + this->get_size(node->child0)) {
-                return private_size(ptr, node, node->child0);
-            }
-            else {
-                return private_size(ptr, node, node->child1);
-            }
+            return (tag & s_used) != 0 ? start : s_none;
         }
 
-        return 0;
+        return s_none;
     }
 
 private:
 
     integer_pointer m_buffer{0};
     size_type m_buffer_size{0};
+    uint32_t m_k{0};
 
-    node_t *m_nodes{nullptr};
-    gsl::span<node_t> m_nodes_view;
+    size_type m_used{0};
+    size_type m_high_water{0};
 
-    node_t *m_root{nullptr};
-    size_type m_node_index{0};
+    gsl::span<block_t> m_blocks;
+    std::array<uint32_t, 32> m_heads{};
 
 public:
 
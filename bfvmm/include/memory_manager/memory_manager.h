@@ -22,14 +22,19 @@
 #ifndef MEMORY_MANAGER_H
 #define MEMORY_MANAGER_H
 
+#include <array>
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <unordered_map>
 
 #include <bfmemory.h>
 #include <bfconstants.h>
+#include <bfmemstatsinterface.h>
 
 #include "buddy_allocator.h"
 #include "object_allocator.h"
+#include "page_arena.h"
 
 // -----------------------------------------------------------------------------
 // Exports
@@ -107,12 +112,12 @@ public:
     using attr_type = decltype(memory_descriptor::type);            ///< Attribute type
     using memory_descriptor_list = std::vector<memory_descriptor>;  ///< Memory descriptor list type
 
-    /// Default Destructor
+    /// Destructor
     ///
     /// @expects none
     /// @ensures none
     ///
-    virtual ~memory_manager() = default;
+    virtual ~memory_manager();
 
     /// Get Singleton Instance
     ///
@@ -127,9 +132,12 @@ public:
 
     /// Allocate Memory
     ///
-    /// Allocates memory from the SLAB allocator. If the requested memory
-    /// is a page or larger, the memory is allocated using the page pool or
-    /// huge pool.
+    /// Allocates memory from the SLAB allocator, which is backed by the
+    /// SLAB pool (see SLAB_POOL_K), a block of the page pool that is set
+    /// aside for it when the memory manager is created. If the requested memory is larger than
+    /// 0x800 bytes, the memory is allocated using the page pool or huge
+    /// pool. SLAB allocations are served from the calling CPU's
+    /// magazine for the requested size class (see MAGAZINE_SIZE).
     ///
     /// @expects none
     /// @ensures none
@@ -172,7 +180,8 @@ public:
     /// Free Memory
     ///
     /// Deallocates a block of memory previously allocated by a call to
-    /// alloc
+    /// alloc. SLAB allocations are returned to the calling CPU's magazine
+    /// for the pointer's size class.
     ///
     /// @expects none
     /// @ensures none
@@ -402,10 +411,33 @@ public:
     ///
     virtual memory_descriptor_list descriptors() const;
 
+    /// Stats
+    ///
+    /// Fills in the current usage of each of the memory manager's pools and
+    /// SLAB allocators. The counters behind these stats are only updated
+    /// while the pools' locks are already held (for the SLAB allocators,
+    /// this is when a CPU's magazine is refilled or drained), so keeping
+    /// track of them adds nothing to the lock-free allocation paths.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param stats the mem_stats_t to fill in
+    ///
+    virtual void stats(gsl::not_null<mem_stats_t *> stats) const;
+
 private:
 
     memory_manager() noexcept;
 
+    static std::size_t slab_index(size_type size) noexcept;
+    std::size_t slab_index(pointer ptr) const noexcept;
+
+    pointer slab_allocate(std::size_t index);
+    pointer alloc_slab(std::size_t index) noexcept;
+    void free_slab(std::size_t index, pointer ptr) noexcept;
+    void drain(std::size_t index, pointer *objs, size_type num) noexcept;
+
 private:
 
     struct virt_t {
@@ -418,12 +450,48 @@ private:
         integer_pointer attr;
     };
 
+    struct extent_t {
+        integer_pointer from;
+        integer_pointer to;
+        size_type size;
+    };
+
+    struct extent_table_t {
+        uint64_t generation;
+        std::vector<extent_t> virt;
+        std::vector<extent_t> phys;
+    };
+
+    struct extent_guard {
+        explicit extent_guard(const memory_manager *self) noexcept;
+        ~extent_guard();
+
+        const memory_manager *m_self;
+        uint64_t m_epoch{};
+
+        extent_guard(extent_guard &&) = delete;
+        extent_guard &operator=(extent_guard &&) = delete;
+        extent_guard(const extent_guard &) = delete;
+        extent_guard &operator=(const extent_guard &) = delete;
+    };
+
+    void update_extents() const;
+    void build_extents(extent_table_t *table) const;
+
     std::unordered_map<integer_pointer, virt_t> m_virt_map;
     std::unordered_map<integer_pointer, phys_t> m_phys_map;
 
+    std::atomic<uint64_t> m_md_generation{1};
+    mutable std::atomic<const extent_table_t *> m_extents{nullptr};
+    mutable std::unique_ptr<extent_table_t> m_extent_table;
+    mutable std::atomic<uint64_t> m_extent_generation{};
+    mutable std::atomic<uint64_t> m_extent_epoch{};
+    mutable std::array<std::atomic<uint64_t>, 2> m_extent_readers{};
+
     buddy_allocator g_page_pool;
     buddy_allocator g_huge_pool;
     buddy_allocator g_mem_map_pool;
+    page_arena g_slab_pool;
 
     object_allocator slab010;
     object_allocator slab020;
@@ -435,6 +503,19 @@ private:
     object_allocator slab400;
     object_allocator slab800;
 
+    struct magazine_t {
+        size_type num;
+        std::array<pointer, MAGAZINE_SIZE> objs;
+    };
+
+    std::array<object_allocator *, 9> m_slabs;
+    std::array<size_type, 9> m_slab_used{};
+    std::array<size_type, 9> m_slab_high_water{};
+    std::array<std::atomic<uint8_t>, 1ULL << PAGE_POOL_K> m_slab_tags{};
+    std::array<std::array<magazine_t, 9>, MAGAZINE_MAX_CPUS> m_magazines{};
+
+    std::array<std::atomic<integer_pointer>, 1ULL << PAGE_POOL_K> m_page_pool_phys{};
+
 public:
 
     /// @cond
@@ -460,6 +541,23 @@ public:
 ///
 #define g_mm bfvmm::memory_manager::instance()
 
+/// Get Memory Stats
+///
+/// Copies a snapshot of the memory manager's stats into the provided
+/// buffer. Each pool is read while holding that pool's lock (see
+/// memory_manager::stats()), and nothing is shared between callers, so
+/// concurrent callers each get their own, consistent copy.
+///
+/// @expects stats != nullptr
+/// @ensures none
+///
+/// @param stats the buffer to copy the memory stats into
+/// @return GET_MEM_STATS_SUCCESS on success, GET_MEM_STATS_FAILURE
+///     otherwise
+///
+extern "C" EXPORT_MEMORY_MANAGER int64_t get_mem_stats(
+    struct mem_stats_t *stats) noexcept;
+
 /// Allocate Page
 ///
 /// This function allocates a page of memory directly from the page pool.
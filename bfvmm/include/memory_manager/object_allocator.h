@@ -26,6 +26,8 @@
 #include <bfexception.h>
 #include <bfconstants.h>
 
+#include "page_arena.h"
+
 // -----------------------------------------------------------------------------
 // Prototypes
 // -----------------------------------------------------------------------------
@@ -131,6 +133,12 @@ void __oa_free(S *ptr)
 /// use by the page pool, and does not include pages allocated for the
 /// allocator's internal stacks.
 ///
+/// By default, the pages that back allocations are allocated using
+/// alloc_page(). If a page arena is provided, these pages are allocated from
+/// the arena instead, which keeps them together, and out of the page pool.
+/// The pages used for the allocator's internal stacks are always allocated
+/// using alloc_page().
+///
 /// Limitations:
 /// - The largest allocation that can take place is a page. Any
 ///   allocation larger than this should use the buddy allocator
@@ -155,10 +163,14 @@ public:
     /// @param size the size of the object to allocate
     /// @param max_pages the max number of pages that may be used. 0 for
     ///     unlimited
+    /// @param arena the page arena to allocate pages from. nullptr to use
+    ///     alloc_page()
     ///
-    object_allocator(size_type size, size_type max_pages = 0) noexcept :
+    object_allocator(
+        size_type size, size_type max_pages = 0, page_arena *arena = nullptr) noexcept :
         m_size(size),
-        m_max_pages(max_pages)
+        m_max_pages(max_pages),
+        m_arena(arena)
     {
         guard_exceptions([&]() {
 
@@ -404,7 +416,7 @@ private:
         }
 
         auto page = &gsl::at(m_page_stack_top->pool, m_page_stack_top->index);
-        page->addr = static_cast<gsl::byte *>(alloc_page());
+        page->addr = static_cast<gsl::byte *>(m_arena != nullptr ? m_arena->allocate() : alloc_page());
         page->index = 0;
 
         ++m_pages_consumed;
@@ -502,7 +514,13 @@ private:
                 if (m_page_stack_top->index != 0) {
                     for (auto i = 0ULL; i < m_page_stack_top->index; ++i) {
                         auto page = &gsl::at(m_page_stack_top->pool, i);
-                        free_page(page->addr);
+
+                        if (m_arena != nullptr) {
+                            m_arena->deallocate(page->addr);
+                        }
+                        else {
+                            free_page(page->addr);
+                        }
                     }
                 }
 
@@ -534,6 +552,8 @@ private:
     size_type m_max_pages{0};
     size_type m_pages_consumed{0};
 
+    page_arena *m_arena{nullptr};
+
 public:
 
     /// @cond
@@ -0,0 +1,299 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// TIDY_EXCLUSION=-cppcoreguidelines-pro-type-reinterpret-cast
+//
+// Reason:
+//     Although in general this is a good rule, for hypervisor level code that
+//     interfaces with the kernel, and raw hardware, this rule is
+//     impractical.
+//
+
+#ifndef PAGE_ARENA_H
+#define PAGE_ARENA_H
+
+#include <new>
+#include <mutex>
+
+#include <bfgsl.h>
+#include <bfconstants.h>
+
+#include "buddy_allocator.h"
+
+// -----------------------------------------------------------------------------
+// Page Arena Definition
+// -----------------------------------------------------------------------------
+
+/// Page Arena
+///
+/// Hands out single pages from a contiguous, pre-allocated buffer of
+/// (1 << k) pages. Pages are handed out in order until the buffer has been
+/// used once, after which pages that have been returned are reused (most
+/// recently returned first). Since the buffer is contiguous, whether or not
+/// a pointer belongs to the arena is a range check, and the page a pointer
+/// belongs to can be converted into an index.
+///
+/// If an overflow allocator is provided, pages are allocated from it once
+/// all of the pages in the arena are in use, so the size of the arena
+/// bounds how many pages are kept together, and not how many pages can be
+/// allocated. Pages from the overflow allocator are returned to it when
+/// they are deallocated.
+///
+/// Limitations:
+/// - Only a single page can be allocated at a time. Use the buddy allocator
+///   for anything larger.
+/// - The arena is not thread-safe. The caller must serialize allocate()
+///   and deallocate(). The overflow allocator is only used while holding
+///   the overflow mutex, so it can be shared with code that does not know
+///   about the arena. contains() and index() can be called at any time.
+///
+class page_arena
+{
+public:
+
+    using pointer = void *;                 ///< Pointer type
+    using integer_pointer = uintptr_t;      ///< Integer pointer type
+    using size_type = std::size_t;          ///< Size type
+
+public:
+
+    /// Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param buffer the buffer to hand out pages from. The buffer must be
+    ///     page aligned, and must be page_arena::buffer_size(k) in size.
+    /// @param k the size of the buffer using the formula:
+    ///     (1ULL << k) * BAREFLANK_PAGE_SIZE
+    /// @param overflow the buddy allocator to allocate pages from once the
+    ///     arena is full. nullptr if allocate() should throw instead
+    /// @param overflow_mutex the mutex that serializes the overflow
+    ///     allocator. Must not be nullptr if overflow is not nullptr
+    ///
+    page_arena(
+        pointer buffer, size_type k,
+        buddy_allocator *overflow = nullptr, std::mutex *overflow_mutex = nullptr) noexcept :
+        m_buffer{reinterpret_cast<integer_pointer>(buffer)},
+        m_buffer_size{buffer_size(k)},
+        m_next{reinterpret_cast<integer_pointer>(buffer)},
+        m_overflow{overflow},
+        m_overflow_mutex{overflow_mutex}
+    { }
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    ~page_arena() noexcept = default;
+
+    /// Allocate
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return a pointer to a page. If all of the pages in the arena are
+    ///     in use, the page is allocated from the overflow allocator, and
+    ///     if there is no overflow allocator, std::bad_alloc is thrown
+    ///
+    inline pointer allocate()
+    {
+        if (auto page = m_free_list; page != nullptr) {
+            m_free_list = page->next;
+            page->next = nullptr;
+
+            m_num_used++;
+            return page;
+        }
+
+        if (m_next == m_buffer + m_buffer_size) {
+            if (m_overflow == nullptr) {
+                throw std::bad_alloc();
+            }
+
+            std::lock_guard<std::mutex> lock(*m_overflow_mutex);
+            auto page = m_overflow->allocate(BAREFLANK_PAGE_SIZE);
+
+            m_num_overflow++;
+            return page;
+        }
+
+        auto page = m_next;
+        m_next += BAREFLANK_PAGE_SIZE;
+
+        m_num_used++;
+        return reinterpret_cast<pointer>(page);
+    }
+
+    /// Deallocate
+    ///
+    /// Returns a page to the arena, or to the overflow allocator if the page
+    /// came from there. If ptr does not point to the start of a page in the
+    /// arena, or to a page of the overflow allocator, this function does
+    /// nothing.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param ptr a pointer to a page previously returned by allocate()
+    ///
+    inline void deallocate(pointer ptr) noexcept
+    {
+        auto addr = reinterpret_cast<integer_pointer>(ptr);
+
+        if ((addr & (BAREFLANK_PAGE_SIZE - 1)) != 0) {
+            return;
+        }
+
+        if (!this->contains(ptr)) {
+            if (m_overflow != nullptr && m_overflow->contains(ptr)) {
+                std::lock_guard<std::mutex> lock(*m_overflow_mutex);
+                m_overflow->deallocate(ptr);
+
+                m_num_overflow--;
+            }
+
+            return;
+        }
+
+        auto page = static_cast<free_page_t *>(ptr);
+        page->next = m_free_list;
+        m_free_list = page;
+
+        m_num_used--;
+    }
+
+    /// Contains
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param ptr to lookup
+    /// @return true if ptr is inside the arena's buffer, false otherwise
+    ///
+    inline bool contains(pointer ptr) const noexcept
+    {
+        auto addr = reinterpret_cast<integer_pointer>(ptr);
+        return addr >= m_buffer && addr < m_buffer + m_buffer_size;
+    }
+
+    /// Index
+    ///
+    /// @expects contains(ptr) == true
+    /// @ensures ret < num_pages()
+    ///
+    /// @param ptr a pointer to any address within a page of the arena
+    /// @return the index of the page that contains ptr
+    ///
+    inline size_type index(pointer ptr) const noexcept
+    { return (reinterpret_cast<integer_pointer>(ptr) - m_buffer) / BAREFLANK_PAGE_SIZE; }
+
+    /// Number of Pages
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the total number of pages in the arena
+    ///
+    inline size_type num_pages() const noexcept
+    { return m_buffer_size / BAREFLANK_PAGE_SIZE; }
+
+    /// Number of Used Pages
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of pages that are currently allocated
+    ///
+    inline size_type num_used() const noexcept
+    { return m_num_used; }
+
+    /// Number of Overflow Pages
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of pages that are currently allocated from the
+    ///     overflow allocator
+    ///
+    inline size_type num_overflow() const noexcept
+    { return m_num_overflow; }
+
+    /// Number of High Water Pages
+    ///
+    /// Pages are only taken from the untouched part of the arena once the
+    /// free list is empty (i.e. once every page that was handed out before
+    /// is in use), so the size of the touched part of the arena is the
+    /// largest number of pages that were ever in use at once.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the largest number of pages that were ever in use at once
+    ///
+    inline size_type num_high_water() const noexcept
+    { return (m_next - m_buffer) / BAREFLANK_PAGE_SIZE; }
+
+    /// Buffer Size
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param k the size of the buffer using the formula:
+    ///     (1ULL << k) * BAREFLANK_PAGE_SIZE
+    /// @return the size of buffer given size k
+    ///
+    inline constexpr static size_type buffer_size(size_type k) noexcept
+    { return (1ULL << k) * BAREFLANK_PAGE_SIZE; }
+
+private:
+
+    struct free_page_t {
+        free_page_t *next;
+    };
+
+    integer_pointer m_buffer;
+    size_type m_buffer_size;
+
+    integer_pointer m_next;
+    free_page_t *m_free_list{nullptr};
+
+    size_type m_num_used{0};
+
+    buddy_allocator *m_overflow{nullptr};
+    std::mutex *m_overflow_mutex{nullptr};
+    size_type m_num_overflow{0};
+
+public:
+
+    /// @cond
+
+    page_arena(page_arena &&) noexcept = delete;
+    page_arena &operator=(page_arena &&) noexcept = delete;
+
+    page_arena(const page_arena &) = delete;
+    page_arena &operator=(const page_arena &) = delete;
+
+    /// @endcond
+};
+
+#endif
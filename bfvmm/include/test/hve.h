@@ -92,6 +92,9 @@ extern "C" void vmcs_resume(
 extern "C" void exit_handler_entry(void)
 { }
 
+extern "C" void exit_handler_save_fpu(void) noexcept
+{ }
+
 auto
 setup_vcpu(MockRepository &mocks, ::intel_x64::vmcs::value_type reason = 0)
 {
@@ -116,6 +119,8 @@ setup_vcpu(MockRepository &mocks, ::intel_x64::vmcs::value_type reason = 0)
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::hlt_delegate);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::load);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::promote);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::enable_vmcs_write_back);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::disable_vmcs_write_back);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::add_handler);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::add_exit_handler);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::dump);
@@ -128,8 +133,20 @@ setup_vcpu(MockRepository &mocks, ::intel_x64::vmcs::value_type reason = 0)
 
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_eptp);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::disable_ept);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::ept_map).Return(nullptr);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::enable_vpid);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::disable_vpid);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::enable_vmcs_shadowing);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::disable_vmcs_shadowing);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::trap_on_vmread);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::pass_through_vmread);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::trap_on_vmwrite);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::pass_through_vmwrite);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::add_vmread_handler);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::add_vmwrite_handler);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::enable_dirty_logging);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::disable_dirty_logging);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::harvest_dirty_log).Return(0);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::trap_on_msr_access);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::pass_through_msr_access);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::add_wrcr0_handler);
@@ -222,12 +239,16 @@ setup_vcpu(MockRepository &mocks, ::intel_x64::vmcs::value_type reason = 0)
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_idt_base);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::idt_limit);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_idt_limit);
-    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::cr0);
-    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_cr0);
-    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::cr3);
-    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_cr3);
-    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::cr4);
-    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_cr4);
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::cr0).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::guest_cr0::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_cr0).Do([&](uint64_t val) { g_vmcs_fields[::intel_x64::vmcs::guest_cr0::addr] = val; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::cr3).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::guest_cr3::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_cr3).Do([&](uint64_t val) { g_vmcs_fields[::intel_x64::vmcs::guest_cr3::addr] = val; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::cr4).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::guest_cr4::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_cr4).Do([&](uint64_t val) { g_vmcs_fields[::intel_x64::vmcs::guest_cr4::addr] = val; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::cr0_read_shadow).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::cr0_read_shadow::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_cr0_read_shadow).Do([&](uint64_t val) { g_vmcs_fields[::intel_x64::vmcs::cr0_read_shadow::addr] = val; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::cr4_read_shadow).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::cr4_read_shadow::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_cr4_read_shadow).Do([&](uint64_t val) { g_vmcs_fields[::intel_x64::vmcs::cr4_read_shadow::addr] = val; });
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::ia32_efer);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::set_ia32_efer);
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::ia32_pat);
@@ -300,6 +321,14 @@ setup_vcpu(MockRepository &mocks, ::intel_x64::vmcs::value_type reason = 0)
 
     mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::save_state).Return(&g_save_state);
 
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::exit_reason).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::exit_reason::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::exit_qualification).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::exit_qualification::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::exit_instruction_length).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::vm_exit_instruction_length::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::exit_instruction_information).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::vm_exit_instruction_information::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::exit_interruption_information).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::vm_exit_interruption_information::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::guest_linear_address).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::guest_linear_address::addr]; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::guest_physical_address).Do([&] { return g_vmcs_fields[::intel_x64::vmcs::guest_physical_address::addr]; });
+
     g_vmcs_fields[::intel_x64::vmcs::exit_reason::addr] = reason;
     g_vmcs_fields[::intel_x64::vmcs::vm_exit_instruction_length::addr] = 42;
 
@@ -31,6 +31,8 @@ std::map<uint32_t, uint32_t> g_ebx_cpuid;
 std::map<uint32_t, uint32_t> g_ecx_cpuid;
 std::map<uint32_t, uint32_t> g_edx_cpuid;
 std::map<x64::portio::port_addr_type, x64::portio::port_32bit_type> g_ports;
+std::map<uint64_t, uint64_t> g_invept;
+std::map<uint64_t, uint64_t> g_invvpid;
 
 x64::rflags::value_type g_rflags = 0;
 
@@ -192,6 +194,48 @@ extern "C" void
 _outd(uint16_t port, uint32_t val) noexcept
 { g_ports[port] = val; }
 
+template<typename T>
+void
+test_ins(uint16_t port, uint64_t m, uint32_t count) noexcept
+{
+    for (auto i = 0U; i < count; i++) {
+        reinterpret_cast<T *>(m)[i] = gsl::narrow_cast<T>(g_ports[port]);
+    }
+}
+
+template<typename T>
+void
+test_outs(uint16_t port, uint64_t m, uint32_t count) noexcept
+{
+    for (auto i = 0U; i < count; i++) {
+        g_ports[port] = reinterpret_cast<T *>(m)[i];
+    }
+}
+
+extern "C" void
+_insbrep(uint16_t port, uint64_t m8, uint32_t count) noexcept
+{ test_ins<x64::portio::port_8bit_type>(port, m8, count); }
+
+extern "C" void
+_inswrep(uint16_t port, uint64_t m16, uint32_t count) noexcept
+{ test_ins<x64::portio::port_16bit_type>(port, m16, count); }
+
+extern "C" void
+_insdrep(uint16_t port, uint64_t m32, uint32_t count) noexcept
+{ test_ins<x64::portio::port_32bit_type>(port, m32, count); }
+
+extern "C" void
+_outsbrep(uint16_t port, uint64_t m8, uint32_t count) noexcept
+{ test_outs<x64::portio::port_8bit_type>(port, m8, count); }
+
+extern "C" void
+_outswrep(uint16_t port, uint64_t m16, uint32_t count) noexcept
+{ test_outs<x64::portio::port_16bit_type>(port, m16, count); }
+
+extern "C" void
+_outsdrep(uint16_t port, uint64_t m32, uint32_t count) noexcept
+{ test_outs<x64::portio::port_32bit_type>(port, m32, count); }
+
 extern "C" void
 _stop() noexcept
 { }
@@ -214,11 +258,11 @@ _invlpg(const void *addr) noexcept
 
 extern "C" bool
 _invept(uint64_t type, void *ptr) noexcept
-{ bfignored(ptr); return true; }
+{ bfignored(ptr); g_invept[type]++; return true; }
 
 extern "C" bool
 _invvpid(uint64_t type, void *ptr) noexcept
-{ bfignored(ptr); return true; }
+{ bfignored(ptr); g_invvpid[type]++; return true; }
 
 extern "C" void
 _cpuid(void *eax, void *ebx, void *ecx, void *edx) noexcept
@@ -269,6 +313,7 @@ bool g_vmxoff_fails = false;
 bool g_write_cr4_fails = false;
 
 std::map<uint64_t, uint64_t> g_vmcs_fields;
+uint64_t g_vmwrite_count = 0;
 
 extern "C" uint64_t
 _read_cr0(void) noexcept
@@ -338,6 +383,7 @@ _vmread(uint64_t field, uint64_t *value) noexcept
 extern "C" bool
 _vmwrite(uint64_t field, uint64_t value) noexcept
 {
+    g_vmwrite_count++;
     g_vmcs_fields[field] = value;
     return true;
 }
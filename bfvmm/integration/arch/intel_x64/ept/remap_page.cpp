@@ -98,7 +98,6 @@ public:
             auto [gpa1, unused1] = this->gva_to_gpa(buffer1.data());
             auto [gpa2, unused2] = this->gva_to_gpa(buffer2.data());
 
-            auto gpa1_2m = bfn::upper(gpa1, ::intel_x64::ept::pd::from);
             auto gpa1_4k = bfn::upper(gpa1, ::intel_x64::ept::pt::from);
             auto gpa2_4k = bfn::upper(gpa2, ::intel_x64::ept::pt::from);
 
@@ -107,13 +106,11 @@ public:
                 MAX_PHYS_ADDR
             );
 
-            ept::identity_map_convert_2m_to_4k(
-                g_guest_map,
-                gpa1_2m
-            );
+            while (g_guest_map.split(gpa1_4k) != ::intel_x64::ept::pt::from) { }
 
-            auto [pte, unused] = g_guest_map.entry(gpa1_4k);
-            ::intel_x64::ept::pt::entry::phys_addr::set(pte, gpa2_4k);
+            g_guest_map.update_entry(gpa1_4k, [&](auto & pte) {
+                ::intel_x64::ept::pt::entry::phys_addr::set(pte, gpa2_4k);
+            });
         });
 
         this->set_eptp(g_guest_map);
@@ -73,14 +73,11 @@ public:
             ept_violation_handler::handler_delegate_t::create<vcpu, &vcpu::test_write_violation_handler>(this)
         );
 
-        auto [pte, unused] =
-            g_guest_map.entry(
-                g_mm->virtptr_to_physint(buffer.data())
-            );
-
-        ::intel_x64::ept::pd::entry::read_access::disable(pte);
-        ::intel_x64::ept::pd::entry::write_access::disable(pte);
-        ::intel_x64::ept::pd::entry::execute_access::disable(pte);
+        g_guest_map.update_entry(g_mm->virtptr_to_physint(buffer.data()), [](auto & pte) {
+            ::intel_x64::ept::pd::entry::read_access::disable(pte);
+            ::intel_x64::ept::pd::entry::write_access::disable(pte);
+            ::intel_x64::ept::pd::entry::execute_access::disable(pte);
+        });
 
         this->set_eptp(g_guest_map);
     }
@@ -0,0 +1,132 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <bfgsl.h>
+#include <bfexception.h>
+
+#include <map>
+#include <mutex>
+#include <debug/exit_stats/exit_stats.h>
+
+// -----------------------------------------------------------------------------
+// Global
+// -----------------------------------------------------------------------------
+
+static std::mutex g_exit_stats_mutex;
+
+static auto &
+exit_stats_map() noexcept
+{
+    static std::map<vcpuid::type, exit_stats_t *> g_exit_stats;
+    return g_exit_stats;
+}
+
+extern "C" int64_t
+get_exit_stats(uint64_t vcpuid, struct exit_stats_t *stats) noexcept
+{
+    if (stats == nullptr) {
+        return GET_EXIT_STATS_FAILURE;
+    }
+
+    std::lock_guard<std::mutex> guard(g_exit_stats_mutex);
+
+    auto iter = exit_stats_map().find(vcpuid);
+    if (iter == exit_stats_map().end()) {
+        return GET_EXIT_STATS_FAILURE;
+    }
+
+    *stats = *iter->second;
+    return GET_EXIT_STATS_SUCCESS;
+}
+
+// -----------------------------------------------------------------------------
+// Exit Stats Implementation
+// -----------------------------------------------------------------------------
+
+namespace bfvmm
+{
+
+exit_stats::exit_stats(vcpuid::type vcpuid) noexcept :
+    m_vcpuid{vcpuid}
+{
+    guard_exceptions([&]() {
+        auto stats = std::make_unique<exit_stats_t>();
+        stats->tag = 0xE815E815E815E815;
+
+        std::lock_guard<std::mutex> guard(g_exit_stats_mutex);
+        exit_stats_map()[vcpuid] = stats.get();
+
+        m_stats = std::move(stats);
+    });
+}
+
+exit_stats::~exit_stats() noexcept
+{
+    if (!m_stats) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(g_exit_stats_mutex);
+
+    auto iter = exit_stats_map().find(m_vcpuid);
+    if (iter != exit_stats_map().end() && iter->second == m_stats.get()) {
+        exit_stats_map().erase(iter);
+    }
+}
+
+void
+exit_stats::record(uint64_t reason, uint64_t cycles) noexcept
+{
+    if (!m_stats || reason >= EXIT_STATS_NUM_REASONS) {
+        return;
+    }
+
+    auto index = gsl::narrow_cast<std::ptrdiff_t>(reason);
+    auto &hist = gsl::at(m_stats->hist, index);
+
+    gsl::at(m_stats->count, index)++;
+    gsl::at(hist, gsl::narrow_cast<std::ptrdiff_t>(bucket(cycles)))++;
+}
+
+void
+exit_stats::clear() noexcept
+{
+    if (!m_stats) {
+        return;
+    }
+
+    auto tag = m_stats->tag;
+
+    *m_stats = {};
+    m_stats->tag = tag;
+}
+
+uint64_t
+exit_stats::bucket(uint64_t cycles) noexcept
+{
+    auto log2 =
+        63ULL - static_cast<uint64_t>(__builtin_clzll(cycles | 1ULL));
+
+    return log2 < EXIT_STATS_NUM_BUCKETS ? log2 : EXIT_STATS_NUM_BUCKETS - 1;
+}
+
+}
@@ -37,6 +37,7 @@
 
 #include <vcpu/vcpu_manager.h>
 #include <debug/debug_ring/debug_ring.h>
+#include <debug/exit_stats/exit_stats.h>
 #include <memory_manager/memory_manager.h>
 
 #include <intrinsics.h>
@@ -135,6 +136,12 @@ bfmain(uintptr_t request, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3)
         case BF_REQUEST_GET_DRR:
             return get_drr(arg1, reinterpret_cast<debug_ring_resources_t **>(arg2));
 
+        case BF_REQUEST_GET_EXIT_STATS:
+            return get_exit_stats(arg1, reinterpret_cast<exit_stats_t *>(arg2));
+
+        case BF_REQUEST_GET_MEM_STATS:
+            return get_mem_stats(reinterpret_cast<mem_stats_t *>(arg1));
+
         case BF_REQUEST_VMM_INIT:
             return private_init_vmm(arg1);
 
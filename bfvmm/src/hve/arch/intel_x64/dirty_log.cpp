@@ -0,0 +1,362 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <hve/arch/intel_x64/vcpu.h>
+
+// Note:
+//
+// The PML buffer holds 512 guest physical addresses. The PML index is the
+// index of the next entry the CPU will write to, and is decremented after
+// each entry is written, so the valid entries are the ones above the
+// index. Once the buffer is full, the index wraps around to 0xFFFF (see
+// section 28.2.6 of the Intel SDM).
+//
+
+static constexpr const uint64_t s_pml_num_entries = 512;
+static constexpr const uint64_t s_pml_index_reset = s_pml_num_entries - 1;
+
+// Note:
+//
+// In write_protect mode, a page that dirty logging has write-protected is
+// marked using bit 11 of its EPT entry, which is ignored by the CPU. Since
+// the mark lives in the (shared) EPT map, any vCPU that faults on the page
+// knows it was write-protected for dirty logging and not by someone else,
+// and a page that was split while it was write-protected stays marked.
+//
+// The vCPU that enabled write_protect mode also registers its log with the
+// map (see ept::mmap::set_dirty_log()), so a vCPU sharing the map that has
+// not enabled dirty logging itself still resolves the fault, and the write
+// is logged to that vCPU instead. Since the bitmap can be written to by
+// other CPUs, it is only ever updated using atomic operations.
+//
+
+static constexpr const uint64_t s_write_protected = 0x0000000000000800ULL;
+static constexpr const uint64_t s_write_access = ::intel_x64::ept::pt::entry::write_access::mask;
+
+namespace bfvmm::intel_x64
+{
+
+dirty_log_handler::dirty_log_handler(
+    gsl::not_null<vcpu *> vcpu
+) :
+    m_vcpu{vcpu},
+    m_pml{make_nullptr_page<uint64_t>()}
+{
+    using namespace vmcs_n;
+
+    vcpu->add_handler(
+        exit_reason::basic_exit_reason::page_modification_log_full,
+        ::handler_delegate_t::create <
+        dirty_log_handler, &dirty_log_handler::handle > (this)
+    );
+
+    vcpu->add_handler(
+        exit_reason::basic_exit_reason::ept_violation,
+        ::handler_delegate_t::create <
+        dirty_log_handler, &dirty_log_handler::handle_ept_violation > (this)
+    );
+}
+
+dirty_log_handler::~dirty_log_handler()
+{
+    guard_exceptions([&]() {
+        if (m_mode == mode_t::write_protect) {
+            m_mmap->set_dirty_log({});
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------
+// Add Handler / Enablers
+// -----------------------------------------------------------------------------
+
+void
+dirty_log_handler::enable(ept::mmap &map, uintptr_t size)
+{
+    using namespace vmcs_n;
+    namespace ept_vpid_cap = ::intel_x64::msrs::ia32_vmx_ept_vpid_cap;
+
+    if (secondary_processor_based_vm_execution_controls::enable_pml::is_allowed1() &&
+        ept_vpid_cap::accessed_dirty_support::is_enabled()) {
+        this->enable(map, size, mode_t::pml);
+    }
+    else {
+        this->enable(map, size, mode_t::write_protect);
+    }
+}
+
+void
+dirty_log_handler::enable(ept::mmap &map, uintptr_t size, mode_t mode)
+{
+    using namespace vmcs_n;
+    namespace ept_vpid_cap = ::intel_x64::msrs::ia32_vmx_ept_vpid_cap;
+
+    if (mode == mode_t::pml) {
+        if (!secondary_processor_based_vm_execution_controls::enable_pml::is_allowed1() ||
+            ept_vpid_cap::accessed_dirty_support::is_disabled()) {
+            throw std::runtime_error("page modification logging is not supported");
+        }
+    }
+
+    this->disable();
+
+    if (mode == mode_t::pml && !m_pml) {
+        m_pml = make_page<uint64_t>();
+        m_pml_phys = g_mm->virtptr_to_physint(m_pml.get());
+    }
+
+    const auto num_pages = (size + ::intel_x64::ept::pt::page_size - 1) >> ::intel_x64::ept::pt::from;
+    m_bitmap.assign((num_pages + 63) >> 6, 0);
+
+    if (mode == mode_t::write_protect) {
+        map.set_dirty_log(
+            ept::mmap::dirty_log_delegate_t::create<dirty_log_handler, &dirty_log_handler::log>(this)
+        );
+    }
+
+    for (uintptr_t gpa = 0; gpa < size;) {
+        const auto from = mode == mode_t::pml ?
+                          map.clear_dirty(gpa) :
+                          map.update_flags(gpa, s_write_protected, s_write_access, s_write_access).second;
+
+        gpa = bfn::upper(gpa, from) + (1ULL << from);
+    }
+
+    m_mmap = &map;
+    m_mmap->shootdown();
+
+    if (mode == mode_t::pml) {
+        gsl::memset(gsl::span<uint64_t>(m_pml.get(), s_pml_num_entries), 0);
+
+        pml_address::set(m_pml_phys);
+        pml_index::set(s_pml_index_reset);
+        ept_pointer::accessed_and_dirty_flags::enable();
+        secondary_processor_based_vm_execution_controls::enable_pml::enable();
+    }
+
+    m_size = size;
+    m_mode = mode;
+}
+
+void
+dirty_log_handler::disable()
+{
+    using namespace vmcs_n;
+
+    switch (m_mode) {
+        case mode_t::pml:
+            this->drain();
+
+            secondary_processor_based_vm_execution_controls::enable_pml::disable();
+            ept_pointer::accessed_and_dirty_flags::disable();
+            break;
+
+        case mode_t::write_protect:
+            for (uintptr_t gpa = 0; gpa < m_size;) {
+                const auto from =
+                    m_mmap->update_flags(gpa, s_write_access, s_write_protected, s_write_protected).second;
+
+                gpa = bfn::upper(gpa, from) + (1ULL << from);
+            }
+
+            m_mmap->set_dirty_log({});
+            break;
+
+        default:
+            return;
+    }
+
+    m_mmap->shootdown();
+    m_mode = mode_t::none;
+}
+
+void
+dirty_log_handler::drain()
+{
+    using namespace vmcs_n;
+
+    if (m_mode != mode_t::pml) {
+        return;
+    }
+
+    const auto index = pml_index::get();
+    const auto first = index >= s_pml_num_entries ? 0 : index + 1;
+
+    gsl::span<uint64_t> pml(m_pml.get(), s_pml_num_entries);
+    for (auto i = first; i < s_pml_num_entries; i++) {
+        const auto gpa = pml.at(gsl::narrow_cast<std::ptrdiff_t>(i));
+        this->log(gpa, m_mmap->lookup(gpa).second);
+    }
+
+    pml_index::set(s_pml_index_reset);
+}
+
+std::size_t
+dirty_log_handler::harvest(gsl::span<uint64_t> bitmap)
+{
+    if (bitmap.size() < gsl::narrow_cast<std::ptrdiff_t>(m_bitmap.size())) {
+        throw std::runtime_error("dirty_log_handler::harvest: bitmap is too small");
+    }
+
+    if (m_mmap == nullptr) {
+        return 0;
+    }
+
+    this->drain();
+
+    std::size_t num_dirty{};
+    uintptr_t next{};
+
+    for (std::size_t i = 0; i < m_bitmap.size(); i++) {
+        auto word = __atomic_exchange_n(&m_bitmap.at(i), 0, __ATOMIC_RELAXED);
+        if (word == 0) {
+            continue;
+        }
+
+        bitmap.at(gsl::narrow_cast<std::ptrdiff_t>(i)) |= word;
+        num_dirty += gsl::narrow_cast<std::size_t>(__builtin_popcountll(word));
+
+        if (m_mode == mode_t::none) {
+            continue;
+        }
+
+        // Note:
+        //
+        // A large page sets all of the bits it covers, but it only has to
+        // be re-armed once, so the rest of its bits are skipped.
+        //
+
+        for (; word != 0; word &= word - 1) {
+            const auto gpa =
+                ((i << 6) + gsl::narrow_cast<uintptr_t>(__builtin_ctzll(word))) << ::intel_x64::ept::pt::from;
+
+            if (gpa < next) {
+                continue;
+            }
+
+            const auto from = this->rearm(gpa);
+            next = bfn::upper(gpa, from) + (1ULL << from);
+        }
+    }
+
+    m_mmap->shootdown();
+    return num_dirty;
+}
+
+// -----------------------------------------------------------------------------
+// Handlers
+// -----------------------------------------------------------------------------
+
+bool
+dirty_log_handler::handle(gsl::not_null<vcpu_t *> vcpu)
+{
+    bfignored(vcpu);
+
+    this->drain();
+    return true;
+}
+
+bool
+dirty_log_handler::handle_ept_violation(gsl::not_null<vcpu_t *> vcpu)
+{
+    using namespace vmcs_n;
+
+    if (exit_qualification::ept_violation::data_write::is_disabled(vcpu->exit_qualification())) {
+        return false;
+    }
+
+    if (m_mode != mode_t::write_protect) {
+        return this->handle_shared_ept_violation(vcpu);
+    }
+
+    const auto gpa = vcpu->guest_physical_address();
+    if (gpa >= m_size) {
+        return false;
+    }
+
+    // Note:
+    //
+    // No INVEPT is needed here. An EPT violation invalidates the mappings
+    // used to translate the address that caused it, and the page is being
+    // made more permissive. If the page is already writable, another vCPU
+    // handled the same page first, and the write only has to be retried.
+    //
+
+    const auto [entry, from] =
+        m_mmap->update_flags(gpa, s_write_access, s_write_protected, s_write_protected);
+
+    if ((entry & s_write_protected) != 0) {
+        this->log(gpa, from);
+        return true;
+    }
+
+    return (entry & s_write_access) != 0;
+}
+
+bool
+dirty_log_handler::handle_shared_ept_violation(gsl::not_null<vcpu_t *> vcpu)
+{
+    // Note:
+    //
+    // This vCPU is not logging writes itself, but it might share its map
+    // with a vCPU that is. If the page was write-protected for dirty
+    // logging, it is made writable again and the write is logged to the
+    // vCPU that write-protected it (see ept::mmap::log_write()).
+    //
+
+    auto map = vcpu->ept_map();
+    if (map == nullptr) {
+        return false;
+    }
+
+    const auto ret =
+        map->log_write(vcpu->guest_physical_address(), s_write_access, s_write_protected, s_write_protected);
+
+    return (ret.first & s_write_protected) != 0;
+}
+
+void
+dirty_log_handler::log(uintptr_t gpa, uintptr_t from)
+{
+    if (from == 0) {
+        from = ::intel_x64::ept::pt::from;
+    }
+
+    const auto num_pages = m_bitmap.size() << 6;
+    const auto first = bfn::upper(gpa, from) >> ::intel_x64::ept::pt::from;
+    const auto last = std::min<uintptr_t>(first + (1ULL << (from - ::intel_x64::ept::pt::from)), num_pages);
+
+    for (auto page = first; page < last; page++) {
+        __atomic_fetch_or(&m_bitmap.at(page >> 6), 1ULL << (page & 63U), __ATOMIC_RELAXED);
+    }
+}
+
+uintptr_t
+dirty_log_handler::rearm(uintptr_t gpa)
+{
+    if (m_mode == mode_t::pml) {
+        return m_mmap->clear_dirty(gpa);
+    }
+
+    return m_mmap->update_flags(gpa, s_write_protected, s_write_access, s_write_access).second;
+}
+
+}
@@ -23,6 +23,9 @@ bits 64
 default rel
 
 extern default_esr
+extern exit_handler_save_fpu
+
+%define CR0_TS 0x8
 
 section .text
 
@@ -110,6 +113,19 @@ section .text
         iretq
 %endmacro
 
+%macro ESR_NOERRCODE_FATAL 1
+    _esr%1_fatal:
+        PUSHALL
+        mov rdi, %1
+        mov rsi, 0
+        mov rdx, 0
+        mov rcx, rsp
+        mov r8,  [gs:0x098]
+        call default_esr wrt ..plt
+        POPALL
+        iretq
+%endmacro
+
 %macro ESR_ERRCODE 1
     global _esr%1
     _esr%1:
@@ -131,7 +147,6 @@ ESR_NOERRCODE 3
 ESR_NOERRCODE 4
 ESR_NOERRCODE 5
 ESR_NOERRCODE 6
-ESR_NOERRCODE 7
 ESR_ERRCODE   8
 ESR_NOERRCODE 9
 ESR_ERRCODE   10
@@ -156,3 +171,31 @@ ESR_NOERRCODE 28
 ESR_NOERRCODE 29
 ESR_NOERRCODE 30
 ESR_NOERRCODE 31
+
+; Device Not Available (#NM)
+;
+; The host's CR0.TS bit is set on every VM exit, which means that the first
+; FPU/SIMD instruction executed by the VMM after a VM exit lands here. When
+; that happens, the guest's FPU/SIMD state is saved and CR0.TS is cleared so
+; that the faulting instruction can be retried. Any other #NM is fatal.
+;
+global _esr7
+_esr7:
+    push rax
+    mov rax, cr0
+    test rax, CR0_TS
+    jz .fatal
+
+    push rcx
+    push rdx
+    call exit_handler_save_fpu wrt ..plt
+    pop rdx
+    pop rcx
+    pop rax
+    iretq
+
+.fatal:
+    pop rax
+    jmp _esr7_fatal
+
+ESR_NOERRCODE_FATAL 7
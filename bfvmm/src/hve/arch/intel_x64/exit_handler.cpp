@@ -68,6 +68,7 @@ setup()
     using namespace ::intel_x64::cpuid;
 
     using namespace bfvmm::x64;
+    using namespace bfvmm::x64::cr3;
     using attr_type = bfvmm::x64::cr3::mmap::attr_type;
 
     for (const auto &md : g_mm->descriptors()) {
@@ -79,6 +80,8 @@ setup()
         g_cr3->map_4k(md.virt, md.phys, attr_type::read_write);
     }
 
+    init_vmm_direct_map();
+
     g_ia32_efer_msr |= msrs::ia32_efer::lme::mask;
     g_ia32_efer_msr |= msrs::ia32_efer::lma::mask;
     g_ia32_efer_msr |= msrs::ia32_efer::nxe::mask;
@@ -227,12 +230,12 @@ emulate_wrmsr(::x64::msrs::field_type msr, ::x64::msrs::value_type val)
 }
 
 uintptr_t
-emulate_rdgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu)
+emulate_rdgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, uint64_t reg)
 {
     using namespace ::intel_x64::vmcs;
     using namespace exit_qualification::control_register_access;
 
-    switch (general_purpose_register::get()) {
+    switch (reg) {
         case general_purpose_register::rax:
             return vcpu->rax();
 
@@ -284,12 +287,12 @@ emulate_rdgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu)
 }
 
 void
-emulate_wrgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, uintptr_t val)
+emulate_wrgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, uint64_t reg, uintptr_t val)
 {
     using namespace ::intel_x64::vmcs;
     using namespace exit_qualification::control_register_access;
 
-    switch (general_purpose_register::get()) {
+    switch (reg) {
         case general_purpose_register::rax:
             vcpu->set_rax(val);
             return;
@@ -356,6 +359,24 @@ emulate_wrgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, uintptr_t val)
     }
 }
 
+uintptr_t
+emulate_rdgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu)
+{
+    using namespace ::intel_x64::vmcs;
+    using namespace exit_qualification::control_register_access;
+
+    return emulate_rdgpr(vcpu, general_purpose_register::get(vcpu->exit_qualification()));
+}
+
+void
+emulate_wrgpr(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, uintptr_t val)
+{
+    using namespace ::intel_x64::vmcs;
+    using namespace exit_qualification::control_register_access;
+
+    emulate_wrgpr(vcpu, general_purpose_register::get(vcpu->exit_qualification()), val);
+}
+
 // -----------------------------------------------------------------------------
 // Handlers
 // -----------------------------------------------------------------------------
@@ -427,13 +448,13 @@ handle_wrcr4(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu)
     using namespace ::intel_x64::vmcs;
     using namespace exit_qualification::control_register_access;
 
-    switch (control_register_number::get()) {
+    switch (control_register_number::get(vcpu->exit_qualification())) {
         case 4: {
             auto val = emulate_rdgpr(vcpu);
-            cr4_read_shadow::set(val);
+            vcpu->set_cr4_read_shadow(val);
 
             val |= ::intel_x64::cr4::vmx_enable_bit::mask;
-            guest_cr4::set(val);
+            vcpu->set_cr4(val);
 
             return vcpu->advance();
         }
@@ -459,7 +480,8 @@ exit_handler::exit_handler(
 ) :
     m_vcpu{vcpu},
     m_ist1{std::make_unique<gsl::byte[]>(STACK_SIZE * 2)},
-    m_stack{std::make_unique<gsl::byte[]>(STACK_SIZE * 2)}
+    m_stack{std::make_unique<gsl::byte[]>(STACK_SIZE * 2)},
+    m_exit_stats{vcpu->id()}
 {
     using namespace bfvmm::x64;
     using namespace ::intel_x64::vmcs;
@@ -521,12 +543,31 @@ void
 exit_handler::add_handler(
     ::intel_x64::vmcs::value_type reason,
     const handler_delegate_t &d)
-{ m_exit_handlers_array.at(reason).push_front(d); }
+{ this->add_to_entry(m_exit_handlers_array.at(reason), d); }
 
 void
 exit_handler::add_exit_handler(
     const handler_delegate_t &d)
-{ m_exit_handlers.push_front(d); }
+{ this->add_to_entry(m_exit_handlers, d); }
+
+void
+exit_handler::seal() noexcept
+{ m_sealed = true; }
+
+void
+exit_handler::add_to_entry(
+    handler_table_entry_t &entry, const handler_delegate_t &d)
+{
+    if (m_sealed) {
+        throw std::runtime_error("exit_handler: cannot add handler once sealed");
+    }
+
+    if (entry.size == entry.delegates.size()) {
+        throw std::runtime_error("exit_handler: MAX_HANDLERS_PER_EXIT_REASON reached");
+    }
+
+    entry.delegates.at(entry.size++) = d;
+}
 
 void
 exit_handler::add_init_handler(
@@ -552,10 +593,21 @@ exit_handler::write_host_state()
     host_ia32_pat::set(g_ia32_pat_msr);
     host_ia32_efer::set(g_ia32_efer_msr);
 
-    host_cr0::set(g_cr0_reg);
+    // Note:
+    //
+    // CR0.TS is set on every VM exit so that the guest's FPU/SIMD state is
+    // only saved if the VMM actually uses the FPU/SIMD registers. See
+    // exit_handler_save_fpu for more details.
+    //
+
+    host_cr0::set(g_cr0_reg | ::intel_x64::cr0::task_switched::mask);
     host_cr3::set(g_cr3_reg);
     host_cr4::set(g_cr4_reg);
 
+    if (::intel_x64::cpuid::feature_information::ecx::xsave::is_enabled()) {
+        m_vcpu->save_state()->fpu_flags |= SAVE_STATE_FPU_XSAVE;
+    }
+
     host_gs_base::set(reinterpret_cast<uintptr_t>(m_vcpu->save_state().get()));
     host_tr_base::set(m_host_gdt.base(5));
 
@@ -729,21 +781,20 @@ exit_handler::handle(
 {
     using namespace ::intel_x64::vmcs;
 
+    exit_handler->m_vcpu->invalidations()->exited();
+
     guard_exceptions([&]() {
 
-        for (const auto &d : exit_handler->m_exit_handlers) {
-            d(exit_handler->m_vcpu);
-        }
+        const auto start = ::x64::read_tsc::get();
+        const auto reason =
+            exit_reason::basic_exit_reason::get(exit_handler->m_vcpu->exit_reason());
 
-        const auto &handlers =
-            exit_handler->m_exit_handlers_array.at(
-                exit_reason::basic_exit_reason::get()
+        if (exit_handler->dispatch(reason)) {
+            exit_handler->m_exit_stats.record(
+                reason, ::x64::read_tsc::get() - start
             );
 
-        for (const auto &d : handlers) {
-            if (d(exit_handler->m_vcpu)) {
-                exit_handler->m_vcpu->run();
-            }
+            exit_handler->m_vcpu->run();
         }
 
         bfdebug_transaction(0, [&](std::string * msg) {
@@ -766,6 +817,24 @@ exit_handler::handle(
     exit_handler->m_vcpu->halt();
 }
 
+bool
+exit_handler::dispatch(::intel_x64::vmcs::value_type reason)
+{
+    const auto &exit_handlers = m_exit_handlers;
+    for (auto i = exit_handlers.size; i > 0; i--) {
+        exit_handlers.delegates.at(i - 1)(m_vcpu);
+    }
+
+    const auto &handlers = m_exit_handlers_array.at(reason);
+    for (auto i = handlers.size; i > 0; i--) {
+        if (handlers.delegates.at(i - 1)(m_vcpu)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 bool
 exit_handler::handle_cpuid(
     gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu)
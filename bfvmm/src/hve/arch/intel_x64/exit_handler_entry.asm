@@ -25,8 +25,20 @@ default rel
 %define VMCS_GUEST_RSP 0x0000681C
 %define VMCS_GUEST_RIP 0x0000681E
 
+%define SAVE_STATE_FPU_FLAGS        0x088
+%define SAVE_STATE_FPU_SAVED        0x090
+%define SAVE_STATE_XSAVE_AREA       0x400
+
+%define SAVE_STATE_FPU_XSAVE        0x1
+%define SAVE_STATE_FPU_SAVED_XSAVE  0x1
+%define SAVE_STATE_FPU_SAVED_FXSAVE 0x2
+
+%define XCR0_SSE                    0x2
+%define XSAVE_MASK                  0xE7
+
 extern _ZN5bfvmm9intel_x6412exit_handler6handleEPS1_
 global exit_handler_entry:function
+global exit_handler_save_fpu:function
 
 section .text
 
@@ -39,6 +51,10 @@ section .text
 ; and RSP is the exit_handler_stack). So the only job that this entry point
 ; has is to preserve the state of the guest
 ;
+; Note that the FPU/SIMD registers are not saved here. The host's CR0.TS bit
+; is set on every VM exit, so the guest's FPU/SIMD state is only saved (see
+; exit_handler_save_fpu) if the VMM actually uses these registers.
+;
 exit_handler_entry:
 
     mov [gs:0x000], rax
@@ -57,15 +73,6 @@ exit_handler_entry:
     mov [gs:0x068], r14
     mov [gs:0x070], r15
 
-    movdqa [gs:0x0C0], xmm0
-    movdqa [gs:0x0E0], xmm1
-    movdqa [gs:0x100], xmm2
-    movdqa [gs:0x120], xmm3
-    movdqa [gs:0x140], xmm4
-    movdqa [gs:0x160], xmm5
-    movdqa [gs:0x180], xmm6
-    movdqa [gs:0x1A0], xmm7
-
     mov rdi, VMCS_GUEST_RIP
     vmread [gs:0x078], rdi
     mov rdi, VMCS_GUEST_RSP
@@ -80,3 +87,38 @@ exit_handler_entry:
 ; resume doesn't happen.
 
     hlt
+
+; Exit Handler Save FPU
+;
+; Saves the guest's FPU/SIMD state to the save state of the vCPU that exited
+; and clears CR0.TS so that the VMM is free to use these registers. This is
+; called by the #NM handler the first time the VMM touches the FPU/SIMD
+; registers after a VM exit, and prior to loading a different VMCS. XSAVE is
+; used if it is supported and the guest's XCR0 enables SSE, otherwise FXSAVE
+; is used. Only RAX, RCX and RDX are modified.
+;
+exit_handler_save_fpu:
+
+    clts
+
+    test qword [gs:SAVE_STATE_FPU_FLAGS], SAVE_STATE_FPU_XSAVE
+    jz .fxsave
+
+    xor ecx, ecx
+    xgetbv
+    test eax, XCR0_SSE
+    jz .fxsave
+
+    mov eax, XSAVE_MASK
+    xor edx, edx
+    xsave64 [gs:SAVE_STATE_XSAVE_AREA]
+    mov qword [gs:SAVE_STATE_FPU_SAVED], SAVE_STATE_FPU_SAVED_XSAVE
+
+    ret
+
+.fxsave:
+
+    fxsave64 [gs:SAVE_STATE_XSAVE_AREA]
+    mov qword [gs:SAVE_STATE_FPU_SAVED], SAVE_STATE_FPU_SAVED_FXSAVE
+
+    ret
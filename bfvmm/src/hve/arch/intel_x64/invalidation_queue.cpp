@@ -0,0 +1,162 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <hve/arch/intel_x64/vcpu.h>
+
+// Note:
+//
+// The requests that can be queued from any CPU are stored as flags, which
+// are set and taken atomically. The individual addresses are only ever
+// queued by the CPU that is executing the vCPU.
+//
+// Each of these requests also takes a ticket once its flag is set. flush()
+// marks the vCPU as executing guest code and then reads the last ticket
+// that was taken before taking the flags, so every ticket up to that one
+// is covered by the flags it executes. A CPU waiting on a ticket either
+// sees that the vCPU is not executing guest code (so the vCPU is certain
+// to see the flag before its next VM entry), or waits for the flush that
+// covers its ticket.
+//
+
+static constexpr const uint32_t s_invept_single_context = 0x1U;
+static constexpr const uint32_t s_invept_global = 0x2U;
+static constexpr const uint32_t s_invvpid_single_context = 0x4U;
+
+namespace bfvmm::intel_x64
+{
+
+uint64_t
+invalidation_queue::invept_single_context() noexcept
+{
+    m_requested.fetch_add(1, std::memory_order_relaxed);
+    m_pending.fetch_or(s_invept_single_context);
+
+    return m_tickets.fetch_add(1) + 1;
+}
+
+uint64_t
+invalidation_queue::invept_global() noexcept
+{
+    m_requested.fetch_add(1, std::memory_order_relaxed);
+    m_pending.fetch_or(s_invept_global);
+
+    return m_tickets.fetch_add(1) + 1;
+}
+
+void
+invalidation_queue::invvpid_individual_address(uintptr_t gva) noexcept
+{
+    m_requested.fetch_add(1, std::memory_order_relaxed);
+    gva = bfn::upper(gva);
+
+    for (std::size_t i = 0; i < m_num_addresses; i++) {
+        if (m_addresses.at(i) == gva) {
+            return;
+        }
+    }
+
+    if (m_num_addresses == m_addresses.size()) {
+        m_pending.fetch_or(s_invvpid_single_context, std::memory_order_release);
+        return;
+    }
+
+    m_addresses.at(m_num_addresses++) = gva;
+}
+
+uint64_t
+invalidation_queue::invvpid_single_context() noexcept
+{
+    m_requested.fetch_add(1, std::memory_order_relaxed);
+    m_pending.fetch_or(s_invvpid_single_context);
+
+    return m_tickets.fetch_add(1) + 1;
+}
+
+void
+invalidation_queue::flush()
+{
+    using namespace vmcs_n;
+    using namespace vmcs_n::secondary_processor_based_vm_execution_controls;
+    namespace ept_vpid_cap = ::intel_x64::msrs::ia32_vmx_ept_vpid_cap;
+
+    m_in_guest.store(true);
+    const auto ticket = m_tickets.load();
+
+    if (this->empty()) {
+        m_completed.store(ticket, std::memory_order_release);
+        return;
+    }
+
+    const auto pending = m_pending.exchange(0, std::memory_order_acquire);
+    const auto num_addresses = std::exchange(m_num_addresses, 0);
+
+    auto ___ = gsl::finally([&] {
+        m_completed.store(ticket, std::memory_order_release);
+    });
+
+    if ((pending & (s_invept_single_context | s_invept_global)) != 0) {
+        if ((pending & s_invept_global) == 0 &&
+            ept_pointer::phys_addr::get() != 0 &&
+            ept_vpid_cap::invept_single_context_support::is_enabled()) {
+            ::intel_x64::vmx::invept_single_context(ept_pointer::get());
+        }
+        else {
+            ::intel_x64::vmx::invept_global();
+        }
+
+        m_issued++;
+
+        if (enable_ept::is_enabled()) {
+            return;
+        }
+    }
+
+    if ((pending & s_invvpid_single_context) == 0 && num_addresses == 0) {
+        return;
+    }
+
+    if (enable_vpid::is_disabled()) {
+        return;
+    }
+
+    const auto vpid = virtual_processor_identifier::get();
+
+    if ((pending & s_invvpid_single_context) != 0 ||
+        ept_vpid_cap::invvpid_individual_address_support::is_disabled()) {
+
+        if (ept_vpid_cap::invvpid_single_context_support::is_enabled()) {
+            ::intel_x64::vmx::invvpid_single_context(vpid);
+        }
+        else {
+            ::intel_x64::vmx::invvpid_all_contexts();
+        }
+
+        m_issued++;
+        return;
+    }
+
+    for (std::size_t i = 0; i < num_addresses; i++) {
+        ::intel_x64::vmx::invvpid_individual_address(vpid, m_addresses.at(i));
+        m_issued++;
+    }
+}
+
+}
@@ -27,6 +27,10 @@
 //     impractical.
 //
 
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
 #include <hve/arch/intel_x64/vcpu.h>
 
 // -----------------------------------------------------------------------------
@@ -70,6 +74,7 @@ vcpu::vcpu(
     m_ept_handler{this},
     m_microcode_handler{this},
     m_vpid_handler{this},
+    m_dirty_log_handler{this},
     m_preemption_timer_handler{this}
 {
     using namespace vmcs_n;
@@ -82,6 +87,34 @@ vcpu::vcpu(
         hlt_delegate_t::create<intel_x64::vcpu, &intel_x64::vcpu::hlt_delegate>(this)
     );
 
+    // Note:
+    //
+    // The shadow VMCS is allocated lazily, which usually happens from a VM
+    // exit (e.g. a nested hypervisor's VMXON / VMPTRLD), long after the exit
+    // handler has been sealed. For this reason, the VMREAD / VMWRITE exit
+    // handlers are registered here, and forward to the shadow VMCS once it
+    // exists.
+    //
+
+    this->add_handler(
+        exit_reason::basic_exit_reason::vmread,
+        ::handler_delegate_t::create<intel_x64::vcpu, &intel_x64::vcpu::handle_vmread>(this)
+    );
+
+    this->add_handler(
+        exit_reason::basic_exit_reason::vmwrite,
+        ::handler_delegate_t::create<intel_x64::vcpu, &intel_x64::vcpu::handle_vmwrite>(this)
+    );
+
+    this->add_exit_handler(
+        ::handler_delegate_t::create<intel_x64::vcpu, &intel_x64::vcpu::handle_gva_tlb>(this)
+    );
+
+    m_preemption_timer_handler.add_handler(
+        preemption_timer_handler::handler_delegate_t::create <
+        intel_x64::vcpu, &intel_x64::vcpu::handle_shootdown_timer > (this)
+    );
+
     m_vmcs.save_state()->vcpu_ptr =
         reinterpret_cast<uintptr_t>(this);
 
@@ -98,6 +131,15 @@ vcpu::vcpu(
     this->enable_vpid();
 }
 
+vcpu::~vcpu()
+{
+    guard_exceptions([&]() {
+        if (m_mmap != nullptr) {
+            m_mmap->detach(&m_invalidation_queue);
+        }
+    });
+}
+
 void
 vcpu::run_delegate(bfobject *obj)
 {
@@ -113,19 +155,50 @@ vcpu::run_delegate(bfobject *obj)
 
     bfignored(obj);
 
+    // Note:
+    //
+    // The map cache may only be used by the CPU that executes this vCPU,
+    // which is the CPU that is about to enter the guest. Every exit this
+    // vCPU handles happens on this CPU until the next VM entry.
+    //
+
+    m_map_cache.set_owner();
+
+    // Note:
+    //
+    // flush() marks the vCPU as being in the guest, so that CPUs performing
+    // a shootdown wait for it to exit. If the VM entry fails, no VM exit
+    // will ever tell the queue that the vCPU left the guest, so this is
+    // done here instead, otherwise those CPUs would wait forever.
+    //
+
     if (m_launched) {
-        m_vmcs.resume();
+        this->expire_gva_tlb();
+
+        try {
+            m_invalidation_queue.flush();
+            m_vmcs.resume();
+        }
+        catch (...) {
+            m_invalidation_queue.exited();
+            throw;
+        }
     }
     else {
 
         m_launched = true;
+        m_exit_handler.seal();
 
         try {
             m_vmcs.load();
+
+            this->expire_gva_tlb();
+            m_invalidation_queue.flush();
             m_vmcs.launch();
         }
         catch (...) {
             m_launched = false;
+            m_invalidation_queue.exited();
             throw;
         }
 
@@ -151,6 +224,14 @@ void
 vcpu::promote()
 { m_vmcs.promote(); }
 
+void
+vcpu::enable_vmcs_write_back() noexcept
+{ m_vmcs.enable_write_back(); }
+
+void
+vcpu::disable_vmcs_write_back()
+{ m_vmcs.disable_write_back(); }
+
 void
 vcpu::add_handler(
     ::intel_x64::vmcs::value_type reason,
@@ -222,9 +303,7 @@ vcpu::halt(const std::string &str)
 bool
 vcpu::advance()
 {
-    using namespace ::intel_x64::vmcs;
-
-    this->set_rip(this->rip() + vm_exit_instruction_length::get());
+    this->set_rip(this->rip() + this->exit_instruction_length());
     return true;
 }
 
@@ -239,17 +318,45 @@ vcpu::advance()
 void
 vcpu::set_eptp(ept::mmap &map)
 {
+    if (m_mmap != &map) {
+        m_dirty_log_handler.disable();
+
+        if (m_mmap != nullptr) {
+            m_mmap->detach(&m_invalidation_queue);
+        }
+
+        map.attach(&m_invalidation_queue);
+        this->enable_shootdown_timer();
+    }
+
     m_ept_handler.set_eptp(&map);
     m_mmap = &map;
+
+    this->flush_gpa_tlb();
+    this->flush_gva_tlb();
 }
 
 void
 vcpu::disable_ept()
 {
+    m_dirty_log_handler.disable();
     m_ept_handler.set_eptp(nullptr);
+
+    if (m_mmap != nullptr) {
+        m_mmap->detach(&m_invalidation_queue);
+    }
+
+    this->disable_shootdown_timer();
     m_mmap = nullptr;
+
+    this->flush_gpa_tlb();
+    this->flush_gva_tlb();
 }
 
+ept::mmap *
+vcpu::ept_map() const
+{ return m_mmap; }
+
 //--------------------------------------------------------------------------
 // VPID
 //--------------------------------------------------------------------------
@@ -262,6 +369,111 @@ void
 vcpu::disable_vpid()
 { m_vpid_handler.disable(); }
 
+//--------------------------------------------------------------------------
+// VMCS Shadowing
+//--------------------------------------------------------------------------
+
+void
+vcpu::enable_vmcs_shadowing()
+{ this->shadow_vmcs()->enable(); }
+
+void
+vcpu::disable_vmcs_shadowing()
+{
+    if (m_vmcs_shadow_handler) {
+        m_vmcs_shadow_handler->disable();
+    }
+}
+
+void
+vcpu::trap_on_vmread(vmcs_n::field_type field)
+{ this->shadow_vmcs()->trap_on_vmread(field); }
+
+void
+vcpu::pass_through_vmread(vmcs_n::field_type field)
+{ this->shadow_vmcs()->pass_through_vmread(field); }
+
+void
+vcpu::trap_on_vmwrite(vmcs_n::field_type field)
+{ this->shadow_vmcs()->trap_on_vmwrite(field); }
+
+void
+vcpu::pass_through_vmwrite(vmcs_n::field_type field)
+{ this->shadow_vmcs()->pass_through_vmwrite(field); }
+
+void
+vcpu::add_vmread_handler(
+    vmcs_n::field_type field, const vmcs_shadow_handler::handler_delegate_t &d)
+{ this->shadow_vmcs()->add_vmread_handler(field, d); }
+
+void
+vcpu::add_vmwrite_handler(
+    vmcs_n::field_type field, const vmcs_shadow_handler::handler_delegate_t &d)
+{ this->shadow_vmcs()->add_vmwrite_handler(field, d); }
+
+vmcs_shadow_handler *
+vcpu::shadow_vmcs()
+{
+    // Note:
+    //
+    // The shadow VMCS (and its VMREAD / VMWRITE bitmaps) are only needed by
+    // vCPUs that run a nested hypervisor, so they are not allocated until
+    // VMCS shadowing is first used.
+    //
+
+    if (!m_vmcs_shadow_handler) {
+        m_vmcs_shadow_handler = std::make_unique<vmcs_shadow_handler>(this);
+    }
+
+    return m_vmcs_shadow_handler.get();
+}
+
+bool
+vcpu::handle_vmread(gsl::not_null<vcpu_t *> obj)
+{
+    bfignored(obj);
+
+    if (!m_vmcs_shadow_handler) {
+        return false;
+    }
+
+    return m_vmcs_shadow_handler->handle_vmread(this);
+}
+
+bool
+vcpu::handle_vmwrite(gsl::not_null<vcpu_t *> obj)
+{
+    bfignored(obj);
+
+    if (!m_vmcs_shadow_handler) {
+        return false;
+    }
+
+    return m_vmcs_shadow_handler->handle_vmwrite(this);
+}
+
+//--------------------------------------------------------------------------
+// Dirty Page Logging
+//--------------------------------------------------------------------------
+
+void
+vcpu::enable_dirty_logging(uintptr_t size)
+{
+    if (m_mmap == nullptr) {
+        throw std::runtime_error("enable_dirty_logging: EPT is not enabled");
+    }
+
+    m_dirty_log_handler.enable(*m_mmap, size);
+}
+
+void
+vcpu::disable_dirty_logging()
+{ m_dirty_log_handler.disable(); }
+
+std::size_t
+vcpu::harvest_dirty_log(gsl::span<uint64_t> bitmap)
+{ return m_dirty_log_handler.harvest(bitmap); }
+
 //--------------------------------------------------------------------------
 // VMX preemption timer
 //--------------------------------------------------------------------------
@@ -272,7 +484,60 @@ vcpu::enable_preemption_timer()
 
 void
 vcpu::disable_preemption_timer()
-{ m_preemption_timer_handler.disable_exiting(); }
+{
+    m_shootdown_timer = false;
+    m_preemption_timer_handler.disable_exiting();
+}
+
+// Note:
+//
+// A CPU that changes an EPT map waits for every vCPU attached to the map to
+// exit (see ept::mmap::shootdown()). A guest that never exits on its own
+// would stall it forever, so while a vCPU is attached to a map, it uses its
+// preemption timer to force a VM exit at least every EPT_SHOOTDOWN_TIMER
+// ticks, unless something else already uses the timer. Since the timer's
+// value is saved on VM exit, it only counts down while the guest executes,
+// and is re-armed once it expires.
+//
+
+void
+vcpu::enable_shootdown_timer()
+{
+    using namespace vmcs_n::pin_based_vm_execution_controls;
+
+    if (m_shootdown_timer || activate_preemption_timer::is_enabled()) {
+        return;
+    }
+
+    m_preemption_timer_handler.enable_exiting();
+    m_preemption_timer_handler.set_timer(EPT_SHOOTDOWN_TIMER);
+
+    m_shootdown_timer = true;
+}
+
+void
+vcpu::disable_shootdown_timer()
+{
+    if (!m_shootdown_timer) {
+        return;
+    }
+
+    m_preemption_timer_handler.disable_exiting();
+    m_shootdown_timer = false;
+}
+
+bool
+vcpu::handle_shootdown_timer(gsl::not_null<vcpu *> obj)
+{
+    bfignored(obj);
+
+    if (!m_shootdown_timer) {
+        return false;
+    }
+
+    m_preemption_timer_handler.set_timer(EPT_SHOOTDOWN_TIMER);
+    return true;
+}
 
 //==========================================================================
 // Helpers
@@ -467,6 +732,16 @@ vcpu::emulate_io_instruction(
     m_io_instruction_handler.emulate(port);
 }
 
+void
+vcpu::add_pass_through_io_instruction_handler(
+    vmcs_n::value_type port,
+    const io_instruction_handler::handler_delegate_t &in_d,
+    const io_instruction_handler::handler_delegate_t &out_d)
+{
+    m_io_instruction_handler.trap_on_access(port);
+    m_io_instruction_handler.add_pass_through_handler(port, in_d, out_d);
+}
+
 void
 vcpu::add_default_io_instruction_handler(
     const ::handler_delegate_t &d)
@@ -589,6 +864,8 @@ void
 vcpu::set_preemption_timer(
     const preemption_timer_handler::value_t val)
 {
+    m_shootdown_timer = false;
+
     m_preemption_timer_handler.enable_exiting();
     m_preemption_timer_handler.set_timer(val);
 }
@@ -614,13 +891,37 @@ vcpu::get_preemption_timer()
 std::pair<uintptr_t, uintptr_t>
 vcpu::gpa_to_hpa(uintptr_t gpa)
 {
+    using namespace ::x64::pt;
+
     if (m_mmap == nullptr) {
         return {gpa, 0};
     }
 
-    return m_mmap->virt_to_phys(gpa);
+    // Note:
+    //
+    // The generation is read before the walk so that, if the map is
+    // modified while we are walking it, the translation is tagged with an
+    // old generation and will simply miss the next time it is looked up.
+    //
+
+    const auto page = bfn::upper(gpa);
+    const auto generation = m_mmap->generation();
+
+    auto &entry = m_gpa_tlb.at((page >> from) & (m_gpa_tlb.size() - 1));
+    if (entry.gpa == page && entry.generation == generation) {
+        return {entry.hpa | bfn::lower(gpa), entry.from};
+    }
+
+    const auto ret = m_mmap->virt_to_phys(gpa);
+    entry = {page, bfn::upper(ret.first), ret.second, generation};
+
+    return ret;
 }
 
+void
+vcpu::flush_gpa_tlb() noexcept
+{ m_gpa_tlb.fill({}); }
+
 std::pair<uintptr_t, uintptr_t>
 vcpu::gva_to_gpa(uint64_t gva)
 {
@@ -631,11 +932,123 @@ vcpu::gva_to_gpa(uint64_t gva)
         return {gva, 0};
     }
 
+    // Note:
+    //
+    // The translation of a large page is cached for each 4k page of it that
+    // is looked up, which keeps the cache direct-mapped. Like gpa_to_hpa(),
+    // the EPT generation is read before the walk, as the walk itself reads
+    // the guest's page tables through EPT.
+    //
+
+    const auto cr3 = guest_cr3::get();
+    const auto page = bfn::upper(gva);
+    const auto generation = m_mmap != nullptr ? m_mmap->generation() : 0;
+
+    auto &entry = m_gva_tlb.at((page >> pt::from) & (m_gva_tlb.size() - 1));
+    if (entry.from != 0 && entry.gva == page && entry.cr3 == cr3 && entry.generation == generation) {
+        return {entry.gpa | bfn::lower(gva), entry.from};
+    }
+
+    const auto ret = this->walk_gva(cr3, gva);
+
+    entry = {cr3, page, bfn::upper(ret.first), ret.second, generation};
+    m_gva_tlb_used = true;
+
+    return ret;
+}
+
+void
+vcpu::flush_gva_tlb() noexcept
+{
+    m_gva_tlb.fill({});
+    m_gva_tlb_used = false;
+}
+
+void
+vcpu::flush_gva_tlb(uint64_t gva) noexcept
+{
+    for (auto &entry : m_gva_tlb) {
+        if (entry.from != 0 && bfn::upper(entry.gva, entry.from) == bfn::upper(gva, entry.from)) {
+            entry = {};
+        }
+    }
+}
+
+void
+vcpu::expire_gva_tlb()
+{
+    using namespace vmcs_n::primary_processor_based_vm_execution_controls;
+
+    if (!m_gva_tlb_used) {
+        return;
+    }
+
+    constexpr const auto cr0_mask = ::intel_x64::cr0::paging::mask;
+    constexpr const auto cr4_mask =
+        ::intel_x64::cr4::page_global_enable::mask | ::intel_x64::cr4::pcid_enable_bit::mask;
+
+    if (cr3_load_exiting::is_enabled() && invlpg_exiting::is_enabled() &&
+        (vmcs_n::cr0_guest_host_mask::get() & cr0_mask) == cr0_mask &&
+        (vmcs_n::cr4_guest_host_mask::get() & cr4_mask) == cr4_mask) {
+        return;
+    }
+
+    this->flush_gva_tlb();
+}
+
+// Note:
+//
+// This is registered as an exit handler for every VM exit (and not as the
+// handler of a specific exit reason), so it runs before any handler that
+// emulates the exit, and even if that handler never returns. INVPCID is
+// not decoded, and MOV to CR3 does not say whether the guest asked to
+// keep its PCID's translations, so both flush the whole cache.
+//
+
+bool
+vcpu::handle_gva_tlb(gsl::not_null<vcpu *> obj)
+{
+    using namespace vmcs_n::exit_reason;
+    using namespace vmcs_n::exit_qualification::control_register_access;
+
+    bfignored(obj);
+
+    if (!m_gva_tlb_used) {
+        return false;
+    }
+
+    switch (basic_exit_reason::get(this->exit_reason())) {
+        case basic_exit_reason::invlpg:
+            this->flush_gva_tlb(this->exit_qualification());
+            break;
+
+        case basic_exit_reason::invpcid:
+            this->flush_gva_tlb();
+            break;
+
+        case basic_exit_reason::control_register_accesses:
+            if (access_type::get(this->exit_qualification()) == access_type::mov_to_cr) {
+                this->flush_gva_tlb();
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return false;
+}
+
+std::pair<uintptr_t, uintptr_t>
+vcpu::walk_gva(uintptr_t cr3, uint64_t gva)
+{
+    using namespace ::x64;
+
     // -------------------------------------------------------------------------
     // PML4
 
     auto pml4_pte =
-        get_entry(bfn::upper(guest_cr3::get()), pml4::index(gva));
+        get_entry(bfn::upper(cr3), pml4::index(gva));
 
     if (pml4::entry::present::is_disabled(pml4_pte)) {
         throw std::runtime_error("pml4_pte is not present");
@@ -703,6 +1116,101 @@ vcpu::gva_to_hpa(uint64_t gva)
     return this->gpa_to_hpa(ret.first);
 }
 
+void
+vcpu::read_guest(uint64_t gva, void *dst, std::size_t len)
+{
+    expects(dst != nullptr);
+    this->copy_guest(gva, static_cast<uint8_t *>(dst), len);
+}
+
+void
+vcpu::write_guest(uint64_t gva, const void *src, std::size_t len)
+{
+    expects(src != nullptr);
+    this->copy_guest(gva, static_cast<const uint8_t *>(src), len);
+}
+
+// Note:
+//
+// A translation returns the size of the page that it came from (0 if
+// paging / EPT is disabled, in which case the translation is an identity
+// map, and the run of contiguous memory is unbounded). The run that can be
+// copied without another translation is limited by the guest's page, as
+// well as the EPT page that backs it.
+//
+
+static std::size_t
+contiguous_bytes(uintptr_t addr, uintptr_t from, std::size_t len) noexcept
+{
+    if (from == 0) {
+        return len;
+    }
+
+    return std::min<std::size_t>(len, (1ULL << from) - bfn::lower(addr, from));
+}
+
+// Note:
+//
+// The direction of a copy is given by the constness of the caller's
+// buffer. A const buffer (write_guest()) is the source, and the guest's
+// memory is the destination, otherwise (read_guest()) the guest's memory
+// is the source, and the buffer is the destination.
+//
+
+template<typename T>
+static void
+copy_bytes(void *hva, T *buf, std::size_t len) noexcept
+{
+    if constexpr (std::is_const_v<T>) {
+        std::memcpy(hva, buf, len);
+    }
+    else {
+        std::memcpy(buf, hva, len);
+    }
+}
+
+template<typename T>
+void
+vcpu::copy_guest(uint64_t gva, T *buf, std::size_t len)
+{
+    while (len != 0) {
+        const auto gpa = this->gva_to_gpa(gva);
+        const auto hpa = this->gpa_to_hpa(gpa.first);
+
+        auto run = contiguous_bytes(gva, gpa.second, len);
+        run = contiguous_bytes(gpa.first, hpa.second, run);
+
+        this->copy_hpa(hpa.first, buf, run);
+
+        gva += run;
+        buf += run;
+        len -= run;
+    }
+}
+
+template<typename T>
+void
+vcpu::copy_hpa(uintptr_t hpa, T *buf, std::size_t len)
+{
+    using namespace ::x64::pt;
+
+    if (auto hva = x64::cr3::vmm_direct_map_hva(hpa, len)) {
+        copy_bytes(hva, buf, len);
+        return;
+    }
+
+    while (len != 0) {
+        const auto run = std::min<std::size_t>(len, page_size - bfn::lower(hpa));
+
+        auto map = m_map_cache.map<uint8_t>(bfn::upper(hpa));
+        copy_bytes(map.get() + bfn::lower(hpa), buf, run);
+
+        hpa += run;
+        buf += run;
+        len -= run;
+    }
+}
+
 void
 vcpu::map_1g_ro(uintptr_t gpa, uintptr_t hpa)
 {
@@ -944,59 +1452,75 @@ vcpu::set_rsp(uint64_t val) noexcept
 
 uint64_t
 vcpu::gdt_base() const noexcept
-{ return vmcs_n::guest_gdtr_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_gdtr_base::addr, vmcs_n::guest_gdtr_base::name); }
 
 void
 vcpu::set_gdt_base(uint64_t val) noexcept
-{ vmcs_n::guest_gdtr_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_gdtr_base::addr, val, vmcs_n::guest_gdtr_base::name); }
 
 uint64_t
 vcpu::gdt_limit() const noexcept
-{ return vmcs_n::guest_gdtr_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_gdtr_limit::addr, vmcs_n::guest_gdtr_limit::name); }
 
 void
 vcpu::set_gdt_limit(uint64_t val) noexcept
-{ vmcs_n::guest_gdtr_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_gdtr_limit::addr, val, vmcs_n::guest_gdtr_limit::name); }
 
 uint64_t
 vcpu::idt_base() const noexcept
-{ return vmcs_n::guest_idtr_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_idtr_base::addr, vmcs_n::guest_idtr_base::name); }
 
 void
 vcpu::set_idt_base(uint64_t val) noexcept
-{ vmcs_n::guest_idtr_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_idtr_base::addr, val, vmcs_n::guest_idtr_base::name); }
 
 uint64_t
 vcpu::idt_limit() const noexcept
-{ return vmcs_n::guest_idtr_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_idtr_limit::addr, vmcs_n::guest_idtr_limit::name); }
 
 void
 vcpu::set_idt_limit(uint64_t val) noexcept
-{ vmcs_n::guest_idtr_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_idtr_limit::addr, val, vmcs_n::guest_idtr_limit::name); }
 
 uint64_t
 vcpu::cr0() const noexcept
-{ return vmcs_n::guest_cr0::get(); }
+{ return m_vmcs.read(vmcs_n::guest_cr0::addr, vmcs_n::guest_cr0::name); }
 
 void
 vcpu::set_cr0(uint64_t val) noexcept
-{ vmcs_n::guest_cr0::set(val); }
+{ m_vmcs.write(vmcs_n::guest_cr0::addr, val, vmcs_n::guest_cr0::name); }
 
 uint64_t
 vcpu::cr3() const noexcept
-{ return vmcs_n::guest_cr3::get(); }
+{ return m_vmcs.read(vmcs_n::guest_cr3::addr, vmcs_n::guest_cr3::name); }
 
 void
 vcpu::set_cr3(uint64_t val) noexcept
-{ vmcs_n::guest_cr3::set(val); }
+{ m_vmcs.write(vmcs_n::guest_cr3::addr, val, vmcs_n::guest_cr3::name); }
 
 uint64_t
 vcpu::cr4() const noexcept
-{ return vmcs_n::guest_cr4::get(); }
+{ return m_vmcs.read(vmcs_n::guest_cr4::addr, vmcs_n::guest_cr4::name); }
 
 void
 vcpu::set_cr4(uint64_t val) noexcept
-{ vmcs_n::guest_cr4::set(val); }
+{ m_vmcs.write(vmcs_n::guest_cr4::addr, val, vmcs_n::guest_cr4::name); }
+
+uint64_t
+vcpu::cr0_read_shadow() const noexcept
+{ return m_vmcs.read(vmcs_n::cr0_read_shadow::addr, vmcs_n::cr0_read_shadow::name); }
+
+void
+vcpu::set_cr0_read_shadow(uint64_t val) noexcept
+{ m_vmcs.write(vmcs_n::cr0_read_shadow::addr, val, vmcs_n::cr0_read_shadow::name); }
+
+uint64_t
+vcpu::cr4_read_shadow() const noexcept
+{ return m_vmcs.read(vmcs_n::cr4_read_shadow::addr, vmcs_n::cr4_read_shadow::name); }
+
+void
+vcpu::set_cr4_read_shadow(uint64_t val) noexcept
+{ m_vmcs.write(vmcs_n::cr4_read_shadow::addr, val, vmcs_n::cr4_read_shadow::name); }
 
 uint64_t
 vcpu::ia32_efer() const noexcept
@@ -1017,259 +1541,287 @@ vcpu::set_ia32_pat(uint64_t val) noexcept
 
 uint64_t
 vcpu::es_selector() const noexcept
-{ return vmcs_n::guest_es_selector::get(); }
+{ return m_vmcs.read(vmcs_n::guest_es_selector::addr, vmcs_n::guest_es_selector::name); }
 
 void
 vcpu::set_es_selector(uint64_t val) noexcept
-{ vmcs_n::guest_es_selector::set(val); }
+{ m_vmcs.write(vmcs_n::guest_es_selector::addr, val, vmcs_n::guest_es_selector::name); }
 
 uint64_t
 vcpu::es_base() const noexcept
-{ return vmcs_n::guest_es_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_es_base::addr, vmcs_n::guest_es_base::name); }
 
 void
 vcpu::set_es_base(uint64_t val) noexcept
-{ vmcs_n::guest_es_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_es_base::addr, val, vmcs_n::guest_es_base::name); }
 
 uint64_t
 vcpu::es_limit() const noexcept
-{ return vmcs_n::guest_es_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_es_limit::addr, vmcs_n::guest_es_limit::name); }
 
 void
 vcpu::set_es_limit(uint64_t val) noexcept
-{ vmcs_n::guest_es_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_es_limit::addr, val, vmcs_n::guest_es_limit::name); }
 
 uint64_t
 vcpu::es_access_rights() const noexcept
-{ return vmcs_n::guest_es_access_rights::get(); }
+{ return m_vmcs.read(vmcs_n::guest_es_access_rights::addr, vmcs_n::guest_es_access_rights::name); }
 
 void
 vcpu::set_es_access_rights(uint64_t val) noexcept
-{ vmcs_n::guest_es_access_rights::set(val); }
+{ m_vmcs.write(vmcs_n::guest_es_access_rights::addr, val, vmcs_n::guest_es_access_rights::name); }
 
 uint64_t
 vcpu::cs_selector() const noexcept
-{ return vmcs_n::guest_cs_selector::get(); }
+{ return m_vmcs.read(vmcs_n::guest_cs_selector::addr, vmcs_n::guest_cs_selector::name); }
 
 void
 vcpu::set_cs_selector(uint64_t val) noexcept
-{ vmcs_n::guest_cs_selector::set(val); }
+{ m_vmcs.write(vmcs_n::guest_cs_selector::addr, val, vmcs_n::guest_cs_selector::name); }
 
 uint64_t
 vcpu::cs_base() const noexcept
-{ return vmcs_n::guest_cs_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_cs_base::addr, vmcs_n::guest_cs_base::name); }
 
 void
 vcpu::set_cs_base(uint64_t val) noexcept
-{ vmcs_n::guest_cs_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_cs_base::addr, val, vmcs_n::guest_cs_base::name); }
 
 uint64_t
 vcpu::cs_limit() const noexcept
-{ return vmcs_n::guest_cs_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_cs_limit::addr, vmcs_n::guest_cs_limit::name); }
 
 void
 vcpu::set_cs_limit(uint64_t val) noexcept
-{ vmcs_n::guest_cs_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_cs_limit::addr, val, vmcs_n::guest_cs_limit::name); }
 
 uint64_t
 vcpu::cs_access_rights() const noexcept
-{ return vmcs_n::guest_cs_access_rights::get(); }
+{ return m_vmcs.read(vmcs_n::guest_cs_access_rights::addr, vmcs_n::guest_cs_access_rights::name); }
 
 void
 vcpu::set_cs_access_rights(uint64_t val) noexcept
-{ vmcs_n::guest_cs_access_rights::set(val); }
+{ m_vmcs.write(vmcs_n::guest_cs_access_rights::addr, val, vmcs_n::guest_cs_access_rights::name); }
 
 uint64_t
 vcpu::ss_selector() const noexcept
-{ return vmcs_n::guest_ss_selector::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ss_selector::addr, vmcs_n::guest_ss_selector::name); }
 
 void
 vcpu::set_ss_selector(uint64_t val) noexcept
-{ vmcs_n::guest_ss_selector::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ss_selector::addr, val, vmcs_n::guest_ss_selector::name); }
 
 uint64_t
 vcpu::ss_base() const noexcept
-{ return vmcs_n::guest_ss_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ss_base::addr, vmcs_n::guest_ss_base::name); }
 
 void
 vcpu::set_ss_base(uint64_t val) noexcept
-{ vmcs_n::guest_ss_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ss_base::addr, val, vmcs_n::guest_ss_base::name); }
 
 uint64_t
 vcpu::ss_limit() const noexcept
-{ return vmcs_n::guest_ss_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ss_limit::addr, vmcs_n::guest_ss_limit::name); }
 
 void
 vcpu::set_ss_limit(uint64_t val) noexcept
-{ vmcs_n::guest_ss_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ss_limit::addr, val, vmcs_n::guest_ss_limit::name); }
 
 uint64_t
 vcpu::ss_access_rights() const noexcept
-{ return vmcs_n::guest_ss_access_rights::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ss_access_rights::addr, vmcs_n::guest_ss_access_rights::name); }
 
 void
 vcpu::set_ss_access_rights(uint64_t val) noexcept
-{ vmcs_n::guest_ss_access_rights::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ss_access_rights::addr, val, vmcs_n::guest_ss_access_rights::name); }
 
 uint64_t
 vcpu::ds_selector() const noexcept
-{ return vmcs_n::guest_ds_selector::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ds_selector::addr, vmcs_n::guest_ds_selector::name); }
 
 void
 vcpu::set_ds_selector(uint64_t val) noexcept
-{ vmcs_n::guest_ds_selector::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ds_selector::addr, val, vmcs_n::guest_ds_selector::name); }
 
 uint64_t
 vcpu::ds_base() const noexcept
-{ return vmcs_n::guest_ds_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ds_base::addr, vmcs_n::guest_ds_base::name); }
 
 void
 vcpu::set_ds_base(uint64_t val) noexcept
-{ vmcs_n::guest_ds_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ds_base::addr, val, vmcs_n::guest_ds_base::name); }
 
 uint64_t
 vcpu::ds_limit() const noexcept
-{ return vmcs_n::guest_ds_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ds_limit::addr, vmcs_n::guest_ds_limit::name); }
 
 void
 vcpu::set_ds_limit(uint64_t val) noexcept
-{ vmcs_n::guest_ds_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ds_limit::addr, val, vmcs_n::guest_ds_limit::name); }
 
 uint64_t
 vcpu::ds_access_rights() const noexcept
-{ return vmcs_n::guest_ds_access_rights::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ds_access_rights::addr, vmcs_n::guest_ds_access_rights::name); }
 
 void
 vcpu::set_ds_access_rights(uint64_t val) noexcept
-{ vmcs_n::guest_ds_access_rights::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ds_access_rights::addr, val, vmcs_n::guest_ds_access_rights::name); }
 
 uint64_t
 vcpu::fs_selector() const noexcept
-{ return vmcs_n::guest_fs_selector::get(); }
+{ return m_vmcs.read(vmcs_n::guest_fs_selector::addr, vmcs_n::guest_fs_selector::name); }
 
 void
 vcpu::set_fs_selector(uint64_t val) noexcept
-{ vmcs_n::guest_fs_selector::set(val); }
+{ m_vmcs.write(vmcs_n::guest_fs_selector::addr, val, vmcs_n::guest_fs_selector::name); }
 
 uint64_t
 vcpu::fs_base() const noexcept
-{ return vmcs_n::guest_fs_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_fs_base::addr, vmcs_n::guest_fs_base::name); }
 
 void
 vcpu::set_fs_base(uint64_t val) noexcept
-{ vmcs_n::guest_fs_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_fs_base::addr, val, vmcs_n::guest_fs_base::name); }
 
 uint64_t
 vcpu::fs_limit() const noexcept
-{ return vmcs_n::guest_fs_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_fs_limit::addr, vmcs_n::guest_fs_limit::name); }
 
 void
 vcpu::set_fs_limit(uint64_t val) noexcept
-{ vmcs_n::guest_fs_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_fs_limit::addr, val, vmcs_n::guest_fs_limit::name); }
 
 uint64_t
 vcpu::fs_access_rights() const noexcept
-{ return vmcs_n::guest_fs_access_rights::get(); }
+{ return m_vmcs.read(vmcs_n::guest_fs_access_rights::addr, vmcs_n::guest_fs_access_rights::name); }
 
 void
 vcpu::set_fs_access_rights(uint64_t val) noexcept
-{ vmcs_n::guest_fs_access_rights::set(val); }
+{ m_vmcs.write(vmcs_n::guest_fs_access_rights::addr, val, vmcs_n::guest_fs_access_rights::name); }
 
 uint64_t
 vcpu::gs_selector() const noexcept
-{ return vmcs_n::guest_gs_selector::get(); }
+{ return m_vmcs.read(vmcs_n::guest_gs_selector::addr, vmcs_n::guest_gs_selector::name); }
 
 void
 vcpu::set_gs_selector(uint64_t val) noexcept
-{ vmcs_n::guest_gs_selector::set(val); }
+{ m_vmcs.write(vmcs_n::guest_gs_selector::addr, val, vmcs_n::guest_gs_selector::name); }
 
 uint64_t
 vcpu::gs_base() const noexcept
-{ return vmcs_n::guest_gs_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_gs_base::addr, vmcs_n::guest_gs_base::name); }
 
 void
 vcpu::set_gs_base(uint64_t val) noexcept
-{ vmcs_n::guest_gs_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_gs_base::addr, val, vmcs_n::guest_gs_base::name); }
 
 uint64_t
 vcpu::gs_limit() const noexcept
-{ return vmcs_n::guest_gs_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_gs_limit::addr, vmcs_n::guest_gs_limit::name); }
 
 void
 vcpu::set_gs_limit(uint64_t val) noexcept
-{ vmcs_n::guest_gs_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_gs_limit::addr, val, vmcs_n::guest_gs_limit::name); }
 
 uint64_t
 vcpu::gs_access_rights() const noexcept
-{ return vmcs_n::guest_gs_access_rights::get(); }
+{ return m_vmcs.read(vmcs_n::guest_gs_access_rights::addr, vmcs_n::guest_gs_access_rights::name); }
 
 void
 vcpu::set_gs_access_rights(uint64_t val) noexcept
-{ vmcs_n::guest_gs_access_rights::set(val); }
+{ m_vmcs.write(vmcs_n::guest_gs_access_rights::addr, val, vmcs_n::guest_gs_access_rights::name); }
 
 uint64_t
 vcpu::tr_selector() const noexcept
-{ return vmcs_n::guest_tr_selector::get(); }
+{ return m_vmcs.read(vmcs_n::guest_tr_selector::addr, vmcs_n::guest_tr_selector::name); }
 
 void
 vcpu::set_tr_selector(uint64_t val) noexcept
-{ vmcs_n::guest_tr_selector::set(val); }
+{ m_vmcs.write(vmcs_n::guest_tr_selector::addr, val, vmcs_n::guest_tr_selector::name); }
 
 uint64_t
 vcpu::tr_base() const noexcept
-{ return vmcs_n::guest_tr_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_tr_base::addr, vmcs_n::guest_tr_base::name); }
 
 void
 vcpu::set_tr_base(uint64_t val) noexcept
-{ vmcs_n::guest_tr_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_tr_base::addr, val, vmcs_n::guest_tr_base::name); }
 
 uint64_t
 vcpu::tr_limit() const noexcept
-{ return vmcs_n::guest_tr_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_tr_limit::addr, vmcs_n::guest_tr_limit::name); }
 
 void
 vcpu::set_tr_limit(uint64_t val) noexcept
-{ vmcs_n::guest_tr_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_tr_limit::addr, val, vmcs_n::guest_tr_limit::name); }
 
 uint64_t
 vcpu::tr_access_rights() const noexcept
-{ return vmcs_n::guest_tr_access_rights::get(); }
+{ return m_vmcs.read(vmcs_n::guest_tr_access_rights::addr, vmcs_n::guest_tr_access_rights::name); }
 
 void
 vcpu::set_tr_access_rights(uint64_t val) noexcept
-{ vmcs_n::guest_tr_access_rights::set(val); }
+{ m_vmcs.write(vmcs_n::guest_tr_access_rights::addr, val, vmcs_n::guest_tr_access_rights::name); }
 
 uint64_t
 vcpu::ldtr_selector() const noexcept
-{ return vmcs_n::guest_ldtr_selector::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ldtr_selector::addr, vmcs_n::guest_ldtr_selector::name); }
 
 void
 vcpu::set_ldtr_selector(uint64_t val) noexcept
-{ vmcs_n::guest_ldtr_selector::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ldtr_selector::addr, val, vmcs_n::guest_ldtr_selector::name); }
 
 uint64_t
 vcpu::ldtr_base() const noexcept
-{ return vmcs_n::guest_ldtr_base::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ldtr_base::addr, vmcs_n::guest_ldtr_base::name); }
 
 void
 vcpu::set_ldtr_base(uint64_t val) noexcept
-{ vmcs_n::guest_ldtr_base::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ldtr_base::addr, val, vmcs_n::guest_ldtr_base::name); }
 
 uint64_t
 vcpu::ldtr_limit() const noexcept
-{ return vmcs_n::guest_ldtr_limit::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ldtr_limit::addr, vmcs_n::guest_ldtr_limit::name); }
 
 void
 vcpu::set_ldtr_limit(uint64_t val) noexcept
-{ vmcs_n::guest_ldtr_limit::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ldtr_limit::addr, val, vmcs_n::guest_ldtr_limit::name); }
 
 uint64_t
 vcpu::ldtr_access_rights() const noexcept
-{ return vmcs_n::guest_ldtr_access_rights::get(); }
+{ return m_vmcs.read(vmcs_n::guest_ldtr_access_rights::addr, vmcs_n::guest_ldtr_access_rights::name); }
 
 void
 vcpu::set_ldtr_access_rights(uint64_t val) noexcept
-{ vmcs_n::guest_ldtr_access_rights::set(val); }
+{ m_vmcs.write(vmcs_n::guest_ldtr_access_rights::addr, val, vmcs_n::guest_ldtr_access_rights::name); }
+
+uint64_t
+vcpu::exit_reason() const
+{ return m_vmcs.read_only_field(vmcs_n::exit_reason::addr, vmcs_n::exit_reason::name); }
+
+uint64_t
+vcpu::exit_qualification() const
+{ return m_vmcs.read_only_field(vmcs_n::exit_qualification::addr, vmcs_n::exit_qualification::name); }
+
+uint64_t
+vcpu::exit_instruction_length() const
+{ return m_vmcs.read_only_field(vmcs_n::vm_exit_instruction_length::addr, vmcs_n::vm_exit_instruction_length::name); }
+
+uint64_t
+vcpu::exit_instruction_information() const
+{ return m_vmcs.read_only_field(vmcs_n::vm_exit_instruction_information::addr, vmcs_n::vm_exit_instruction_information::name); }
+
+uint64_t
+vcpu::exit_interruption_information() const
+{ return m_vmcs.read_only_field(vmcs_n::vm_exit_interruption_information::addr, vmcs_n::vm_exit_interruption_information::name); }
+
+uint64_t
+vcpu::guest_linear_address() const
+{ return m_vmcs.read_only_field(vmcs_n::guest_linear_address::addr, vmcs_n::guest_linear_address::name); }
+
+uint64_t
+vcpu::guest_physical_address() const
+{ return m_vmcs.read_only_field(vmcs_n::guest_physical_address::addr, vmcs_n::guest_physical_address::name); }
 
 gsl::not_null<save_state_t *>
 vcpu::save_state() const
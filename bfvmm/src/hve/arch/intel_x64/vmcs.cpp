@@ -42,6 +42,33 @@ extern "C" void vmcs_promote(
 extern "C" void vmcs_resume(
     bfvmm::intel_x64::save_state_t *save_state) noexcept;
 
+extern "C" void exit_handler_save_fpu(void) noexcept;
+
+// -----------------------------------------------------------------------------
+// Read Only Field Cache
+// -----------------------------------------------------------------------------
+
+// Note:
+//
+// A VMCS field encoding stores the field's width in bits 14:13, its type in
+// bits 11:10 and its index in bits 9:1 (see Appendix B of the Intel SDM).
+// All of the read-only data fields (type 1) have an index less than 8, so
+// the cache has one slot for each width / index pair. The high half of a
+// 64bit field (access type 1) is never cached.
+//
+
+static constexpr bool
+is_cached_field(::intel_x64::vmcs::field_type field) noexcept
+{
+    return ((field >> 10) & 0x3U) == 1 && ((field >> 1) & 0x1FFU) < 8 && (field & 0x1U) == 0;
+}
+
+static constexpr std::size_t
+cached_field_slot(::intel_x64::vmcs::field_type field) noexcept
+{
+    return static_cast<std::size_t>((((field >> 13) & 0x3U) << 3) | ((field >> 1) & 0x7U));
+}
+
 // -----------------------------------------------------------------------------
 // Implementation
 // -----------------------------------------------------------------------------
@@ -76,7 +103,11 @@ vmcs::vmcs(
 void
 vmcs::launch()
 {
+    this->invalidate_read_only_fields();
+
     try {
+        this->flush_writes();
+
         if (m_vcpu->is_host_vm_vcpu()) {
             ::intel_x64::vm::launch_demote();
         }
@@ -96,6 +127,8 @@ vmcs::launch()
 void
 vmcs::promote()
 {
+    this->flush_writes();
+
     vmcs_promote(m_save_state.get());
     throw std::runtime_error("vmcs promote failed");
 }
@@ -103,6 +136,9 @@ vmcs::promote()
 void
 vmcs::resume()
 {
+    this->flush_writes();
+    this->invalidate_read_only_fields();
+
     vmcs_resume(m_save_state.get());
 
     this->check();
@@ -112,15 +148,116 @@ vmcs::resume()
 void
 vmcs::load()
 {
+    // Note:
+    //
+    // If CR0.TS is set, we are handling a VM exit and the FPU/SIMD state
+    // of the vCPU that exited is still in the registers. Since loading a
+    // different VMCS might result in a different vCPU being resumed, this
+    // state has to be saved first, otherwise it would be lost.
+    //
+
+    if (::intel_x64::cr0::task_switched::is_enabled()) {
+        exit_handler_save_fpu();
+    }
+
+    this->invalidate_read_only_fields();
     ::intel_x64::vm::load(&m_vmcs_region_phys);
+
+    this->flush_writes();
 }
 
 void
 vmcs::clear()
 {
+    this->invalidate_read_only_fields();
     ::intel_x64::vm::clear(&m_vmcs_region_phys);
 }
 
+::intel_x64::vmcs::value_type
+vmcs::read_only_field(
+    ::intel_x64::vmcs::field_type field, const char *name) const
+{
+    if (!is_cached_field(field)) {
+        return ::intel_x64::vm::read(field, name);
+    }
+
+    const auto slot = cached_field_slot(field);
+    const auto mask = 1U << slot;
+
+    if ((m_read_only_fields_valid & mask) == 0) {
+        m_read_only_fields.at(slot) = ::intel_x64::vm::read(field, name);
+        m_read_only_fields_valid |= mask;
+    }
+
+    return m_read_only_fields.at(slot);
+}
+
+void
+vmcs::invalidate_read_only_fields() const noexcept
+{ m_read_only_fields_valid = 0; }
+
+::intel_x64::vmcs::value_type
+vmcs::read(
+    ::intel_x64::vmcs::field_type field, const char *name) const
+{
+    for (std::size_t i = 0; i < m_num_pending_writes; i++) {
+        const auto &entry = m_pending_writes.at(i);
+        if (entry.field == field) {
+            return entry.val;
+        }
+    }
+
+    return this->read_only_field(field, name);
+}
+
+void
+vmcs::write(
+    ::intel_x64::vmcs::field_type field,
+    ::intel_x64::vmcs::value_type val,
+    const char *name)
+{
+    if (!m_write_back) {
+        ::intel_x64::vm::write(field, val, name);
+        return;
+    }
+
+    for (std::size_t i = 0; i < m_num_pending_writes; i++) {
+        auto &entry = m_pending_writes.at(i);
+        if (entry.field == field) {
+            entry.val = val;
+            return;
+        }
+    }
+
+    if (m_num_pending_writes == m_pending_writes.size()) {
+        this->flush_writes();
+    }
+
+    m_pending_writes.at(m_num_pending_writes++) = {field, val, name};
+}
+
+void
+vmcs::flush_writes()
+{
+    for (std::size_t i = 0; i < m_num_pending_writes; i++) {
+        const auto &entry = m_pending_writes.at(i);
+        ::intel_x64::vm::write(entry.field, entry.val, entry.name);
+    }
+
+    m_num_pending_writes = 0;
+}
+
+void
+vmcs::enable_write_back() noexcept
+{ m_write_back = true; }
+
+void
+vmcs::disable_write_back()
+{
+    this->flush_writes();
+    m_write_back = false;
+}
+
 bool
 vmcs::check() const noexcept
 {
@@ -60,6 +60,11 @@ default rel
 %define VMCS_GUEST_IDTR_BASE                                      0x00006818
 %define VMCS_GUEST_IDTR_LIMIT                                     0x00004812
 
+%define SAVE_STATE_FPU_SAVED                                      0x00000090
+%define SAVE_STATE_XSAVE_AREA                                     0x00000400
+%define SAVE_STATE_FPU_SAVED_XSAVE                                0x00000001
+%define XSAVE_MASK                                                0x000000E7
+
 %define VMCS_GUEST_CR0                                            0x00006800
 %define VMCS_GUEST_CR3                                            0x00006802
 %define VMCS_GUEST_CR4                                            0x00006804
@@ -100,6 +105,33 @@ vmcs_promote:
 
     mov r15, rdi
 
+    ;
+    ; Restore FPU/SIMD State
+    ;
+    ; This must be done before the guest's CR0 is restored as the guest's
+    ; CR0.TS bit might be set.
+    ;
+
+    mov rcx, [rdi + SAVE_STATE_FPU_SAVED]
+    test rcx, rcx
+    jz .fpu_restored
+
+    mov qword [rdi + SAVE_STATE_FPU_SAVED], 0
+
+    cmp rcx, SAVE_STATE_FPU_SAVED_XSAVE
+    jne .fxrstor
+
+    mov eax, XSAVE_MASK
+    xor edx, edx
+    xrstor64 [rdi + SAVE_STATE_XSAVE_AREA]
+    jmp .fpu_restored
+
+.fxrstor:
+
+    fxrstor64 [rdi + SAVE_STATE_XSAVE_AREA]
+
+.fpu_restored:
+
     ;
     ; Restore Control Registers
     ;
@@ -273,15 +305,6 @@ vmcs_promote:
 
     mov rdi, r15
 
-    movdqa xmm7,   [rdi + 0x1A0]
-    movdqa xmm6,   [rdi + 0x180]
-    movdqa xmm5,   [rdi + 0x160]
-    movdqa xmm4,   [rdi + 0x140]
-    movdqa xmm3,   [rdi + 0x120]
-    movdqa xmm2,   [rdi + 0x100]
-    movdqa xmm1,   [rdi + 0x0E0]
-    movdqa xmm0,   [rdi + 0x0C0]
-
     mov rsp,       [rdi + 0x080]
     mov rax,       [rdi + 0x078]
     push rax
@@ -25,6 +25,12 @@ default rel
 %define VMCS_GUEST_RSP 0x0000681C
 %define VMCS_GUEST_RIP 0x0000681E
 
+%define SAVE_STATE_FPU_SAVED        0x090
+%define SAVE_STATE_XSAVE_AREA       0x400
+
+%define SAVE_STATE_FPU_SAVED_XSAVE  0x1
+%define XSAVE_MASK                  0xE7
+
 global vmcs_resume:function
 
 section .text
@@ -48,14 +54,31 @@ vmcs_resume:
     mov rsi, VMCS_GUEST_RIP
     vmwrite rsi, [rdi + 0x078]
 
-    movdqa xmm7,  [rdi + 0x1A0]
-    movdqa xmm6,  [rdi + 0x180]
-    movdqa xmm5,  [rdi + 0x160]
-    movdqa xmm4,  [rdi + 0x140]
-    movdqa xmm3,  [rdi + 0x120]
-    movdqa xmm2,  [rdi + 0x100]
-    movdqa xmm1,  [rdi + 0x0E0]
-    movdqa xmm0,  [rdi + 0x0C0]
+    ;
+    ; Restore the guest's FPU/SIMD state, but only if the VMM used the
+    ; FPU/SIMD registers during this VM exit (and thus saved the guest's
+    ; state). Otherwise the guest's state never left the registers.
+    ;
+
+    mov rcx, [rdi + SAVE_STATE_FPU_SAVED]
+    test rcx, rcx
+    jz .fpu_restored
+
+    mov qword [rdi + SAVE_STATE_FPU_SAVED], 0
+
+    cmp rcx, SAVE_STATE_FPU_SAVED_XSAVE
+    jne .fxrstor
+
+    mov eax, XSAVE_MASK
+    xor edx, edx
+    xrstor64 [rdi + SAVE_STATE_XSAVE_AREA]
+    jmp .fpu_restored
+
+.fxrstor:
+
+    fxrstor64 [rdi + SAVE_STATE_XSAVE_AREA]
+
+.fpu_restored:
 
     mov r15, [rdi + 0x070]
     mov r14, [rdi + 0x068]
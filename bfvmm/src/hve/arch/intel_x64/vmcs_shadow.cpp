@@ -0,0 +1,451 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <hve/arch/intel_x64/vcpu.h>
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+// Note:
+//
+// The VMREAD / VMWRITE bitmaps are indexed using bits 14:0 of the field's
+// encoding. A VMREAD / VMWRITE of a field that has any of bits 63:15 set
+// always causes a VM exit (see section 24.6.15 of the Intel SDM).
+//
+
+static constexpr const ::intel_x64::vmcs::field_type s_max_shadow_field = 0x7FFF;
+
+static gsl::span<uint8_t>
+bitmap_view(const page_ptr<uint8_t> &bitmap)
+{ return gsl::span<uint8_t>(bitmap.get(), ::x64::pt::page_size); }
+
+// Note:
+//
+// VM-instruction error numbers (see section 30.4 of the Intel SDM), and the
+// RFLAGS bits that VMX instructions use to report success / failure (see
+// section 30.2 of the Intel SDM).
+//
+
+static constexpr const uint64_t s_unsupported_component = 12;
+static constexpr const uint64_t s_read_only_component = 13;
+
+static constexpr const uint64_t s_vmx_status_flags =
+    ::x64::rflags::carry_flag::mask |
+    ::x64::rflags::parity_flag::mask |
+    ::x64::rflags::auxiliary_carry_flag::mask |
+    ::x64::rflags::zero_flag::mask |
+    ::x64::rflags::sign_flag::mask |
+    ::x64::rflags::overflow_flag::mask;
+
+static bool
+is_read_only_field(::intel_x64::vmcs::field_type field)
+{ return ((field >> 10) & 0x3U) == 1U; }
+
+// -----------------------------------------------------------------------------
+// Implementation
+// -----------------------------------------------------------------------------
+
+namespace bfvmm::intel_x64
+{
+
+vmcs_shadow_handler::vmcs_shadow_handler(
+    gsl::not_null<vcpu *> vcpu
+) :
+    m_vcpu{vcpu},
+    m_shadow_vmcs_region{make_page<uint32_t>()},
+    m_shadow_vmcs_region_phys{g_mm->virtptr_to_physint(m_shadow_vmcs_region.get())},
+    m_vmread_bitmap{make_page<uint8_t>()},
+    m_vmwrite_bitmap{make_page<uint8_t>()}
+{
+    gsl::span<uint32_t> id{m_shadow_vmcs_region.get(), 1024};
+    id[0] = gsl::narrow<uint32_t>(::intel_x64::msrs::ia32_vmx_basic::revision_id::get()) | 0x80000000U;
+
+    ::intel_x64::vm::clear(&m_shadow_vmcs_region_phys);
+
+    gsl::memset(bitmap_view(m_vmread_bitmap), 0xFF);
+    gsl::memset(bitmap_view(m_vmwrite_bitmap), 0xFF);
+}
+
+// -----------------------------------------------------------------------------
+// Add Handler
+// -----------------------------------------------------------------------------
+
+void
+vmcs_shadow_handler::add_vmread_handler(
+    vmcs_n::field_type field, const handler_delegate_t &d)
+{
+    this->trap_on_vmread(field);
+    m_vmread_handlers[field].push_front(d);
+}
+
+void
+vmcs_shadow_handler::add_vmwrite_handler(
+    vmcs_n::field_type field, const handler_delegate_t &d)
+{
+    this->trap_on_vmwrite(field);
+    m_vmwrite_handlers[field].push_front(d);
+}
+
+void
+vmcs_shadow_handler::enable()
+{
+    using namespace vmcs_n;
+
+    if (!secondary_processor_based_vm_execution_controls::vmcs_shadowing::is_allowed1()) {
+        throw std::runtime_error("vmcs shadowing is not supported");
+    }
+
+    vmcs_link_pointer::set(m_shadow_vmcs_region_phys);
+    vmread_bitmap_address::set(g_mm->virtptr_to_physint(m_vmread_bitmap.get()));
+    vmwrite_bitmap_address::set(g_mm->virtptr_to_physint(m_vmwrite_bitmap.get()));
+
+    secondary_processor_based_vm_execution_controls::vmcs_shadowing::enable();
+    m_enabled = true;
+}
+
+void
+vmcs_shadow_handler::disable()
+{
+    using namespace vmcs_n;
+
+    secondary_processor_based_vm_execution_controls::vmcs_shadowing::disable();
+    vmcs_link_pointer::set(0xFFFFFFFFFFFFFFFF);
+
+    m_enabled = false;
+}
+
+void
+vmcs_shadow_handler::trap_on_vmread(vmcs_n::field_type field)
+{
+    if (field > s_max_shadow_field) {
+        return;
+    }
+
+    auto view = bitmap_view(m_vmread_bitmap);
+    set_bit(view, field);
+}
+
+void
+vmcs_shadow_handler::pass_through_vmread(vmcs_n::field_type field)
+{
+    if (field > s_max_shadow_field) {
+        throw std::runtime_error("invalid vmcs field: " + std::to_string(field));
+    }
+
+    auto view = bitmap_view(m_vmread_bitmap);
+    clear_bit(view, field);
+}
+
+void
+vmcs_shadow_handler::trap_on_vmwrite(vmcs_n::field_type field)
+{
+    if (field > s_max_shadow_field) {
+        return;
+    }
+
+    auto view = bitmap_view(m_vmwrite_bitmap);
+    set_bit(view, field);
+}
+
+void
+vmcs_shadow_handler::pass_through_vmwrite(vmcs_n::field_type field)
+{
+    if (field > s_max_shadow_field) {
+        throw std::runtime_error("invalid vmcs field: " + std::to_string(field));
+    }
+
+    auto view = bitmap_view(m_vmwrite_bitmap);
+    clear_bit(view, field);
+}
+
+bool
+vmcs_shadow_handler::is_vmread_trapped(vmcs_n::field_type field) const
+{
+    if (field > s_max_shadow_field) {
+        return true;
+    }
+
+    auto view = bitmap_view(m_vmread_bitmap);
+    return is_bit_set(view.at(field >> 3), field & 7);
+}
+
+bool
+vmcs_shadow_handler::is_vmwrite_trapped(vmcs_n::field_type field) const
+{
+    if (field > s_max_shadow_field) {
+        return true;
+    }
+
+    auto view = bitmap_view(m_vmwrite_bitmap);
+    return is_bit_set(view.at(field >> 3), field & 7);
+}
+
+vmcs_n::value_type
+vmcs_shadow_handler::read(vmcs_n::field_type field)
+{
+    this->load();
+    auto ___ = gsl::finally([&] {
+        m_vcpu->load();
+    });
+
+    return ::intel_x64::vm::read(field, "shadow vmcs");
+}
+
+void
+vmcs_shadow_handler::write(vmcs_n::field_type field, vmcs_n::value_type val)
+{
+    this->load();
+    auto ___ = gsl::finally([&] {
+        m_vcpu->load();
+    });
+
+    ::intel_x64::vm::write(field, val, "shadow vmcs");
+}
+
+void
+vmcs_shadow_handler::load()
+{ ::intel_x64::vm::load(&m_shadow_vmcs_region_phys); }
+
+// -----------------------------------------------------------------------------
+// Handlers
+// -----------------------------------------------------------------------------
+
+bool
+vmcs_shadow_handler::handle_vmread(gsl::not_null<vcpu *> vcpu)
+{
+    using namespace vmcs_n::vm_exit_instruction_information::vmread;
+
+    if (!m_enabled) {
+        return false;
+    }
+
+    const auto ii = vcpu->exit_instruction_information();
+
+    struct info_t info = {
+        emulate_rdgpr(vcpu, reg2::get(ii)),
+        0,
+        false,
+        false
+    };
+
+    try {
+        info.val = this->read(info.field);
+    }
+    catch (std::runtime_error &) {
+        return this->fail(vcpu, s_unsupported_component);
+    }
+
+    const auto &hdlrs =
+        m_vmread_handlers.find(info.field);
+
+    if (hdlrs != m_vmread_handlers.end()) {
+        for (const auto &d : hdlrs->second) {
+            if (d(vcpu, info)) {
+                break;
+            }
+        }
+    }
+
+    if (!info.ignore_write) {
+        const auto size = this->operand_size();
+
+        if (mem_reg::get(ii) == mem_reg::reg) {
+            emulate_wrgpr(
+                vcpu, reg1::get(ii), size == 8 ? info.val : info.val & 0xFFFFFFFFULL
+            );
+        }
+        else {
+            vcpu->write_guest(this->operand_address(vcpu, ii), &info.val, size);
+        }
+    }
+
+    return this->succeed(vcpu, info);
+}
+
+bool
+vmcs_shadow_handler::handle_vmwrite(gsl::not_null<vcpu *> vcpu)
+{
+    using namespace vmcs_n::vm_exit_instruction_information::vmwrite;
+
+    if (!m_enabled) {
+        return false;
+    }
+
+    const auto ii = vcpu->exit_instruction_information();
+    const auto size = this->operand_size();
+
+    struct info_t info = {
+        emulate_rdgpr(vcpu, reg2::get(ii)),
+        0,
+        false,
+        false
+    };
+
+    if (mem_reg::get(ii) == mem_reg::reg) {
+        info.val = emulate_rdgpr(vcpu, reg1::get(ii));
+    }
+    else {
+        vcpu->read_guest(this->operand_address(vcpu, ii), &info.val, size);
+    }
+
+    if (size != 8) {
+        info.val &= 0xFFFFFFFFULL;
+    }
+
+    if (is_read_only_field(info.field) &&
+        !::intel_x64::msrs::ia32_vmx_misc::vmwrite_all_fields_support::is_enabled()) {
+        return this->fail(vcpu, s_read_only_component);
+    }
+
+    const auto &hdlrs =
+        m_vmwrite_handlers.find(info.field);
+
+    if (hdlrs != m_vmwrite_handlers.end()) {
+        for (const auto &d : hdlrs->second) {
+            if (d(vcpu, info)) {
+                break;
+            }
+        }
+    }
+
+    if (!info.ignore_write) {
+        try {
+            this->write(info.field, info.val);
+        }
+        catch (std::runtime_error &) {
+            return this->fail(vcpu, s_unsupported_component);
+        }
+    }
+
+    return this->succeed(vcpu, info);
+}
+
+// -----------------------------------------------------------------------------
+// Private
+// -----------------------------------------------------------------------------
+
+uint64_t
+vmcs_shadow_handler::operand_address(gsl::not_null<vcpu *> vcpu, uint64_t ii)
+{
+    using namespace vmcs_n::vm_exit_instruction_information::vmread;
+
+    uint64_t addr = vcpu->exit_qualification();
+
+    if (base_reg_invalid::is_disabled(ii)) {
+        addr += emulate_rdgpr(vcpu, base_reg::get(ii));
+    }
+
+    if (index_reg_invalid::is_disabled(ii)) {
+        addr += emulate_rdgpr(vcpu, index_reg::get(ii)) << scaling::get(ii);
+    }
+
+    switch (address_size::get(ii)) {
+        case address_size::_16bit:
+            addr &= 0xFFFFULL;
+            break;
+
+        case address_size::_32bit:
+            addr &= 0xFFFFFFFFULL;
+            break;
+
+        default:
+            break;
+    }
+
+    switch (segment_register::get(ii)) {
+        case segment_register::es:
+            return addr + vcpu->es_base();
+
+        case segment_register::cs:
+            return addr + vcpu->cs_base();
+
+        case segment_register::ss:
+            return addr + vcpu->ss_base();
+
+        case segment_register::ds:
+            return addr + vcpu->ds_base();
+
+        case segment_register::fs:
+            return addr + vcpu->fs_base();
+
+        default:
+            return addr + vcpu->gs_base();
+    }
+}
+
+std::size_t
+vmcs_shadow_handler::operand_size() const
+{
+    using namespace vmcs_n;
+
+    // Note:
+    //
+    // VMREAD / VMWRITE operate on 64 bit operands in 64 bit mode, and on 32
+    // bit operands everywhere else. Operand size prefixes are ignored.
+    //
+
+    if (vm_entry_controls::ia_32e_mode_guest::is_enabled() &&
+        guest_cs_access_rights::l::is_enabled()) {
+        return 8;
+    }
+
+    return 4;
+}
+
+bool
+vmcs_shadow_handler::succeed(gsl::not_null<vcpu *> vcpu, const info_t &info)
+{
+    vmcs_n::guest_rflags::set(
+        vmcs_n::guest_rflags::get() & ~s_vmx_status_flags
+    );
+
+    if (!info.ignore_advance) {
+        return vcpu->advance();
+    }
+
+    return true;
+}
+
+bool
+vmcs_shadow_handler::fail(gsl::not_null<vcpu *> vcpu, uint64_t error)
+{
+    // Note:
+    //
+    // This is VMfailValid. The error number can only be stored in the shadow
+    // VMCS if the CPU allows the VM-instruction error field (which is read
+    // only) to be written, otherwise it is left unchanged.
+    //
+
+    vmcs_n::guest_rflags::set(
+        (vmcs_n::guest_rflags::get() & ~s_vmx_status_flags) |
+        ::x64::rflags::zero_flag::mask
+    );
+
+    if (::intel_x64::msrs::ia32_vmx_misc::vmwrite_all_fields_support::is_enabled()) {
+        this->write(vmcs_n::vm_instruction_error::addr, error);
+    }
+
+    return vcpu->advance();
+}
+
+}
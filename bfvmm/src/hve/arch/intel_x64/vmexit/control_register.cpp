@@ -26,7 +26,7 @@ namespace bfvmm::intel_x64
 
 static bool
 emulate_ia_32e_mode_switch(
-    control_register_handler::info_t &info)
+    gsl::not_null<vcpu_t *> vcpu, control_register_handler::info_t &info)
 {
     using namespace vmcs_n::guest_cr0;
     using namespace vmcs_n::guest_ia32_efer;
@@ -40,14 +40,14 @@ emulate_ia_32e_mode_switch(
     if (paging::is_enabled(info.val)) {
         lma::enable();
         ia_32e_mode_guest::enable();
-        ::intel_x64::vmx::invept_global();
     }
     else {
         lma::disable();
         ia_32e_mode_guest::disable();
-        ::intel_x64::vmx::invept_global();
     }
 
+    vcpu->invalidations()->invept_single_context();
+
     return true;
 }
 
@@ -56,10 +56,9 @@ default_wrcr0_handler(
     gsl::not_null<vcpu_t *> vcpu, control_register_handler::info_t &info)
 {
     using namespace vmcs_n::guest_cr0;
-    bfignored(vcpu);
 
-    if (paging::is_enabled() != paging::is_enabled(info.val)) {
-        return emulate_ia_32e_mode_switch(info);
+    if (paging::is_enabled(vcpu->cr0()) != paging::is_enabled(info.val)) {
+        return emulate_ia_32e_mode_switch(vcpu, info);
     }
 
     return true;
@@ -79,10 +78,10 @@ static bool
 default_wrcr3_handler(
     gsl::not_null<vcpu_t *> vcpu, control_register_handler::info_t &info)
 {
-    bfignored(vcpu);
     bfignored(info);
 
-    ::intel_x64::vmx::invept_global();
+    vcpu->flush_gva_tlb();
+    vcpu->invalidations()->invvpid_single_context();
     return true;
 }
 
@@ -160,7 +159,7 @@ control_register_handler::enable_wrcr0_exiting(
     mask |= m_vcpu->global_state()->ia32_vmx_cr0_fixed0;
 
     cr0_guest_host_mask::set(mask);
-    cr0_read_shadow::set(guest_cr0::get());
+    m_vcpu->set_cr0_read_shadow(m_vcpu->cr0());
 }
 
 void
@@ -185,7 +184,7 @@ control_register_handler::enable_wrcr4_exiting(
     mask |= m_vcpu->global_state()->ia32_vmx_cr4_fixed0;
 
     cr4_guest_host_mask::set(mask);
-    cr4_read_shadow::set(guest_cr4::get());
+    m_vcpu->set_cr4_read_shadow(m_vcpu->cr4());
 }
 
 // -----------------------------------------------------------------------------
@@ -197,7 +196,7 @@ control_register_handler::handle(gsl::not_null<vcpu_t *> vcpu)
 {
     using namespace vmcs_n::exit_qualification::control_register_access;
 
-    switch (control_register_number::get()) {
+    switch (control_register_number::get(vcpu->exit_qualification())) {
         case 0:
             return handle_cr0(vcpu);
 
@@ -219,7 +218,7 @@ control_register_handler::handle_cr0(gsl::not_null<vcpu_t *> vcpu)
 {
     using namespace vmcs_n::exit_qualification::control_register_access;
 
-    switch (access_type::get()) {
+    switch (access_type::get(vcpu->exit_qualification())) {
         case access_type::mov_to_cr:
             return handle_wrcr0(vcpu);
 
@@ -245,7 +244,7 @@ control_register_handler::handle_cr3(gsl::not_null<vcpu_t *> vcpu)
 {
     using namespace vmcs_n::exit_qualification::control_register_access;
 
-    switch (access_type::get()) {
+    switch (access_type::get(vcpu->exit_qualification())) {
         case access_type::mov_to_cr:
             return handle_wrcr3(vcpu);
 
@@ -269,7 +268,7 @@ control_register_handler::handle_cr4(gsl::not_null<vcpu_t *> vcpu)
 {
     using namespace vmcs_n::exit_qualification::control_register_access;
 
-    switch (access_type::get()) {
+    switch (access_type::get(vcpu->exit_qualification())) {
         case access_type::mov_to_cr:
             return handle_wrcr4(vcpu);
 
@@ -295,7 +294,7 @@ control_register_handler::handle_wrcr0(gsl::not_null<vcpu_t *> vcpu)
 {
     struct info_t info = {
         emulate_rdgpr(vcpu),
-        vmcs_n::cr0_read_shadow::get(),
+        vcpu->cr0_read_shadow(),
         false,
         false
     };
@@ -310,8 +309,8 @@ control_register_handler::handle_wrcr0(gsl::not_null<vcpu_t *> vcpu)
     }
 
     if (!info.ignore_write) {
-        vmcs_n::guest_cr0::set(info.val);
-        vmcs_n::cr0_read_shadow::set(info.shadow);
+        vcpu->set_cr0(info.val);
+        vcpu->set_cr0_read_shadow(info.shadow);
     }
 
     if (!info.ignore_advance) {
@@ -325,7 +324,7 @@ bool
 control_register_handler::handle_rdcr3(gsl::not_null<vcpu_t *> vcpu)
 {
     struct info_t info = {
-        vmcs_n::guest_cr3::get(),
+        vcpu->cr3(),
         0,
         false,
         false
@@ -365,7 +364,7 @@ control_register_handler::handle_wrcr3(gsl::not_null<vcpu_t *> vcpu)
     }
 
     if (!info.ignore_write) {
-        vmcs_n::guest_cr3::set(info.val & 0x7FFFFFFFFFFFFFFF);
+        vcpu->set_cr3(info.val & 0x7FFFFFFFFFFFFFFF);
     }
 
     if (!info.ignore_advance) {
@@ -380,7 +379,7 @@ control_register_handler::handle_wrcr4(gsl::not_null<vcpu_t *> vcpu)
 {
     struct info_t info = {
         emulate_rdgpr(vcpu),
-        vmcs_n::cr4_read_shadow::get(),
+        vcpu->cr4_read_shadow(),
         false,
         false
     };
@@ -395,8 +394,8 @@ control_register_handler::handle_wrcr4(gsl::not_null<vcpu_t *> vcpu)
     }
 
     if (!info.ignore_write) {
-        vmcs_n::guest_cr4::set(info.val);
-        vmcs_n::cr4_read_shadow::set(info.shadow);
+        vcpu->set_cr4(info.val);
+        vcpu->set_cr4_read_shadow(info.shadow);
     }
 
     if (!info.ignore_advance) {
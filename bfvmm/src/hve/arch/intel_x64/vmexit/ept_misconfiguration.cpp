@@ -53,8 +53,8 @@ bool
 ept_misconfiguration_handler::handle(gsl::not_null<vcpu_t *> vcpu)
 {
     struct info_t info = {
-        vmcs_n::guest_linear_address::get(),
-        vmcs_n::guest_physical_address::get(),
+        vcpu->guest_linear_address(),
+        vcpu->guest_physical_address(),
         false
     };
 
@@ -79,11 +79,11 @@ bool
 ept_violation_handler::handle(gsl::not_null<vcpu_t *> vcpu)
 {
     using namespace vmcs_n;
-    auto qual = exit_qualification::ept_violation::get();
+    auto qual = vcpu->exit_qualification();
 
     struct info_t info = {
-        guest_linear_address::get(),
-        guest_physical_address::get(),
+        vcpu->guest_linear_address(),
+        vcpu->guest_physical_address(),
         qual,
         true
     };
@@ -68,7 +68,9 @@ bool
 external_interrupt_handler::handle(gsl::not_null<vcpu_t *> vcpu)
 {
     struct info_t info = {
-        vmcs_n::vm_exit_interruption_information::vector::get()
+        vmcs_n::vm_exit_interruption_information::vector::get(
+            vcpu->exit_interruption_information()
+        )
     };
 
     for (const auto &d : m_handlers) {
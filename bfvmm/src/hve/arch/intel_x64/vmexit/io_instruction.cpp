@@ -27,8 +27,99 @@
 //     saying the lvalue (d) can't bind to the rvalue.
 //
 
+#include <cstring>
+#include <algorithm>
+
 #include <hve/arch/intel_x64/vcpu.h>
 
+// -----------------------------------------------------------------------------
+// String Instruction Helpers
+// -----------------------------------------------------------------------------
+
+// Note:
+//
+// INS and OUTS store the address size in the same bits of the VM-exit
+// instruction information field, so the INS definitions are used for both.
+//
+
+static uint64_t
+address_size_mask(uint64_t instruction_information)
+{
+    namespace ins = vmcs_n::vm_exit_instruction_information::ins;
+
+    switch (ins::address_size::get(instruction_information)) {
+        case ins::address_size::_16bit:
+            return 0x000000000000FFFFULL;
+
+        case ins::address_size::_32bit:
+            return 0x00000000FFFFFFFFULL;
+
+        default:
+            return 0xFFFFFFFFFFFFFFFFULL;
+    }
+}
+
+// Note:
+//
+// Without the VM-exit instruction information, the address size of the
+// guest's code segment is used (i.e. an address size prefix is not
+// honored). The L bit can only be set in 64bit mode.
+//
+
+static uint64_t
+default_address_size_mask()
+{
+    namespace cs = vmcs_n::guest_cs_access_rights;
+
+    if (cs::l::is_enabled()) {
+        return 0xFFFFFFFFFFFFFFFFULL;
+    }
+
+    if (cs::db::is_enabled()) {
+        return 0x00000000FFFFFFFFULL;
+    }
+
+    return 0x000000000000FFFFULL;
+}
+
+// Note:
+//
+// A 16bit register update preserves the upper bits of the register while
+// a 32bit register update zero extends, just like the CPU would.
+//
+
+static uint64_t
+update_register(uint64_t reg, uint64_t val, uint64_t mask)
+{
+    if (mask == 0x000000000000FFFFULL) {
+        return set_bits(reg, mask, val);
+    }
+
+    return val & mask;
+}
+
+// Note:
+//
+// Returns the number of elements (up to max) that can be accessed, starting
+// at the provided address and moving in the provided direction, without
+// leaving the address's page. 0 is returned if the first element crosses
+// a page boundary.
+//
+
+static uint64_t
+elements_in_page(uint64_t addr, uint64_t bytes, bool backward, uint64_t max)
+{
+    using namespace ::x64::pt;
+    const auto offset = bfn::lower(addr);
+
+    if (offset + bytes > page_size) {
+        return 0;
+    }
+
+    auto count = backward ? (offset / bytes) + 1 : (page_size - offset) / bytes;
+    return count < max ? count : max;
+}
+
 namespace bfvmm::intel_x64
 {
 
@@ -36,6 +127,7 @@ io_instruction_handler::io_instruction_handler(
     gsl::not_null<vcpu *> vcpu
 ) :
     m_vcpu{vcpu},
+    m_ins_outs_information{::intel_x64::msrs::ia32_vmx_basic::ins_outs_exit_information::is_enabled()},
     m_io_bitmap_a{vcpu->m_io_bitmap_a.get(), ::x64::pt::page_size},
     m_io_bitmap_b{vcpu->m_io_bitmap_b.get(), ::x64::pt::page_size}
 {
@@ -56,6 +148,18 @@ io_instruction_handler::add_handler(
     vmcs_n::value_type port,
     const handler_delegate_t &in_d,
     const handler_delegate_t &out_d)
+{
+    m_in_handlers[port].push_front(std::move(in_d));
+    m_out_handlers[port].push_front(std::move(out_d));
+
+    m_intercept[port] = true;
+}
+
+void
+io_instruction_handler::add_pass_through_handler(
+    vmcs_n::value_type port,
+    const handler_delegate_t &in_d,
+    const handler_delegate_t &out_d)
 {
     m_in_handlers[port].push_front(std::move(in_d));
     m_out_handlers[port].push_front(std::move(out_d));
@@ -128,12 +232,7 @@ bool
 io_instruction_handler::handle(gsl::not_null<vcpu_t *> vcpu)
 {
     namespace io_instruction = vmcs_n::exit_qualification::io_instruction;
-    auto eq = io_instruction::get();
-
-    auto reps = 1ULL;
-    if (io_instruction::rep_prefixed::is_enabled(eq)) {
-        reps = vcpu->rcx() & 0x00000000FFFFFFFFULL;
-    }
+    auto eq = vcpu->exit_qualification();
 
     struct info_t info = {
         0ULL,
@@ -154,22 +253,21 @@ io_instruction_handler::handle(gsl::not_null<vcpu_t *> vcpu)
             break;
     }
 
-    if (io_instruction::string_instruction::is_enabled(eq)) {
-        info.address = vmcs_n::guest_linear_address::get();
-    }
+    const auto in =
+        io_instruction::direction_of_access::get(eq) == io_instruction::direction_of_access::in;
 
-    for (auto i = 0ULL; i < reps; i++) {
-        switch (io_instruction::direction_of_access::get(eq)) {
-            case io_instruction::direction_of_access::in:
-                handle_in(vcpu, info);
-                break;
+    if (io_instruction::string_instruction::is_enabled(eq)) {
+        info.address = vcpu->guest_linear_address();
 
-            default:
-                handle_out(vcpu, info);
-                break;
-        }
+        handle_string(vcpu, info, in, io_instruction::rep_prefixed::is_enabled(eq));
+        return true;
+    }
 
-        info.address += info.size_of_access + 1ULL;
+    if (in) {
+        handle_in(vcpu, info);
+    }
+    else {
+        handle_out(vcpu, info);
     }
 
     return true;
@@ -244,6 +342,233 @@ io_instruction_handler::handle_out(gsl::not_null<vcpu_t *> vcpu, info_t &info)
     return false;
 }
 
+bool
+io_instruction_handler::handle_string(
+    gsl::not_null<vcpu_t *> vcpu, info_t &info, bool in, bool rep)
+{
+    using namespace ::x64::pt;
+
+    auto &handlers = in ? m_in_handlers : m_out_handlers;
+    const auto &hdlrs = handlers.find(info.port_number);
+
+    if (GSL_LIKELY(hdlrs != handlers.end())) {
+        const auto mask = m_ins_outs_information ?
+                          address_size_mask(vcpu->exit_instruction_information()) :
+                          default_address_size_mask();
+
+        const auto backward =
+            ::x64::rflags::direction_flag::is_enabled(vmcs_n::guest_rflags::get());
+
+        const auto bytes = info.size_of_access + 1ULL;
+        const auto reps = rep ? vcpu->rcx() & mask : 1ULL;
+
+        // Note:
+        //
+        // Without the VM-exit instruction information, the address size
+        // is a guess, so only one element is handled per VM exit. The
+        // instruction is not advanced until RCX reaches 0, so the guest
+        // executes it again (and exits again) for each element, and the
+        // registers are never off by more than one element.
+        //
+
+        const auto limit = m_ins_outs_information ? reps : std::min(reps, 1ULL);
+
+        auto done = 0ULL;
+        auto advance = true;
+
+        while (done < limit) {
+            auto count = elements_in_page(info.address, bytes, backward, limit - done);
+            auto handled = 0ULL;
+
+            if (GSL_LIKELY(count != 0)) {
+                const auto gva =
+                    backward ? info.address - ((count - 1) * bytes) : info.address;
+
+                auto hpa = vcpu->gva_to_hpa(gva).first;
+                auto map = vcpu->map_hpa_4k<uint8_t>(bfn::upper(hpa));
+
+                handled = this->handle_block(
+                    vcpu, hdlrs->second, info, map.get() + bfn::lower(hpa), count, in, backward, advance
+                );
+            }
+            else {
+
+                // Note:
+                //
+                // The element crosses a page boundary, so it is staged in
+                // a local buffer instead of being accessed in place.
+                //
+
+                const auto gva = info.address;
+                std::array<uint8_t, sizeof(uint32_t)> buf{};
+
+                count = 1;
+
+                if (!in) {
+                    vcpu->read_guest(gva, buf.data(), bytes);
+                }
+
+                handled = this->handle_block(
+                    vcpu, hdlrs->second, info, buf.data(), count, in, backward, advance
+                );
+
+                if (in && handled != 0) {
+                    vcpu->write_guest(gva, buf.data(), bytes);
+                }
+            }
+
+            done += handled;
+
+            if (handled != count) {
+                break;
+            }
+        }
+
+        const auto delta = done * bytes;
+
+        if (in) {
+            const auto rdi = vcpu->rdi();
+            vcpu->set_rdi(update_register(rdi, backward ? rdi - delta : rdi + delta, mask));
+        }
+        else {
+            const auto rsi = vcpu->rsi();
+            vcpu->set_rsi(update_register(rsi, backward ? rsi - delta : rsi + delta, mask));
+        }
+
+        if (rep) {
+            vcpu->set_rcx(update_register(vcpu->rcx(), reps - done, mask));
+        }
+
+        if (done == reps) {
+            return advance ? vcpu->advance() : true;
+        }
+
+        if (done == limit) {
+            return true;
+        }
+    }
+
+    if (m_default_handler.is_valid()) {
+        bfdebug_nhex(0, in ? "handle_ins" : "handle_outs", info.port_number);
+        return m_default_handler(vcpu);
+    }
+
+    return false;
+}
+
+uint64_t
+io_instruction_handler::handle_block(
+    gsl::not_null<vcpu_t *> vcpu,
+    const std::list<handler_delegate_t> &hdlrs,
+    info_t &info,
+    uint8_t *buf,
+    uint64_t count,
+    bool in,
+    bool backward,
+    bool &advance)
+{
+    const auto bytes = info.size_of_access + 1ULL;
+    const auto hardware = !m_emulate[info.port_number];
+
+    // Note:
+    //
+    // Elements are accessed in the order the guest would access them,
+    // which means that when the direction flag is set, the first element
+    // is at the end of buf. In this case, the port can't be accessed using
+    // a single REP INS / OUTS (which always move forward), so each element
+    // is accessed individually instead.
+    //
+    // A REP INS reads the whole block from the port before the handlers
+    // are called, so it is only used if none of the port's handlers can
+    // decline an element (which would drop the rest of the block).
+    //
+
+    const auto batch = hardware && !backward;
+    const auto batch_in = batch && !m_intercept[info.port_number];
+
+    if (in && batch_in) {
+        emulate_ins(info, buf, count);
+    }
+
+    auto pending = 0ULL;
+    auto pending_buf = buf;
+
+    for (auto i = 0ULL; i < count; i++) {
+        auto element = backward ? buf + ((count - 1 - i) * bytes) : buf + (i * bytes);
+
+        info.val = 0ULL;
+        info.ignore_write = false;
+        info.ignore_advance = false;
+
+        if (in) {
+            if (batch_in) {
+                std::memcpy(&info.val, element, bytes);
+            }
+            else if (hardware) {
+                emulate_in(info);
+            }
+        }
+        else {
+            std::memcpy(&info.val, element, bytes);
+        }
+
+        auto handled = false;
+        for (const auto &d : hdlrs) {
+            if (d(vcpu, info)) {
+                handled = true;
+                break;
+            }
+        }
+
+        if (!handled) {
+            emulate_outs(info, pending_buf, pending);
+            return i;
+        }
+
+        if (info.ignore_advance) {
+            advance = false;
+        }
+
+        if (in) {
+            if (!info.ignore_write) {
+                std::memcpy(element, &info.val, bytes);
+            }
+        }
+        else if (!info.ignore_write && hardware) {
+
+            // Note:
+            //
+            // Consecutive elements that are written to the port unmodified
+            // are sent using a single REP OUTS directly from the guest's
+            // memory. An element that was modified by a handler ends the
+            // run, and is sent on its own.
+            //
+
+            if (batch && std::memcmp(element, &info.val, bytes) == 0) {
+                pending++;
+            }
+            else {
+                emulate_outs(info, pending_buf, pending);
+                emulate_out(info);
+
+                pending = 0;
+                pending_buf = element + bytes;
+            }
+        }
+        else {
+            emulate_outs(info, pending_buf, pending);
+
+            pending = 0;
+            pending_buf = element + bytes;
+        }
+
+        info.address = backward ? info.address - bytes : info.address + bytes;
+    }
+
+    emulate_outs(info, pending_buf, pending);
+    return count;
+}
+
 void
 io_instruction_handler::emulate_in(info_t &info)
 {
@@ -293,6 +618,78 @@ io_instruction_handler::emulate_out(info_t &info)
     }
 }
 
+void
+io_instruction_handler::emulate_ins(info_t &info, uint8_t *buf, uint64_t count)
+{
+    namespace io_instruction = vmcs_n::exit_qualification::io_instruction;
+
+    if (count == 0) {
+        return;
+    }
+
+    switch (info.size_of_access) {
+        case io_instruction::size_of_access::one_byte:
+            ::x64::portio::insbrep(
+                gsl::narrow_cast<uint16_t>(info.port_number),
+                buf,
+                gsl::narrow_cast<uint32_t>(count)
+            );
+            break;
+
+        case io_instruction::size_of_access::two_byte:
+            ::x64::portio::inswrep(
+                gsl::narrow_cast<uint16_t>(info.port_number),
+                buf,
+                gsl::narrow_cast<uint32_t>(count)
+            );
+            break;
+
+        default:
+            ::x64::portio::insdrep(
+                gsl::narrow_cast<uint16_t>(info.port_number),
+                buf,
+                gsl::narrow_cast<uint32_t>(count)
+            );
+            break;
+    }
+}
+
+void
+io_instruction_handler::emulate_outs(info_t &info, uint8_t *buf, uint64_t count)
+{
+    namespace io_instruction = vmcs_n::exit_qualification::io_instruction;
+
+    if (count == 0) {
+        return;
+    }
+
+    switch (info.size_of_access) {
+        case io_instruction::size_of_access::one_byte:
+            ::x64::portio::outsbrep(
+                gsl::narrow_cast<uint16_t>(info.port_number),
+                buf,
+                gsl::narrow_cast<uint32_t>(count)
+            );
+            break;
+
+        case io_instruction::size_of_access::two_byte:
+            ::x64::portio::outswrep(
+                gsl::narrow_cast<uint16_t>(info.port_number),
+                buf,
+                gsl::narrow_cast<uint32_t>(count)
+            );
+            break;
+
+        default:
+            ::x64::portio::outsdrep(
+                gsl::narrow_cast<uint16_t>(info.port_number),
+                buf,
+                gsl::narrow_cast<uint32_t>(count)
+            );
+            break;
+    }
+}
+
 void
 io_instruction_handler::load_operand(
     gsl::not_null<vcpu_t *> vcpu, info_t &info)
@@ -190,11 +190,11 @@ sipi_signal_handler::handle(gsl::not_null<vcpu_t *> vcpu)
     // by a full 12 bits since the first 4 bits are the RPL and TI bits.
     //
 
-    uint64_t vector_cs_selector =
-        vmcs_n::exit_qualification::sipi::vector::get() << 8;
+    auto vector =
+        vmcs_n::exit_qualification::sipi::vector::get(vcpu->exit_qualification());
 
-    uint64_t vector_cs_base =
-        vmcs_n::exit_qualification::sipi::vector::get() << 12;
+    uint64_t vector_cs_selector = vector << 8;
+    uint64_t vector_cs_base = vector << 12;
 
     vmcs_n::guest_cs_selector::set(vector_cs_selector);
     vmcs_n::guest_cs_base::set(vector_cs_base);
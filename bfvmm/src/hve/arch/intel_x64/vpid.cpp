@@ -19,27 +19,112 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <bfdebug.h>
 #include <hve/arch/intel_x64/vcpu.h>
 
 namespace bfvmm::intel_x64
 {
 
+// -----------------------------------------------------------------------------
+// VPID Allocator
+// -----------------------------------------------------------------------------
+
+vpid_allocator::vpid_allocator() noexcept
+{ m_bitmap.at(0) = 1; }
+
+vpid_allocator *
+vpid_allocator::instance() noexcept
+{
+    static vpid_allocator self;
+    return &self;
+}
+
+uint16_t
+vpid_allocator::allocate() noexcept
+{
+    // Note:
+    //
+    // The search starts at the word that the last VPID was allocated from,
+    // and wraps around, which means that a released VPID is not handed out
+    // again until the rest of the VPID space has been searched. If a word
+    // is modified while it is being searched, the CAS fails and the search
+    // of that word is retried using the updated value.
+    //
+
+    const auto start = m_next.load(std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < m_bitmap.size(); i++) {
+        const auto index = (start + i) % m_bitmap.size();
+        auto &word = m_bitmap.at(index);
+
+        auto val = word.load(std::memory_order_relaxed);
+        while (val != ~0ULL) {
+            const auto bit = static_cast<std::size_t>(__builtin_ctzll(~val));
+
+            if (word.compare_exchange_weak(val, val | (1ULL << bit), std::memory_order_acquire)) {
+                m_next.store(index, std::memory_order_relaxed);
+                return static_cast<uint16_t>((index * 64) + bit);
+            }
+        }
+    }
+
+    return 0;
+}
+
+void
+vpid_allocator::release(uint16_t id) noexcept
+{
+    if (id == 0) {
+        return;
+    }
+
+    m_bitmap.at(id / 64U).fetch_and(~(1ULL << (id % 64U)), std::memory_order_release);
+}
+
+bool
+vpid_allocator::is_allocated(uint16_t id) const noexcept
+{ return (m_bitmap.at(id / 64U).load(std::memory_order_relaxed) & (1ULL << (id % 64U))) != 0; }
+
+// -----------------------------------------------------------------------------
+// VPID Handler
+// -----------------------------------------------------------------------------
+
 vpid_handler::vpid_handler(
     gsl::not_null<vcpu *> vcpu
 ) :
-    m_vcpu{vcpu}
+    m_vcpu{vcpu},
+    m_id{vpid_allocator::instance()->allocate()}
 {
-    static uint16_t s_id = 1;
-    m_id = s_id++;
-
     vmcs_n::virtual_processor_identifier::set(m_id);
+
+    // Note:
+    //
+    // The VPID might have been used by a vCPU that has since been
+    // destroyed (or by a hypervisor that was loaded before this one), in
+    // which case the TLB might still contain mappings tagged with it. These
+    // are invalidated before this vCPU's first VM entry.
+    //
+
+    if (m_id != 0) {
+        vcpu->invalidations()->invvpid_single_context();
+    }
 }
 
+vpid_handler::~vpid_handler()
+{ vpid_allocator::instance()->release(gsl::narrow_cast<uint16_t>(m_id)); }
+
 vmcs_n::value_type vpid_handler::id() const noexcept
 { return m_id; }
 
 void vpid_handler::enable()
-{ vmcs_n::secondary_processor_based_vm_execution_controls::enable_vpid::enable(); }
+{
+    if (m_id == 0) {
+        bfalert_info(0, "all VPIDs are in use. VPID remains disabled");
+        return;
+    }
+
+    vmcs_n::secondary_processor_based_vm_execution_controls::enable_vpid::enable();
+}
 
 void vpid_handler::disable()
 { vmcs_n::secondary_processor_based_vm_execution_controls::enable_vpid::disable(); }
@@ -0,0 +1,288 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// TIDY_EXCLUSION=-cppcoreguidelines-pro-type-reinterpret-cast
+//
+// Reason:
+//     Although in general this is a good rule, for hypervisor level code that
+//     interfaces with the kernel, and raw hardware, this rule is
+//     impractical.
+//
+
+#include <bfthreadcontext.h>
+#include <hve/arch/x64/map_cache.h>
+
+// Note:
+//
+// The windows are a single, contiguous range of host virtual addresses,
+// which is allocated the first time the cache is used, so the window that
+// is being released can be found using the address alone. Once a window is
+// mapped, the PTE that maps it is remembered. The page tables that hold
+// these PTEs are never released while the cache exists (unmap() does not
+// release page tables), so pointing a window at a different host physical
+// address is a PTE write followed by an INVLPG of the window.
+//
+// The cache remembers the CPU that owns it (see set_owner()), and only that
+// CPU is allowed to modify the cache. The INVLPG above only flushes the
+// TLB of the CPU that executes it, which is fine as long as the windows
+// are only ever accessed by that CPU, which is why a map from any other
+// CPU is not served by the cache (a lock would protect the cache, but not
+// the TLBs of the other CPUs).
+//
+
+static constexpr std::size_t
+bucket(uintptr_t hpa) noexcept
+{ return static_cast<std::size_t>((hpa >> ::x64::pt::from) & (MAP_CACHE_SIZE - 1)); }
+
+namespace bfvmm::x64
+{
+
+map_cache::~map_cache()
+{
+    if (m_base == 0) {
+        return;
+    }
+
+    for (index_type i = 0; i < MAP_CACHE_SIZE; i++) {
+        if (m_windows.at(i).pte != nullptr) {
+            g_cr3->unmap(window_hva(i));
+            ::x64::tlb::invlpg(window_hva(i));
+        }
+    }
+
+    g_mm->free_map(reinterpret_cast<void *>(m_base));
+}
+
+void *
+map_cache::acquire(uintptr_t hpa)
+{
+    expects(bfn::lower(hpa, ::x64::pt::from) == 0);
+
+    if (!this->owner()) {
+        return nullptr;
+    }
+
+    if (m_base == 0) {
+        this->init();
+    }
+
+    for (auto i = m_buckets.at(bucket(hpa)); i != s_none; i = m_windows.at(i).chain) {
+        auto &window = m_windows.at(i);
+
+        if (window.hpa == hpa) {
+            if (window.refs++ == 0) {
+                this->lru_remove(i);
+            }
+
+            m_hits++;
+            return reinterpret_cast<void *>(window_hva(i));
+        }
+    }
+
+    m_misses++;
+
+    const auto i = m_lru_tail;
+    if (i == s_none) {
+        return nullptr;
+    }
+
+    auto &window = m_windows.at(i);
+    const auto hva = window_hva(i);
+
+    if (window.pte == nullptr) {
+        window.pte = &g_cr3->map_4k(hva, hpa);
+    }
+    else {
+        this->hash_remove(i);
+
+        ::x64::pt::entry::phys_addr::set(*window.pte, hpa);
+        ::x64::tlb::invlpg(hva);
+    }
+
+    this->lru_remove(i);
+
+    window.hpa = hpa;
+    window.refs = 1;
+    this->hash_insert(i);
+
+    return reinterpret_cast<void *>(hva);
+}
+
+void
+map_cache::release(void *hva) noexcept
+{
+    const auto addr = reinterpret_cast<uintptr_t>(hva);
+
+    if (addr < m_base || addr >= m_base + (MAP_CACHE_SIZE * ::x64::pt::page_size)) {
+        return;
+    }
+
+    if (!this->owner()) {
+        bferror_nhex(0, "map_cache: window released by a remote cpu", addr);
+        return;
+    }
+
+    const auto i = static_cast<index_type>((addr - m_base) >> ::x64::pt::from);
+    auto &window = m_windows.at(i);
+
+    if (window.refs > 0 && --window.refs == 0) {
+        this->lru_push(i);
+    }
+}
+
+void
+map_cache::clear()
+{
+    if (m_base == 0) {
+        return;
+    }
+
+    expects(this->owner());
+
+    for (auto i = m_lru_head; i != s_none; i = m_windows.at(i).next) {
+        auto &window = m_windows.at(i);
+
+        if (window.pte == nullptr) {
+            continue;
+        }
+
+        this->hash_remove(i);
+
+        g_cr3->unmap(window_hva(i));
+        ::x64::tlb::invlpg(window_hva(i));
+
+        window.hpa = 0;
+        window.pte = nullptr;
+    }
+}
+
+void
+map_cache::set_owner() noexcept
+{
+    const auto cpuid = thread_context_cpuid();
+
+    if (m_cpuid == cpuid) {
+        return;
+    }
+
+    for (index_type i = 0; m_base != 0 && i < MAP_CACHE_SIZE; i++) {
+        if (m_windows.at(i).pte != nullptr) {
+            ::x64::tlb::invlpg(window_hva(i));
+        }
+    }
+
+    m_cpuid = cpuid;
+}
+
+void
+map_cache::init()
+{
+    using namespace ::x64::pt;
+
+    auto base = g_mm->alloc_map(MAP_CACHE_SIZE * page_size);
+    if (base == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    m_base = reinterpret_cast<uintptr_t>(base);
+    m_buckets.fill(s_none);
+
+    for (index_type i = 0; i < MAP_CACHE_SIZE; i++) {
+        this->lru_push(i);
+    }
+}
+
+bool
+map_cache::owner() const noexcept
+{ return thread_context_cpuid() == m_cpuid; }
+
+void
+map_cache::hash_insert(index_type i) noexcept
+{
+    auto &head = m_buckets.at(bucket(m_windows.at(i).hpa));
+
+    m_windows.at(i).chain = head;
+    head = i;
+}
+
+void
+map_cache::hash_remove(index_type i) noexcept
+{
+    auto *link = &m_buckets.at(bucket(m_windows.at(i).hpa));
+
+    while (*link != s_none) {
+        if (*link == i) {
+            *link = m_windows.at(i).chain;
+            break;
+        }
+
+        link = &m_windows.at(*link).chain;
+    }
+
+    m_windows.at(i).chain = s_none;
+}
+
+void
+map_cache::lru_push(index_type i) noexcept
+{
+    auto &window = m_windows.at(i);
+
+    window.prev = s_none;
+    window.next = m_lru_head;
+
+    if (m_lru_head != s_none) {
+        m_windows.at(m_lru_head).prev = i;
+    }
+    else {
+        m_lru_tail = i;
+    }
+
+    m_lru_head = i;
+}
+
+void
+map_cache::lru_remove(index_type i) noexcept
+{
+    auto &window = m_windows.at(i);
+
+    if (window.prev != s_none) {
+        m_windows.at(window.prev).next = window.next;
+    }
+    else {
+        m_lru_head = window.next;
+    }
+
+    if (window.next != s_none) {
+        m_windows.at(window.next).prev = window.prev;
+    }
+    else {
+        m_lru_tail = window.prev;
+    }
+
+    window.prev = s_none;
+    window.next = s_none;
+}
+
+uintptr_t
+map_cache::window_hva(index_type i) const noexcept
+{ return m_base + (static_cast<uintptr_t>(i) << ::x64::pt::from); }
+
+}
@@ -28,6 +28,7 @@
 //
 
 #include <hve/arch/x64/unmapper.h>
+#include <hve/arch/x64/map_cache.h>
 #include <memory_manager/arch/x64/cr3.h>
 
 namespace bfvmm::x64
@@ -37,21 +38,33 @@ void
 unmapper::operator()(void *p) const
 {
     bfignored(p);
-    using namespace ::x64::pt;
+
+    if (m_hva == 0) {
+        return;
+    }
+
+    if (m_cache != nullptr) {
+        m_cache->release(reinterpret_cast<void *>(m_hva));
+        return;
+    }
 
     /// Note:
     ///
-    /// For now, we do not have a map_gva function that is above 4k, so we
-    /// only need to loop with 4k granularity. All of the map_gpa functions
-    /// only need to unmap once, so they will work as well. At some point,
-    /// we should add a map_gva functions that is above 4k. When this is
-    /// done, we will likely have to track the granularity so that we know
-    /// what pages need to be unmapped specifically.
+    /// The range might be mapped using 1g or 2m pages (e.g. map_hpa_1g()),
+    /// so the range is walked using the size of the page that was actually
+    /// unmapped, which results in a single unmap and a single INVLPG per
+    /// page instead of one per 4k of the range. INVLPG invalidates the
+    /// entire page that contains the provided address, no matter its size.
+    ///
+    /// The INVLPG cannot be deferred, as the range is returned to the memory
+    /// manager below, and might be mapped again right away.
     ///
 
-    for (auto hva = m_hva; hva < m_hva + m_len; hva += page_size) {
-        g_cr3->unmap(hva);
+    for (auto hva = m_hva; hva < m_hva + m_len;) {
+        const auto from = g_cr3->unmap(reinterpret_cast<void *>(hva));
+
         ::x64::tlb::invlpg(hva);
+        hva = bfn::upper(hva, from) + (1ULL << from);
     }
 
     g_mm->free_map(reinterpret_cast<void *>(m_hva));
@@ -19,9 +19,17 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
+
 #include <bfupperlower.h>
 #include <memory_manager/arch/x64/cr3/helpers.h>
 
+// -----------------------------------------------------------------------------
+// Global Variables
+// -----------------------------------------------------------------------------
+
+static bfvmm::x64::cr3::mmap::phys_addr_t g_vmm_direct_map_size{};
+
 // -----------------------------------------------------------------------------
 // Helpers
 // -----------------------------------------------------------------------------
@@ -300,4 +308,49 @@ identity_map_convert_4k_to_2m(
     map.map_2m(addr, addr, attr, cache);
 }
 
+mmap::phys_addr_t
+direct_map(
+    mmap &map,
+    mmap::phys_addr_t size)
+{
+    using namespace ::intel_x64::ept;
+
+    expects(size != 0);
+
+    if (::intel_x64::cpuid::ext_feature_info::edx::pages_avail::is_enabled()) {
+        size = bfn::upper(size + pdpt::page_size - 1, pdpt::from);
+
+        for (mmap::phys_addr_t hpa = 0; hpa < size; hpa += pdpt::page_size) {
+            map.map_1g(DIRECT_MAP_START + hpa, hpa);
+        }
+    }
+    else {
+        size = bfn::upper(size + pd::page_size - 1, pd::from);
+
+        for (mmap::phys_addr_t hpa = 0; hpa < size; hpa += pd::page_size) {
+            map.map_2m(DIRECT_MAP_START + hpa, hpa);
+        }
+    }
+
+    return size;
+}
+
+void
+init_vmm_direct_map()
+{
+    if (DIRECT_MAP_SIZE == 0 || g_vmm_direct_map_size != 0) {
+        return;
+    }
+
+    const auto bits = ::x64::cpuid::addr_size::phys::get();
+    const auto size = bits != 0 && bits < 64 ? 1ULL << bits : DIRECT_MAP_SIZE;
+
+    g_vmm_direct_map_size =
+        direct_map(*vmm_cr3(), std::min<mmap::phys_addr_t>(size, DIRECT_MAP_SIZE));
+}
+
+mmap::phys_addr_t
+vmm_direct_map_size() noexcept
+{ return g_vmm_direct_map_size; }
+
 }
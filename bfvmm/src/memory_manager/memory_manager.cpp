@@ -34,10 +34,13 @@
 //     impractical.
 //
 
+#include <algorithm>
+
 #include <bfgsl.h>
 #include <bfconstants.h>
 #include <bfexception.h>
 #include <bfupperlower.h>
+#include <bfthreadcontext.h>
 
 #include <memory_manager/memory_manager.h>
 
@@ -71,59 +74,6 @@ auto &alloc_mem_map_mutex()
     return s_alloc_mem_map_mutex;
 }
 
-// -----------------------------------------------------------------------------
-// Stats
-// -----------------------------------------------------------------------------
-
-#if 0
-
-struct stats_data_t {
-    size_t size;
-    size_t count;
-};
-
-int g_stats_index = 0;
-stats_data_t g_stats_data[2048] = {};
-
-extern "C" EXPORT_SYM void
-print_stats()
-{
-    char numstr[64]; \
-    const char *str_text = "\033[1;32mDEBUG\033[0m: size = "; \
-    const char *str_next = ", count = "; \
-    const char *str_endl = "\n"; \
-
-    for (int i = 0; i < g_stats_index; i++) {
-        unsafe_write_cstr(str_text, strlen(str_text)); \
-        bfitoa(g_stats_data[i].size, numstr, 16); \
-        unsafe_write_cstr(numstr, strlen(numstr)); \
-        unsafe_write_cstr(str_next, strlen(str_next)); \
-        bfitoa(g_stats_data[i].count, numstr, 16); \
-        unsafe_write_cstr(numstr, strlen(numstr)); \
-        unsafe_write_cstr(str_endl, strlen(str_endl)); \
-    }
-}
-
-inline void add_stats(size_t size)
-{
-    auto found = false;
-
-    for (int i = 0; i < g_stats_index; i++) {
-        if (g_stats_data[i].size == size) {
-            found = true;
-            g_stats_data[i].count++;
-        }
-    }
-
-    if (!found) {
-        g_stats_data[g_stats_index].size = size;
-        g_stats_data[g_stats_index].count++;
-        g_stats_index++;
-    }
-}
-
-#endif
-
 // -----------------------------------------------------------------------------
 // Implementation
 // -----------------------------------------------------------------------------
@@ -148,8 +98,60 @@ alignas(BAREFLANK_PAGE_SIZE) uint8_t g_huge_pool_node_tree[buddy_allocator::node
 constexpr auto g_mem_map_pool_k = MEM_MAP_POOL_K;
 alignas(BAREFLANK_PAGE_SIZE) uint8_t g_mem_map_pool_node_tree[buddy_allocator::node_tree_size(g_mem_map_pool_k)] = {};
 
+constexpr auto g_slab_pool_k = SLAB_POOL_K;
+static_assert(g_slab_pool_k < g_page_pool_k, "the SLAB pool must be smaller than the page pool");
+
 /// \endcond
 
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+static std::size_t
+page_pool_index(uintptr_t virt) noexcept
+{ return (virt - reinterpret_cast<uintptr_t>(g_page_pool_buffer)) / BAREFLANK_PAGE_SIZE; }
+
+template<typename T>
+static void
+coalesce_extents(std::vector<T> &extents)
+{
+    std::sort(extents.begin(), extents.end(), [](const auto & lhs, const auto & rhs) {
+        return lhs.from < rhs.from;
+    });
+
+    std::size_t num = 0;
+    for (const auto &extent : extents) {
+        if (num != 0) {
+            auto &prev = extents.at(num - 1);
+
+            if (prev.from + prev.size == extent.from && prev.to + prev.size == extent.to) {
+                prev.size += extent.size;
+                continue;
+            }
+        }
+
+        extents.at(num++) = extent;
+    }
+
+    extents.resize(num);
+}
+
+template<typename T>
+static const T *
+find_extent(const std::vector<T> &extents, uintptr_t addr) noexcept
+{
+    auto iter = std::upper_bound(extents.begin(), extents.end(), addr, [](auto lhs, const auto & rhs) {
+        return lhs < rhs.from;
+    });
+
+    if (iter == extents.begin()) {
+        return nullptr;
+    }
+
+    --iter;
+    return addr - iter->from < iter->size ? &*iter : nullptr;
+}
+
 // -----------------------------------------------------------------------------
 // Implementation
 // -----------------------------------------------------------------------------
@@ -166,59 +168,27 @@ memory_manager::instance() noexcept
 memory_manager::pointer
 memory_manager::alloc(size_type size) noexcept
 {
-    std::lock_guard<std::mutex> lock(alloc_mutex());
-
     if (size == 0) {
         return nullptr;
     }
 
-    try {
-        if (size <= 0x010) {
-            return slab010.allocate();
-        }
-
-        if (size <= 0x020) {
-            return slab020.allocate();
-        }
-
-        if (size <= 0x030) {
-            return slab030.allocate();
-        }
-
-        if (size <= 0x040) {
-            return slab040.allocate();
-        }
-
-        if (size <= 0x080) {
-            return slab080.allocate();
-        }
-
-        if (size <= 0x100) {
-            return slab100.allocate();
-        }
-
-        if (size <= 0x200) {
-            return slab200.allocate();
-        }
-
-        if (size <= 0x400) {
-            return slab400.allocate();
-        }
+    if (size <= 0x800) {
+        return this->alloc_slab(slab_index(size));
+    }
 
-        if (size <= 0x800) {
-            return slab800.allocate();
-        }
+    if (size > BAREFLANK_PAGE_SIZE) {
+        std::lock_guard<std::mutex> lock(alloc_mutex());
 
-        if (size > BAREFLANK_PAGE_SIZE) {
+        try {
             return static_cast<pointer>(g_huge_pool.allocate(size));
         }
+        catch (...)
+        { WARNING("memory_manager::alloc: std::bad_alloc thrown"); }
 
-        return alloc_page();
+        return nullptr;
     }
-    catch (...)
-    { WARNING("memory_manager::alloc: std::bad_alloc thrown"); }
 
-    return nullptr;
+    return alloc_page();
 }
 
 memory_manager::pointer
@@ -256,46 +226,16 @@ memory_manager::alloc_map(size_type size) noexcept
 void
 memory_manager::free(pointer ptr) noexcept
 {
-    std::lock_guard<std::mutex> lock(alloc_mutex());
-
-    if (slab010.contains(ptr)) {
-        return slab010.deallocate(ptr);
-    }
-
-    if (slab020.contains(ptr)) {
-        return slab020.deallocate(ptr);
-    }
-
-    if (slab030.contains(ptr)) {
-        return slab030.deallocate(ptr);
-    }
-
-    if (slab040.contains(ptr)) {
-        return slab040.deallocate(ptr);
-    }
-
-    if (slab080.contains(ptr)) {
-        return slab080.deallocate(ptr);
-    }
-
-    if (slab100.contains(ptr)) {
-        return slab100.deallocate(ptr);
-    }
-
-    if (slab200.contains(ptr)) {
-        return slab200.deallocate(ptr);
-    }
-
-    if (slab400.contains(ptr)) {
-        return slab400.deallocate(ptr);
+    if (auto index = this->slab_index(ptr); index < m_slabs.size()) {
+        return this->free_slab(index, ptr);
     }
 
-    if (slab800.contains(ptr)) {
-        return slab800.deallocate(ptr);
-    }
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex());
 
-    if (g_huge_pool.contains(ptr)) {
-        return g_huge_pool.deallocate(ptr);
+        if (g_huge_pool.contains(ptr)) {
+            return g_huge_pool.deallocate(ptr);
+        }
     }
 
     free_page(ptr);
@@ -318,46 +258,16 @@ memory_manager::free_map(pointer ptr) noexcept
 memory_manager::size_type
 memory_manager::size(pointer ptr) const noexcept
 {
-    std::lock_guard<std::mutex> lock(alloc_mutex());
-
-    if (slab010.contains(ptr)) {
-        return slab010.size(ptr);
-    }
-
-    if (slab020.contains(ptr)) {
-        return slab020.size(ptr);
-    }
-
-    if (slab030.contains(ptr)) {
-        return slab030.size(ptr);
-    }
-
-    if (slab040.contains(ptr)) {
-        return slab040.size(ptr);
-    }
-
-    if (slab080.contains(ptr)) {
-        return slab080.size(ptr);
-    }
-
-    if (slab100.contains(ptr)) {
-        return slab100.size(ptr);
-    }
-
-    if (slab200.contains(ptr)) {
-        return slab200.size(ptr);
+    if (auto index = this->slab_index(ptr); index < m_slabs.size()) {
+        return m_slabs.at(index)->size(ptr);
     }
 
-    if (slab400.contains(ptr)) {
-        return slab400.size(ptr);
-    }
-
-    if (slab800.contains(ptr)) {
-        return slab800.size(ptr);
-    }
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex());
 
-    if (g_huge_pool.contains(ptr)) {
-        return g_huge_pool.size(ptr);
+        if (g_huge_pool.contains(ptr)) {
+            return g_huge_pool.size(ptr);
+        }
     }
 
     return size_page(ptr);
@@ -393,10 +303,18 @@ memory_manager::virtint_to_physint(integer_pointer virt) const
     auto lower = bfn::lower(virt);
     auto upper = bfn::upper(virt);
 
-    std::lock_guard<std::mutex> guard(md_mutex());
+    if (g_page_pool.contains(reinterpret_cast<pointer>(upper))) {
+        if (auto phys = m_page_pool_phys.at(page_pool_index(upper)).load(std::memory_order_acquire); phys != 0) {
+            return phys | lower;
+        }
+    }
+    else {
+        this->update_extents();
+        extent_guard guard(this);
 
-    if (auto iter = m_virt_map.find(upper); iter != m_virt_map.end()) {
-        return iter->second.phys | lower;
+        if (auto extent = find_extent(m_extents.load(std::memory_order_acquire)->virt, virt)) {
+            return extent->to + (virt - extent->from);
+        }
     }
 
     throw std::runtime_error(
@@ -419,13 +337,11 @@ memory_manager::virtptr_to_physptr(const pointer virt) const
 memory_manager::integer_pointer
 memory_manager::physint_to_virtint(integer_pointer phys) const
 {
-    auto lower = bfn::lower(phys);
-    auto upper = bfn::upper(phys);
+    this->update_extents();
+    extent_guard guard(this);
 
-    std::lock_guard<std::mutex> guard(md_mutex());
-
-    if (auto iter = m_phys_map.find(upper); iter != m_phys_map.end()) {
-        return iter->second.virt | lower;
+    if (auto extent = find_extent(m_extents.load(std::memory_order_acquire)->phys, phys)) {
+        return extent->to + (phys - extent->from);
     }
 
     throw std::runtime_error(
@@ -453,6 +369,12 @@ memory_manager::add_md(integer_pointer virt, integer_pointer phys, attr_type att
 
         m_virt_map.erase(virt);
         m_phys_map.erase(phys);
+
+        if (g_page_pool.contains(reinterpret_cast<pointer>(virt))) {
+            m_page_pool_phys.at(page_pool_index(virt)).store(0, std::memory_order_release);
+        }
+
+        m_md_generation.fetch_add(1, std::memory_order_release);
     });
 
     expects(bfn::lower(virt) == 0);
@@ -475,6 +397,12 @@ memory_manager::add_md(integer_pointer virt, integer_pointer phys, attr_type att
 
         m_virt_map[virt] = {phys, attr};
         m_phys_map[phys] = {virt, attr};
+
+        if (g_page_pool.contains(reinterpret_cast<pointer>(virt))) {
+            m_page_pool_phys.at(page_pool_index(virt)).store(phys, std::memory_order_release);
+        }
+
+        m_md_generation.fetch_add(1, std::memory_order_release);
     }
 }
 
@@ -489,6 +417,12 @@ memory_manager::remove_md(integer_pointer virt, integer_pointer phys)
 
         m_virt_map.erase(virt);
         m_phys_map.erase(phys);
+
+        if (g_page_pool.contains(reinterpret_cast<pointer>(virt))) {
+            m_page_pool_phys.at(page_pool_index(virt)).store(0, std::memory_order_release);
+        }
+
+        m_md_generation.fetch_add(1, std::memory_order_release);
     }
 }
 
@@ -505,21 +439,384 @@ memory_manager::descriptors() const
     return list;
 }
 
+// Note:
+//
+// The virt / phys conversions do not take the md lock. Instead, they search
+// an extent table, which is a sorted list of the virtually and physically
+// contiguous runs of the memory descriptors. A table is never modified once
+// it has been published. Each time a memory descriptor is added or removed,
+// the md generation is incremented, and the next conversion that sees a
+// table from an older generation builds and publishes a new one. Pages
+// from the page pool (which is one contiguous buffer) are converted from
+// virt to phys using a flat table indexed by page, and are left out of the
+// virt side of the extent table.
+//
+// Since a conversion could still be searching the table that was replaced,
+// the old table is only freed after a grace period. Every search is
+// bracketed by an extent_guard, which counts the search against the
+// current epoch (one of two counters). Once the new table is published,
+// the epoch is advanced, and the old table is freed once the count of the
+// previous epoch has drained, as a search that starts after that can only
+// see the new table (i.e. RCU with two counters, like ept::mmap). A
+// conversion updates the table before it takes the guard, so the thread
+// that waits for the grace period is never counted itself.
+//
+
+memory_manager::extent_guard::extent_guard(const memory_manager *self) noexcept :
+    m_self{self}
+{
+    while (true) {
+        m_epoch = m_self->m_extent_epoch.load();
+        m_self->m_extent_readers.at(m_epoch & 1U).fetch_add(1);
+
+        if (m_self->m_extent_epoch.load() == m_epoch) {
+            return;
+        }
+
+        m_self->m_extent_readers.at(m_epoch & 1U).fetch_sub(1);
+    }
+}
+
+memory_manager::extent_guard::~extent_guard()
+{ m_self->m_extent_readers.at(m_epoch & 1U).fetch_sub(1, std::memory_order_release); }
+
+void
+memory_manager::update_extents() const
+{
+    if (GSL_LIKELY(m_extent_generation.load(std::memory_order_acquire) == m_md_generation.load(std::memory_order_acquire))) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(md_mutex());
+
+    if (m_extent_generation.load(std::memory_order_acquire) == m_md_generation.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    auto new_table = std::make_unique<extent_table_t>();
+    this->build_extents(new_table.get());
+
+    auto old_table = std::exchange(m_extent_table, std::move(new_table));
+    m_extents.store(m_extent_table.get(), std::memory_order_release);
+    m_extent_generation.store(m_extent_table->generation, std::memory_order_release);
+
+    if (old_table) {
+        const auto epoch = m_extent_epoch.fetch_add(1);
+        while (m_extent_readers.at(epoch & 1U).load() != 0) {
+        }
+    }
+}
+
+void
+memory_manager::build_extents(extent_table_t *table) const
+{
+    table->generation = m_md_generation.load(std::memory_order_acquire);
+
+    table->virt.reserve(m_virt_map.size());
+    table->phys.reserve(m_phys_map.size());
+
+    for (const auto &p : m_virt_map) {
+        if (!g_page_pool.contains(reinterpret_cast<pointer>(p.first))) {
+            table->virt.push_back({p.first, p.second.phys, BAREFLANK_PAGE_SIZE});
+        }
+    }
+
+    for (const auto &p : m_phys_map) {
+        table->phys.push_back({p.first, p.second.virt, BAREFLANK_PAGE_SIZE});
+    }
+
+    coalesce_extents(table->virt);
+    coalesce_extents(table->phys);
+}
+
+static void
+buddy_stats(mem_stats_pool_t &pool, const buddy_allocator &allocator, std::size_t total) noexcept
+{
+    pool.total = total;
+    pool.used = allocator.used();
+    pool.free = total - allocator.used();
+    pool.high_water = allocator.high_water();
+    pool.largest_free = allocator.largest_free();
+}
+
+void
+memory_manager::stats(gsl::not_null<mem_stats_t *> stats) const
+{
+    stats->tag = 0x3E353E353E353E35;
+
+    {
+        std::lock_guard<std::mutex> lock(alloc_page_mutex());
+        buddy_stats(gsl::at(stats->pools, MEM_STATS_POOL_PAGE), g_page_pool, buddy_allocator::buffer_size(g_page_pool_k));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(alloc_mem_map_mutex());
+        buddy_stats(gsl::at(stats->pools, MEM_STATS_POOL_MEM_MAP), g_mem_map_pool, buddy_allocator::buffer_size(g_mem_map_pool_k));
+    }
+
+    std::lock_guard<std::mutex> lock(alloc_mutex());
+    buddy_stats(gsl::at(stats->pools, MEM_STATS_POOL_HUGE), g_huge_pool, buddy_allocator::buffer_size(g_huge_pool_k));
+
+    auto &slab_pool = gsl::at(stats->pools, MEM_STATS_POOL_SLAB);
+    slab_pool.total = page_arena::buffer_size(g_slab_pool_k);
+    slab_pool.used = g_slab_pool.num_used() * BAREFLANK_PAGE_SIZE;
+    slab_pool.free = slab_pool.total - slab_pool.used;
+    slab_pool.high_water = g_slab_pool.num_high_water() * BAREFLANK_PAGE_SIZE;
+    slab_pool.largest_free = slab_pool.free != 0 ? BAREFLANK_PAGE_SIZE : 0;
+
+    // Note:
+    //
+    // The objects in the magazines are allocated as far as the SLAB
+    // allocators are concerned, but they are free as far as the rest of
+    // the VMM is concerned. The magazines of the other CPUs are read
+    // without synchronizing with them, so the number of cached objects
+    // might be off by a few objects if the other CPUs are allocating.
+    //
+
+    for (std::size_t i = 0; i < m_slabs.size(); i++) {
+        size_type cached = 0;
+        for (const auto &magazines : m_magazines) {
+            cached += magazines.at(i).num;
+        }
+
+        auto &slab = gsl::at(stats->slabs, gsl::narrow_cast<std::ptrdiff_t>(i));
+        slab.size = m_slabs.at(i)->size(nullptr);
+        slab.used = m_slab_used.at(i) - cached;
+        slab.free = m_slabs.at(i)->num_free() + cached;
+        slab.high_water = m_slab_high_water.at(i);
+    }
+}
+
+std::size_t
+memory_manager::slab_index(size_type size) noexcept
+{
+    if (size <= 0x010) {
+        return 0;
+    }
+
+    if (size <= 0x020) {
+        return 1;
+    }
+
+    if (size <= 0x030) {
+        return 2;
+    }
+
+    if (size <= 0x040) {
+        return 3;
+    }
+
+    if (size <= 0x080) {
+        return 4;
+    }
+
+    if (size <= 0x100) {
+        return 5;
+    }
+
+    if (size <= 0x200) {
+        return 6;
+    }
+
+    if (size <= 0x400) {
+        return 7;
+    }
+
+    return 8;
+}
+
+// Note:
+//
+// All of the SLAB allocators get their pages from the SLAB pool, and once
+// the SLAB pool is full, from the page pool. Since the SLAB pool is carved
+// out of the page pool, every page a SLAB allocator uses is a page of the
+// page pool, and each of these pages is tagged with the index of the size
+// class it belongs to (plus 1, as 0 means untagged). Every object that a
+// SLAB allocator hands out goes through slab_allocate(), which tags the
+// object's page before the object is returned. As a result, a pointer's
+// size class is found using a range check and a table lookup, without a
+// lock. The SLAB allocators only give their pages back when they are
+// destroyed, so a tagged page is never handed out by the page pool.
+//
+
+std::size_t
+memory_manager::slab_index(pointer ptr) const noexcept
+{
+    if (!g_page_pool.contains(ptr)) {
+        return m_slabs.size();
+    }
+
+    const auto index = page_pool_index(reinterpret_cast<integer_pointer>(ptr));
+
+    if (auto tag = m_slab_tags.at(index).load(std::memory_order_relaxed); tag != 0) {
+        return tag - 1U;
+    }
+
+    return m_slabs.size();
+}
+
+memory_manager::pointer
+memory_manager::slab_allocate(std::size_t index)
+{
+    const auto tag = gsl::narrow_cast<uint8_t>(index + 1);
+
+    auto ptr = m_slabs.at(index)->allocate();
+
+    if (++m_slab_used.at(index) > m_slab_high_water.at(index)) {
+        m_slab_high_water.at(index) = m_slab_used.at(index);
+    }
+
+    auto &page_tag = m_slab_tags.at(page_pool_index(reinterpret_cast<integer_pointer>(ptr)));
+
+    if (page_tag.load(std::memory_order_relaxed) != tag) {
+        page_tag.store(tag, std::memory_order_relaxed);
+    }
+
+    return ptr;
+}
+
+// Note:
+//
+// Each CPU has a magazine (i.e. a small stack of objects) for each SLAB
+// size class. A magazine is only ever used by the CPU that owns it, and the
+// VMM is never preempted, so objects are allocated from and freed to a
+// magazine without a lock. An empty magazine is refilled with half a
+// magazine of objects from the SLAB allocator, and a full magazine returns
+// half of its objects, so the lock is taken once per batch and a CPU that
+// alternates between allocating and freeing does not take it at all.
+//
+
+memory_manager::pointer
+memory_manager::alloc_slab(std::size_t index) noexcept
+{
+    const auto cpuid = thread_context_cpuid();
+
+    if (GSL_UNLIKELY(cpuid >= m_magazines.size())) {
+        std::lock_guard<std::mutex> lock(alloc_mutex());
+
+        try {
+            return this->slab_allocate(index);
+        }
+        catch (...)
+        { WARNING("memory_manager::alloc: std::bad_alloc thrown"); }
+
+        return nullptr;
+    }
+
+    auto &magazine = m_magazines.at(cpuid).at(index);
+
+    if (magazine.num == 0) {
+        std::lock_guard<std::mutex> lock(alloc_mutex());
+
+        try {
+            while (magazine.num < MAGAZINE_SIZE / 2) {
+                magazine.objs.at(magazine.num) = this->slab_allocate(index);
+                magazine.num++;
+            }
+        }
+        catch (...) {
+            if (magazine.num == 0) {
+                WARNING("memory_manager::alloc: std::bad_alloc thrown");
+                return nullptr;
+            }
+        }
+    }
+
+    return magazine.objs.at(--magazine.num);
+}
+
+void
+memory_manager::free_slab(std::size_t index, pointer ptr) noexcept
+{
+    const auto cpuid = thread_context_cpuid();
+
+    if (GSL_UNLIKELY(cpuid >= m_magazines.size())) {
+        std::lock_guard<std::mutex> lock(alloc_mutex());
+        return this->drain(index, &ptr, 1);
+    }
+
+    auto &magazine = m_magazines.at(cpuid).at(index);
+
+    if (magazine.num == MAGAZINE_SIZE) {
+        std::lock_guard<std::mutex> lock(alloc_mutex());
+
+        magazine.num -= MAGAZINE_SIZE / 2;
+        this->drain(index, &magazine.objs.at(magazine.num), MAGAZINE_SIZE / 2);
+    }
+
+    magazine.objs.at(magazine.num++) = ptr;
+}
+
+void
+memory_manager::drain(std::size_t index, pointer *objs, size_type num) noexcept
+{
+    guard_exceptions([&]() {
+        for (auto obj : gsl::make_span(objs, gsl::narrow_cast<std::ptrdiff_t>(num))) {
+            m_slabs.at(index)->deallocate(obj);
+            m_slab_used.at(index)--;
+        }
+    });
+}
+
 memory_manager::memory_manager() noexcept :
     g_page_pool(static_cast<void *>(g_page_pool_buffer), g_page_pool_k, static_cast<void *>(g_page_pool_node_tree)),
     g_huge_pool(static_cast<void *>(g_huge_pool_buffer), g_huge_pool_k, static_cast<void *>(g_huge_pool_node_tree)),
     g_mem_map_pool(MEM_MAP_POOL_START, g_mem_map_pool_k, static_cast<void *>(g_mem_map_pool_node_tree)),
-    slab010(0x010, 0),
-    slab020(0x020, 0),
-    slab030(0x030, 0),
-    slab040(0x040, 0),
-    slab080(0x080, 0),
-    slab100(0x100, 0),
-    slab200(0x200, 0),
-    slab400(0x400, 0),
-    slab800(0x800, 0)
+    g_slab_pool(
+        g_page_pool.allocate(page_arena::buffer_size(g_slab_pool_k)), g_slab_pool_k,
+        &g_page_pool, &alloc_page_mutex()
+    ),
+    slab010(0x010, 0, &g_slab_pool),
+    slab020(0x020, 0, &g_slab_pool),
+    slab030(0x030, 0, &g_slab_pool),
+    slab040(0x040, 0, &g_slab_pool),
+    slab080(0x080, 0, &g_slab_pool),
+    slab100(0x100, 0, &g_slab_pool),
+    slab200(0x200, 0, &g_slab_pool),
+    slab400(0x400, 0, &g_slab_pool),
+    slab800(0x800, 0, &g_slab_pool),
+    m_slabs{
+        &slab010, &slab020, &slab030, &slab040, &slab080,
+        &slab100, &slab200, &slab400, &slab800
+    }
 { }
 
+memory_manager::~memory_manager()
+{
+    // Note:
+    //
+    // The objects that are still in the magazines are allocated as far as
+    // the SLAB allocators are concerned. These are returned so that the SLAB
+    // allocators can release their pages. Only a single thread is left at
+    // this point, so the lock is not taken.
+    //
+
+    for (auto &magazines : m_magazines) {
+        for (std::size_t i = 0; i < magazines.size(); i++) {
+            auto &magazine = magazines.at(i);
+
+            this->drain(i, magazine.objs.data(), magazine.num);
+            magazine.num = 0;
+        }
+    }
+}
+
+}
+
+// -----------------------------------------------------------------------------
+// Memory Stats
+// -----------------------------------------------------------------------------
+
+extern "C" int64_t
+get_mem_stats(struct mem_stats_t *stats) noexcept
+{
+    if (stats == nullptr) {
+        return GET_MEM_STATS_FAILURE;
+    }
+
+    return guard_exceptions(GET_MEM_STATS_FAILURE, [&] {
+        g_mm->stats(stats);
+    });
 }
 
 #ifdef VMM
@@ -0,0 +1,130 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <catch/catch.hpp>
+
+#include <bfgsl.h>
+#include <debug/exit_stats/exit_stats.h>
+
+using namespace bfvmm;
+
+exit_stats_t g_stats;
+
+TEST_CASE("get_exit_stats: invalid stats")
+{
+    CHECK(get_exit_stats(0, nullptr) == GET_EXIT_STATS_FAILURE);
+}
+
+TEST_CASE("get_exit_stats: invalid vcpuid")
+{
+    CHECK(get_exit_stats(0x1000, &g_stats) == GET_EXIT_STATS_FAILURE);
+}
+
+TEST_CASE("get_exit_stats: success")
+{
+    exit_stats es(0);
+
+    gsl::at(es.data()->count, 1) = 42;
+
+    CHECK(get_exit_stats(0, &g_stats) == GET_EXIT_STATS_SUCCESS);
+    CHECK(g_stats.tag == es.data()->tag);
+    CHECK(gsl::at(g_stats.count, 1) == 42);
+
+    gsl::at(es.data()->count, 1) = 43;
+    CHECK(gsl::at(g_stats.count, 1) == 42);
+}
+
+TEST_CASE("get_exit_stats: destroyed")
+{
+    {
+        exit_stats es(0);
+    }
+
+    CHECK(get_exit_stats(0, &g_stats) == GET_EXIT_STATS_FAILURE);
+}
+
+TEST_CASE("get_exit_stats: moved")
+{
+    exit_stats es1(0);
+    auto es2 = std::move(es1);
+
+    gsl::at(es2.data()->count, 1) = 42;
+
+    CHECK(get_exit_stats(0, &g_stats) == GET_EXIT_STATS_SUCCESS);
+    CHECK(gsl::at(g_stats.count, 1) == 42);
+}
+
+TEST_CASE("exit_stats: bucket")
+{
+    CHECK(exit_stats::bucket(0) == 0);
+    CHECK(exit_stats::bucket(1) == 0);
+    CHECK(exit_stats::bucket(2) == 1);
+    CHECK(exit_stats::bucket(3) == 1);
+    CHECK(exit_stats::bucket(4) == 2);
+    CHECK(exit_stats::bucket(1000) == 9);
+    CHECK(exit_stats::bucket(1024) == 10);
+    CHECK(exit_stats::bucket(0xFFFFFFFFFFFFFFFF) == EXIT_STATS_NUM_BUCKETS - 1);
+}
+
+TEST_CASE("exit_stats: record")
+{
+    exit_stats es(0);
+
+    es.record(10, 1000);
+    es.record(10, 1001);
+    es.record(10, 5);
+    es.record(48, 0xFFFFFFFFFFFFFFFF);
+
+    auto stats = es.data();
+
+    CHECK(stats->count[10] == 3);
+    CHECK(stats->hist[10][9] == 2);
+    CHECK(stats->hist[10][2] == 1);
+    CHECK(stats->count[48] == 1);
+    CHECK(stats->hist[48][EXIT_STATS_NUM_BUCKETS - 1] == 1);
+}
+
+TEST_CASE("exit_stats: record invalid reason")
+{
+    exit_stats es(0);
+
+    CHECK_NOTHROW(es.record(EXIT_STATS_NUM_REASONS, 10));
+    CHECK_NOTHROW(es.record(0xFFFFFFFFFFFFFFFF, 10));
+
+    for (const auto &count : es.data()->count) {
+        CHECK(count == 0);
+    }
+}
+
+TEST_CASE("exit_stats: clear")
+{
+    exit_stats es(0);
+
+    auto tag = es.data()->tag;
+
+    es.record(10, 1000);
+    es.clear();
+
+    CHECK(es.data()->count[10] == 0);
+    CHECK(es.data()->hist[10][9] == 0);
+    CHECK(es.data()->tag == tag);
+}
@@ -0,0 +1,429 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <test/support.h>
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+using namespace bfvmm::intel_x64;
+using namespace ::intel_x64::vmcs;
+
+static void
+enable_pml_support()
+{
+    g_msrs[::intel_x64::msrs::ia32_vmx_ept_vpid_cap::addr] |=
+        ::intel_x64::msrs::ia32_vmx_ept_vpid_cap::accessed_dirty_support::mask;
+}
+
+static bool
+is_dirty(gsl::span<uint64_t> bitmap, uintptr_t gpa)
+{
+    const auto page = gpa >> ::intel_x64::ept::pt::from;
+    return (bitmap.at(gsl::narrow_cast<std::ptrdiff_t>(page >> 6)) & (1ULL << (page & 63U))) != 0;
+}
+
+TEST_CASE("dirty_log: construct / destruct")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+
+    CHECK_NOTHROW(dirty_log_handler{vcpu});
+    CHECK(dirty_log_handler{vcpu}.pml() == nullptr);
+}
+
+TEST_CASE("dirty_log: enable not supported")
+{
+    setup_test_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    g_msrs[::intel_x64::msrs::ia32_vmx_ept_vpid_cap::addr] = 0;
+    CHECK_THROWS(dlog.enable(mmap, 0x400000, dirty_log_handler::mode_t::pml));
+    CHECK(!dlog.is_enabled());
+
+    enable_pml_support();
+    g_msrs[::intel_x64::msrs::ia32_vmx_procbased_ctls2::addr] = 0;
+    CHECK_THROWS(dlog.enable(mmap, 0x400000, dirty_log_handler::mode_t::pml));
+    CHECK(!dlog.is_enabled());
+
+    CHECK_NOTHROW(dlog.enable(mmap, 0x400000));
+    CHECK(dlog.mode() == dirty_log_handler::mode_t::write_protect);
+}
+
+TEST_CASE("dirty_log: enable / disable")
+{
+    setup_test_support();
+    enable_pml_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    auto &pte = mmap.map_4k(0x1000, 0x1000);
+    ::intel_x64::ept::pt::entry::dirty::enable(pte);
+
+    CHECK_NOTHROW(dlog.enable(mmap, 0x400000));
+    CHECK(dlog.mode() == dirty_log_handler::mode_t::pml);
+    CHECK(dlog.bitmap_size() == 16);
+    CHECK(pml_address::get() == g_mm->virtptr_to_physint(dlog.pml()));
+    CHECK(pml_index::get() == 511);
+    CHECK(ept_pointer::accessed_and_dirty_flags::is_enabled());
+    CHECK(secondary_processor_based_vm_execution_controls::enable_pml::is_enabled());
+    CHECK(::intel_x64::ept::pt::entry::dirty::is_disabled(pte));
+
+    CHECK_NOTHROW(dlog.disable());
+    CHECK(!dlog.is_enabled());
+    CHECK(ept_pointer::accessed_and_dirty_flags::is_disabled());
+    CHECK(secondary_processor_based_vm_execution_controls::enable_pml::is_disabled());
+}
+
+TEST_CASE("dirty_log: pml full exit")
+{
+    setup_test_support();
+    enable_pml_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    mmap.map_4k(0x1000, 0x1000);
+    mmap.map_4k(0x3000, 0x3000);
+
+    dlog.enable(mmap, 0x400000);
+
+    auto pml = gsl::span<uint64_t>(dlog.pml(), 512);
+    for (auto i = 0; i < 512; i++) {
+        pml.at(i) = (i & 1) == 0 ? 0x1000 : 0x3000;
+    }
+    pml_index::set(0xFFFF);
+
+    CHECK(dlog.handle(vcpu));
+    CHECK(pml_index::get() == 511);
+
+    std::vector<uint64_t> bitmap(dlog.bitmap_size());
+    CHECK(dlog.harvest(bitmap) == 2);
+    CHECK(is_dirty(bitmap, 0x1000));
+    CHECK(!is_dirty(bitmap, 0x2000));
+    CHECK(is_dirty(bitmap, 0x3000));
+}
+
+TEST_CASE("dirty_log: harvest")
+{
+    setup_test_support();
+    enable_pml_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    auto &pte = mmap.map_4k(0x1000, 0x1000);
+    mmap.map_4k(0x2000, 0x2000);
+
+    dlog.enable(mmap, 0x400000);
+
+    auto pml = gsl::span<uint64_t>(dlog.pml(), 512);
+    pml.at(511) = 0x1000;
+    pml.at(510) = 0x2000;
+    pml.at(509) = 0x10000000;
+    pml_index::set(508);
+
+    ::intel_x64::ept::pt::entry::dirty::enable(pte);
+
+    std::vector<uint64_t> bitmap(dlog.bitmap_size());
+    bitmap.at(0) = 0x10;
+
+    CHECK(dlog.harvest(bitmap) == 2);
+    CHECK(pml_index::get() == 511);
+    CHECK(is_dirty(bitmap, 0x1000));
+    CHECK(is_dirty(bitmap, 0x2000));
+    CHECK(is_dirty(bitmap, 0x4000));
+    CHECK(::intel_x64::ept::pt::entry::dirty::is_disabled(pte));
+
+    std::vector<uint64_t> empty(dlog.bitmap_size());
+    CHECK(dlog.harvest(empty) == 0);
+
+    std::vector<uint64_t> small(dlog.bitmap_size() - 1);
+    CHECK_THROWS(dlog.harvest(small));
+}
+
+TEST_CASE("dirty_log: large pages")
+{
+    setup_test_support();
+    enable_pml_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    auto &pde = mmap.map_2m(0x200000, 0x200000);
+
+    dlog.enable(mmap, 0x400000);
+
+    gsl::span<uint64_t>(dlog.pml(), 512).at(511) = 0x212000;
+    pml_index::set(510);
+
+    ::intel_x64::ept::pd::entry::dirty::enable(pde);
+
+    std::vector<uint64_t> bitmap(dlog.bitmap_size());
+    CHECK(dlog.harvest(bitmap) == 512);
+    CHECK(!is_dirty(bitmap, 0x1FF000));
+    CHECK(is_dirty(bitmap, 0x200000));
+    CHECK(is_dirty(bitmap, 0x3FF000));
+    CHECK(::intel_x64::ept::pd::entry::dirty::is_disabled(pde));
+}
+
+TEST_CASE("dirty_log: write protect enable / disable")
+{
+    setup_test_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    auto &pte1 = mmap.map_4k(0x1000, 0x1000, ept::mmap::attr_type::read_write);
+    auto &pte2 = mmap.map_4k(0x2000, 0x2000, ept::mmap::attr_type::read_only);
+    auto &pte3 = mmap.map_4k(0x800000, 0x800000, ept::mmap::attr_type::read_write);
+
+    CHECK_NOTHROW(dlog.enable(mmap, 0x400000, dirty_log_handler::mode_t::write_protect));
+    CHECK(dlog.mode() == dirty_log_handler::mode_t::write_protect);
+    CHECK(dlog.pml() == nullptr);
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_disabled(pte1));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_disabled(pte2));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_enabled(pte3));
+    CHECK(secondary_processor_based_vm_execution_controls::enable_pml::is_disabled());
+
+    CHECK_NOTHROW(dlog.disable());
+    CHECK(!dlog.is_enabled());
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_enabled(pte1));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_disabled(pte2));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_enabled(pte3));
+}
+
+TEST_CASE("dirty_log: write protect fault")
+{
+    setup_test_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    uint64_t qual = exit_qualification::ept_violation::data_write::mask;
+    uint64_t gpa = 0x1000;
+
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::exit_qualification).Do([&] { return qual; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::guest_physical_address).Do([&] { return gpa; });
+
+    auto &pte1 = mmap.map_4k(0x1000, 0x1000, ept::mmap::attr_type::read_write);
+    auto &pte2 = mmap.map_4k(0x2000, 0x2000, ept::mmap::attr_type::read_only);
+    mmap.map_4k(0x800000, 0x800000, ept::mmap::attr_type::read_only);
+
+    CHECK(!dlog.handle_ept_violation(vcpu));
+
+    dlog.enable(mmap, 0x400000, dirty_log_handler::mode_t::write_protect);
+
+    CHECK(dlog.handle_ept_violation(vcpu));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_enabled(pte1));
+    CHECK(dlog.handle_ept_violation(vcpu));
+
+    gpa = 0x2000;
+    CHECK(!dlog.handle_ept_violation(vcpu));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_disabled(pte2));
+
+    gpa = 0x800000;
+    CHECK(!dlog.handle_ept_violation(vcpu));
+
+    gpa = 0x1000;
+    qual = exit_qualification::ept_violation::data_read::mask;
+    CHECK(!dlog.handle_ept_violation(vcpu));
+
+    std::vector<uint64_t> bitmap(dlog.bitmap_size());
+    CHECK(dlog.harvest(bitmap) == 1);
+    CHECK(is_dirty(bitmap, 0x1000));
+    CHECK(!is_dirty(bitmap, 0x2000));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_disabled(pte1));
+
+    qual = exit_qualification::ept_violation::data_write::mask;
+    CHECK(dlog.handle_ept_violation(vcpu));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_enabled(pte1));
+}
+
+TEST_CASE("dirty_log: write protect large pages")
+{
+    setup_test_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    uint64_t qual = exit_qualification::ept_violation::data_write::mask;
+    uint64_t gpa = 0x212000;
+
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::exit_qualification).Do([&] { return qual; });
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::guest_physical_address).Do([&] { return gpa; });
+
+    auto &pde = mmap.map_2m(0x200000, 0x200000, ept::mmap::attr_type::read_write);
+
+    dlog.enable(mmap, 0x400000, dirty_log_handler::mode_t::write_protect);
+    CHECK(::intel_x64::ept::pd::entry::write_access::is_disabled(pde));
+
+    CHECK(dlog.handle_ept_violation(vcpu));
+    CHECK(::intel_x64::ept::pd::entry::write_access::is_enabled(pde));
+
+    std::vector<uint64_t> bitmap(dlog.bitmap_size());
+    CHECK(dlog.harvest(bitmap) == 512);
+    CHECK(is_dirty(bitmap, 0x200000));
+    CHECK(is_dirty(bitmap, 0x3FF000));
+    CHECK(::intel_x64::ept::pd::entry::write_access::is_disabled(pde));
+}
+
+TEST_CASE("dirty_log: invept on sharing vcpus")
+{
+    setup_test_support();
+    enable_pml_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto dlog = dirty_log_handler{vcpu};
+
+    mmap.map_4k(0x1000, 0x1000);
+
+    invalidation_queue queue{};
+    mmap.attach(&queue);
+
+    CHECK_NOTHROW(dlog.enable(mmap, 0x400000));
+    CHECK(queue.requested() == 1);
+    CHECK_NOTHROW(queue.flush());
+    queue.exited();
+
+    std::vector<uint64_t> bitmap(dlog.bitmap_size());
+    CHECK(dlog.harvest(bitmap) == 0);
+    CHECK(queue.requested() == 2);
+    CHECK(!queue.empty());
+
+    CHECK_NOTHROW(dlog.disable());
+    CHECK(queue.requested() == 3);
+}
+
+TEST_CASE("dirty_log: write protect shared map")
+{
+    setup_test_support();
+
+    ept::mmap mmap{};
+
+    MockRepository mocks;
+    auto vcpu1 = setup_vcpu(mocks);
+    auto vcpu2 = setup_vcpu(mocks);
+    auto dlog1 = dirty_log_handler{vcpu1};
+    auto dlog2 = dirty_log_handler{vcpu2};
+
+    uint64_t qual = exit_qualification::ept_violation::data_write::mask;
+    uint64_t gpa = 0x1000;
+
+    mocks.OnCall(vcpu1, bfvmm::intel_x64::vcpu::exit_qualification).Do([&] { return qual; });
+    mocks.OnCall(vcpu1, bfvmm::intel_x64::vcpu::guest_physical_address).Do([&] { return gpa; });
+    mocks.OnCall(vcpu2, bfvmm::intel_x64::vcpu::exit_qualification).Do([&] { return qual; });
+    mocks.OnCall(vcpu2, bfvmm::intel_x64::vcpu::guest_physical_address).Do([&] { return gpa; });
+    mocks.OnCall(vcpu2, bfvmm::intel_x64::vcpu::ept_map).Return(&mmap);
+
+    auto &pte1 = mmap.map_4k(0x1000, 0x1000, ept::mmap::attr_type::read_write);
+    auto &pte2 = mmap.map_4k(0x2000, 0x2000, ept::mmap::attr_type::read_only);
+
+    CHECK(!dlog2.handle_ept_violation(vcpu2));
+
+    dlog1.enable(mmap, 0x400000, dirty_log_handler::mode_t::write_protect);
+    CHECK(!dlog2.is_enabled());
+
+    CHECK(dlog2.handle_ept_violation(vcpu2));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_enabled(pte1));
+    CHECK(!dlog2.handle_ept_violation(vcpu2));
+
+    gpa = 0x2000;
+    CHECK(!dlog2.handle_ept_violation(vcpu2));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_disabled(pte2));
+
+    std::vector<uint64_t> bitmap(dlog1.bitmap_size());
+    CHECK(dlog1.harvest(bitmap) == 1);
+    CHECK(is_dirty(bitmap, 0x1000));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_disabled(pte1));
+
+    gpa = 0x1000;
+    CHECK(dlog1.handle_ept_violation(vcpu1));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_enabled(pte1));
+
+    dlog1.disable();
+
+    std::vector<uint64_t> empty(dlog1.bitmap_size());
+    CHECK(dlog1.harvest(empty) == 1);
+
+    mmap.update_flags(0x1000, 0x800, 0x2);
+    CHECK(dlog2.handle_ept_violation(vcpu2));
+    CHECK(::intel_x64::ept::pt::entry::write_access::is_enabled(pte1));
+    CHECK(dlog1.harvest(empty) == 0);
+}
+
+TEST_CASE("dirty_log: vcpu")
+{
+    setup_test_support();
+    enable_pml_support();
+
+    bfvmm::intel_x64::vcpu vcpu{0};
+    ept::mmap mmap{};
+
+    CHECK_THROWS(vcpu.enable_dirty_logging(0x400000));
+
+    vcpu.set_eptp(mmap);
+    CHECK_NOTHROW(vcpu.enable_dirty_logging(0x400000));
+    CHECK(vcpu.dirty_log()->is_enabled());
+
+    std::vector<uint64_t> bitmap(vcpu.dirty_log()->bitmap_size());
+    CHECK(vcpu.harvest_dirty_log(bitmap) == 0);
+
+    vcpu.disable_ept();
+    CHECK(!vcpu.dirty_log()->is_enabled());
+    CHECK(secondary_processor_based_vm_execution_controls::enable_pml::is_disabled());
+}
+
+#endif
@@ -0,0 +1,499 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <thread>
+#include <test/support.h>
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+using namespace bfvmm::intel_x64;
+
+TEST_CASE("ept_mmap: construct / destruct")
+{
+    setup_test_support();
+    CHECK_NOTHROW(ept::mmap{});
+}
+
+TEST_CASE("ept_mmap: map / virt_to_phys")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_1g(0x40000000, 0x80000000);
+    mmap.map_2m(0x200000, 0x400000);
+    mmap.map_4k(0x1000, 0x2000);
+
+    CHECK(mmap.virt_to_phys(0x40001234).first == 0x80001234);
+    CHECK(mmap.virt_to_phys(0x40001234).second == ::intel_x64::ept::pdpt::from);
+    CHECK(mmap.virt_to_phys(0x201234).first == 0x401234);
+    CHECK(mmap.virt_to_phys(0x201234).second == ::intel_x64::ept::pd::from);
+    CHECK(mmap.virt_to_phys(0x1234).first == 0x2234);
+    CHECK(mmap.virt_to_phys(0x1234).second == ::intel_x64::ept::pt::from);
+
+    CHECK(mmap.is_1g(0x40000000ULL));
+    CHECK(mmap.is_2m(0x200000ULL));
+    CHECK(mmap.is_4k(0x1000ULL));
+
+    CHECK_THROWS(mmap.virt_to_phys(0x3000));
+    CHECK_THROWS(mmap.from(0x3000ULL));
+    CHECK_THROWS(mmap.get_entry(0x3000ULL));
+    CHECK_THROWS(mmap.update_entry(0x3000ULL, [](auto & pte) { bfignored(pte); }));
+}
+
+TEST_CASE("ept_mmap: lookup does not allocate")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_4k(0x1000, 0x2000);
+    auto num_pages = g_allocated_pages.size();
+
+    CHECK(mmap.lookup(0x1234).first == 0x2234);
+    CHECK(mmap.lookup(0x1234).second == ::intel_x64::ept::pt::from);
+    CHECK(mmap.is_mapped(0x1000));
+
+    CHECK(mmap.lookup(0x3000).second == 0);
+    CHECK(mmap.lookup(0x40000000).second == 0);
+    CHECK(mmap.lookup(0x8000000000).second == 0);
+    CHECK(!mmap.is_mapped(0x8000000000));
+    CHECK_THROWS(mmap.virt_to_phys(0x8000000000));
+    CHECK_THROWS(mmap.from(0x8000000000ULL));
+
+    CHECK(g_allocated_pages.size() == num_pages);
+}
+
+TEST_CASE("ept_mmap: unmap / release")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_4k(0x1000, 0x2000);
+    auto num_pages = g_allocated_pages.size();
+
+    CHECK(mmap.unmap(reinterpret_cast<void *>(0x8000000000)) == ::intel_x64::ept::pdpt::from);
+    CHECK_NOTHROW(mmap.release(0x8000000000ULL));
+    CHECK(g_allocated_pages.size() == num_pages);
+
+    CHECK(mmap.unmap(reinterpret_cast<void *>(0x1000)) == ::intel_x64::ept::pt::from);
+    CHECK(!mmap.is_mapped(0x1000));
+
+    CHECK_NOTHROW(mmap.release(0x1000ULL));
+    CHECK(g_allocated_pages.size() < num_pages);
+}
+
+TEST_CASE("ept_mmap: map after release")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_4k(0x1000, 0x2000);
+    mmap.unmap(0x1000ULL);
+    mmap.release(0x1000ULL);
+
+    CHECK(mmap.lookup(0x1000).second == 0);
+
+    mmap.map_4k(0x1000, 0x3000);
+    CHECK(mmap.lookup(0x1234).first == 0x3234);
+    CHECK(mmap.is_4k(0x1000ULL));
+}
+
+TEST_CASE("ept_mmap: generation")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    auto generation = mmap.generation();
+
+    mmap.map_4k(0x1000, 0x2000);
+    CHECK(mmap.generation() != generation);
+
+    generation = mmap.generation();
+    mmap.lookup(0x1000);
+    CHECK_NOTHROW(mmap.virt_to_phys(0x1000));
+    CHECK(mmap.generation() == generation);
+
+    generation = mmap.generation();
+    mmap.update_entry(0x1000ULL, [](auto & pte) {
+        ::intel_x64::ept::pt::entry::write_access::disable(pte);
+    });
+    CHECK(mmap.generation() != generation);
+
+    mmap.unmap(0x1000ULL);
+    CHECK(mmap.generation() != generation);
+}
+
+TEST_CASE("ept_mmap: update entry")
+{
+    using namespace ::intel_x64::ept;
+
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_4k(0x1000, 0x2000);
+
+    auto [pte, from] = mmap.update_entry(0x1000ULL, [](auto & entry) {
+        pt::entry::phys_addr::set(entry, 0x5000);
+        pt::entry::write_access::disable(entry);
+    });
+
+    CHECK(from == pt::from);
+    CHECK(pt::entry::phys_addr::get(pte) == 0x5000);
+    CHECK(pt::entry::write_access::is_disabled(pte));
+    CHECK(mmap.get_entry(0x1000ULL).first == pte);
+    CHECK(mmap.virt_to_phys(0x1234).first == 0x5234);
+}
+
+TEST_CASE("ept_mmap: log write")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    std::vector<std::pair<uintptr_t, uintptr_t>> writes;
+    auto log = [&](uintptr_t gpa, uintptr_t from) { writes.emplace_back(gpa, from); };
+
+    mmap.map_4k(0x1000, 0x1000);
+    mmap.map_2m(0x200000, 0x200000);
+
+    CHECK(mmap.log_write(0x1000ULL, 0x2, 0x800, 0x800).first != 0);
+    CHECK(writes.empty());
+
+    mmap.set_dirty_log(ept::mmap::dirty_log_delegate_t::create(log));
+    mmap.update_flags(0x1000ULL, 0x800, 0);
+    mmap.update_flags(0x200000ULL, 0x800, 0);
+
+    mmap.log_write(0x1123ULL, 0x2, 0x800, 0x800);
+    mmap.log_write(0x1123ULL, 0x2, 0x800, 0x800);
+    mmap.log_write(0x212000ULL, 0x2, 0x800, 0x800);
+    mmap.log_write(0x400000ULL, 0x2, 0x800, 0x800);
+
+    REQUIRE(writes.size() == 2);
+    CHECK(writes.at(0).first == 0x1123);
+    CHECK(writes.at(0).second == ::intel_x64::ept::pt::from);
+    CHECK(writes.at(1).first == 0x212000);
+    CHECK(writes.at(1).second == ::intel_x64::ept::pd::from);
+
+    mmap.set_dirty_log({});
+    mmap.update_flags(0x1000ULL, 0x800, 0);
+    mmap.log_write(0x1000ULL, 0x2, 0x800, 0x800);
+    CHECK(writes.size() == 2);
+}
+
+TEST_CASE("ept_mmap: map range")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    auto generation = mmap.generation();
+    mmap.map_range(0x3FDFF000, 0x3FDFF000, 0x1000 + 0x200000 + 0x40000000 + 0x1000);
+    CHECK(mmap.generation() == generation + 2);
+
+    CHECK(mmap.is_4k(0x3FDFF000ULL));
+    CHECK(mmap.is_2m(0x3FE00000ULL));
+    CHECK(mmap.is_1g(0x40000000ULL));
+    CHECK(mmap.is_4k(0x80000000ULL));
+    CHECK(!mmap.is_mapped(0x80001000));
+    CHECK(mmap.virt_to_phys(0x7FFFFFFF).first == 0x7FFFFFFF);
+
+    CHECK_THROWS(mmap.map_range(0x80000000, 0x80000000, 0x1000));
+}
+
+TEST_CASE("ept_mmap: map range max page size")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_range(
+        0, 0, 0x40000000,
+        ept::mmap::attr_type::read_write,
+        ept::mmap::memory_type::uncacheable,
+        ::intel_x64::ept::pd::from
+    );
+
+    CHECK(mmap.is_2m(0x1000ULL));
+    CHECK(mmap.is_2m(0x3FE00000ULL));
+}
+
+TEST_CASE("ept_mmap: map range unaligned phys")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_range(0x200000, 0x201000, 0x200000);
+
+    CHECK(mmap.is_4k(0x200000ULL));
+    CHECK(mmap.virt_to_phys(0x3FF000).first == 0x400000);
+}
+
+TEST_CASE("ept_mmap: split 2m")
+{
+    using namespace ::intel_x64::ept;
+
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_2m(0x200000, 0x400000, ept::mmap::attr_type::read_only, ept::mmap::memory_type::uncacheable);
+
+    CHECK(mmap.split(0x200000) == pt::from);
+    CHECK(mmap.is_4k(0x200000ULL));
+    CHECK(mmap.is_4k(0x3FF000ULL));
+    CHECK(mmap.virt_to_phys(0x3FF123).first == 0x5FF123);
+
+    auto [pte, unused] = mmap.get_entry(0x201000ULL);
+    CHECK(pt::entry::read_access::is_enabled(pte));
+    CHECK(pt::entry::write_access::is_disabled(pte));
+    CHECK(pt::entry::memory_type::get(pte) == pt::entry::memory_type::uncacheable);
+
+    CHECK(mmap.split(0x200000) == pt::from);
+    CHECK_THROWS(mmap.split(0x600000));
+}
+
+TEST_CASE("ept_mmap: split 1g")
+{
+    using namespace ::intel_x64::ept;
+
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_1g(0x40000000, 0x80000000);
+
+    CHECK(mmap.split(0x40201000) == pd::from);
+    CHECK(mmap.is_2m(0x40000000ULL));
+    CHECK(mmap.virt_to_phys(0x7FFFFFFF).first == 0xBFFFFFFF);
+
+    CHECK(mmap.split(0x40201000) == pt::from);
+    CHECK(mmap.is_4k(0x40201000ULL));
+    CHECK(mmap.is_2m(0x40400000ULL));
+    CHECK(mmap.virt_to_phys(0x40201123).first == 0x80201123);
+}
+
+TEST_CASE("ept_mmap: coalesce")
+{
+    using namespace ::intel_x64::ept;
+
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_2m(0x200000, 0x400000);
+    auto num_pages = g_allocated_pages.size();
+
+    mmap.split(0x200000);
+    CHECK(g_allocated_pages.size() == num_pages + 1);
+
+    CHECK(mmap.coalesce(0x201000));
+    CHECK(mmap.is_2m(0x200000ULL));
+    CHECK(mmap.virt_to_phys(0x3FF123).first == 0x5FF123);
+    CHECK(g_allocated_pages.size() == num_pages);
+
+    CHECK(!mmap.coalesce(0x200000));
+    CHECK_THROWS(mmap.coalesce(0x600000));
+}
+
+TEST_CASE("ept_mmap: coalesce non-uniform")
+{
+    using namespace ::intel_x64::ept;
+
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_2m(0x200000, 0x400000);
+    mmap.split(0x200000);
+
+    mmap.update_entry(0x201000ULL, [](auto & pte) {
+        pt::entry::write_access::disable(pte);
+    });
+    CHECK(!mmap.coalesce(0x200000));
+
+    mmap.update_entry(0x201000ULL, [](auto & pte) {
+        pt::entry::write_access::enable(pte);
+        pt::entry::phys_addr::set(pte, 0x800000);
+    });
+    CHECK(!mmap.coalesce(0x200000));
+
+    mmap.update_entry(0x201000ULL, [](auto & pte) {
+        pt::entry::phys_addr::set(pte, 0x401000);
+    });
+    CHECK(mmap.coalesce(0x200000));
+}
+
+TEST_CASE("ept_mmap: coalesce 1g")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    mmap.map_1g(0x40000000, 0x80000000);
+    mmap.split(0x40000000);
+
+    CHECK(!mmap.coalesce(0x40000000));
+
+    g_msrs[::intel_x64::msrs::ia32_vmx_ept_vpid_cap::addr] =
+        ::intel_x64::msrs::ia32_vmx_ept_vpid_cap::pdpte_1gb_support::mask;
+
+    CHECK(mmap.coalesce(0x40000000));
+    CHECK(mmap.is_1g(0x40000000ULL));
+}
+
+TEST_CASE("ept_mmap: split / coalesce invalidate attached vcpus")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    invalidation_queue queue1{};
+    invalidation_queue queue2{};
+
+    mmap.attach(&queue1);
+    mmap.attach(&queue2);
+    mmap.attach(&queue2);
+
+    mmap.map_2m(0x200000, 0x400000);
+    CHECK(queue1.empty());
+    CHECK(queue2.empty());
+
+    mmap.split(0x200000);
+    CHECK(!queue1.empty());
+    CHECK(!queue2.empty());
+    CHECK(queue2.requested() == 1);
+
+    CHECK_NOTHROW(queue1.flush());
+    CHECK_NOTHROW(queue2.flush());
+    queue1.exited();
+    queue2.exited();
+
+    mmap.detach(&queue2);
+
+    CHECK(mmap.coalesce(0x200000));
+    CHECK(!queue1.empty());
+    CHECK(queue2.empty());
+
+    mmap.shootdown();
+    CHECK(queue1.requested() == 3);
+    CHECK(queue2.requested() == 1);
+}
+
+TEST_CASE("ept_mmap: coalesce waits for attached vcpus")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    invalidation_queue queue{};
+    mmap.attach(&queue);
+
+    mmap.map_2m(0x200000, 0x400000);
+    mmap.split(0x200000);
+
+    auto num_pages = g_allocated_pages.size();
+    CHECK_NOTHROW(queue.flush());
+
+    std::atomic<bool> done{};
+    std::thread thread([&] {
+        mmap.coalesce(0x200000);
+        done = true;
+    });
+
+    while (queue.empty()) {
+        std::this_thread::yield();
+    }
+
+    CHECK(!done);
+    CHECK(g_allocated_pages.size() == num_pages);
+
+    queue.exited();
+    thread.join();
+
+    CHECK(done);
+    CHECK(g_allocated_pages.size() == num_pages - 1);
+    CHECK(mmap.is_2m(0x200000ULL));
+}
+
+TEST_CASE("ept_mmap: release invalidates attached vcpus")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    invalidation_queue queue{};
+    mmap.attach(&queue);
+
+    mmap.map_4k(0x1000, 0x2000);
+    mmap.unmap(0x1000ULL);
+    CHECK(queue.empty());
+
+    mmap.release(0x1000ULL);
+    CHECK(!queue.empty());
+    CHECK(queue.requested() == 1);
+
+    CHECK_NOTHROW(queue.flush());
+    queue.exited();
+
+    mmap.release(0x1000ULL);
+    CHECK(queue.empty());
+}
+
+TEST_CASE("ept_mmap: shootdown waits for attached vcpus")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    invalidation_queue queue{};
+    mmap.attach(&queue);
+
+    CHECK_NOTHROW(mmap.shootdown());
+    CHECK(!queue.empty());
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(queue.empty());
+
+    std::atomic<bool> done{};
+    std::thread thread([&] {
+        mmap.shootdown();
+        done = true;
+    });
+
+    while (queue.empty()) {
+        std::this_thread::yield();
+    }
+
+    CHECK(!done);
+    CHECK_NOTHROW(queue.flush());
+
+    thread.join();
+    CHECK(done);
+}
+
+TEST_CASE("ept_mmap: invept")
+{
+    setup_test_support();
+    ept::mmap mmap{};
+
+    CHECK_NOTHROW(mmap.invept());
+
+    mmap.eptp();
+    CHECK_NOTHROW(mmap.invept());
+
+    g_msrs[::intel_x64::msrs::ia32_vmx_ept_vpid_cap::addr] =
+        ::intel_x64::msrs::ia32_vmx_ept_vpid_cap::invept_single_context_support::mask;
+
+    CHECK_NOTHROW(mmap.invept());
+}
+
+#endif
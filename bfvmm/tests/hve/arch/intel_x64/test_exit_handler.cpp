@@ -53,6 +53,23 @@ TEST_CASE("exit_handler: construct / destruct")
     CHECK_NOTHROW(bfvmm::intel_x64::exit_handler{vcpu});
 }
 
+TEST_CASE("exit_handler: lazy fpu")
+{
+    using namespace ::intel_x64::vmcs;
+
+    setup_test_support();
+
+    MockRepository mocks;
+    auto &&vcpu = setup_vcpu(mocks, 0x0);
+
+    g_save_state.fpu_flags = 0;
+    auto &&ehlr = bfvmm::intel_x64::exit_handler{vcpu};
+
+    CHECK((g_vmcs_fields[host_cr0::addr] & ::intel_x64::cr0::task_switched::mask) != 0);
+    CHECK(g_save_state.fpu_flags == bfvmm::intel_x64::SAVE_STATE_FPU_XSAVE);
+    CHECK(g_save_state.fpu_saved == bfvmm::intel_x64::SAVE_STATE_FPU_LIVE);
+}
+
 TEST_CASE("exit_handler: add_handler")
 {
     setup_test_support();
@@ -79,6 +96,80 @@ TEST_CASE("exit_handler: add_handler invalid reason")
     );
 }
 
+TEST_CASE("exit_handler: add_handler too many handlers")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto &&vcpu = setup_vcpu(mocks, 0x0);
+    auto &&ehlr = bfvmm::intel_x64::exit_handler{vcpu};
+
+    for (auto i = 0ULL; i < MAX_HANDLERS_PER_EXIT_REASON; i++) {
+        CHECK_NOTHROW(
+            ehlr.add_handler(0, handler_delegate_t::create<test_handler>())
+        );
+    }
+
+    CHECK_THROWS(
+        ehlr.add_handler(0, handler_delegate_t::create<test_handler>())
+    );
+}
+
+TEST_CASE("exit_handler: add_handler once sealed")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto &&vcpu = setup_vcpu(mocks, 0x0);
+    auto &&ehlr = bfvmm::intel_x64::exit_handler{vcpu};
+
+    CHECK(!ehlr.is_sealed());
+    ehlr.seal();
+    CHECK(ehlr.is_sealed());
+
+    CHECK_THROWS(
+        ehlr.add_handler(0, handler_delegate_t::create<test_handler>())
+    );
+
+    CHECK_THROWS(
+        ehlr.add_exit_handler(handler_delegate_t::create<test_handler>())
+    );
+}
+
+TEST_CASE("exit_handler: handlers execute in reverse order")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto &&vcpu = setup_vcpu(mocks, ::intel_x64::vmcs::exit_reason::basic_exit_reason::rdtsc);
+    auto &&ehlr = bfvmm::intel_x64::exit_handler{vcpu};
+
+    std::vector<int> order;
+
+    auto first = [&](gsl::not_null<bfvmm::intel_x64::vcpu *>) {
+        order.push_back(1);
+        return false;
+    };
+
+    auto second = [&](gsl::not_null<bfvmm::intel_x64::vcpu *>) {
+        order.push_back(2);
+        return false;
+    };
+
+    ehlr.add_handler(
+        ::intel_x64::vmcs::exit_reason::basic_exit_reason::rdtsc,
+        handler_delegate_t::create(first)
+    );
+
+    ehlr.add_handler(
+        ::intel_x64::vmcs::exit_reason::basic_exit_reason::rdtsc,
+        handler_delegate_t::create(second)
+    );
+
+    CHECK_NOTHROW(ehlr.handle(&ehlr));
+    CHECK(order == std::vector<int>({2, 1}));
+}
+
 TEST_CASE("exit_handler: unhandled exit reason")
 {
     setup_test_support();
@@ -180,6 +271,31 @@ TEST_CASE("exit_handler: handle_cpuid")
     CHECK(g_save_state.rip != 0);
 }
 
+TEST_CASE("exit_handler: exit stats")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto &&vcpu = setup_vcpu(mocks, ::intel_x64::vmcs::exit_reason::basic_exit_reason::cpuid);
+    auto &&ehlr = bfvmm::intel_x64::exit_handler{vcpu};
+
+    CHECK_NOTHROW(ehlr.handle(&ehlr));
+    CHECK_NOTHROW(ehlr.handle(&ehlr));
+
+    exit_stats_t stats{};
+    CHECK(get_exit_stats(0, &stats) == GET_EXIT_STATS_SUCCESS);
+
+    auto reason = ::intel_x64::vmcs::exit_reason::basic_exit_reason::cpuid;
+    auto hits = 0ULL;
+
+    for (const auto &bucket : gsl::at(stats.hist, reason)) {
+        hits += bucket;
+    }
+
+    CHECK(gsl::at(stats.count, reason) == 2);
+    CHECK(hits == 2);
+}
+
 TEST_CASE("exit_handler: handle_cpuid ack")
 {
     setup_test_support();
@@ -0,0 +1,163 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <list>
+
+#include <test/support.h>
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+constexpr const auto num_exits = 100000ULL;
+constexpr const auto num_handlers = 4ULL;
+
+// Note:
+//
+// Each benchmark below dispatches num_exits VM exits to num_handlers
+// handlers, the oldest of which handles the VM exit. The exits are
+// dispatched with dispatch() instead of handle(), as handle() would resume
+// the guest, which on a mocked vCPU returns and falls through to the
+// unhandled exit path. The legacy and flat benchmarks perform the same
+// work, so the difference between their run times (e.g. as reported by
+// --durations yes) is the cost of the dispatch itself.
+//
+
+static bool
+pass_handler(gsl::not_null<bfvmm::intel_x64::vcpu *>)
+{ return false; }
+
+static bool
+resume_handler(gsl::not_null<bfvmm::intel_x64::vcpu *>)
+{ return true; }
+
+// Note:
+//
+// The following is a copy of the std::list based dispatch that the exit
+// handler used before the flat dispatch table was introduced. It is used as
+// the baseline for the benchmarks below.
+//
+
+class legacy_exit_handler
+{
+public:
+
+    legacy_exit_handler(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu) :
+        m_vcpu{vcpu}
+    { }
+
+    void add_handler(
+        ::intel_x64::vmcs::value_type reason, const handler_delegate_t &d)
+    { m_exit_handlers_array.at(reason).push_front(d); }
+
+    bool dispatch(::intel_x64::vmcs::value_type reason)
+    {
+        for (const auto &d : m_exit_handlers) {
+            d(m_vcpu);
+        }
+
+        for (const auto &d : m_exit_handlers_array.at(reason)) {
+            if (d(m_vcpu)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+
+    bfvmm::intel_x64::vcpu *m_vcpu;
+
+    std::list<handler_delegate_t> m_exit_handlers;
+    std::array<std::list<handler_delegate_t>, 128> m_exit_handlers_array;
+};
+
+template<typename T>
+void
+dispatch_exits(::intel_x64::vmcs::value_type reason)
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto &&vcpu = setup_vcpu(mocks, reason);
+    auto &&ehlr = T{vcpu};
+
+    ehlr.add_handler(reason, handler_delegate_t::create<resume_handler>());
+    for (auto i = 1ULL; i < num_handlers; i++) {
+        ehlr.add_handler(reason, handler_delegate_t::create<pass_handler>());
+    }
+
+    auto handled = 0ULL;
+    for (auto i = 0ULL; i < num_exits; i++) {
+        if (ehlr.dispatch(reason)) {
+            handled++;
+        }
+    }
+
+    CHECK(handled == num_exits);
+}
+
+TEST_CASE("exit_handler benchmark: cpuid, legacy")
+{
+    dispatch_exits<legacy_exit_handler>(
+        ::intel_x64::vmcs::exit_reason::basic_exit_reason::cpuid
+    );
+}
+
+TEST_CASE("exit_handler benchmark: cpuid, flat")
+{
+    dispatch_exits<bfvmm::intel_x64::exit_handler>(
+        ::intel_x64::vmcs::exit_reason::basic_exit_reason::cpuid
+    );
+}
+
+TEST_CASE("exit_handler benchmark: rdmsr, legacy")
+{
+    dispatch_exits<legacy_exit_handler>(
+        ::intel_x64::vmcs::exit_reason::basic_exit_reason::rdmsr
+    );
+}
+
+TEST_CASE("exit_handler benchmark: rdmsr, flat")
+{
+    dispatch_exits<bfvmm::intel_x64::exit_handler>(
+        ::intel_x64::vmcs::exit_reason::basic_exit_reason::rdmsr
+    );
+}
+
+TEST_CASE("exit_handler benchmark: ept violation, legacy")
+{
+    dispatch_exits<legacy_exit_handler>(
+        ::intel_x64::vmcs::exit_reason::basic_exit_reason::ept_violation
+    );
+}
+
+TEST_CASE("exit_handler benchmark: ept violation, flat")
+{
+    dispatch_exits<bfvmm::intel_x64::exit_handler>(
+        ::intel_x64::vmcs::exit_reason::basic_exit_reason::ept_violation
+    );
+}
+
+#endif
@@ -0,0 +1,246 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <test/support.h>
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+using namespace bfvmm::intel_x64;
+using namespace ::intel_x64::vmcs;
+using namespace ::intel_x64::vmcs::secondary_processor_based_vm_execution_controls;
+
+namespace ept_vpid_cap = ::intel_x64::msrs::ia32_vmx_ept_vpid_cap;
+
+static void
+setup_invalidations(bool ept, bool vpid)
+{
+    setup_test_support();
+
+    g_invept.clear();
+    g_invvpid.clear();
+
+    g_msrs[ept_vpid_cap::addr] =
+        ept_vpid_cap::invept_single_context_support::mask |
+        ept_vpid_cap::invvpid_individual_address_support::mask |
+        ept_vpid_cap::invvpid_single_context_support::mask;
+
+    ept ? enable_ept::enable() : enable_ept::disable();
+    vpid ? enable_vpid::enable() : enable_vpid::disable();
+
+    ept_pointer::phys_addr::set(0x1000U);
+    virtual_processor_identifier::set(1U);
+}
+
+TEST_CASE("invalidation_queue: empty")
+{
+    setup_invalidations(true, true);
+    invalidation_queue queue{};
+
+    CHECK(queue.empty());
+    CHECK_NOTHROW(queue.flush());
+
+    CHECK(g_invept.empty());
+    CHECK(g_invvpid.empty());
+    CHECK(queue.requested() == 0);
+    CHECK(queue.issued() == 0);
+}
+
+TEST_CASE("invalidation_queue: invept batched")
+{
+    setup_invalidations(true, true);
+    invalidation_queue queue{};
+
+    queue.invept_single_context();
+    queue.invept_single_context();
+    queue.invept_single_context();
+    CHECK(!queue.empty());
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(queue.empty());
+
+    CHECK(g_invept[1] == 1);
+    CHECK(g_invept[2] == 0);
+    CHECK(queue.requested() == 3);
+    CHECK(queue.issued() == 1);
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(g_invept[1] == 1);
+}
+
+TEST_CASE("invalidation_queue: invept global")
+{
+    setup_invalidations(true, true);
+    invalidation_queue queue{};
+
+    queue.invept_single_context();
+    queue.invept_global();
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(g_invept[1] == 0);
+    CHECK(g_invept[2] == 1);
+    CHECK(queue.issued() == 1);
+}
+
+TEST_CASE("invalidation_queue: invept single context not supported")
+{
+    setup_invalidations(true, true);
+    invalidation_queue queue{};
+
+    g_msrs[ept_vpid_cap::addr] = 0;
+    queue.invept_single_context();
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(g_invept[1] == 0);
+    CHECK(g_invept[2] == 1);
+}
+
+TEST_CASE("invalidation_queue: invept subsumes invvpid")
+{
+    setup_invalidations(true, true);
+    invalidation_queue queue{};
+
+    queue.invvpid_individual_address(0x1000);
+    queue.invvpid_single_context();
+    queue.invept_single_context();
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(g_invept[1] == 1);
+    CHECK(g_invvpid.empty());
+    CHECK(queue.requested() == 3);
+    CHECK(queue.issued() == 1);
+}
+
+TEST_CASE("invalidation_queue: invvpid individual address")
+{
+    setup_invalidations(false, true);
+    invalidation_queue queue{};
+
+    queue.invvpid_individual_address(0x1000);
+    queue.invvpid_individual_address(0x1FFF);
+    queue.invvpid_individual_address(0x2000);
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(g_invept.empty());
+    CHECK(g_invvpid[0] == 2);
+    CHECK(g_invvpid[1] == 0);
+    CHECK(queue.requested() == 3);
+    CHECK(queue.issued() == 2);
+}
+
+TEST_CASE("invalidation_queue: invvpid overflow")
+{
+    setup_invalidations(false, true);
+    invalidation_queue queue{};
+
+    for (uintptr_t i = 0; i <= INVALIDATION_QUEUE_SIZE; i++) {
+        queue.invvpid_individual_address(i * 0x1000);
+    }
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(g_invvpid[0] == 0);
+    CHECK(g_invvpid[1] == 1);
+    CHECK(queue.issued() == 1);
+}
+
+TEST_CASE("invalidation_queue: invvpid single context")
+{
+    setup_invalidations(false, true);
+    invalidation_queue queue{};
+
+    queue.invvpid_individual_address(0x1000);
+    queue.invvpid_single_context();
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(g_invvpid[0] == 0);
+    CHECK(g_invvpid[1] == 1);
+}
+
+TEST_CASE("invalidation_queue: invvpid not supported")
+{
+    setup_invalidations(false, true);
+    invalidation_queue queue{};
+
+    g_msrs[ept_vpid_cap::addr] = 0;
+    queue.invvpid_individual_address(0x1000);
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(g_invvpid[0] == 0);
+    CHECK(g_invvpid[1] == 0);
+    CHECK(g_invvpid[2] == 1);
+}
+
+TEST_CASE("invalidation_queue: vpid disabled")
+{
+    setup_invalidations(false, false);
+    invalidation_queue queue{};
+
+    queue.invvpid_individual_address(0x1000);
+    queue.invvpid_single_context();
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(queue.empty());
+    CHECK(g_invvpid.empty());
+    CHECK(queue.issued() == 0);
+}
+
+TEST_CASE("invalidation_queue: acknowledged")
+{
+    setup_invalidations(true, true);
+    invalidation_queue queue{};
+
+    auto ticket1 = queue.invept_single_context();
+    CHECK(queue.acknowledged(ticket1));
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(queue.acknowledged(ticket1));
+
+    auto ticket2 = queue.invept_global();
+    CHECK(ticket2 > ticket1);
+    CHECK(!queue.acknowledged(ticket2));
+
+    queue.exited();
+    CHECK(queue.acknowledged(ticket2));
+    CHECK(!queue.empty());
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(queue.acknowledged(ticket2));
+
+    auto ticket3 = queue.invvpid_single_context();
+    CHECK(!queue.acknowledged(ticket3));
+
+    CHECK_NOTHROW(queue.flush());
+    CHECK(queue.acknowledged(ticket3));
+}
+
+TEST_CASE("invalidation_queue: vcpu")
+{
+    setup_invalidations(true, true);
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    CHECK(vcpu.invalidations()->empty());
+    vcpu.invalidations()->invept_single_context();
+    CHECK(!vcpu.invalidations()->empty());
+}
+
+#endif
@@ -0,0 +1,486 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// TIDY_EXCLUSION=-cppcoreguidelines-pro-type-reinterpret-cast
+//
+// Reason:
+//     Although in general this is a good rule, for hypervisor level code that
+//     interfaces with the kernel, and raw hardware, this rule is
+//     impractical.
+//
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <array>
+#include <vector>
+
+#include <test/support.h>
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+using namespace ::intel_x64::vmcs;
+namespace io = exit_qualification::io_instruction;
+namespace ins = vm_exit_instruction_information::ins;
+namespace outs = vm_exit_instruction_information::outs;
+
+using io_instruction_handler = bfvmm::intel_x64::io_instruction_handler;
+using info_t = io_instruction_handler::info_t;
+
+constexpr const auto g_port = 0x42ULL;
+constexpr const auto g_gva = 0x10000ULL;
+constexpr const auto g_length = 2ULL;
+
+// Note:
+//
+// The VMM's memory maps are not backed by anything in a unit test, so the
+// memory manager is mocked to hand out real buffers from alloc_map(), and
+// the guest's memory is whatever the vCPU's map cache windows hold. Paging
+// and EPT are disabled, so a GVA is its own HPA.
+//
+
+alignas(0x1000) static std::array<uint8_t, MAP_CACHE_SIZE * 0x1000> g_cache_windows{};
+alignas(0x1000) static std::array<uint8_t, 0x1000> g_map_window{};
+
+static void
+prefault(uint8_t *buf, std::size_t size)
+{
+    for (std::size_t i = 0; i < size; i += 0x1000) {
+        g_cr3->map_4k(buf + i, 0x1000);
+        g_cr3->unmap(buf + i);
+    }
+}
+
+static void *
+alloc_map(bfvmm::memory_manager::size_type size)
+{
+    if (size == g_cache_windows.size()) {
+        return g_cache_windows.data();
+    }
+
+    return g_map_window.data();
+}
+
+static void
+setup_mm(MockRepository &mocks)
+{
+    prefault(g_cache_windows.data(), g_cache_windows.size());
+    prefault(g_map_window.data(), g_map_window.size());
+
+    auto mm = mocks.Mock<bfvmm::memory_manager>();
+    mocks.OnCallFunc(bfvmm::memory_manager::instance).Return(mm);
+
+    mocks.OnCall(mm, bfvmm::memory_manager::alloc_map).Do(alloc_map);
+    mocks.OnCall(mm, bfvmm::memory_manager::free_map);
+}
+
+static void
+setup_exit(
+    uint64_t size, bool in, bool rep, uint64_t address_size, bool info = true)
+{
+    using namespace ::intel_x64::msrs;
+
+    g_msrs[ia32_vmx_basic::addr] =
+        info ? ia32_vmx_basic::ins_outs_exit_information::mask : 0ULL;
+
+    auto eq = 0ULL;
+    eq = set_bits(eq, io::size_of_access::mask, size << io::size_of_access::from);
+    eq = set_bits(eq, io::direction_of_access::mask, (in ? 1ULL : 0ULL) << io::direction_of_access::from);
+    eq = set_bits(eq, io::string_instruction::mask, io::string_instruction::mask);
+    eq = set_bits(eq, io::rep_prefixed::mask, rep ? io::rep_prefixed::mask : 0ULL);
+    eq = set_bits(eq, io::operand_encoding::mask, 0ULL);
+
+    ::intel_x64::vm::write(exit_qualification::addr, eq, "");
+    ::intel_x64::vm::write(
+        vm_exit_instruction_information::addr,
+        address_size << ins::address_size::from,
+        ""
+    );
+    ::intel_x64::vm::write(vm_exit_instruction_length::addr, g_length, "");
+    ::intel_x64::vm::write(guest_rflags::addr, 0, "");
+    ::intel_x64::vm::write(guest_cs_access_rights::addr, 0, "");
+
+    ::intel_x64::vmcs::guest_cr0::paging::disable();
+}
+
+static void
+setup_registers(
+    bfvmm::intel_x64::vcpu &vcpu, uint64_t rcx, uint64_t reg, uint64_t gva)
+{
+    vcpu.set_rip(0);
+    vcpu.set_rcx(rcx);
+    vcpu.set_rdx(g_port);
+    vcpu.set_rsi(reg);
+    vcpu.set_rdi(reg);
+
+    ::intel_x64::vm::write(guest_linear_address::addr, gva, "");
+}
+
+static std::vector<uint64_t> g_addresses;
+static std::vector<uint64_t> g_values;
+static uint64_t g_next_val;
+static uint64_t g_decline_after;
+static bool g_default_called;
+
+static void
+reset_handlers()
+{
+    g_addresses.clear();
+    g_values.clear();
+    g_next_val = 0x10;
+    g_decline_after = ~0ULL;
+    g_default_called = false;
+}
+
+static bool
+observe(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, info_t &info)
+{
+    bfignored(vcpu);
+
+    g_addresses.push_back(info.address);
+    g_values.push_back(info.val);
+
+    return true;
+}
+
+static bool
+intercept(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, info_t &info)
+{
+    bfignored(vcpu);
+
+    if (g_addresses.size() == g_decline_after) {
+        return false;
+    }
+
+    g_addresses.push_back(info.address);
+    g_values.push_back(info.val);
+
+    info.val = g_next_val++;
+    return true;
+}
+
+static bool
+default_handler(gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu)
+{
+    bfignored(vcpu);
+
+    g_default_called = true;
+    return true;
+}
+
+static auto
+observer()
+{ return io_instruction_handler::handler_delegate_t::create<observe>(); }
+
+static auto
+interceptor()
+{ return io_instruction_handler::handler_delegate_t::create<intercept>(); }
+
+template<typename T, std::size_t N>
+static auto
+read_guest(bfvmm::intel_x64::vcpu &vcpu, uint64_t gva)
+{
+    std::array<T, N> buf{};
+    vcpu.read_guest(gva, buf.data(), sizeof(buf));
+
+    return buf;
+}
+
+TEST_CASE("io_instruction: rep ins with pass through handlers")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+    mocks.NeverCallFunc(_inb);
+
+    reset_handlers();
+    g_ports[g_port] = 0xAB;
+
+    setup_exit(io::size_of_access::one_byte, true, true, ins::address_size::_64bit);
+    setup_registers(vcpu, 16, g_gva, g_gva);
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_pass_through_handler(g_port, observer(), observer());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_addresses.size() == 16);
+    CHECK(g_addresses.front() == g_gva);
+    CHECK(g_addresses.back() == g_gva + 15);
+    CHECK(g_values.back() == 0xAB);
+
+    CHECK(vcpu.rcx() == 0);
+    CHECK(vcpu.rdi() == g_gva + 16);
+    CHECK(vcpu.rip() == g_length);
+
+    for (const auto &val : read_guest<uint8_t, 16>(vcpu, g_gva)) {
+        CHECK(val == 0xAB);
+    }
+}
+
+TEST_CASE("io_instruction: rep ins with an intercepting handler")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+    mocks.NeverCallFunc(_insbrep);
+
+    reset_handlers();
+    g_ports[g_port] = 0xAB;
+
+    setup_exit(io::size_of_access::one_byte, true, true, ins::address_size::_64bit);
+    setup_registers(vcpu, 4, g_gva, g_gva);
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_pass_through_handler(g_port, observer(), observer());
+    handler.add_handler(g_port, interceptor(), interceptor());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_values == std::vector<uint64_t>{0xAB, 0xAB, 0xAB, 0xAB});
+    CHECK(vcpu.rcx() == 0);
+    CHECK(vcpu.rdi() == g_gva + 4);
+    CHECK(vcpu.rip() == g_length);
+    CHECK(read_guest<uint8_t, 4>(vcpu, g_gva) == std::array<uint8_t, 4>{0x10, 0x11, 0x12, 0x13});
+}
+
+TEST_CASE("io_instruction: rep ins with the direction flag set")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+    mocks.NeverCallFunc(_inswrep);
+
+    reset_handlers();
+
+    setup_exit(io::size_of_access::two_byte, true, true, ins::address_size::_64bit);
+    setup_registers(vcpu, 3, g_gva + 0x10, g_gva + 0x10);
+    ::intel_x64::vm::write(guest_rflags::addr, ::x64::rflags::direction_flag::mask, "");
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_handler(g_port, interceptor(), interceptor());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_addresses == std::vector<uint64_t>{g_gva + 0x10, g_gva + 0xE, g_gva + 0xC});
+    CHECK(vcpu.rcx() == 0);
+    CHECK(vcpu.rdi() == g_gva + 0xA);
+    CHECK(vcpu.rip() == g_length);
+    CHECK(read_guest<uint16_t, 3>(vcpu, g_gva + 0xC) == std::array<uint16_t, 3>{0x12, 0x11, 0x10});
+}
+
+TEST_CASE("io_instruction: rep outs")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    reset_handlers();
+
+    std::array<uint16_t, 4> buf{1, 2, 3, 4};
+    vcpu.write_guest(g_gva, buf.data(), sizeof(buf));
+
+    setup_exit(io::size_of_access::two_byte, false, true, outs::address_size::_64bit);
+    setup_registers(vcpu, 4, g_gva, g_gva);
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_handler(g_port, observer(), observer());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_values == std::vector<uint64_t>{1, 2, 3, 4});
+    CHECK(g_ports[g_port] == 4);
+
+    CHECK(vcpu.rcx() == 0);
+    CHECK(vcpu.rsi() == g_gva + 8);
+    CHECK(vcpu.rip() == g_length);
+}
+
+TEST_CASE("io_instruction: 16bit address size")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    reset_handlers();
+
+    setup_exit(io::size_of_access::one_byte, false, true, outs::address_size::_16bit);
+    setup_registers(vcpu, 0xFFFF0004, 0xABCD0010, g_gva + 0x10);
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_handler(g_port, observer(), observer());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_addresses.size() == 4);
+    CHECK(vcpu.rcx() == 0xFFFF0000);
+    CHECK(vcpu.rsi() == 0xABCD0014);
+    CHECK(vcpu.rip() == g_length);
+}
+
+TEST_CASE("io_instruction: 32bit address size")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    reset_handlers();
+
+    setup_exit(io::size_of_access::one_byte, false, true, outs::address_size::_32bit);
+    setup_registers(vcpu, 0xFFFFFFFF00000004, 0xFFFFFFFF00000010, g_gva + 0x10);
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_handler(g_port, observer(), observer());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_addresses.size() == 4);
+    CHECK(vcpu.rcx() == 0);
+    CHECK(vcpu.rsi() == 0x14);
+    CHECK(vcpu.rip() == g_length);
+}
+
+TEST_CASE("io_instruction: rep ins across a page boundary")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    reset_handlers();
+
+    setup_exit(io::size_of_access::four_byte, true, true, ins::address_size::_64bit);
+    setup_registers(vcpu, 3, g_gva + 0xFFE, g_gva + 0xFFE);
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_handler(g_port, interceptor(), interceptor());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_addresses == std::vector<uint64_t>{g_gva + 0xFFE, g_gva + 0x1002, g_gva + 0x1006});
+    CHECK(vcpu.rcx() == 0);
+    CHECK(vcpu.rdi() == g_gva + 0x100A);
+    CHECK(vcpu.rip() == g_length);
+    CHECK(read_guest<uint32_t, 3>(vcpu, g_gva + 0xFFE) == std::array<uint32_t, 3>{0x10, 0x11, 0x12});
+}
+
+TEST_CASE("io_instruction: rep outs across a page boundary")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    reset_handlers();
+
+    std::array<uint8_t, 0x20> buf{};
+    for (auto i = 0U; i < buf.size(); i++) {
+        buf.at(i) = gsl::narrow_cast<uint8_t>(i);
+    }
+
+    vcpu.write_guest(g_gva + 0xFF0, buf.data(), buf.size());
+
+    setup_exit(io::size_of_access::one_byte, false, true, outs::address_size::_64bit);
+    setup_registers(vcpu, buf.size(), g_gva + 0xFF0, g_gva + 0xFF0);
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_handler(g_port, observer(), observer());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_values.size() == buf.size());
+    CHECK(g_values.at(0x10) == 0x10);
+    CHECK(g_values.back() == 0x1F);
+    CHECK(g_ports[g_port] == 0x1F);
+
+    CHECK(vcpu.rcx() == 0);
+    CHECK(vcpu.rsi() == g_gva + 0x1010);
+    CHECK(vcpu.rip() == g_length);
+}
+
+TEST_CASE("io_instruction: partial block")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    reset_handlers();
+    g_decline_after = 3;
+
+    setup_exit(io::size_of_access::one_byte, true, true, ins::address_size::_64bit);
+    setup_registers(vcpu, 8, g_gva, g_gva);
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_handler(g_port, interceptor(), interceptor());
+    handler.set_default_handler(::handler_delegate_t::create<default_handler>());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_default_called);
+    CHECK(g_addresses.size() == 3);
+    CHECK(vcpu.rcx() == 5);
+    CHECK(vcpu.rdi() == g_gva + 3);
+    CHECK(vcpu.rip() == 0);
+    CHECK(read_guest<uint8_t, 3>(vcpu, g_gva) == std::array<uint8_t, 3>{0x10, 0x11, 0x12});
+}
+
+TEST_CASE("io_instruction: no instruction information")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    reset_handlers();
+
+    setup_exit(io::size_of_access::one_byte, true, true, ins::address_size::_64bit, false);
+    setup_registers(vcpu, 0xFFFFFFFF00000004, 0xFFFFFFFF00000010, g_gva + 0x10);
+    ::intel_x64::vm::write(guest_cs_access_rights::addr, guest_cs_access_rights::db::mask, "");
+
+    io_instruction_handler handler{&vcpu};
+    handler.add_pass_through_handler(g_port, observer(), observer());
+
+    CHECK(handler.handle(&vcpu));
+
+    CHECK(g_addresses.size() == 1);
+    CHECK(vcpu.rcx() == 3);
+    CHECK(vcpu.rdi() == 0x11);
+    CHECK(vcpu.rip() == 0);
+}
+
+#endif
@@ -66,6 +66,22 @@ TEST_CASE("vcpu: resume")
     CHECK_THROWS(vcpu.run());
 }
 
+TEST_CASE("vcpu: failed resume leaves the guest")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    mocks.OnCallFunc(bfvmm::intel_x64::check::all);
+
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    CHECK_NOTHROW(vcpu.run());
+    CHECK_THROWS(vcpu.run());
+
+    auto ticket = vcpu.invalidations()->invvpid_single_context();
+    CHECK(vcpu.invalidations()->acknowledged(ticket));
+}
+
 TEST_CASE("vcpu: hlt")
 {
     setup_test_support();
@@ -105,6 +121,16 @@ TEST_CASE("vcpu: add handlers")
     CHECK_NOTHROW(vcpu.add_exit_handler(handler_delegate_t::create<test_handler>()));
 }
 
+TEST_CASE("vcpu: add handlers after run")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    CHECK_NOTHROW(vcpu.run());
+    CHECK_THROWS(vcpu.add_handler(0, handler_delegate_t::create<test_handler>()));
+    CHECK_THROWS(vcpu.add_exit_handler(handler_delegate_t::create<test_handler>()));
+}
+
 TEST_CASE("vcpu: dump")
 {
     setup_test_support();
@@ -259,6 +285,71 @@ TEST_CASE("vcpu: registers")
     CHECK(vcpu.ldtr_access_rights() == 42);
 }
 
+TEST_CASE("vcpu: vmcs write back")
+{
+    using namespace ::intel_x64::vmcs;
+
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    vcpu.enable_vmcs_write_back();
+
+    g_vmcs_fields[guest_cr4::addr] = 0;
+    vcpu.set_cr4(1);
+    vcpu.set_cr4(2);
+
+    CHECK(vcpu.cr4() == 2);
+    CHECK(g_vmcs_fields[guest_cr4::addr] == 0);
+
+    vcpu.load();
+    CHECK(g_vmcs_fields[guest_cr4::addr] == 2);
+
+    vcpu.set_cr4(3);
+    vcpu.disable_vmcs_write_back();
+    CHECK(g_vmcs_fields[guest_cr4::addr] == 3);
+
+    vcpu.set_cr4(4);
+    CHECK(g_vmcs_fields[guest_cr4::addr] == 4);
+}
+
+TEST_CASE("vcpu: vmcs write back queue full")
+{
+    using namespace ::intel_x64::vmcs;
+
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    vcpu.enable_vmcs_write_back();
+    g_vmwrite_count = 0;
+
+    for (auto i = 0ULL; i <= VMCS_WRITE_QUEUE_SIZE; i++) {
+        vcpu.set_cr4_read_shadow(i);
+        vcpu.set_cr0_read_shadow(i);
+        vcpu.set_cr4(i);
+    }
+
+    CHECK(g_vmwrite_count == 0);
+
+    vcpu.set_es_base(1);
+    vcpu.set_cs_base(1);
+    vcpu.set_ss_base(1);
+    vcpu.set_ds_base(1);
+    vcpu.set_fs_base(1);
+    vcpu.set_gs_base(1);
+    vcpu.set_tr_base(1);
+    vcpu.set_ldtr_base(1);
+    vcpu.set_es_limit(1);
+    vcpu.set_cs_limit(1);
+    vcpu.set_ss_limit(1);
+    vcpu.set_ds_limit(1);
+    vcpu.set_fs_limit(1);
+    vcpu.set_gs_limit(1);
+
+    CHECK(g_vmwrite_count == VMCS_WRITE_QUEUE_SIZE);
+    CHECK(g_vmcs_fields[guest_cr4::addr] == VMCS_WRITE_QUEUE_SIZE);
+    CHECK(vcpu.gs_limit() == 1);
+}
+
 TEST_CASE("vcpu: save state")
 {
     setup_test_support();
@@ -267,4 +358,104 @@ TEST_CASE("vcpu: save state")
     CHECK_NOTHROW(vcpu.save_state());
 }
 
+TEST_CASE("vcpu: gpa to hpa")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    CHECK(vcpu.gpa_to_hpa(0x1234).first == 0x1234);
+
+    bfvmm::intel_x64::ept::mmap mmap{};
+    mmap.map_4k(0x1000, 0x2000);
+    mmap.map_2m(0x200000, 0x400000);
+    vcpu.set_eptp(mmap);
+
+    CHECK(vcpu.gpa_to_hpa(0x1234).first == 0x2234);
+    CHECK(vcpu.gpa_to_hpa(0x1234).second == ::intel_x64::ept::pt::from);
+    CHECK(vcpu.gpa_to_hpa(0x1FFF).first == 0x2FFF);
+    CHECK(vcpu.gpa_to_hpa(0x201234).first == 0x401234);
+    CHECK(vcpu.gpa_to_hpa(0x201234).second == ::intel_x64::ept::pd::from);
+
+    mmap.unmap(0x1000);
+    mmap.map_4k(0x1000, 0x3000);
+    CHECK(vcpu.gpa_to_hpa(0x1234).first == 0x3234);
+
+    mmap.unmap(0x1000);
+    CHECK_THROWS(vcpu.gpa_to_hpa(0x1234));
+
+    vcpu.disable_ept();
+    CHECK(vcpu.gpa_to_hpa(0x1234).first == 0x1234);
+}
+
+TEST_CASE("vcpu: set eptp arms the shootdown timer")
+{
+    using namespace ::intel_x64::vmcs;
+
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    pin_based_vm_execution_controls::activate_preemption_timer::disable();
+
+    bfvmm::intel_x64::ept::mmap mmap{};
+    vcpu.set_eptp(mmap);
+
+    CHECK(pin_based_vm_execution_controls::activate_preemption_timer::is_enabled());
+    CHECK(vcpu.get_preemption_timer() == EPT_SHOOTDOWN_TIMER);
+
+    vcpu.disable_ept();
+    CHECK(pin_based_vm_execution_controls::activate_preemption_timer::is_disabled());
+
+    vcpu.set_preemption_timer(42);
+    vcpu.set_eptp(mmap);
+    CHECK(vcpu.get_preemption_timer() == 42);
+
+    vcpu.disable_ept();
+    CHECK(pin_based_vm_execution_controls::activate_preemption_timer::is_enabled());
+}
+
+TEST_CASE("vcpu: gva to gpa paging disabled")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    ::intel_x64::vmcs::guest_cr0::paging::disable();
+
+    CHECK(vcpu.gva_to_gpa(0x1234).first == 0x1234);
+    CHECK(vcpu.gva_to_gpa(0x1234).second == 0);
+}
+
+TEST_CASE("vcpu: flush gva tlb")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    CHECK_NOTHROW(vcpu.flush_gva_tlb());
+    CHECK_NOTHROW(vcpu.flush_gva_tlb(0x1234));
+
+    CHECK_NOTHROW(vcpu.run());
+    CHECK_NOTHROW(vcpu.flush_gva_tlb());
+}
+
+TEST_CASE("vcpu: gva tlb kept across exits")
+{
+    using namespace ::intel_x64::vmcs;
+    using namespace primary_processor_based_vm_execution_controls;
+
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    cr3_load_exiting::enable();
+    invlpg_exiting::enable();
+    cr0_guest_host_mask::set(::intel_x64::cr0::paging::mask);
+    cr4_guest_host_mask::set(
+        ::intel_x64::cr4::page_global_enable::mask | ::intel_x64::cr4::pcid_enable_bit::mask
+    );
+
+    CHECK_NOTHROW(vcpu.run());
+    CHECK_NOTHROW(vcpu.run());
+
+    cr4_guest_host_mask::set(0);
+    CHECK_NOTHROW(vcpu.run());
+}
+
 #endif
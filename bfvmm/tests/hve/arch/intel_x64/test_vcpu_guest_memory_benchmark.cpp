@@ -0,0 +1,165 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// TIDY_EXCLUSION=-cppcoreguidelines-pro-type-reinterpret-cast
+//
+// Reason:
+//     Although in general this is a good rule, for hypervisor level code that
+//     interfaces with the kernel, and raw hardware, this rule is
+//     impractical.
+//
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <array>
+#include <vector>
+#include <cstring>
+
+#include <test/support.h>
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+constexpr const auto num_copies = 100000ULL;
+
+// Note:
+//
+// The VMM's memory maps are not backed by anything in a unit test, so the
+// memory manager is mocked to hand out real buffers from alloc_map(): one
+// for the vCPU's map cache, and one for map_gva_4k(). Paging and EPT are
+// disabled, so a GVA is its own HPA. The page tables that the VMM's CR3
+// needs to map these buffers are created before the memory manager is
+// mocked, so that mapping them later does not allocate.
+//
+
+alignas(0x1000) static std::array<uint8_t, MAP_CACHE_SIZE * 0x1000> g_cache_windows{};
+alignas(0x1000) static std::array<uint8_t, 0x10000> g_map_window{};
+
+static void
+prefault(uint8_t *buf, std::size_t size)
+{
+    for (std::size_t i = 0; i < size; i += 0x1000) {
+        g_cr3->map_4k(buf + i, 0x1000);
+        g_cr3->unmap(buf + i);
+    }
+}
+
+static void *
+alloc_map(bfvmm::memory_manager::size_type size)
+{
+    if (size == g_cache_windows.size()) {
+        return g_cache_windows.data();
+    }
+
+    return g_map_window.data();
+}
+
+static void *
+physint_to_virtptr(bfvmm::memory_manager::integer_pointer phys)
+{ return reinterpret_cast<void *>(phys); }
+
+static void
+setup_mm(MockRepository &mocks)
+{
+    prefault(g_cache_windows.data(), g_cache_windows.size());
+    prefault(g_map_window.data(), g_map_window.size());
+
+    auto mm = mocks.Mock<bfvmm::memory_manager>();
+    mocks.OnCallFunc(bfvmm::memory_manager::instance).Return(mm);
+
+    mocks.OnCall(mm, bfvmm::memory_manager::alloc_map).Do(alloc_map);
+    mocks.OnCall(mm, bfvmm::memory_manager::free_map);
+    mocks.OnCall(mm, bfvmm::memory_manager::physint_to_virtptr).Do(physint_to_virtptr);
+}
+
+// Note:
+//
+// The map benchmarks copy guest memory the way it was done before
+// read_guest() was introduced, by mapping the guest buffer with
+// map_gva_4k() and copying out of the map. The read benchmarks perform the
+// same copies with read_guest(), so the difference between their run times
+// (e.g. as reported by --durations yes) is the cost of the mapping.
+//
+
+template<typename F>
+void
+copy_guest(uint64_t gva, std::size_t len, F func)
+{
+    setup_test_support();
+
+    bfvmm::intel_x64::vcpu vcpu{0};
+    ::intel_x64::vmcs::guest_cr0::paging::disable();
+
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    std::vector<uint8_t> in(len, 0x42);
+    std::vector<uint8_t> out(len, 0);
+
+    vcpu.write_guest(gva, in.data(), len);
+
+    for (auto i = 0ULL; i < num_copies; i++) {
+        func(vcpu, out);
+    }
+
+    CHECK(in == out);
+}
+
+static void
+map_guest(bfvmm::intel_x64::vcpu &vcpu, uint64_t gva, std::vector<uint8_t> &out)
+{
+    auto map = vcpu.map_gva_4k<uint8_t>(gva, out.size());
+    std::memcpy(out.data(), map.get(), out.size());
+}
+
+static void
+read_guest(bfvmm::intel_x64::vcpu &vcpu, uint64_t gva, std::vector<uint8_t> &out)
+{ vcpu.read_guest(gva, out.data(), out.size()); }
+
+TEST_CASE("guest memory benchmark: struct across a page boundary, map")
+{
+    copy_guest(0x10FE0, 64, [](auto &vcpu, auto &out) {
+        map_guest(vcpu, 0x10FE0, out);
+    });
+}
+
+TEST_CASE("guest memory benchmark: struct across a page boundary, read")
+{
+    copy_guest(0x10FE0, 64, [](auto &vcpu, auto &out) {
+        read_guest(vcpu, 0x10FE0, out);
+    });
+}
+
+TEST_CASE("guest memory benchmark: 16k buffer, map")
+{
+    copy_guest(0x20800, 0x4000 - 0x800, [](auto &vcpu, auto &out) {
+        map_guest(vcpu, 0x20800, out);
+    });
+}
+
+TEST_CASE("guest memory benchmark: 16k buffer, read")
+{
+    copy_guest(0x20800, 0x4000 - 0x800, [](auto &vcpu, auto &out) {
+        read_guest(vcpu, 0x20800, out);
+    });
+}
+
+#endif
@@ -125,4 +125,63 @@ TEST_CASE("vmcs: save state")
     CHECK(vmcs.save_state() != nullptr);
 }
 
+TEST_CASE("vmcs: read only field cached")
+{
+    using namespace ::intel_x64::vmcs;
+
+    MockRepository mocks;
+    auto vmcs = setup_vmcs(mocks);
+
+    g_vmcs_fields[exit_qualification::addr] = 1;
+    g_vmcs_fields[vm_exit_instruction_length::addr] = 2;
+    CHECK(vmcs.read_only_field(exit_qualification::addr) == 1);
+    CHECK(vmcs.read_only_field(vm_exit_instruction_length::addr) == 2);
+
+    g_vmcs_fields[exit_qualification::addr] = 3;
+    g_vmcs_fields[vm_exit_instruction_length::addr] = 4;
+    CHECK(vmcs.read_only_field(exit_qualification::addr) == 1);
+    CHECK(vmcs.read_only_field(vm_exit_instruction_length::addr) == 2);
+}
+
+TEST_CASE("vmcs: read only field not cached")
+{
+    using namespace ::intel_x64::vmcs;
+
+    MockRepository mocks;
+    auto vmcs = setup_vmcs(mocks);
+
+    g_vmcs_fields[guest_rflags::addr] = 1;
+    CHECK(vmcs.read_only_field(guest_rflags::addr) == 1);
+
+    g_vmcs_fields[guest_rflags::addr] = 2;
+    CHECK(vmcs.read_only_field(guest_rflags::addr) == 2);
+}
+
+TEST_CASE("vmcs: read only field invalidated")
+{
+    using namespace ::intel_x64::vmcs;
+
+    MockRepository mocks;
+    auto vmcs = setup_vmcs(mocks);
+
+    g_vmcs_fields[exit_reason::addr] = 1;
+    CHECK(vmcs.read_only_field(exit_reason::addr) == 1);
+
+    g_vmcs_fields[exit_reason::addr] = 2;
+    vmcs.invalidate_read_only_fields();
+    CHECK(vmcs.read_only_field(exit_reason::addr) == 2);
+
+    g_vmcs_fields[exit_reason::addr] = 3;
+    CHECK_THROWS(vmcs.resume());
+    CHECK(vmcs.read_only_field(exit_reason::addr) == 3);
+
+    g_vmcs_fields[exit_reason::addr] = 4;
+    CHECK_NOTHROW(vmcs.load());
+    CHECK(vmcs.read_only_field(exit_reason::addr) == 4);
+
+    g_vmcs_fields[exit_reason::addr] = 5;
+    CHECK_NOTHROW(vmcs.clear());
+    CHECK(vmcs.read_only_field(exit_reason::addr) == 5);
+}
+
 #endif
@@ -0,0 +1,583 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <test/support.h>
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+using namespace ::intel_x64::vmcs;
+
+TEST_CASE("vmcs_shadow: construct / destruct")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+
+    CHECK_NOTHROW(bfvmm::intel_x64::vmcs_shadow_handler{vcpu});
+}
+
+TEST_CASE("vmcs_shadow: enable")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    CHECK_NOTHROW(shadow.enable());
+    CHECK(vmcs_link_pointer::get() == shadow.phys());
+    CHECK(vmread_bitmap_address::get() != 0);
+    CHECK(vmwrite_bitmap_address::get() != 0);
+    CHECK(secondary_processor_based_vm_execution_controls::vmcs_shadowing::is_enabled());
+}
+
+TEST_CASE("vmcs_shadow: enable not supported")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    g_msrs[::intel_x64::msrs::ia32_vmx_procbased_ctls2::addr] = 0;
+    CHECK_THROWS(shadow.enable());
+}
+
+TEST_CASE("vmcs_shadow: disable")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+
+    CHECK_NOTHROW(shadow.disable());
+    CHECK(vmcs_link_pointer::get() == 0xFFFFFFFFFFFFFFFF);
+    CHECK(secondary_processor_based_vm_execution_controls::vmcs_shadowing::is_disabled());
+}
+
+TEST_CASE("vmcs_shadow: default bitmaps")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    CHECK(shadow.is_vmread_trapped(exit_reason::addr));
+    CHECK(shadow.is_vmread_trapped(exit_qualification::addr));
+    CHECK(shadow.is_vmread_trapped(guest_rip::addr));
+    CHECK(shadow.is_vmread_trapped(pin_based_vm_execution_controls::addr));
+
+    CHECK(shadow.is_vmwrite_trapped(guest_rip::addr));
+    CHECK(shadow.is_vmwrite_trapped(exit_reason::addr));
+    CHECK(shadow.is_vmwrite_trapped(pin_based_vm_execution_controls::addr));
+}
+
+TEST_CASE("vmcs_shadow: trap / pass through")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.pass_through_vmread(ept_pointer::addr);
+    CHECK(!shadow.is_vmread_trapped(ept_pointer::addr));
+    CHECK(shadow.is_vmwrite_trapped(ept_pointer::addr));
+
+    shadow.pass_through_vmwrite(ept_pointer::addr);
+    CHECK(!shadow.is_vmwrite_trapped(ept_pointer::addr));
+
+    shadow.trap_on_vmread(ept_pointer::addr);
+    shadow.trap_on_vmwrite(ept_pointer::addr);
+    CHECK(shadow.is_vmread_trapped(ept_pointer::addr));
+    CHECK(shadow.is_vmwrite_trapped(ept_pointer::addr));
+}
+
+TEST_CASE("vmcs_shadow: invalid field")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    CHECK_THROWS(shadow.pass_through_vmread(0x8000));
+    CHECK_THROWS(shadow.pass_through_vmwrite(0x8000));
+    CHECK_NOTHROW(shadow.trap_on_vmread(0x8000));
+    CHECK_NOTHROW(shadow.trap_on_vmwrite(0x8000));
+    CHECK(shadow.is_vmread_trapped(0x8000));
+    CHECK(shadow.is_vmwrite_trapped(0x8000));
+}
+
+TEST_CASE("vmcs_shadow: read / write")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    CHECK_NOTHROW(shadow.write(guest_rip::addr, 42));
+    CHECK(shadow.read(guest_rip::addr) == 42);
+}
+
+TEST_CASE("vmcs_shadow: load failure")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    g_vmload_fails = true;
+    auto ___ = gsl::finally([&] {
+        g_vmload_fails = false;
+    });
+
+    CHECK_THROWS(shadow.load());
+    CHECK_THROWS(shadow.read(guest_rip::addr));
+    CHECK_THROWS(shadow.write(guest_rip::addr, 42));
+}
+
+// -----------------------------------------------------------------------------
+// VMREAD / VMWRITE Handlers
+// -----------------------------------------------------------------------------
+
+namespace ii = vm_exit_instruction_information::vmread;
+
+static uint64_t
+reg_operands(uint64_t reg1, uint64_t reg2)
+{
+    return
+        (reg1 << ii::reg1::from) |
+        (ii::mem_reg::reg << ii::mem_reg::from) |
+        (reg2 << ii::reg2::from);
+}
+
+static void
+setup_vmx_status(bool long_mode = true)
+{
+    g_vmcs_fields[guest_rflags::addr] =
+        ::x64::rflags::carry_flag::mask | ::x64::rflags::zero_flag::mask;
+
+    if (long_mode) {
+        vm_entry_controls::ia_32e_mode_guest::enable();
+        guest_cs_access_rights::l::enable();
+    }
+    else {
+        vm_entry_controls::ia_32e_mode_guest::disable();
+        guest_cs_access_rights::l::disable();
+    }
+}
+
+static bool
+vmx_succeeded()
+{
+    return
+        ::x64::rflags::carry_flag::is_disabled(guest_rflags::get()) &&
+        ::x64::rflags::zero_flag::is_disabled(guest_rflags::get());
+}
+
+static bool
+vmx_failed_valid()
+{
+    return
+        ::x64::rflags::carry_flag::is_disabled(guest_rflags::get()) &&
+        ::x64::rflags::zero_flag::is_enabled(guest_rflags::get());
+}
+
+TEST_CASE("vmcs_shadow: handlers not enabled")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    CHECK(!shadow.handle_vmread(vcpu));
+    CHECK(!shadow.handle_vmwrite(vcpu));
+}
+
+TEST_CASE("vmcs_shadow: vmread register")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    shadow.write(ept_pointer::addr, 0xFFFFFFFF12345678);
+    setup_vmx_status();
+
+    g_save_state.rip = 0;
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    CHECK(shadow.handle_vmread(vcpu));
+    CHECK(g_save_state.rax == 0xFFFFFFFF12345678);
+    CHECK(g_save_state.rip == 42);
+    CHECK(vmx_succeeded());
+}
+
+TEST_CASE("vmcs_shadow: vmread register 32bit")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    shadow.write(ept_pointer::addr, 0xFFFFFFFF12345678);
+    setup_vmx_status(false);
+
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    CHECK(shadow.handle_vmread(vcpu));
+    CHECK(g_save_state.rax == 0x12345678);
+}
+
+TEST_CASE("vmcs_shadow: vmread memory")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    uint64_t gva = 0;
+    uint64_t val = 0;
+
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::write_guest).Do([&](uint64_t addr, const void *src, std::size_t len) {
+        gva = addr;
+        std::memcpy(&val, src, len);
+    });
+
+    shadow.enable();
+    shadow.write(ept_pointer::addr, 42);
+    setup_vmx_status();
+
+    g_save_state.rcx = ept_pointer::addr;
+    g_save_state.rbx = 0x1000;
+    g_save_state.rsi = 0x10;
+    g_vmcs_fields[exit_qualification::addr] = 0x8;
+    g_vmcs_fields[vm_exit_instruction_information::addr] =
+        (ii::scaling::scale_by_4 << ii::scaling::from) |
+        (ii::address_size::_64bit << ii::address_size::from) |
+        (ii::segment_register::ds << ii::segment_register::from) |
+        (6ULL << ii::index_reg::from) |
+        (3ULL << ii::base_reg::from) |
+        (1ULL << ii::reg2::from);
+
+    CHECK(shadow.handle_vmread(vcpu));
+    CHECK(gva == 0x1000 + (0x10 << 2) + 0x8);
+    CHECK(val == 42);
+    CHECK(vmx_succeeded());
+}
+
+TEST_CASE("vmcs_shadow: vmread handler")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    shadow.pass_through_vmread(ept_pointer::addr);
+    shadow.write(ept_pointer::addr, 42);
+    setup_vmx_status();
+
+    shadow.add_vmread_handler(
+        ept_pointer::addr,
+        bfvmm::intel_x64::vmcs_shadow_handler::handler_delegate_t::create([](
+    gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, bfvmm::intel_x64::vmcs_shadow_handler::info_t &info) {
+        bfignored(vcpu);
+        CHECK(info.val == 42);
+        info.val = 23;
+        return true;
+    }));
+
+    CHECK(shadow.is_vmread_trapped(ept_pointer::addr));
+
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    CHECK(shadow.handle_vmread(vcpu));
+    CHECK(g_save_state.rax == 23);
+}
+
+TEST_CASE("vmcs_shadow: vmread ignore write / advance")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    setup_vmx_status();
+
+    shadow.add_vmread_handler(
+        ept_pointer::addr,
+        bfvmm::intel_x64::vmcs_shadow_handler::handler_delegate_t::create([](
+    gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, bfvmm::intel_x64::vmcs_shadow_handler::info_t &info) {
+        bfignored(vcpu);
+        info.ignore_write = true;
+        info.ignore_advance = true;
+        return true;
+    }));
+
+    g_save_state.rip = 0;
+    g_save_state.rax = 0;
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    CHECK(shadow.handle_vmread(vcpu));
+    CHECK(g_save_state.rax == 0);
+    CHECK(g_save_state.rip == 0);
+}
+
+TEST_CASE("vmcs_shadow: vmread failure")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    setup_vmx_status();
+
+    g_msrs[::intel_x64::msrs::ia32_vmx_misc::addr] = 0;
+    g_save_state.rip = 0;
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    g_vmload_fails = true;
+    auto ___ = gsl::finally([&] {
+        g_vmload_fails = false;
+    });
+
+    CHECK(shadow.handle_vmread(vcpu));
+    CHECK(g_save_state.rip == 42);
+    CHECK(vmx_failed_valid());
+}
+
+TEST_CASE("vmcs_shadow: vmwrite register")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    setup_vmx_status();
+
+    g_save_state.rip = 0;
+    g_save_state.rax = 0x1234;
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    CHECK(shadow.handle_vmwrite(vcpu));
+    CHECK(shadow.read(ept_pointer::addr) == 0x1234);
+    CHECK(g_save_state.rip == 42);
+    CHECK(vmx_succeeded());
+}
+
+TEST_CASE("vmcs_shadow: vmwrite memory")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    uint64_t gva = 0;
+
+    mocks.OnCall(vcpu, bfvmm::intel_x64::vcpu::read_guest).Do([&](uint64_t addr, void *dst, std::size_t len) {
+        uint64_t val = 0xFFFFFFFF00005678;
+        gva = addr;
+        std::memcpy(dst, &val, len);
+    });
+
+    shadow.enable();
+    setup_vmx_status(false);
+
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[exit_qualification::addr] = 0x10008;
+    g_vmcs_fields[vm_exit_instruction_information::addr] =
+        (ii::address_size::_16bit << ii::address_size::from) |
+        (ii::segment_register::ds << ii::segment_register::from) |
+        ii::index_reg_invalid::mask |
+        ii::base_reg_invalid::mask |
+        (1ULL << ii::reg2::from);
+
+    CHECK(shadow.handle_vmwrite(vcpu));
+    CHECK(gva == 0x8);
+    CHECK(shadow.read(ept_pointer::addr) == 0x5678);
+}
+
+TEST_CASE("vmcs_shadow: vmwrite handler")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    shadow.write(ept_pointer::addr, 0);
+    setup_vmx_status();
+
+    shadow.add_vmwrite_handler(
+        ept_pointer::addr,
+        bfvmm::intel_x64::vmcs_shadow_handler::handler_delegate_t::create([](
+    gsl::not_null<bfvmm::intel_x64::vcpu *> vcpu, bfvmm::intel_x64::vmcs_shadow_handler::info_t &info) {
+        bfignored(vcpu);
+        CHECK(info.val == 42);
+        info.ignore_write = true;
+        return true;
+    }));
+
+    g_save_state.rax = 42;
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    CHECK(shadow.handle_vmwrite(vcpu));
+    CHECK(shadow.read(ept_pointer::addr) == 0);
+    CHECK(vmx_succeeded());
+}
+
+TEST_CASE("vmcs_shadow: vmwrite read only field")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    shadow.write(exit_reason::addr, 0);
+    setup_vmx_status();
+
+    g_save_state.rax = 42;
+    g_save_state.rcx = exit_reason::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    g_msrs[::intel_x64::msrs::ia32_vmx_misc::addr] = 0;
+    CHECK(shadow.handle_vmwrite(vcpu));
+    CHECK(shadow.read(exit_reason::addr) == 0);
+    CHECK(vmx_failed_valid());
+
+    setup_vmx_status();
+
+    g_msrs[::intel_x64::msrs::ia32_vmx_misc::addr] =
+        ::intel_x64::msrs::ia32_vmx_misc::vmwrite_all_fields_support::mask;
+    CHECK(shadow.handle_vmwrite(vcpu));
+    CHECK(shadow.read(exit_reason::addr) == 42);
+    CHECK(vmx_succeeded());
+}
+
+TEST_CASE("vmcs_shadow: vmwrite failure")
+{
+    setup_test_support();
+
+    MockRepository mocks;
+    auto vcpu = setup_vcpu(mocks);
+    auto shadow = bfvmm::intel_x64::vmcs_shadow_handler{vcpu};
+
+    shadow.enable();
+    setup_vmx_status();
+
+    g_msrs[::intel_x64::msrs::ia32_vmx_misc::addr] = 0;
+    g_save_state.rcx = ept_pointer::addr;
+    g_vmcs_fields[vm_exit_instruction_information::addr] = reg_operands(0, 1);
+
+    g_vmload_fails = true;
+    auto ___ = gsl::finally([&] {
+        g_vmload_fails = false;
+    });
+
+    CHECK(shadow.handle_vmwrite(vcpu));
+    CHECK(vmx_failed_valid());
+}
+
+TEST_CASE("vmcs_shadow: vcpu")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    CHECK_NOTHROW(vcpu.enable_vmcs_shadowing());
+    CHECK(vmcs_link_pointer::get() == vcpu.shadow_vmcs()->phys());
+
+    CHECK_NOTHROW(vcpu.pass_through_vmwrite(ept_pointer::addr));
+    CHECK(!vcpu.shadow_vmcs()->is_vmwrite_trapped(ept_pointer::addr));
+    CHECK_NOTHROW(vcpu.trap_on_vmwrite(ept_pointer::addr));
+    CHECK(vcpu.shadow_vmcs()->is_vmwrite_trapped(ept_pointer::addr));
+
+    CHECK_NOTHROW(vcpu.disable_vmcs_shadowing());
+    CHECK(vmcs_link_pointer::get() == 0xFFFFFFFFFFFFFFFF);
+}
+
+TEST_CASE("vmcs_shadow: vcpu lazy")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    vmcs_link_pointer::set(0xFFFFFFFFFFFFFFFF);
+
+    CHECK_NOTHROW(vcpu.disable_vmcs_shadowing());
+    CHECK(vmcs_link_pointer::get() == 0xFFFFFFFFFFFFFFFF);
+
+    CHECK_NOTHROW(vcpu.add_vmread_handler(ept_pointer::addr, {}));
+    CHECK(vcpu.shadow_vmcs()->is_vmread_trapped(ept_pointer::addr));
+    CHECK(!vcpu.shadow_vmcs()->is_enabled());
+}
+
+TEST_CASE("vmcs_shadow: vcpu after run")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    CHECK_NOTHROW(vcpu.run());
+
+    CHECK_NOTHROW(vcpu.enable_vmcs_shadowing());
+    CHECK(vmcs_link_pointer::get() == vcpu.shadow_vmcs()->phys());
+
+    CHECK_NOTHROW(vcpu.add_vmread_handler(ept_pointer::addr, {}));
+    CHECK_NOTHROW(vcpu.add_vmwrite_handler(ept_pointer::addr, {}));
+    CHECK_NOTHROW(vcpu.pass_through_vmread(guest_rip::addr));
+}
+
+#endif
@@ -0,0 +1,94 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <test/support.h>
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+using namespace bfvmm::intel_x64;
+
+TEST_CASE("vpid_allocator: allocate")
+{
+    vpid_allocator allocator{};
+
+    CHECK(allocator.is_allocated(0));
+    CHECK(allocator.allocate() == 1);
+    CHECK(allocator.allocate() == 2);
+    CHECK(allocator.allocate() == 3);
+
+    CHECK(allocator.is_allocated(2));
+    CHECK(!allocator.is_allocated(4));
+}
+
+TEST_CASE("vpid_allocator: release")
+{
+    vpid_allocator allocator{};
+
+    auto id1 = allocator.allocate();
+    auto id2 = allocator.allocate();
+
+    allocator.release(id1);
+    CHECK(!allocator.is_allocated(id1));
+    CHECK(allocator.is_allocated(id2));
+
+    CHECK_NOTHROW(allocator.release(0));
+    CHECK(allocator.is_allocated(0));
+}
+
+TEST_CASE("vpid_allocator: exhausted")
+{
+    vpid_allocator allocator{};
+
+    for (auto i = 1U; i <= 0xFFFFU; i++) {
+        allocator.allocate();
+    }
+
+    CHECK(allocator.is_allocated(0xFFFF));
+    CHECK(allocator.allocate() == 0);
+
+    allocator.release(42);
+    CHECK(allocator.allocate() == 42);
+    CHECK(allocator.allocate() == 0);
+}
+
+TEST_CASE("vpid_handler: unique ids")
+{
+    setup_test_support();
+
+    auto vcpu1 = std::make_unique<bfvmm::intel_x64::vcpu>(0);
+    auto id1 = ::intel_x64::vmcs::virtual_processor_identifier::get();
+    auto vcpu2 = std::make_unique<bfvmm::intel_x64::vcpu>(1);
+    auto id2 = ::intel_x64::vmcs::virtual_processor_identifier::get();
+
+    CHECK(id1 != 0);
+    CHECK(id2 != 0);
+    CHECK(id1 != id2);
+    CHECK(!vcpu2->invalidations()->empty());
+
+    vcpu1.reset();
+    CHECK(!vpid_allocator::instance()->is_allocated(gsl::narrow_cast<uint16_t>(id1)));
+    CHECK(vpid_allocator::instance()->is_allocated(gsl::narrow_cast<uint16_t>(id2)));
+}
+
+#endif
@@ -0,0 +1,266 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// TIDY_EXCLUSION=-cppcoreguidelines-pro-type-reinterpret-cast
+//
+// Reason:
+//     Although in general this is a good rule, for hypervisor level code that
+//     interfaces with the kernel, and raw hardware, this rule is
+//     impractical.
+//
+
+#include <catch/catch.hpp>
+#include <hippomocks.h>
+
+#include <test/support.h>
+#include <hve/arch/x64/map_cache.h>
+
+using namespace bfvmm::x64;
+
+constexpr uintptr_t g_hpa1 = 0x10000;
+constexpr uintptr_t g_hpa2 = 0x20000;
+
+static uintptr_t
+phys(const void *hva)
+{ return g_cr3->virt_to_phys(reinterpret_cast<uintptr_t>(hva)).first; }
+
+TEST_CASE("map_cache: hit")
+{
+    map_cache cache{};
+    cache.set_owner();
+
+    void *hva1{};
+    void *hva2{};
+
+    {
+        auto map = cache.map<uint64_t>(g_hpa1);
+        hva1 = map.get();
+        CHECK(phys(hva1) == g_hpa1);
+    }
+
+    {
+        auto map = cache.map<uint64_t>(g_hpa1);
+        hva2 = map.get();
+    }
+
+    CHECK(hva1 == hva2);
+    CHECK(cache.hits() == 1);
+    CHECK(cache.misses() == 1);
+}
+
+TEST_CASE("map_cache: nested maps share a window")
+{
+    map_cache cache{};
+    cache.set_owner();
+
+    auto map1 = cache.map<uint64_t>(g_hpa1);
+    auto map2 = cache.map<uint64_t>(g_hpa1);
+    auto map3 = cache.map<uint64_t>(g_hpa2);
+
+    CHECK(map1.get() == map2.get());
+    CHECK(map1.get() != map3.get());
+    CHECK(phys(map3.get()) == g_hpa2);
+}
+
+TEST_CASE("map_cache: least recently used window is reused")
+{
+    map_cache cache{};
+    cache.set_owner();
+
+    void *first{};
+    for (uintptr_t i = 0; i < MAP_CACHE_SIZE; i++) {
+        auto map = cache.map<uint64_t>(g_hpa1 + (i * ::x64::pt::page_size));
+        if (i == 0) {
+            first = map.get();
+        }
+    }
+
+    {
+        auto map = cache.map<uint64_t>(g_hpa1 + (MAP_CACHE_SIZE * ::x64::pt::page_size));
+        CHECK(map.get() == first);
+        CHECK(phys(map.get()) == g_hpa1 + (MAP_CACHE_SIZE * ::x64::pt::page_size));
+    }
+
+    CHECK(cache.misses() == MAP_CACHE_SIZE + 1);
+
+    {
+        auto map = cache.map<uint64_t>(g_hpa1 + ::x64::pt::page_size);
+        CHECK(phys(map.get()) == g_hpa1 + ::x64::pt::page_size);
+    }
+
+    CHECK(cache.hits() == 1);
+
+    {
+        auto map = cache.map<uint64_t>(g_hpa1);
+        CHECK(phys(map.get()) == g_hpa1);
+    }
+
+    CHECK(cache.misses() == MAP_CACHE_SIZE + 2);
+}
+
+TEST_CASE("map_cache: all windows in use")
+{
+    map_cache cache{};
+    cache.set_owner();
+    std::vector<unique_map<uint64_t>> maps;
+
+    for (uintptr_t i = 0; i < MAP_CACHE_SIZE; i++) {
+        maps.push_back(cache.map<uint64_t>(g_hpa1 + (i * ::x64::pt::page_size)));
+    }
+
+    auto map = cache.map<uint64_t>(g_hpa2 + (MAP_CACHE_SIZE * ::x64::pt::page_size));
+    CHECK(map != nullptr);
+    CHECK(phys(map.get()) == g_hpa2 + (MAP_CACHE_SIZE * ::x64::pt::page_size));
+
+    for (const auto &m : maps) {
+        CHECK(m.get() != map.get());
+    }
+}
+
+TEST_CASE("map_cache: clear")
+{
+    map_cache cache{};
+    cache.set_owner();
+
+    {
+        auto map = cache.map<uint64_t>(g_hpa1);
+    }
+
+    auto map = cache.map<uint64_t>(g_hpa2);
+    CHECK_NOTHROW(cache.clear());
+    CHECK(phys(map.get()) == g_hpa2);
+
+    {
+        auto map = cache.map<uint64_t>(g_hpa1);
+        CHECK(phys(map.get()) == g_hpa1);
+    }
+
+    CHECK(cache.hits() == 0);
+    CHECK(cache.misses() == 3);
+}
+
+TEST_CASE("map_cache: no owner")
+{
+    map_cache cache{};
+
+    CHECK(cache.acquire(g_hpa1) == nullptr);
+
+    auto map = cache.map<uint64_t>(g_hpa1);
+    CHECK(phys(map.get()) == g_hpa1);
+
+    CHECK(cache.hits() == 0);
+    CHECK(cache.misses() == 0);
+}
+
+TEST_CASE("map_cache: acquire / release")
+{
+    map_cache cache{};
+    cache.set_owner();
+
+    auto hva = cache.acquire(g_hpa1);
+    CHECK(hva != nullptr);
+    CHECK(cache.acquire(g_hpa1) == hva);
+
+    cache.release(hva);
+    cache.release(hva);
+    cache.release(hva);
+
+    CHECK_THROWS(cache.acquire(g_hpa1 + 1));
+}
+
+#ifdef _HIPPOMOCKS__ENABLE_CFUNC_MOCKING_SUPPORT
+
+TEST_CASE("map_cache: remote cpu")
+{
+    map_cache cache{};
+    cache.set_owner();
+
+    auto hva = cache.acquire(g_hpa1);
+    CHECK(hva != nullptr);
+
+    {
+        MockRepository mocks;
+        mocks.OnCallFunc(thread_context_cpuid).Return(1);
+
+        CHECK(cache.acquire(g_hpa1) == nullptr);
+        CHECK(cache.acquire(g_hpa2) == nullptr);
+
+        auto map = cache.map<uint64_t>(g_hpa1);
+        CHECK(map.get() != hva);
+        CHECK(phys(map.get()) == g_hpa1);
+
+        cache.release(hva);
+        CHECK_THROWS(cache.clear());
+    }
+
+    CHECK(cache.hits() == 0);
+    CHECK(cache.misses() == 1);
+
+    cache.release(hva);
+    CHECK_NOTHROW(cache.clear());
+}
+
+TEST_CASE("map_cache: out of memory")
+{
+    map_cache cache{};
+    cache.set_owner();
+
+    {
+        MockRepository mocks;
+        auto mm = mocks.Mock<bfvmm::memory_manager>();
+        mocks.OnCallFunc(bfvmm::memory_manager::instance).Return(mm);
+        mocks.OnCall(mm, bfvmm::memory_manager::alloc_map).Return(nullptr);
+
+        CHECK_THROWS_AS(cache.acquire(g_hpa1), std::bad_alloc);
+    }
+
+    auto hva = cache.acquire(g_hpa1);
+    CHECK(hva != nullptr);
+    CHECK(phys(hva) == g_hpa1);
+
+    cache.release(hva);
+}
+
+TEST_CASE("map_cache: vcpu")
+{
+    setup_test_support();
+    bfvmm::intel_x64::vcpu vcpu{0};
+
+    {
+        auto map = vcpu.map_hpa_4k<uint64_t>(g_hpa1);
+    }
+
+    CHECK(vcpu.map_cache()->misses() == 0);
+    CHECK_NOTHROW(vcpu.run());
+
+    {
+        auto map = vcpu.map_hpa_4k<uint64_t>(g_hpa1);
+    }
+
+    {
+        auto map = vcpu.map_hpa_4k<uint64_t>(g_hpa1);
+    }
+
+    CHECK(vcpu.map_cache()->hits() == 1);
+    CHECK(vcpu.map_cache()->misses() == 1);
+}
+
+#endif
@@ -182,3 +182,43 @@ TEST_CASE("identity_map_convert_2m_to_4k")
     CHECK(mmap.is_2m(nullptr));
     CHECK(mmap.is_2m(::x64::pd::page_size - ::x64::pt::page_size));
 }
+
+TEST_CASE("direct_map 1g")
+{
+    g_edx_cpuid[::intel_x64::cpuid::ext_feature_info::addr] =
+        ::intel_x64::cpuid::ext_feature_info::edx::pages_avail::mask;
+
+    cr3::mmap mmap{};
+    CHECK(direct_map(mmap, ::x64::pdpt::page_size + 1) == ::x64::pdpt::page_size * 2);
+
+    CHECK(mmap.is_1g(DIRECT_MAP_START + (::x64::pdpt::page_size * 0)));
+    CHECK(mmap.is_1g(DIRECT_MAP_START + (::x64::pdpt::page_size * 1)));
+    CHECK_THROWS(mmap.is_1g(DIRECT_MAP_START + (::x64::pdpt::page_size * 2)));
+
+    auto hpa = ::x64::pdpt::page_size + 0x1234;
+    CHECK(mmap.virt_to_phys(DIRECT_MAP_START + hpa).first == hpa);
+
+    g_edx_cpuid[::intel_x64::cpuid::ext_feature_info::addr] = 0;
+}
+
+TEST_CASE("direct_map 2m")
+{
+    g_edx_cpuid[::intel_x64::cpuid::ext_feature_info::addr] = 0;
+
+    cr3::mmap mmap{};
+    CHECK(direct_map(mmap, 1) == ::x64::pd::page_size);
+
+    CHECK(mmap.is_2m(DIRECT_MAP_START));
+    CHECK_THROWS(mmap.is_2m(DIRECT_MAP_START + ::x64::pd::page_size));
+    CHECK(mmap.virt_to_phys(DIRECT_MAP_START + 0x1234).first == 0x1234);
+
+    CHECK_THROWS(direct_map(mmap, 0));
+}
+
+TEST_CASE("vmm direct map disabled")
+{
+    CHECK_NOTHROW(cr3::init_vmm_direct_map());
+
+    CHECK(cr3::vmm_direct_map_size() == DIRECT_MAP_SIZE);
+    CHECK(cr3::vmm_direct_map_hva(0, ::x64::pt::page_size) == nullptr);
+}
@@ -55,9 +55,9 @@ TEST_CASE("buddy_allocator: buffer_size")
 
 TEST_CASE("buddy_allocator: node_tree_size")
 {
-    CHECK(buddy_allocator::node_tree_size(0) == 1 * 32);
-    CHECK(buddy_allocator::node_tree_size(1) == 3 * 32);
-    CHECK(buddy_allocator::node_tree_size(2) == 7 * 32);
+    CHECK(buddy_allocator::node_tree_size(0) == 1 * 12);
+    CHECK(buddy_allocator::node_tree_size(1) == 2 * 12);
+    CHECK(buddy_allocator::node_tree_size(2) == 4 * 12);
 }
 
 TEST_CASE("buddy_allocator: constructor pointer")
@@ -1303,3 +1303,38 @@ TEST_CASE("buddy_allocator: size 32k blocks")
     auto ptr1 = buddy.allocate(0x8000);
     CHECK(buddy.size(ptr1) == 0x8000);
 }
+
+TEST_CASE("buddy_allocator: usage")
+{
+    auto nt = std::make_unique<char[]>(node_tree_size);
+    buddy_allocator buddy{0x100000ULL, k, nt.get()};
+
+    CHECK(buddy.used() == 0);
+    CHECK(buddy.high_water() == 0);
+    CHECK(buddy.largest_free() == 0x8000);
+
+    auto ptr1 = buddy.allocate(0x1000);
+    auto ptr2 = buddy.allocate(0x2000);
+
+    CHECK(buddy.used() == 0x3000);
+    CHECK(buddy.high_water() == 0x3000);
+    CHECK(buddy.largest_free() == 0x4000);
+
+    auto ptr3 = buddy.allocate(0x4000);
+
+    CHECK(buddy.used() == 0x7000);
+    CHECK(buddy.high_water() == 0x7000);
+    CHECK(buddy.largest_free() == 0x1000);
+
+    buddy.deallocate(ptr3);
+    buddy.deallocate(ptr2);
+
+    CHECK(buddy.used() == 0x1000);
+    CHECK(buddy.high_water() == 0x7000);
+    CHECK(buddy.largest_free() == 0x4000);
+
+    buddy.deallocate(ptr1);
+
+    CHECK(buddy.used() == 0);
+    CHECK(buddy.largest_free() == 0x8000);
+}
@@ -0,0 +1,369 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// TIDY_EXCLUSION=-cppcoreguidelines-pro-type-reinterpret-cast
+//
+// Reason:
+//     Although in general this is a good rule, for hypervisor level code that
+//     interfaces with the kernel, and raw hardware, this rule is
+//     impractical.
+//
+
+#include <catch/catch.hpp>
+
+#include <array>
+#include <memory>
+
+#include <test/support.h>
+#include <memory_manager/buddy_allocator.h>
+
+constexpr const auto k = 10ULL;
+constexpr const auto num_pages = 1ULL << k;
+constexpr const auto num_iterations = 200ULL;
+constexpr const uintptr_t buffer = 0x100000000000ULL;
+
+// Note:
+//
+// The following is a copy of the binary tree based buddy allocator that was
+// used before the free list based buddy allocator was introduced (with the
+// debug output removed). It is used as the baseline for the benchmarks
+// below.
+//
+
+class legacy_buddy_allocator
+{
+public:
+
+    using pointer = void *;
+    using integer_pointer = uintptr_t;
+    using size_type = std::size_t;
+
+private:
+
+    struct node_t {
+        node_t *child0;
+        node_t *child1;
+        integer_pointer ptr;
+        size_type size;
+    };
+
+    auto get_size(node_t *node) const
+    { return get_bits(node->size, 0x0FFFFFFFFFFFFFFFULL); }
+
+    auto is_unused(node_t *node) const
+    { return get_bits(node->size, 0xC000000000000000ULL) == 0x0000000000000000ULL; }
+
+    auto is_leaf(node_t *node) const
+    { return get_bits(node->size, 0xC000000000000000ULL) == 0x4000000000000000ULL; }
+
+    auto is_full(node_t *node) const
+    { return get_bits(node->size, 0xC000000000000000ULL) == 0xC000000000000000ULL; }
+
+    node_t *set_unused(node_t *node) noexcept
+    {
+        node->size = set_bits(node->size, 0xC000000000000000ULL, 0x0000000000000000ULL);
+        return node;
+    }
+
+    node_t *set_leaf(node_t *node) noexcept
+    {
+        node->size = set_bits(node->size, 0xC000000000000000ULL, 0x4000000000000000ULL);
+        return node;
+    }
+
+    node_t *set_parent(node_t *node) noexcept
+    {
+        node->size = set_bits(node->size, 0xC000000000000000ULL, 0x8000000000000000ULL);
+        return node;
+    }
+
+    node_t *set_full(node_t *node) noexcept
+    {
+        node->size = set_bits(node->size, 0xC000000000000000ULL, 0xC000000000000000ULL);
+        return node;
+    }
+
+public:
+
+    legacy_buddy_allocator(integer_pointer buffer, size_type k, void *node_tree) noexcept
+    {
+        m_buffer_size = buddy_allocator::buffer_size(k);
+
+        m_nodes_view = gsl::span<node_t>(
+            static_cast<node_t *>(node_tree), gsl::narrow_cast<std::ptrdiff_t>((2ULL << k) - 1ULL)
+        );
+
+        m_root = &m_nodes_view[m_node_index++];
+        m_root->ptr = buffer;
+        m_root->size = m_buffer_size;
+    }
+
+    pointer allocate(size_type size)
+    {
+        if (size > m_buffer_size || size == 0) {
+            throw std::bad_alloc();
+        }
+
+        if (size < BAREFLANK_PAGE_SIZE) {
+            size = BAREFLANK_PAGE_SIZE;
+        }
+
+        if (auto ptr = this->private_allocate(next_power_2(size), m_root)) {
+            return ptr;
+        }
+
+        throw std::bad_alloc();
+    }
+
+    void deallocate(pointer ptr)
+    {
+        if (ptr == nullptr) {
+            return;
+        }
+
+        this->private_deallocate(reinterpret_cast<integer_pointer>(ptr), nullptr, m_root);
+    }
+
+    static size_type node_tree_size(size_type k) noexcept
+    { return ((2ULL << k) - 1ULL) * sizeof(node_t); }
+
+private:
+
+    void get_nodes(node_t *parent)
+    {
+        auto child0 = &m_nodes_view[m_node_index++];
+        auto child1 = &m_nodes_view[m_node_index++];
+
+        child0->size = this->get_size(parent) >> 1;
+        child1->size = this->get_size(parent) >> 1;
+
+        child0->ptr = parent->ptr;
+        child1->ptr = parent->ptr + child0->size;
+
+        parent->child0 = child0;
+        parent->child1 = child1;
+    }
+
+    pointer private_allocate(size_type size, node_t *node)
+    {
+        if (this->is_leaf(node) || this->is_full(node)) {
+            return nullptr;
+        }
+
+        if (size == this->get_size(node)) {
+            if (this->is_unused(node)) {
+                return reinterpret_cast<pointer>(this->set_leaf(node)->ptr);
+            }
+
+            return nullptr;
+        }
+
+        if (!node->child0) {
+            this->get_nodes(node);
+        }
+
+        for (auto child : {node->child0, node->child1}) {
+            if (size == this->get_size(child) ? this->is_unused(child) :
+                !this->is_full(child) && !this->is_leaf(child)) {
+                if (auto ptr = this->private_allocate_next(size, node, child)) {
+                    return ptr;
+                }
+            }
+        }
+
+        return nullptr;
+    }
+
+    pointer private_allocate_next(size_type size, node_t *parent, node_t *node)
+    {
+        auto ptr = this->private_allocate(size, node);
+
+        if (ptr) {
+            this->set_parent(parent);
+
+            if ((this->is_leaf(parent->child0) || this->is_full(parent->child0)) &&
+                (this->is_leaf(parent->child1) || this->is_full(parent->child1))) {
+                this->set_full(parent);
+            }
+        }
+
+        return ptr;
+    }
+
+    bool private_deallocate(integer_pointer ptr, node_t *parent, node_t *node)
+    {
+        if (this->is_leaf(node)) {
+            this->set_unused(node);
+            return true;
+        }
+
+        if (!node->child0) {
+            return false;
+        }
+
+        auto child = ptr < node->child0->ptr + this->get_size(node->child0) ?
+                     node->child0 : node->child1;
+
+        auto res = this->private_deallocate(ptr, node, child);
+
+        if (res) {
+            this->set_parent(node);
+
+            if (this->is_unused(node->child0) && this->is_unused(node->child1)) {
+                this->set_unused(node);
+            }
+        }
+
+        return res;
+    }
+
+private:
+
+    node_t *m_root{nullptr};
+    size_type m_buffer_size{0};
+    std::ptrdiff_t m_node_index{0};
+    gsl::span<node_t> m_nodes_view;
+};
+
+// Note:
+//
+// Each of the following sequences starts and ends with an empty allocator,
+// so that every iteration of a benchmark performs the same work. The sizes
+// are chosen so that the buffer is fragmented into blocks of different
+// orders, which forces the allocator to split and merge blocks constantly.
+//
+
+template<typename T>
+void
+interleaved_sizes(T &allocator)
+{
+    std::array<void *, num_pages / 4> ptrs{};
+
+    for (auto i = 0ULL; i < ptrs.size(); i++) {
+        ptrs.at(i) = allocator.allocate(BAREFLANK_PAGE_SIZE << (i & 0x1U));
+    }
+
+    for (auto i = 0ULL; i < ptrs.size(); i++) {
+        allocator.deallocate(ptrs.at(ptrs.size() - 1 - i));
+    }
+}
+
+template<typename T>
+void
+free_every_other(T &allocator)
+{
+    std::array<void *, num_pages> ptrs{};
+
+    for (auto &ptr : ptrs) {
+        ptr = allocator.allocate(BAREFLANK_PAGE_SIZE);
+    }
+
+    for (auto i = 0ULL; i < ptrs.size(); i += 2) {
+        allocator.deallocate(ptrs.at(i));
+    }
+
+    for (auto i = 0ULL; i < ptrs.size(); i += 2) {
+        ptrs.at(i) = allocator.allocate(BAREFLANK_PAGE_SIZE);
+    }
+
+    for (auto &ptr : ptrs) {
+        allocator.deallocate(ptr);
+    }
+}
+
+template<typename T>
+void
+reallocate(T &allocator)
+{
+    std::array<void *, 64> ptrs{};
+    auto seed = 0x2545F4914F6CDD1DULL;
+
+    for (auto &ptr : ptrs) {
+        ptr = allocator.allocate(BAREFLANK_PAGE_SIZE);
+    }
+
+    for (auto i = 0ULL; i < num_pages; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+
+        auto &ptr = ptrs.at((seed >> 33) % ptrs.size());
+        allocator.deallocate(ptr);
+        ptr = allocator.allocate(BAREFLANK_PAGE_SIZE << ((seed >> 40) % 4));
+    }
+
+    for (auto &ptr : ptrs) {
+        allocator.deallocate(ptr);
+    }
+}
+
+// Note:
+//
+// Each benchmark below runs one of the above sequences num_iterations times,
+// against either the legacy or the free list based buddy allocator. Both
+// perform the same work, so the difference between their run times (e.g. as
+// reported by --durations yes) is the cost of the allocator itself. Since
+// every sequence frees what it allocates, the whole buffer must be free
+// once the benchmark is done.
+//
+
+template<typename T>
+void
+run_sequence(void (*func)(T &))
+{
+    auto node_tree = std::make_unique<uint8_t[]>(T::node_tree_size(k));
+    T allocator{buffer, k, node_tree.get()};
+
+    for (auto i = 0ULL; i < num_iterations; i++) {
+        func(allocator);
+    }
+
+    auto ptr = allocator.allocate(buddy_allocator::buffer_size(k));
+    CHECK(reinterpret_cast<uintptr_t>(ptr) == buffer);
+}
+
+TEST_CASE("buddy_allocator benchmark: interleaved sizes, legacy")
+{
+    run_sequence(interleaved_sizes<legacy_buddy_allocator>);
+}
+
+TEST_CASE("buddy_allocator benchmark: interleaved sizes, free list")
+{
+    run_sequence(interleaved_sizes<buddy_allocator>);
+}
+
+TEST_CASE("buddy_allocator benchmark: free every other, legacy")
+{
+    run_sequence(free_every_other<legacy_buddy_allocator>);
+}
+
+TEST_CASE("buddy_allocator benchmark: free every other, free list")
+{
+    run_sequence(free_every_other<buddy_allocator>);
+}
+
+TEST_CASE("buddy_allocator benchmark: reallocate, legacy")
+{
+    run_sequence(reallocate<legacy_buddy_allocator>);
+}
+
+TEST_CASE("buddy_allocator benchmark: reallocate, free list")
+{
+    run_sequence(reallocate<buddy_allocator>);
+}
@@ -78,6 +78,34 @@ TEST_CASE("alloc heap and size")
     g_mm->free(buf12);
 }
 
+TEST_CASE("alloc reuses freed objects")
+{
+    auto buf01 = g_mm->alloc(0x010);
+    g_mm->free(buf01);
+
+    auto buf02 = g_mm->alloc(0x010);
+    CHECK(buf01 == buf02);
+    g_mm->free(buf02);
+}
+
+TEST_CASE("alloc / free more than a magazine")
+{
+    std::set<void *> bufs;
+
+    for (auto i = 0ULL; i < MAGAZINE_SIZE * 4; i++) {
+        auto buf = g_mm->alloc(0x040);
+
+        CHECK(g_mm->size(buf) == 0x040);
+        bufs.insert(buf);
+    }
+
+    CHECK(bufs.size() == MAGAZINE_SIZE * 4);
+
+    for (auto buf : bufs) {
+        g_mm->free(buf);
+    }
+}
+
 TEST_CASE("alloc page and size")
 {
     auto buf01 = g_mm->alloc_page();
@@ -196,3 +224,153 @@ TEST_CASE("physint_to_virtint success")
 
     g_mm->remove_md(0x12345000, 0x54321000);
 }
+
+TEST_CASE("virt / phys conversions across contiguous descriptors")
+{
+    g_mm->add_md(0x12345000, 0x54321000, 0);
+    g_mm->add_md(0x12346000, 0x54322000, 0);
+    g_mm->add_md(0x12347000, 0x11111000, 0);
+
+    CHECK(g_mm->virtint_to_physint(0x12345ABC) == 0x54321ABC);
+    CHECK(g_mm->virtint_to_physint(0x12346ABC) == 0x54322ABC);
+    CHECK(g_mm->virtint_to_physint(0x12347ABC) == 0x11111ABC);
+    CHECK(g_mm->physint_to_virtint(0x54322ABC) == 0x12346ABC);
+    CHECK(g_mm->physint_to_virtint(0x11111ABC) == 0x12347ABC);
+
+    CHECK_THROWS(g_mm->virtint_to_physint(0x12348000));
+    CHECK_THROWS(g_mm->physint_to_virtint(0x54323000));
+
+    g_mm->remove_md(0x12346000, 0x54322000);
+
+    CHECK(g_mm->virtint_to_physint(0x12345ABC) == 0x54321ABC);
+    CHECK_THROWS(g_mm->virtint_to_physint(0x12346ABC));
+    CHECK_THROWS(g_mm->physint_to_virtint(0x54322ABC));
+
+    g_mm->remove_md(0x12345000, 0x54321000);
+    g_mm->remove_md(0x12347000, 0x11111000);
+}
+
+TEST_CASE("virt / phys conversions while descriptors change")
+{
+    g_mm->add_md(0x12345000, 0x54321000, 0);
+
+    for (uintptr_t i = 0; i < 100; i++) {
+        const auto virt = 0x20000000 + (i * 0x1000);
+        const auto phys = 0x40000000 + (i * 0x1000);
+
+        g_mm->add_md(virt, phys, 0);
+        CHECK(g_mm->virtint_to_physint(virt | 0xABC) == (phys | 0xABC));
+        CHECK(g_mm->physint_to_virtint(phys | 0xABC) == (virt | 0xABC));
+        CHECK(g_mm->virtint_to_physint(0x12345ABC) == 0x54321ABC);
+
+        g_mm->remove_md(virt, phys);
+        CHECK_THROWS(g_mm->virtint_to_physint(virt));
+    }
+
+    g_mm->remove_md(0x12345000, 0x54321000);
+}
+
+TEST_CASE("alloc more than fits in the SLAB pool")
+{
+    // Note:
+    //
+    // When the driver loads the VMM, it adds a descriptor for every page
+    // of the VMM, which is ~64K descriptors, each of which needs a ~48 byte
+    // node in both the virt and the phys map. That alone uses most of the
+    // SLAB pool, so allocations like these have to spill into the page pool
+    // once the SLAB pool is full.
+    //
+
+    constexpr const auto num = 0x10000ULL * 4;
+    std::vector<void *> bufs;
+
+    for (auto i = 0ULL; i < num; i++) {
+        bufs.push_back(g_mm->alloc(0x030));
+    }
+
+    auto stats = std::make_unique<mem_stats_t>();
+    g_mm->stats(stats.get());
+
+    const auto &slab_pool = stats->pools[MEM_STATS_POOL_SLAB];
+    CHECK(slab_pool.used == slab_pool.total);
+
+    CHECK(std::find(bufs.begin(), bufs.end(), nullptr) == bufs.end());
+    CHECK(g_mm->size(bufs.front()) == 0x030);
+    CHECK(g_mm->size(bufs.back()) == 0x030);
+
+    for (auto buf : bufs) {
+        g_mm->free(buf);
+    }
+
+    auto buf = g_mm->alloc(0x030);
+    CHECK(g_mm->size(buf) == 0x030);
+    g_mm->free(buf);
+}
+
+TEST_CASE("virt / phys conversions for the page pool")
+{
+    auto virt = reinterpret_cast<uintptr_t>(g_mm->alloc_page());
+
+    CHECK_THROWS(g_mm->virtint_to_physint(virt));
+
+    g_mm->add_md(virt, 0x54321000, 0);
+
+    CHECK(g_mm->virtint_to_physint(virt | 0xABC) == 0x54321ABC);
+    CHECK(g_mm->physint_to_virtint(0x54321ABC) == (virt | 0xABC));
+
+    g_mm->remove_md(virt, 0x54321000);
+
+    CHECK_THROWS(g_mm->virtint_to_physint(virt));
+    CHECK_THROWS(g_mm->physint_to_virtint(0x54321000));
+
+    g_mm->free_page(reinterpret_cast<void *>(virt));
+}
+
+TEST_CASE("stats")
+{
+    auto stats = std::make_unique<mem_stats_t>();
+    g_mm->stats(stats.get());
+
+    const auto &page_pool = stats->pools[MEM_STATS_POOL_PAGE];
+    const auto page_pool_used = page_pool.used;
+
+    CHECK(page_pool.total == buddy_allocator::buffer_size(PAGE_POOL_K));
+    CHECK(page_pool.used + page_pool.free == page_pool.total);
+    CHECK(page_pool.high_water >= page_pool.used);
+    CHECK(page_pool.largest_free <= page_pool.free);
+
+    auto page = g_mm->alloc_page();
+    g_mm->stats(stats.get());
+
+    CHECK(page_pool.used == page_pool_used + BAREFLANK_PAGE_SIZE);
+    CHECK(page_pool.high_water >= page_pool.used);
+
+    g_mm->free_page(page);
+
+    const auto &slab = stats->slabs[0];
+    const auto slab_used = slab.used;
+
+    auto obj = g_mm->alloc(0x10);
+    g_mm->stats(stats.get());
+
+    CHECK(slab.size == 0x10);
+    CHECK(slab.used == slab_used + 1);
+    CHECK(slab.free != 0);
+    CHECK(slab.high_water >= slab.used);
+    CHECK(stats->pools[MEM_STATS_POOL_SLAB].used != 0);
+
+    g_mm->free(obj);
+    g_mm->stats(stats.get());
+
+    CHECK(slab.used == slab_used);
+}
+
+TEST_CASE("get_mem_stats")
+{
+    auto stats = std::make_unique<mem_stats_t>();
+
+    CHECK(get_mem_stats(nullptr) == GET_MEM_STATS_FAILURE);
+    CHECK(get_mem_stats(stats.get()) == GET_MEM_STATS_SUCCESS);
+    CHECK(stats->tag == 0x3E353E353E353E35);
+    CHECK(stats->pools[MEM_STATS_POOL_PAGE].total == buddy_allocator::buffer_size(PAGE_POOL_K));
+}
@@ -0,0 +1,198 @@
+//
+// Copyright (C) 2019 Assured Information Security, Inc.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <catch/catch.hpp>
+
+#include <test/support.h>
+#include <memory_manager/page_arena.h>
+
+constexpr const auto test_arena_k = 2ULL;
+alignas(BAREFLANK_PAGE_SIZE) uint8_t g_test_arena_buffer[page_arena::buffer_size(test_arena_k)] = {};
+
+alignas(BAREFLANK_PAGE_SIZE) uint8_t g_test_overflow_buffer[buddy_allocator::buffer_size(test_arena_k)] = {};
+alignas(BAREFLANK_PAGE_SIZE) uint8_t g_test_overflow_node_tree[buddy_allocator::node_tree_size(test_arena_k)] = {};
+
+TEST_CASE("page_arena: buffer size")
+{
+    CHECK(page_arena::buffer_size(0) == BAREFLANK_PAGE_SIZE);
+    CHECK(page_arena::buffer_size(2) == BAREFLANK_PAGE_SIZE * 4);
+}
+
+TEST_CASE("page_arena: allocate")
+{
+    page_arena arena{g_test_arena_buffer, test_arena_k};
+
+    CHECK(arena.num_pages() == 4);
+    CHECK(arena.num_used() == 0);
+
+    CHECK(arena.allocate() == &g_test_arena_buffer[0x0000]);
+    CHECK(arena.allocate() == &g_test_arena_buffer[0x1000]);
+    CHECK(arena.allocate() == &g_test_arena_buffer[0x2000]);
+    CHECK(arena.allocate() == &g_test_arena_buffer[0x3000]);
+    CHECK_THROWS(arena.allocate());
+
+    CHECK(arena.num_used() == 4);
+}
+
+TEST_CASE("page_arena: deallocate")
+{
+    page_arena arena{g_test_arena_buffer, test_arena_k};
+
+    auto page1 = arena.allocate();
+    auto page2 = arena.allocate();
+
+    arena.deallocate(page1);
+    arena.deallocate(page2);
+    CHECK(arena.num_used() == 0);
+
+    CHECK(arena.allocate() == page2);
+    CHECK(arena.allocate() == page1);
+    CHECK(arena.allocate() == &g_test_arena_buffer[0x2000]);
+}
+
+TEST_CASE("page_arena: deallocate invalid")
+{
+    page_arena arena{g_test_arena_buffer, test_arena_k};
+    int i{};
+
+    auto page = arena.allocate();
+
+    CHECK_NOTHROW(arena.deallocate(nullptr));
+    CHECK_NOTHROW(arena.deallocate(&i));
+    CHECK_NOTHROW(arena.deallocate(&g_test_arena_buffer[0x10]));
+    CHECK(arena.num_used() == 1);
+
+    arena.deallocate(page);
+    CHECK(arena.num_used() == 0);
+}
+
+TEST_CASE("page_arena: high water")
+{
+    page_arena arena{g_test_arena_buffer, test_arena_k};
+    CHECK(arena.num_high_water() == 0);
+
+    auto page1 = arena.allocate();
+    auto page2 = arena.allocate();
+    CHECK(arena.num_high_water() == 2);
+
+    arena.deallocate(page1);
+    arena.deallocate(page2);
+    CHECK(arena.num_high_water() == 2);
+
+    arena.allocate();
+    arena.allocate();
+    CHECK(arena.num_high_water() == 2);
+
+    arena.allocate();
+    CHECK(arena.num_high_water() == 3);
+}
+
+TEST_CASE("page_arena: contains / index")
+{
+    page_arena arena{g_test_arena_buffer, test_arena_k};
+    int i{};
+
+    CHECK(!arena.contains(&i));
+    CHECK(arena.contains(&g_test_arena_buffer[0x0000]));
+    CHECK(arena.contains(&g_test_arena_buffer[0x3FFF]));
+    CHECK(!arena.contains(&g_test_arena_buffer[0x3FFF] + 1));
+
+    CHECK(arena.index(&g_test_arena_buffer[0x0000]) == 0);
+    CHECK(arena.index(&g_test_arena_buffer[0x1FFF]) == 1);
+    CHECK(arena.index(&g_test_arena_buffer[0x3010]) == 3);
+}
+
+TEST_CASE("page_arena: object allocator")
+{
+    page_arena arena{g_test_arena_buffer, test_arena_k};
+
+    {
+        object_allocator pool{0x800, 0, &arena};
+
+        auto obj1 = pool.allocate();
+        auto obj2 = pool.allocate();
+        auto obj3 = pool.allocate();
+
+        CHECK(arena.contains(obj1));
+        CHECK(arena.contains(obj3));
+        CHECK(arena.num_used() == 2);
+
+        pool.deallocate(obj1);
+        pool.deallocate(obj2);
+        pool.deallocate(obj3);
+    }
+
+    CHECK(arena.num_used() == 0);
+}
+
+TEST_CASE("page_arena: overflow")
+{
+    std::mutex mutex;
+    buddy_allocator overflow{g_test_overflow_buffer, test_arena_k, g_test_overflow_node_tree};
+    page_arena arena{g_test_arena_buffer, test_arena_k, &overflow, &mutex};
+
+    for (auto i = 0ULL; i < arena.num_pages(); i++) {
+        arena.allocate();
+    }
+
+    auto page1 = arena.allocate();
+    auto page2 = arena.allocate();
+
+    CHECK(!arena.contains(page1));
+    CHECK(overflow.contains(page1));
+    CHECK(overflow.contains(page2));
+    CHECK(arena.num_used() == arena.num_pages());
+    CHECK(arena.num_overflow() == 2);
+    CHECK(overflow.used() == BAREFLANK_PAGE_SIZE * 2);
+
+    arena.deallocate(page1);
+    arena.deallocate(page2);
+
+    CHECK(arena.num_overflow() == 0);
+    CHECK(overflow.used() == 0);
+}
+
+TEST_CASE("page_arena: object allocator overflow")
+{
+    std::mutex mutex;
+    buddy_allocator overflow{g_test_overflow_buffer, test_arena_k, g_test_overflow_node_tree};
+    page_arena arena{g_test_arena_buffer, test_arena_k, &overflow, &mutex};
+
+    {
+        object_allocator pool{0x800, 0, &arena};
+        std::vector<void *> objs;
+
+        for (auto i = 0ULL; i < (arena.num_pages() + 1) * 2; i++) {
+            objs.push_back(pool.allocate());
+        }
+
+        CHECK(arena.num_used() == arena.num_pages());
+        CHECK(arena.num_overflow() == 1);
+        CHECK(overflow.contains(objs.back()));
+
+        for (auto obj : objs) {
+            pool.deallocate(obj);
+        }
+    }
+
+    CHECK(arena.num_used() == 0);
+    CHECK(arena.num_overflow() == 0);
+}